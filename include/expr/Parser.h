@@ -20,6 +20,7 @@ namespace llvm {
 }
 
 namespace klee {
+  class ArrayCache;
   class ExprBuilder;
 
 namespace expr {
@@ -228,9 +229,13 @@ namespace expr {
     /// \arg MB - The input data.
     /// \arg Builder - The expression builder to use for constructing
     /// expressions.
+    /// \arg Cache - The cache to create arrays in, so that parsers
+    /// sharing it agree on the arrays they declare. If null, the
+    /// parser uses a cache of its own.
     static Parser *Create(const std::string Name,
                           const llvm::MemoryBuffer *MB,
-                          ExprBuilder *Builder);
+                          ExprBuilder *Builder,
+                          ArrayCache *Cache = 0);
   };
 }
 }
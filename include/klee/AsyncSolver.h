@@ -0,0 +1,112 @@
+//===-- AsyncSolver.h -------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_ASYNCSOLVER_H
+#define KLEE_ASYNCSOLVER_H
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+
+#include <deque>
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+namespace klee {
+  class SolverWorker;
+
+  /// AsyncSolver - Computes the validity of queries in a pool of solver
+  /// worker processes without blocking the caller. A query is submitted
+  /// under a tag and its answer is collected later with poll(), so the
+  /// caller can go on with other work while it is being solved.
+  ///
+  /// The validity of a query is decided by two satisfiability queries,
+  /// one for each side of the expression, which run in different workers
+  /// when there are enough of them. As the constraints are assumed to be
+  /// satisfiable, an unsatisfiable side decides the query on its own.
+  class AsyncSolver {
+  public:
+    typedef void *Tag;
+
+    struct Answer {
+      Tag tag;
+      /// The expression the query was submitted with.
+      ref<Expr> expr;
+      bool success;
+      /// Whether the query failed because it ran out of time.
+      bool timedOut;
+      Solver::Validity validity;
+      /// The wall time from submission to the answer, in seconds.
+      double time;
+    };
+
+  private:
+    enum SideResult { Unanswered, Possible, Impossible };
+
+    struct Pending {
+      Tag tag;
+      ConstraintManager constraints;
+      ref<Expr> expr;
+      double submitted;
+      /// Whether the expression may be true, and whether it may be false.
+      SideResult sides[2];
+    };
+
+    /// A side of a query, queued or being solved by a worker.
+    struct Job {
+      uint64_t id;
+      unsigned side;
+      double deadline;
+    };
+
+    double timeout;
+    uint64_t nextID;
+    std::vector<SolverWorker*> workers;
+    /// The job of each busy worker. The answer of a worker whose query
+    /// was decided or cancelled in the meantime is thrown away.
+    std::vector<Job> jobs;
+    std::map<uint64_t, Pending> pending;
+    std::map<Tag, uint64_t> ids;
+    std::deque<Job> queue;
+
+    void dispatch(std::vector<Answer> &answers);
+    void receive(unsigned worker, std::vector<Answer> &answers);
+    void finish(const Job &job, SolverImpl::SolverRunStatus status,
+                bool hasSolution, std::vector<Answer> &answers);
+    void drop(std::map<uint64_t, Pending>::iterator it);
+
+  public:
+    /// \param solvers - The solvers the workers use, one worker per
+    /// solver; the workers take ownership of them.
+    /// \param _timeout - The most time in seconds a side of a query may
+    /// take, 0 for no limit.
+    AsyncSolver(const std::vector<Solver*> &solvers, double _timeout);
+    ~AsyncSolver();
+
+    /// Submit the validity query for \a expr under \a constraints. There
+    /// may be one query in flight per tag.
+    void submit(Tag tag, const ConstraintManager &constraints,
+                ref<Expr> expr);
+
+    /// Drop the query in flight for \a tag, if any.
+    void cancel(Tag tag);
+
+    /// Whether any query is waiting for its answer.
+    bool hasPending() const { return !pending.empty(); }
+
+    /// Append the answers which came in to \a answers. If \a wait is set
+    /// and a query is in flight, block until there is at least one, or
+    /// until a signal arrives.
+    void poll(bool wait, std::vector<Answer> &answers);
+  };
+}
+
+#endif
@@ -13,12 +13,30 @@ namespace klee {
 
 extern llvm::cl::opt<bool> UseFastCexSolver;
 
+extern llvm::cl::opt<bool> UseKnownBitsSolver;
+
+extern llvm::cl::opt<bool> UseLinearEquationSolver;
+
 extern llvm::cl::opt<bool> UseCexCache;
 
 extern llvm::cl::opt<bool> UseCache;
 
+extern llvm::cl::opt<std::string> QueryCacheFile;
+
+extern llvm::cl::opt<std::string> SharedQueryCache;
+
+extern llvm::cl::opt<unsigned> SharedQueryCacheSize;
+
+extern llvm::cl::opt<bool> UseLocalSearch;
+
+extern llvm::cl::opt<unsigned> LocalSearchFlips;
+
+extern llvm::cl::opt<double> LocalSearchTime;
+
 extern llvm::cl::opt<bool> UseIndependentSolver; 
 
+extern llvm::cl::opt<bool> UseQueryCanonicalization;
+
 extern llvm::cl::opt<bool> DebugValidateSolver;
   
 extern llvm::cl::opt<int> MinQueryTimeToLog;
@@ -29,6 +47,8 @@ extern llvm::cl::opt<bool> UseForkedCoreSolver;
 
 extern llvm::cl::opt<bool> CoreSolverOptimizeDivides;
 
+extern llvm::cl::opt<bool> CoreSolverIncremental;
+
 ///The different query logging solvers that can switched on/off
 enum QueryLoggingSolverType
 {
@@ -44,7 +64,13 @@ enum QueryLoggingSolverType
  */
 extern llvm::cl::list<QueryLoggingSolverType> queryLoggingOptions;
 
-enum CoreSolverType { STP_SOLVER, METASMT_SOLVER, DUMMY_SOLVER, Z3_SOLVER };
+enum CoreSolverType {
+  STP_SOLVER,
+  METASMT_SOLVER,
+  DUMMY_SOLVER,
+  Z3_SOLVER,
+  PORTFOLIO_SOLVER
+};
 extern llvm::cl::opt<CoreSolverType> CoreSolverToUse;
 
 #ifdef ENABLE_METASMT
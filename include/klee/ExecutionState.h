@@ -16,6 +16,7 @@
 
 // FIXME: We do not want to be exposing these? :(
 #include "../../lib/Core/AddressSpace.h"
+#include "../../lib/Core/ReplayLog.h"
 #include "klee/Internal/Module/KInstIterator.h"
 
 #include <map>
@@ -30,6 +31,7 @@ struct KFunction;
 struct KInstruction;
 class MemoryObject;
 class PTreeNode;
+class StatisticRecord;
 struct InstructionInfo;
 
 llvm::raw_ostream &operator<<(llvm::raw_ostream &os, const MemoryMap &mm);
@@ -61,6 +63,36 @@ struct StackFrame {
   ~StackFrame();
 };
 
+/// @brief A branch taken by --lazy-fork without asking the solver which
+/// of its sides are feasible, shared by the two states it created. The
+/// path up to the branch is feasible, so once one side is found
+/// infeasible the other is known to be feasible.
+class UncheckedBranch {
+public:
+  /// Required by klee::ref-managed objects.
+  unsigned refCount;
+
+  /// The branch condition, to be added to the constraints of the state
+  /// taking the true side.
+  ref<Expr> condition;
+
+  /// Whether one side was found infeasible, and then which side is
+  /// feasible.
+  bool decided;
+  bool feasibleSide;
+
+  /// The instruction and call path the fork was counted for, to take it
+  /// back if a side is infeasible.
+  unsigned statIndex;
+  StatisticRecord *statContext;
+
+  UncheckedBranch(ref<Expr> _condition, unsigned _statIndex,
+                  StatisticRecord *_statContext)
+    : refCount(0), condition(_condition), decided(false),
+      feasibleSide(false), statIndex(_statIndex),
+      statContext(_statContext) {}
+};
+
 /// @brief ExecutionState representing a path under exploration
 class ExecutionState {
 public:
@@ -109,6 +141,12 @@ public:
   /// @brief Exploration depth, i.e., number of times KLEE branched for this state
   unsigned depth;
 
+  /// @brief Number of partitioning forks taken so far, and the
+  /// branch directions taken at them (most recent in the low bit).
+  /// Only maintained when exploring in --parallel-workers mode.
+  unsigned partitionDepth;
+  uint64_t partitionPrefix;
+
   /// @brief History of complete path: represents branches taken to
   /// reach/create this state (both concrete and symbolic)
   TreeOStream pathOS;
@@ -133,6 +171,33 @@ public:
   /// @brief Pointer to the process tree of the current state
   PTreeNode *ptreeNode;
 
+  /// @brief Number of instructions executed on this path
+  uint64_t steppedInstructions;
+
+  /// @brief Events of this path needed to rebuild it after it was made
+  /// dormant (see --dormant-states). Null unless that mode is enabled.
+  ref<ReplayLog> replayLog;
+
+  /// @brief Log being followed while this state is a replica
+  /// rebuilding a dormant state, null otherwise
+  ReplayCursor *replay;
+
+  /// @brief Whether the address space and constraints were dropped, to
+  /// be rebuilt from replayLog when the state is selected again
+  bool dormant;
+
+  /// @brief Whether the large objects of this state were written out by
+  /// --max-memory-spill and it has not run since
+  bool spilled;
+
+  /// @brief The branch which created this state in --lazy-fork mode,
+  /// until the side it took is checked when the state is next selected
+  /// or terminated. Null otherwise.
+  ref<UncheckedBranch> uncheckedBranch;
+
+  /// @brief The side of uncheckedBranch this state took
+  bool uncheckedSide;
+
   /// @brief Ordered list of symbolics: used to generate test cases.
   //
   // FIXME: Move to a shared list structure (not critical).
@@ -168,6 +233,14 @@ public:
   void addConstraint(ref<Expr> e) { constraints.addConstraint(e); }
 
   bool merge(const ExecutionState &b);
+
+  /// @brief Drop the address space and constraints of the state. The
+  /// stack is kept so searchers can still look at the state.
+  void makeDormant();
+
+  /// @brief Take over the contents of \a replica, which re-executed
+  /// the path of this dormant state.
+  void wake(ExecutionState &replica);
   void dumpStack(llvm::raw_ostream &out) const;
 };
 }
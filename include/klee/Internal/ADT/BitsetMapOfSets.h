@@ -0,0 +1,422 @@
+//===-- BitsetMapOfSets.h ---------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __UTIL_BITSETMAPOFSETS_H__
+#define __UTIL_BITSETMAPOFSETS_H__
+
+#include <algorithm>
+#include <cassert>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+namespace klee {
+
+  /// BitsetMapOfSets - A map from sets to values, with the subset and
+  /// superset searches of MapOfSets, that keeps its size within a budget.
+  ///
+  /// Set elements are interned into small dense IDs, and each key is
+  /// stored as a sparse bitset over them: the nonzero 64-bit words and
+  /// their positions, plus a one-word signature for rejecting most
+  /// candidates without looking at the words. Searches scan the keys
+  /// linearly.
+  ///
+  /// Each entry has a cost, given by the caller for its value plus the
+  /// size of its key. When the total goes over the budget, entries are
+  /// evicted in least recently used order, except that an entry which
+  /// was found by a search since it was last considered gets another
+  /// round. Evicted values are handed back to the caller, which owns
+  /// them.
+  template<class K, class V>
+  class BitsetMapOfSets {
+    struct Word {
+      uint32_t index;
+      uint64_t bits;
+
+      bool operator<(const Word &b) const {
+        return index < b.index || (index == b.index && bits < b.bits);
+      }
+      bool operator==(const Word &b) const {
+        return index == b.index && bits == b.bits;
+      }
+    };
+    typedef std::vector<Word> Key;
+
+    struct Entry {
+      Key key;
+      uint64_t signature;
+      V value;
+      size_t cost;
+      bool referenced;
+      unsigned prev, next;
+    };
+
+    static const unsigned None = ~0U;
+
+    std::map<K, unsigned> ids;
+    std::vector<K> elements;
+    std::vector<unsigned> idUses;
+    std::vector<unsigned> freeIDs;
+
+    std::vector<Entry> entries;
+    std::map<Key, unsigned> exact;
+    /// The LRU list of entries, most recent first.
+    unsigned head, tail;
+
+    size_t budget, totalCost;
+    uint64_t numEvictions;
+
+  public:
+    /// \param _budget - The total cost to stay within, or 0 for no limit.
+    explicit BitsetMapOfSets(size_t _budget = 0)
+      : head(None), tail(None), budget(_budget), totalCost(0),
+        numEvictions(0) {}
+
+    /// Insert \a value for \a set, replacing the value already there.
+    /// Values that no longer have an entry, either replaced or evicted,
+    /// are appended to \a dropped.
+    void insert(const std::set<K> &set, const V &value, size_t cost,
+                std::vector<V> &dropped);
+
+    /// The value for \a set. Returned values are valid until the next
+    /// insertion.
+    V *lookup(const std::set<K> &set);
+
+    /// Find the value of a superset of \a set satisfying \a p.
+    template<class Predicate>
+    V *findSuperset(const std::set<K> &set, const Predicate &p);
+    /// Find the value of a subset of \a set satisfying \a p.
+    template<class Predicate>
+    V *findSubset(const std::set<K> &set, const Predicate &p);
+
+    /// Remove every entry, appending their values to \a dropped.
+    void clear(std::vector<V> &dropped);
+
+    unsigned size() const { return entries.size(); }
+    size_t getCost() const { return totalCost; }
+    uint64_t getNumEvictions() const { return numEvictions; }
+
+  private:
+    static void buildKey(std::vector<unsigned> &setIDs, Key &key,
+                         uint64_t &signature);
+    void makeKey(const std::set<K> &set, Key &key, uint64_t &signature);
+    bool makePartialKey(const std::set<K> &set, Key &key,
+                        uint64_t &signature);
+    unsigned intern(const K &element);
+    void release(const Key &key);
+
+    static bool isSubset(const Key &a, const Key &b);
+    /// The cost of an entry itself; keys are held twice.
+    static size_t getOverhead(const Key &key) {
+      return sizeof(Entry) + 2 * key.size() * sizeof(Word);
+    }
+
+    void unlink(unsigned i);
+    void pushFront(unsigned i);
+    void touch(unsigned i);
+    void remove(unsigned i, std::vector<V> &dropped);
+    void evict(unsigned keep, std::vector<V> &dropped);
+  };
+
+  /***/
+
+  template<class K, class V>
+  unsigned BitsetMapOfSets<K,V>::intern(const K &element) {
+    typename std::map<K, unsigned>::iterator it = ids.find(element);
+    unsigned id;
+    if (it != ids.end()) {
+      id = it->second;
+    } else {
+      if (freeIDs.empty()) {
+        id = elements.size();
+        elements.push_back(element);
+        idUses.push_back(0);
+      } else {
+        id = freeIDs.back();
+        freeIDs.pop_back();
+        elements[id] = element;
+      }
+      ids.insert(std::make_pair(element, id));
+    }
+    ++idUses[id];
+    return id;
+  }
+
+  template<class K, class V>
+  void BitsetMapOfSets<K,V>::buildKey(std::vector<unsigned> &setIDs,
+                                      Key &key, uint64_t &signature) {
+    std::sort(setIDs.begin(), setIDs.end());
+    key.clear();
+    signature = 0;
+    for (unsigned i = 0; i != setIDs.size(); ++i) {
+      unsigned id = setIDs[i];
+      if (key.empty() || key.back().index != id / 64) {
+        Word w = { id / 64, 0 };
+        key.push_back(w);
+      }
+      key.back().bits |= 1ULL << (id % 64);
+      signature |= 1ULL << (id % 64);
+    }
+  }
+
+  /// Build the key of \a set, interning elements not seen yet.
+  template<class K, class V>
+  void BitsetMapOfSets<K,V>::makeKey(const std::set<K> &set, Key &key,
+                                     uint64_t &signature) {
+    std::vector<unsigned> setIDs;
+    setIDs.reserve(set.size());
+    for (typename std::set<K>::const_iterator it = set.begin(),
+           ie = set.end(); it != ie; ++it)
+      setIDs.push_back(intern(*it));
+    buildKey(setIDs, key, signature);
+  }
+
+  /// Build the key of the elements of \a set which are interned, and
+  /// return whether that is all of them. Elements which are not interned
+  /// cannot be in any stored key.
+  template<class K, class V>
+  bool BitsetMapOfSets<K,V>::makePartialKey(const std::set<K> &set, Key &key,
+                                            uint64_t &signature) {
+    std::vector<unsigned> setIDs;
+    setIDs.reserve(set.size());
+    for (typename std::set<K>::const_iterator it = set.begin(),
+           ie = set.end(); it != ie; ++it) {
+      typename std::map<K, unsigned>::iterator id = ids.find(*it);
+      if (id != ids.end())
+        setIDs.push_back(id->second);
+    }
+    buildKey(setIDs, key, signature);
+    return setIDs.size() == set.size();
+  }
+
+  /// Drop the uses of the elements of \a key, freeing unused IDs.
+  template<class K, class V>
+  void BitsetMapOfSets<K,V>::release(const Key &key) {
+    for (unsigned i = 0; i != key.size(); ++i) {
+      for (uint64_t bits = key[i].bits; bits; bits &= bits - 1) {
+        unsigned id = key[i].index * 64 + __builtin_ctzll(bits);
+        if (--idUses[id] == 0) {
+          ids.erase(elements[id]);
+          elements[id] = K();
+          freeIDs.push_back(id);
+        }
+      }
+    }
+  }
+
+  template<class K, class V>
+  bool BitsetMapOfSets<K,V>::isSubset(const Key &a, const Key &b) {
+    typename Key::const_iterator bi = b.begin(), be = b.end();
+    for (typename Key::const_iterator ai = a.begin(), ae = a.end();
+         ai != ae; ++ai) {
+      while (bi != be && bi->index < ai->index)
+        ++bi;
+      if (bi == be || bi->index != ai->index || (ai->bits & ~bi->bits))
+        return false;
+      ++bi;
+    }
+    return true;
+  }
+
+  template<class K, class V>
+  void BitsetMapOfSets<K,V>::unlink(unsigned i) {
+    Entry &e = entries[i];
+    if (e.prev != None)
+      entries[e.prev].next = e.next;
+    else
+      head = e.next;
+    if (e.next != None)
+      entries[e.next].prev = e.prev;
+    else
+      tail = e.prev;
+  }
+
+  template<class K, class V>
+  void BitsetMapOfSets<K,V>::pushFront(unsigned i) {
+    Entry &e = entries[i];
+    e.prev = None;
+    e.next = head;
+    if (head != None)
+      entries[head].prev = i;
+    else
+      tail = i;
+    head = i;
+  }
+
+  template<class K, class V>
+  void BitsetMapOfSets<K,V>::touch(unsigned i) {
+    entries[i].referenced = true;
+    if (head != i) {
+      unlink(i);
+      pushFront(i);
+    }
+  }
+
+  /// Remove entry \a i, moving the last entry into its place.
+  template<class K, class V>
+  void BitsetMapOfSets<K,V>::remove(unsigned i, std::vector<V> &dropped) {
+    unlink(i);
+    Entry &e = entries[i];
+    dropped.push_back(e.value);
+    totalCost -= e.cost;
+    exact.erase(e.key);
+    release(e.key);
+
+    unsigned last = entries.size() - 1;
+    if (i != last) {
+      Entry &moved = entries[last];
+      if (moved.prev != None)
+        entries[moved.prev].next = i;
+      else
+        head = i;
+      if (moved.next != None)
+        entries[moved.next].prev = i;
+      else
+        tail = i;
+      exact[moved.key] = i;
+      entries[i] = moved;
+    }
+    entries.pop_back();
+  }
+
+  /// Evict entries until the budget is met, never evicting \a keep.
+  template<class K, class V>
+  void BitsetMapOfSets<K,V>::evict(unsigned keep, std::vector<V> &dropped) {
+    while (budget && totalCost > budget && tail != None) {
+      unsigned victim = tail;
+      if (victim == keep) {
+        // Other entries given another round were moved before it.
+        if (head == keep)
+          break;
+        unlink(keep);
+        pushFront(keep);
+        continue;
+      }
+      if (entries[victim].referenced) {
+        // Useful entries get another round before they can be evicted.
+        entries[victim].referenced = false;
+        unlink(victim);
+        pushFront(victim);
+        continue;
+      }
+      // The entry to keep may be the last one, which remove() moves.
+      if (keep == entries.size() - 1)
+        keep = victim;
+      remove(victim, dropped);
+      ++numEvictions;
+    }
+  }
+
+  template<class K, class V>
+  void BitsetMapOfSets<K,V>::insert(const std::set<K> &set, const V &value,
+                                    size_t cost, std::vector<V> &dropped) {
+    Key key;
+    uint64_t signature;
+    makeKey(set, key, signature);
+
+    typename std::map<Key, unsigned>::iterator it = exact.find(key);
+    if (it != exact.end()) {
+      // The key already holds its uses of the IDs.
+      release(key);
+      Entry &e = entries[it->second];
+      dropped.push_back(e.value);
+      totalCost -= e.cost;
+      e.value = value;
+      e.cost = cost + getOverhead(key);
+      totalCost += e.cost;
+      touch(it->second);
+      evict(it->second, dropped);
+      return;
+    }
+
+    Entry e;
+    e.key = key;
+    e.signature = signature;
+    e.value = value;
+    e.cost = cost + getOverhead(key);
+    e.referenced = false;
+    unsigned i = entries.size();
+    entries.push_back(e);
+    exact.insert(std::make_pair(key, i));
+    pushFront(i);
+    totalCost += entries[i].cost;
+    evict(i, dropped);
+  }
+
+  template<class K, class V>
+  V *BitsetMapOfSets<K,V>::lookup(const std::set<K> &set) {
+    Key key;
+    uint64_t signature;
+    if (!makePartialKey(set, key, signature))
+      return 0;
+
+    typename std::map<Key, unsigned>::iterator it = exact.find(key);
+    if (it == exact.end())
+      return 0;
+    touch(it->second);
+    return &entries[it->second].value;
+  }
+
+  template<class K, class V>
+  template<class Predicate>
+  V *BitsetMapOfSets<K,V>::findSuperset(const std::set<K> &set,
+                                        const Predicate &p) {
+    Key key;
+    uint64_t signature;
+    if (!makePartialKey(set, key, signature))
+      return 0;
+
+    for (unsigned i = 0, e = entries.size(); i != e; ++i) {
+      Entry &entry = entries[i];
+      if ((signature & ~entry.signature) == 0 &&
+          isSubset(key, entry.key) && p(entry.value)) {
+        touch(i);
+        return &entry.value;
+      }
+    }
+    return 0;
+  }
+
+  template<class K, class V>
+  template<class Predicate>
+  V *BitsetMapOfSets<K,V>::findSubset(const std::set<K> &set,
+                                      const Predicate &p) {
+    Key key;
+    uint64_t signature;
+    makePartialKey(set, key, signature);
+
+    for (unsigned i = 0, e = entries.size(); i != e; ++i) {
+      Entry &entry = entries[i];
+      if ((entry.signature & ~signature) == 0 &&
+          isSubset(entry.key, key) && p(entry.value)) {
+        touch(i);
+        return &entry.value;
+      }
+    }
+    return 0;
+  }
+
+  template<class K, class V>
+  void BitsetMapOfSets<K,V>::clear(std::vector<V> &dropped) {
+    for (unsigned i = 0; i != entries.size(); ++i)
+      dropped.push_back(entries[i].value);
+    entries.clear();
+    exact.clear();
+    ids.clear();
+    elements.clear();
+    idUses.clear();
+    freeIDs.clear();
+    head = tail = None;
+    totalCost = 0;
+  }
+
+}
+
+#endif
@@ -0,0 +1,768 @@
+//===-- ImmutableBTree.h ----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __UTIL_IMMUTABLEBTREE_H__
+#define __UTIL_IMMUTABLEBTREE_H__
+
+#include <cassert>
+#include <cstddef>
+
+namespace klee {
+  /// ImmutableBTree - A persistent B+ tree with the interface of
+  /// ImmutableTree. Values live in the leaves, and interior nodes keep
+  /// the smallest key of each child. Updates copy the path from the root
+  /// to the modified leaf, which is a handful of wide nodes instead of a
+  /// node per level of a binary tree, and lookups scan a few contiguous
+  /// arrays instead of chasing a pointer per comparison.
+  template<class K, class V, class KOV, class CMP>
+  class ImmutableBTree {
+  public:
+    static size_t allocated;
+    class iterator;
+
+    typedef K key_type;
+    typedef V value_type;
+    typedef KOV key_of_value;
+    typedef CMP key_compare;
+
+    enum { MaxEntries = 16, MinEntries = MaxEntries / 2, MaxDepth = 16 };
+
+  public:
+    ImmutableBTree();
+    ImmutableBTree(const ImmutableBTree &s);
+    ~ImmutableBTree();
+
+    ImmutableBTree &operator=(const ImmutableBTree &s);
+
+    bool empty() const;
+
+    size_t count(const key_type &key) const; // always 0 or 1
+    const value_type *lookup(const key_type &key) const;
+
+    // find the last value less than or equal to key, or null if
+    // no such value exists
+    const value_type *lookup_previous(const key_type &key) const;
+
+    const value_type &min() const;
+    const value_type &max() const;
+    size_t size() const;
+
+    ImmutableBTree insert(const value_type &value) const;
+    ImmutableBTree replace(const value_type &value) const;
+    ImmutableBTree remove(const key_type &key) const;
+    ImmutableBTree popMin(value_type &valueOut) const;
+    ImmutableBTree popMax(value_type &valueOut) const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const key_type &key) const;
+    iterator lower_bound(const key_type &key) const;
+    iterator upper_bound(const key_type &key) const;
+
+    static size_t getAllocated() { return allocated; }
+
+  private:
+    class Node;
+    class Leaf;
+    class Inner;
+
+    Node *root; // null when empty
+    size_t elements;
+
+    ImmutableBTree(Node *_root, size_t _elements);
+
+    static bool less(const key_type &a, const key_type &b) {
+      return key_compare()(a, b);
+    }
+    static const key_type &keyOf(const value_type &v) {
+      return key_of_value()(v);
+    }
+
+    static unsigned leafLowerBound(const Leaf *l, const key_type &k);
+    static unsigned childIndex(const Inner *n, const key_type &k);
+
+    static Node *makeLeaf(const value_type *values, unsigned total,
+                          Node *&split);
+    static Node *makeInner(const key_type *keys, Node *const *children,
+                           unsigned total, Node *&split);
+
+    static Node *insertNode(Node *n, const value_type &v, bool replace,
+                            Node *&split, bool &added);
+    static Node *removeNode(Node *n, const key_type &k);
+
+    ImmutableBTree insertOrReplace(const value_type &value,
+                                   bool replace) const;
+  };
+
+  /***/
+
+  template<class K, class V, class KOV, class CMP>
+  class ImmutableBTree<K,V,KOV,CMP>::Node {
+  public:
+    unsigned references;
+    unsigned count;
+    bool isLeaf;
+
+    Node(bool _isLeaf) : references(1), count(0), isLeaf(_isLeaf) {
+      ++allocated;
+    }
+    ~Node() { --allocated; }
+
+    Node *incref() {
+      ++references;
+      return this;
+    }
+    void decref() {
+      if (--references == 0) {
+        if (isLeaf)
+          delete static_cast<Leaf*>(this);
+        else
+          delete static_cast<Inner*>(this);
+      }
+    }
+
+    const key_type &minKey() const {
+      assert(count && "empty node has no key");
+      return isLeaf ? keyOf(static_cast<const Leaf*>(this)->values[0]) :
+                      static_cast<const Inner*>(this)->keys[0];
+    }
+  };
+
+  template<class K, class V, class KOV, class CMP>
+  class ImmutableBTree<K,V,KOV,CMP>::Leaf : public Node {
+  public:
+    value_type values[MaxEntries];
+
+    Leaf() : Node(true) {}
+  };
+
+  template<class K, class V, class KOV, class CMP>
+  class ImmutableBTree<K,V,KOV,CMP>::Inner : public Node {
+  public:
+    // keys[i] is the smallest key below children[i]
+    key_type keys[MaxEntries];
+    Node *children[MaxEntries];
+
+    Inner() : Node(false) {}
+    ~Inner() {
+      for (unsigned i=0; i<this->count; i++)
+        children[i]->decref();
+    }
+  };
+
+  template<class K, class V, class KOV, class CMP>
+  class ImmutableBTree<K,V,KOV,CMP>::iterator {
+    friend class ImmutableBTree<K,V,KOV,CMP>;
+  private:
+    struct Position {
+      Node *node;
+      unsigned index;
+    };
+
+    Node *root; // so can back up from end
+    // path[0] is the root, path[depth-1] the leaf, depth 0 is the end
+    Position path[MaxDepth];
+    unsigned depth;
+
+    void push(Node *n, unsigned index) {
+      assert(depth < MaxDepth && "tree too deep");
+      path[depth].node = n;
+      path[depth].index = index;
+      ++depth;
+    }
+
+    void descendFirst(Node *n) {
+      for (;;) {
+        push(n, 0);
+        if (n->isLeaf)
+          break;
+        n = static_cast<Inner*>(n)->children[0];
+      }
+    }
+
+    void descendLast(Node *n) {
+      for (;;) {
+        push(n, n->count - 1);
+        if (n->isLeaf)
+          break;
+        n = static_cast<Inner*>(n)->children[n->count - 1];
+      }
+    }
+
+  public:
+    iterator(Node *_root, bool atBeginning) : root(_root), depth(0) {
+      if (root) {
+        root->incref();
+        if (atBeginning)
+          descendFirst(root);
+      }
+    }
+    iterator(const iterator &i) : root(i.root), depth(i.depth) {
+      if (root)
+        root->incref();
+      for (unsigned d=0; d<depth; d++)
+        path[d] = i.path[d];
+    }
+    ~iterator() {
+      if (root)
+        root->decref();
+    }
+
+    iterator &operator=(const iterator &b) {
+      if (b.root)
+        b.root->incref();
+      if (root)
+        root->decref();
+      root = b.root;
+      depth = b.depth;
+      for (unsigned d=0; d<depth; d++)
+        path[d] = b.path[d];
+      return *this;
+    }
+
+    const value_type &operator*() {
+      Position &p = path[depth - 1];
+      return static_cast<Leaf*>(p.node)->values[p.index];
+    }
+
+    const value_type *operator->() {
+      return &**this;
+    }
+
+    bool operator==(const iterator &b) {
+      if (depth != b.depth)
+        return false;
+      if (!depth)
+        return true;
+      const Position &p = path[depth - 1], &bp = b.path[depth - 1];
+      return p.node == bp.node && p.index == bp.index;
+    }
+    bool operator!=(const iterator &b) {
+      return !(*this == b);
+    }
+
+    iterator &operator--() {
+      if (!depth) {
+        if (root)
+          descendLast(root);
+        return *this;
+      }
+
+      // find the deepest level which can move left
+      while (depth && path[depth - 1].index == 0)
+        --depth;
+      if (!depth)
+        return *this;
+
+      Position &p = path[depth - 1];
+      --p.index;
+      if (!p.node->isLeaf) {
+        Node *child = static_cast<Inner*>(p.node)->children[p.index];
+        descendLast(child);
+      }
+      return *this;
+    }
+
+    iterator &operator++() {
+      assert(depth);
+
+      // find the deepest level which can move right
+      while (depth && path[depth - 1].index + 1 == path[depth - 1].node->count)
+        --depth;
+      if (!depth)
+        return *this;
+
+      Position &p = path[depth - 1];
+      ++p.index;
+      if (!p.node->isLeaf) {
+        Node *child = static_cast<Inner*>(p.node)->children[p.index];
+        descendFirst(child);
+      }
+      return *this;
+    }
+  };
+
+  /***/
+
+  template<class K, class V, class KOV, class CMP>
+  size_t ImmutableBTree<K,V,KOV,CMP>::allocated = 0;
+
+  template<class K, class V, class KOV, class CMP>
+  unsigned ImmutableBTree<K,V,KOV,CMP>::leafLowerBound(const Leaf *l,
+                                                      const key_type &k) {
+    unsigned i = 0;
+    while (i < l->count && less(keyOf(l->values[i]), k))
+      ++i;
+    return i;
+  }
+
+  // The child which would hold k: the last one whose smallest key is
+  // not greater than k, or the first child.
+  template<class K, class V, class KOV, class CMP>
+  unsigned ImmutableBTree<K,V,KOV,CMP>::childIndex(const Inner *n,
+                                                  const key_type &k) {
+    unsigned i = 1;
+    while (i < n->count && !less(k, n->keys[i]))
+      ++i;
+    return i - 1;
+  }
+
+  // Build a leaf from total values, splitting it in two (returned in
+  // split) if they do not fit.
+  template<class K, class V, class KOV, class CMP>
+  typename ImmutableBTree<K,V,KOV,CMP>::Node *
+  ImmutableBTree<K,V,KOV,CMP>::makeLeaf(const value_type *values,
+                                        unsigned total, Node *&split) {
+    unsigned leftCount = total > MaxEntries ? total / 2 : total;
+    Leaf *left = new Leaf();
+    for (unsigned i=0; i<leftCount; i++)
+      left->values[i] = values[i];
+    left->count = leftCount;
+
+    split = 0;
+    if (leftCount != total) {
+      Leaf *right = new Leaf();
+      for (unsigned i=leftCount; i<total; i++)
+        right->values[i - leftCount] = values[i];
+      right->count = total - leftCount;
+      split = right;
+    }
+    return left;
+  }
+
+  // Build an interior node taking ownership of the given children.
+  template<class K, class V, class KOV, class CMP>
+  typename ImmutableBTree<K,V,KOV,CMP>::Node *
+  ImmutableBTree<K,V,KOV,CMP>::makeInner(const key_type *keys,
+                                         Node *const *children,
+                                         unsigned total, Node *&split) {
+    unsigned leftCount = total > MaxEntries ? total / 2 : total;
+    Inner *left = new Inner();
+    for (unsigned i=0; i<leftCount; i++) {
+      left->keys[i] = keys[i];
+      left->children[i] = children[i];
+    }
+    left->count = leftCount;
+
+    split = 0;
+    if (leftCount != total) {
+      Inner *right = new Inner();
+      for (unsigned i=leftCount; i<total; i++) {
+        right->keys[i - leftCount] = keys[i];
+        right->children[i - leftCount] = children[i];
+      }
+      right->count = total - leftCount;
+      split = right;
+    }
+    return left;
+  }
+
+  // Returns n (with a new reference) if nothing changed.
+  template<class K, class V, class KOV, class CMP>
+  typename ImmutableBTree<K,V,KOV,CMP>::Node *
+  ImmutableBTree<K,V,KOV,CMP>::insertNode(Node *n, const value_type &v,
+                                          bool replace, Node *&split,
+                                          bool &added) {
+    const key_type &k = keyOf(v);
+    split = 0;
+
+    if (n->isLeaf) {
+      Leaf *l = static_cast<Leaf*>(n);
+      unsigned pos = leafLowerBound(l, k);
+      bool exists = pos < l->count && !less(k, keyOf(l->values[pos]));
+      if (exists && !replace)
+        return n->incref();
+
+      value_type values[MaxEntries + 1];
+      unsigned total = 0;
+      for (unsigned i=0; i<pos; i++)
+        values[total++] = l->values[i];
+      values[total++] = v;
+      for (unsigned i=exists ? pos + 1 : pos; i<l->count; i++)
+        values[total++] = l->values[i];
+
+      added = !exists;
+      return makeLeaf(values, total, split);
+    }
+
+    Inner *in = static_cast<Inner*>(n);
+    unsigned pos = childIndex(in, k);
+    Node *childSplit;
+    Node *child = insertNode(in->children[pos], v, replace, childSplit, added);
+    if (child == in->children[pos]) {
+      child->decref();
+      return n->incref();
+    }
+
+    key_type keys[MaxEntries + 1];
+    Node *children[MaxEntries + 1];
+    unsigned total = 0;
+    for (unsigned i=0; i<in->count; i++) {
+      if (i == pos) {
+        keys[total] = child->minKey();
+        children[total++] = child;
+        if (childSplit) {
+          keys[total] = childSplit->minKey();
+          children[total++] = childSplit;
+        }
+      } else {
+        keys[total] = in->keys[i];
+        children[total++] = in->children[i]->incref();
+      }
+    }
+    return makeInner(keys, children, total, split);
+  }
+
+  // Returns n (with a new reference) if k is not present. The result
+  // may be underfull, the caller rebalances it with a sibling.
+  template<class K, class V, class KOV, class CMP>
+  typename ImmutableBTree<K,V,KOV,CMP>::Node *
+  ImmutableBTree<K,V,KOV,CMP>::removeNode(Node *n, const key_type &k) {
+    Node *split;
+
+    if (n->isLeaf) {
+      Leaf *l = static_cast<Leaf*>(n);
+      unsigned pos = leafLowerBound(l, k);
+      if (pos == l->count || less(k, keyOf(l->values[pos])))
+        return n->incref();
+
+      value_type values[MaxEntries];
+      unsigned total = 0;
+      for (unsigned i=0; i<l->count; i++)
+        if (i != pos)
+          values[total++] = l->values[i];
+      return makeLeaf(values, total, split);
+    }
+
+    Inner *in = static_cast<Inner*>(n);
+    unsigned pos = childIndex(in, k);
+    Node *child = removeNode(in->children[pos], k);
+    if (child == in->children[pos]) {
+      child->decref();
+      return n->incref();
+    }
+
+    key_type keys[MaxEntries];
+    Node *children[MaxEntries];
+    unsigned total = 0;
+
+    if (child->count >= MinEntries || in->count == 1) {
+      for (unsigned i=0; i<in->count; i++) {
+        if (i == pos) {
+          if (!child->count) {
+            child->decref();
+            continue;
+          }
+          keys[total] = child->minKey();
+          children[total++] = child;
+        } else {
+          keys[total] = in->keys[i];
+          children[total++] = in->children[i]->incref();
+        }
+      }
+      return makeInner(keys, children, total, split);
+    }
+
+    // Merge the underfull child with a sibling, or spread the entries
+    // of both evenly if they do not fit in one node.
+    unsigned first = pos ? pos - 1 : pos;
+    Node *a = first == pos ? child : in->children[first];
+    Node *b = first == pos ? in->children[first + 1] : child;
+    Node *merged, *mergedSplit;
+    if (child->isLeaf) {
+      value_type values[2 * MaxEntries];
+      unsigned count = 0;
+      for (unsigned i=0; i<a->count; i++)
+        values[count++] = static_cast<Leaf*>(a)->values[i];
+      for (unsigned i=0; i<b->count; i++)
+        values[count++] = static_cast<Leaf*>(b)->values[i];
+      merged = makeLeaf(values, count, mergedSplit);
+    } else {
+      key_type mkeys[2 * MaxEntries];
+      Node *mchildren[2 * MaxEntries];
+      unsigned count = 0;
+      for (unsigned i=0; i<a->count; i++, count++) {
+        mkeys[count] = static_cast<Inner*>(a)->keys[i];
+        mchildren[count] = static_cast<Inner*>(a)->children[i]->incref();
+      }
+      for (unsigned i=0; i<b->count; i++, count++) {
+        mkeys[count] = static_cast<Inner*>(b)->keys[i];
+        mchildren[count] = static_cast<Inner*>(b)->children[i]->incref();
+      }
+      merged = makeInner(mkeys, mchildren, count, mergedSplit);
+    }
+    child->decref();
+
+    for (unsigned i=0; i<in->count; i++) {
+      if (i == first) {
+        keys[total] = merged->minKey();
+        children[total++] = merged;
+        if (mergedSplit) {
+          keys[total] = mergedSplit->minKey();
+          children[total++] = mergedSplit;
+        }
+        ++i;
+      } else {
+        keys[total] = in->keys[i];
+        children[total++] = in->children[i]->incref();
+      }
+    }
+    return makeInner(keys, children, total, split);
+  }
+
+  /***/
+
+  template<class K, class V, class KOV, class CMP>
+  ImmutableBTree<K,V,KOV,CMP>::ImmutableBTree()
+    : root(0), elements(0) {
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  ImmutableBTree<K,V,KOV,CMP>::ImmutableBTree(Node *_root, size_t _elements)
+    : root(_root), elements(_elements) {
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  ImmutableBTree<K,V,KOV,CMP>::ImmutableBTree(const ImmutableBTree &s)
+    : root(s.root), elements(s.elements) {
+    if (root)
+      root->incref();
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  ImmutableBTree<K,V,KOV,CMP>::~ImmutableBTree() {
+    if (root)
+      root->decref();
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  ImmutableBTree<K,V,KOV,CMP> &
+  ImmutableBTree<K,V,KOV,CMP>::operator=(const ImmutableBTree &s) {
+    if (s.root)
+      s.root->incref();
+    if (root)
+      root->decref();
+    root = s.root;
+    elements = s.elements;
+    return *this;
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  bool ImmutableBTree<K,V,KOV,CMP>::empty() const {
+    return !root;
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  size_t ImmutableBTree<K,V,KOV,CMP>::count(const key_type &k) const {
+    return lookup(k) ? 1 : 0;
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  const typename ImmutableBTree<K,V,KOV,CMP>::value_type *
+  ImmutableBTree<K,V,KOV,CMP>::lookup(const key_type &k) const {
+    if (!root)
+      return 0;
+    Node *n = root;
+    while (!n->isLeaf) {
+      Inner *in = static_cast<Inner*>(n);
+      n = in->children[childIndex(in, k)];
+    }
+    Leaf *l = static_cast<Leaf*>(n);
+    unsigned i = leafLowerBound(l, k);
+    if (i < l->count && !less(k, keyOf(l->values[i])))
+      return &l->values[i];
+    return 0;
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  const typename ImmutableBTree<K,V,KOV,CMP>::value_type *
+  ImmutableBTree<K,V,KOV,CMP>::lookup_previous(const key_type &k) const {
+    if (!root)
+      return 0;
+    // Separator keys are exact minimums, so the leaf reached holds the
+    // answer unless k is smaller than every key.
+    Node *n = root;
+    while (!n->isLeaf) {
+      Inner *in = static_cast<Inner*>(n);
+      n = in->children[childIndex(in, k)];
+    }
+    Leaf *l = static_cast<Leaf*>(n);
+    unsigned i = 0;
+    while (i < l->count && !less(k, keyOf(l->values[i])))
+      ++i;
+    return i ? &l->values[i - 1] : 0;
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  const typename ImmutableBTree<K,V,KOV,CMP>::value_type &
+  ImmutableBTree<K,V,KOV,CMP>::min() const {
+    assert(root);
+    Node *n = root;
+    while (!n->isLeaf)
+      n = static_cast<Inner*>(n)->children[0];
+    return static_cast<Leaf*>(n)->values[0];
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  const typename ImmutableBTree<K,V,KOV,CMP>::value_type &
+  ImmutableBTree<K,V,KOV,CMP>::max() const {
+    assert(root);
+    Node *n = root;
+    while (!n->isLeaf)
+      n = static_cast<Inner*>(n)->children[n->count - 1];
+    return static_cast<Leaf*>(n)->values[n->count - 1];
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  size_t ImmutableBTree<K,V,KOV,CMP>::size() const {
+    return elements;
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  ImmutableBTree<K,V,KOV,CMP>
+  ImmutableBTree<K,V,KOV,CMP>::insertOrReplace(const value_type &value,
+                                               bool replace) const {
+    if (!root) {
+      Leaf *l = new Leaf();
+      l->values[0] = value;
+      l->count = 1;
+      return ImmutableBTree(l, 1);
+    }
+
+    Node *split;
+    bool added = false;
+    Node *n = insertNode(root, value, replace, split, added);
+    if (n == root) {
+      n->decref();
+      return *this;
+    }
+    if (split) {
+      Inner *in = new Inner();
+      in->keys[0] = n->minKey();
+      in->children[0] = n;
+      in->keys[1] = split->minKey();
+      in->children[1] = split;
+      in->count = 2;
+      n = in;
+    }
+    return ImmutableBTree(n, elements + (added ? 1 : 0));
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  ImmutableBTree<K,V,KOV,CMP>
+  ImmutableBTree<K,V,KOV,CMP>::insert(const value_type &value) const {
+    return insertOrReplace(value, false);
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  ImmutableBTree<K,V,KOV,CMP>
+  ImmutableBTree<K,V,KOV,CMP>::replace(const value_type &value) const {
+    return insertOrReplace(value, true);
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  ImmutableBTree<K,V,KOV,CMP>
+  ImmutableBTree<K,V,KOV,CMP>::remove(const key_type &key) const {
+    if (!root)
+      return *this;
+
+    Node *n = removeNode(root, key);
+    if (n == root) {
+      n->decref();
+      return *this;
+    }
+
+    // Drop a root left with a single child, or with nothing.
+    if (!n->isLeaf && n->count == 1) {
+      Node *child = static_cast<Inner*>(n)->children[0]->incref();
+      n->decref();
+      n = child;
+    } else if (!n->count) {
+      n->decref();
+      n = 0;
+    }
+    return ImmutableBTree(n, elements - 1);
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  ImmutableBTree<K,V,KOV,CMP>
+  ImmutableBTree<K,V,KOV,CMP>::popMin(value_type &valueOut) const {
+    valueOut = min();
+    return remove(keyOf(valueOut));
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  ImmutableBTree<K,V,KOV,CMP>
+  ImmutableBTree<K,V,KOV,CMP>::popMax(value_type &valueOut) const {
+    valueOut = max();
+    return remove(keyOf(valueOut));
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  inline typename ImmutableBTree<K,V,KOV,CMP>::iterator
+  ImmutableBTree<K,V,KOV,CMP>::begin() const {
+    return iterator(root, true);
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  inline typename ImmutableBTree<K,V,KOV,CMP>::iterator
+  ImmutableBTree<K,V,KOV,CMP>::end() const {
+    return iterator(root, false);
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  inline typename ImmutableBTree<K,V,KOV,CMP>::iterator
+  ImmutableBTree<K,V,KOV,CMP>::find(const key_type &key) const {
+    iterator end(root,false), it = lower_bound(key);
+    if (it==end || less(key,keyOf(*it))) {
+      return end;
+    } else {
+      return it;
+    }
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  inline typename ImmutableBTree<K,V,KOV,CMP>::iterator
+  ImmutableBTree<K,V,KOV,CMP>::lower_bound(const key_type &k) const {
+    iterator it(root,false);
+    if (!root)
+      return it;
+
+    Node *n = root;
+    while (!n->isLeaf) {
+      Inner *in = static_cast<Inner*>(n);
+      unsigned i = childIndex(in, k);
+      it.push(n, i);
+      n = in->children[i];
+    }
+    Leaf *l = static_cast<Leaf*>(n);
+    unsigned i = leafLowerBound(l, k);
+    if (i < l->count) {
+      it.push(n, i);
+    } else {
+      // past the end of this leaf, the first value of the next one
+      it.push(n, l->count - 1);
+      ++it;
+    }
+    return it;
+  }
+
+  template<class K, class V, class KOV, class CMP>
+  typename ImmutableBTree<K,V,KOV,CMP>::iterator
+  ImmutableBTree<K,V,KOV,CMP>::upper_bound(const key_type &key) const {
+    iterator end(root,false),it = lower_bound(key);
+    if (it!=end &&
+        !less(key,keyOf(*it))) // no need to loop, no duplicates
+      ++it;
+    return it;
+  }
+
+}
+
+#endif
@@ -11,8 +11,9 @@
 #define __UTIL_IMMUTABLEMAP_H__
 
 #include <functional>
+#include <utility>
 
-#include "ImmutableTree.h"
+#include "ImmutableBTree.h"
 
 namespace klee {
   template<class V, class D>
@@ -27,7 +28,7 @@ namespace klee {
     typedef K key_type;
     typedef std::pair<K,D> value_type;
 
-    typedef ImmutableTree<K, value_type, _Select1st<value_type,key_type>, CMP> Tree;
+    typedef ImmutableBTree<K, value_type, _Select1st<value_type,key_type>, CMP> Tree;
     typedef typename Tree::iterator iterator;
 
   private:
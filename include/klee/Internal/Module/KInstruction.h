@@ -37,6 +37,10 @@ namespace klee {
     int *operands;
     /// Destination register index.
     unsigned dest;
+    /// Width in bits of the result, or 0 if the instruction has no sized
+    /// result. Decoded once so that executing does not query the target
+    /// data for it.
+    unsigned width;
 
   public:
     virtual ~KInstruction(); 
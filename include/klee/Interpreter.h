@@ -13,6 +13,7 @@
 #include <string>
 #include <map>
 #include <set>
+#include <stdint.h>
 
 struct KTest;
 
@@ -28,6 +29,20 @@ class ExecutionState;
 class Interpreter;
 class TreeStreamWriter;
 
+/// CheckpointPosition - How far a live state had come when a checkpoint
+/// was written (see --checkpoint-interval). --resume follows its
+/// branches again without asking the solver.
+struct CheckpointPosition {
+  /// The number of forks on the path.
+  unsigned depth;
+  /// The number of instructions executed on the path.
+  uint64_t instructions;
+  /// The side taken at each branch, '0' or '1' as in a .path file.
+  std::vector<unsigned char> branches;
+
+  CheckpointPosition() : depth(0), instructions(0) {}
+};
+
 class InterpreterHandler {
 public:
   InterpreterHandler() {}
@@ -43,6 +58,17 @@ public:
   virtual void processTestCase(const ExecutionState &state,
                                const char *err, 
                                const char *suffix) = 0;
+
+  /// Replace the last checkpoint with the inputs reaching each of the
+  /// live states and the position of each state (see
+  /// --checkpoint-interval).
+  virtual void processCheckpoint(const std::vector<
+                                 std::vector<
+                                 std::pair<std::string,
+                                 std::vector<unsigned char> > > >
+                                 &solutions,
+                                 const std::vector<CheckpointPosition>
+                                 &positions) = 0;
 };
 
 class Interpreter {
@@ -77,8 +103,22 @@ public:
     /// symbolic execution on concrete programs.
     unsigned MakeConcreteSymbolic;
 
+    /// Process level partitioning of the exploration (see
+    /// --parallel-workers). The first PartitionDepth symbolic forks
+    /// on every path select one of 2^PartitionDepth subtrees, which
+    /// are dealt round-robin to PartitionCount workers; this
+    /// interpreter only explores the subtrees owned by
+    /// PartitionIndex. A PartitionCount of 0 or 1 disables
+    /// partitioning.
+    unsigned PartitionIndex;
+    unsigned PartitionCount;
+    unsigned PartitionDepth;
+
     InterpreterOptions()
-      : MakeConcreteSymbolic(false)
+      : MakeConcreteSymbolic(false),
+        PartitionIndex(0),
+        PartitionCount(0),
+        PartitionDepth(0)
     {}
   };
 
@@ -124,6 +164,12 @@ public:
   // for the search. use null to reset.
   virtual void useSeeds(const std::vector<struct KTest *> *seeds) = 0;
 
+  /// For each seed, the position of the checkpointed state it reaches
+  /// (see --resume). The path up to it is re-executed without asking the
+  /// solver at branches, and is not counted again.
+  virtual void useSeedPrefixes(const std::vector<CheckpointPosition>
+                               *positions) = 0;
+
   virtual void runFunctionAsMain(llvm::Function *f,
                                  int argc,
                                  char **argv,
@@ -289,12 +289,44 @@ namespace klee {
   /// \param s - The underlying solver to use.
   Solver *createFastCexSolver(Solver *s);
 
+  /// createLocalSearchSolver - Create a solver which looks for solutions by
+  /// stochastic local search over the symbolic bytes, starting from recent
+  /// solutions, before using the underlying solver.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param maxFlips - The most bytes one search may change.
+  /// \param maxTime - The most time in seconds one search may take.
+  Solver *createLocalSearchSolver(Solver *s, unsigned maxFlips,
+                                  double maxTime);
+
+  /// createKnownBitsSolver - Create a solver which tries to decide queries
+  /// by propagating known bits and value intervals through the constraints,
+  /// before using the underlying solver.
+  ///
+  /// \param s - The underlying solver to use.
+  Solver *createKnownBitsSolver(Solver *s);
+
+  /// createLinearEquationSolver - Create a solver which tries to decide
+  /// queries by solving their linear equalities modulo a power of two,
+  /// before using the underlying solver.
+  ///
+  /// \param s - The underlying solver to use.
+  Solver *createLinearEquationSolver(Solver *s);
+
   /// createIndependentSolver - Create a solver which will eliminate any
   /// unnecessary constraints before propogating the query to the underlying
   /// solver.
   ///
   /// \param s - The underlying solver to use.
   Solver *createIndependentSolver(Solver *s);
+
+  /// createCanonicalizingSolver - Create a solver which renames the
+  /// symbolic arrays of each query in first-use order and orders the
+  /// operands of commutative operators, so that the caches below it see
+  /// structurally equal queries as equal.
+  ///
+  /// \param s - The underlying solver to use.
+  Solver *createCanonicalizingSolver(Solver *s);
   
   /// createPCLoggingSolver - Create a solver which will forward all queries
   /// after writing them to the given path in .pc format.
@@ -307,10 +339,40 @@ namespace klee {
                                     int minQueryTimeToLog);
 
 
+  /// createPersistentCachingSolver - Create a solver which caches the
+  /// answers of the given solver in a file, so that later runs can reuse
+  /// them. Queries are keyed by a structural hash that ignores array
+  /// names.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param path - The cache file, created if it does not exist.
+  Solver *createPersistentCachingSolver(Solver *s, const std::string &path);
+
+  /// createSharedCachingSolver - Create a solver which caches the answers
+  /// of the given solver in POSIX shared memory, so that concurrent runs
+  /// on the same machine reuse each other's answers. Answers too large
+  /// for a cache slot are not shared.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param name - The shared memory object, created if it does not exist.
+  /// \param size - The size in bytes of the object if it is created.
+  Solver *createSharedCachingSolver(Solver *s, const std::string &name,
+                                    size_t size);
+
   /// createDummySolver - Create a dummy solver implementation which always
   /// fails.
   Solver *createDummySolver();
 
+  /// createPortfolioSolver - Create a solver which races the given
+  /// solvers against each other, each in a worker process of its own,
+  /// and answers with whichever finishes first. Backends that keep
+  /// winning a class of queries end up running them alone.
+  ///
+  /// \param solvers - The solvers to race; the portfolio takes ownership.
+  /// \param names - The names of the solvers, for reporting.
+  Solver *createPortfolioSolver(const std::vector<Solver *> &solvers,
+                                const std::vector<std::string> &names);
+
   // Create a solver based on the supplied ``CoreSolverType``.
   Solver *createCoreSolver(CoreSolverType cst);
 }
@@ -21,12 +21,24 @@ namespace stats {
   extern Statistic queriesValid;
   extern Statistic queryCacheHits;
   extern Statistic queryCacheMisses;
+  extern Statistic persistentCacheHits;
+  extern Statistic persistentCacheMisses;
+  extern Statistic sharedCacheHits;
+  extern Statistic sharedCacheMisses;
   extern Statistic queryCexCacheHits;
   extern Statistic queryCexCacheMisses;
+  extern Statistic cexCacheEvictions;
+  extern Statistic localSearchHits;
+  extern Statistic localSearchMisses;
+  extern Statistic localSearchTime;
+  extern Statistic localSearchSavedTime;
   extern Statistic queryConstructTime;
   extern Statistic queryConstructs;
   extern Statistic queryCounterexamples;
   extern Statistic queryTime;
+
+  /// The validity queries handed to the --async-solver-workers.
+  extern Statistic asyncQueries;
   
 #ifdef DEBUG
   extern Statistic arrayHashTime;
@@ -0,0 +1,104 @@
+//===-- ExprTape.h ----------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_EXPRTAPE_H
+#define KLEE_EXPRTAPE_H
+
+#include "klee/Expr.h"
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+namespace klee {
+  class Assignment;
+
+  /// ExprTape - A set of constraints compiled into a flat list of
+  /// instructions in topological order, for checking many assignments
+  /// against them at once.
+  ///
+  /// Assignments are evaluated Lanes at a time, one per lane. Every
+  /// instruction computes its result for all lanes in a tight loop over
+  /// 64-bit values, which the compiler can vectorize. Only expressions of
+  /// at most 64 bits are supported.
+  ///
+  /// An assignment satisfies the tape if it satisfies every constraint
+  /// the way Assignment::satisfies() checks it, except that a constraint
+  /// whose value depends on a division by zero fails the check. As with
+  /// the evaluator, the side of a select which is not taken does not
+  /// count. The check is therefore never more permissive than
+  /// Assignment::satisfies().
+  class ExprTape {
+  public:
+    enum { Lanes = 8 };
+
+  private:
+    struct Instruction {
+      Expr::Kind kind;
+      Expr::Width width;
+      unsigned result;
+      unsigned ops[3];
+      unsigned numOps;
+      /// The extract offset, the operand width of an extension or a
+      /// signed comparison, or the read this instruction performs.
+      unsigned aux;
+    };
+
+    struct Read {
+      const Array *root;
+      /// The position of the root in the per-lane binding tables.
+      unsigned array;
+      /// The index and value slots of the updates, newest first.
+      std::vector<std::pair<unsigned, unsigned> > updates;
+      /// The initial values of a constant root.
+      std::vector<uint64_t> constants;
+    };
+
+    /// The constraints, which keep the compiled expressions alive.
+    std::vector<ref<Expr> > held;
+    std::vector<Instruction> instructions;
+    std::vector<Read> reads;
+    std::vector<const Array *> arrays;
+    std::vector<unsigned> constraints;
+    std::map<const Expr *, unsigned> slots;
+    std::map<const Array *, unsigned> arrayIndices;
+    /// The value of every slot in every lane, slot-major. Constant slots
+    /// are filled in when compiled and never written afterwards.
+    std::vector<uint64_t> values;
+    /// Whether the value of every slot in every lane depends on a
+    /// division by zero, laid out as values.
+    std::vector<unsigned char> undefined;
+    unsigned numSlots;
+    bool valid;
+
+    unsigned compile(const ref<Expr> &e);
+    unsigned newSlot();
+    unsigned getArrayIndex(const Array *array);
+
+  public:
+    ExprTape() : numSlots(0), valid(true) {}
+
+    /// Add a constraint to the tape. Returns false, and leaves the tape
+    /// unusable, if the constraint has an unsupported expression.
+    bool addConstraint(const ref<Expr> &constraint);
+
+    bool isValid() const { return valid; }
+
+    /// Return the index of the first of \a assignments satisfying every
+    /// constraint, or -1 if there is none.
+    int findSatisfying(const std::vector<const Assignment *> &assignments);
+
+    /// Check \a count (at most Lanes) assignments, setting
+    /// satisfied[i] for each one.
+    void evaluate(const Assignment *const *assignments, unsigned count,
+                  bool *satisfied);
+  };
+}
+
+#endif
@@ -12,6 +12,21 @@ UseFastCexSolver("use-fast-cex-solver",
 		 llvm::cl::init(false),
 		 llvm::cl::desc("(default=off)"));
 
+llvm::cl::opt<bool>
+UseKnownBitsSolver("use-known-bits-solver",
+                   llvm::cl::init(false),
+                   llvm::cl::desc("Try to decide queries from the known bits "
+                                  "and value intervals of their reads before "
+                                  "the core solver (default=off)"));
+
+llvm::cl::opt<bool>
+UseLinearEquationSolver("use-linear-equation-solver",
+                        llvm::cl::init(false),
+                        llvm::cl::desc("Try to decide queries by solving their "
+                                       "linear equalities with Gaussian "
+                                       "elimination before the core solver "
+                                       "(default=off)"));
+
 llvm::cl::opt<bool>
 UseCexCache("use-cex-cache",
             llvm::cl::init(true),
@@ -22,11 +37,56 @@ UseCache("use-cache",
          llvm::cl::init(true),
          llvm::cl::desc("Use validity caching (default=on)"));
 
+llvm::cl::opt<std::string>
+QueryCacheFile("query-cache-file",
+               llvm::cl::desc("Keep the answers of the core solver in this file "
+                              "and reuse them in later runs (default=off)"));
+
+llvm::cl::opt<std::string>
+SharedQueryCache("shared-query-cache",
+                 llvm::cl::desc("Share the answers of the core solver with "
+                                "concurrent runs through the POSIX shared "
+                                "memory object of this name (default=off)"));
+
+llvm::cl::opt<unsigned>
+SharedQueryCacheSize("shared-query-cache-size",
+                     llvm::cl::init(256),
+                     llvm::cl::desc("Size in MB of the shared query cache when "
+                                    "this run creates it (default=256)"));
+
+llvm::cl::opt<bool>
+UseLocalSearch("use-local-search",
+               llvm::cl::init(false),
+               llvm::cl::desc("Look for solutions by stochastic local search "
+                              "over the symbolic bytes before the core solver "
+                              "(default=off)"));
+
+llvm::cl::opt<unsigned>
+LocalSearchFlips("local-search-flips",
+                 llvm::cl::init(1000),
+                 llvm::cl::desc("Maximum number of bytes changed in one local "
+                                "search (default=1000)"));
+
+llvm::cl::opt<double>
+LocalSearchTime("local-search-time",
+                llvm::cl::init(0.01),
+                llvm::cl::desc("Maximum time for one local search "
+                               "(default=0.01s)"),
+                llvm::cl::value_desc("seconds"));
+
 llvm::cl::opt<bool>
 UseIndependentSolver("use-independent-solver",
                      llvm::cl::init(true),
                      llvm::cl::desc("Use constraint independence (default=on)"));
 
+llvm::cl::opt<bool>
+UseQueryCanonicalization("use-query-canonicalization",
+                         llvm::cl::init(false),
+                         llvm::cl::desc("Rename arrays and order commutative "
+                                        "operands before the caches, so that "
+                                        "queries equal up to renaming share "
+                                        "cache entries (default=off)"));
+
 llvm::cl::opt<bool>
 DebugValidateSolver("debug-validate-solver",
 		             llvm::cl::init(false));
@@ -47,7 +107,7 @@ MaxCoreSolverTime("max-solver-time",
 
 llvm::cl::opt<bool>
 UseForkedCoreSolver("use-forked-solver",
-             llvm::cl::desc("Run the core SMT solver in a forked process (default=on)"),
+             llvm::cl::desc("Run the core SMT solver in a separate worker process (default=on)"),
              llvm::cl::init(true));
 
 llvm::cl::opt<bool>
@@ -55,6 +115,13 @@ CoreSolverOptimizeDivides("solver-optimize-divides",
                  llvm::cl::desc("Optimize constant divides into add/shift/multiplies before passing to core SMT solver (default=on)"),
                  llvm::cl::init(true));
 
+llvm::cl::opt<bool>
+CoreSolverIncremental("solver-incremental",
+                      llvm::cl::desc("Keep the constraints of the last query asserted in the core "
+                                     "SMT solver and only assert the constraints a query adds to "
+                                     "them (STP and Z3 only, default=off)"),
+                      llvm::cl::init(false));
+
 
 /* Using cl::list<> instead of cl::bits<> results in quite a bit of ugliness when it comes to checking
  * if an option is set. Unfortunately with gcc4.7 cl::bits<> is broken with LLVM2.9 and I doubt everyone
@@ -114,6 +181,8 @@ llvm::cl::opt<CoreSolverType> CoreSolverToUse(
                      clEnumValN(METASMT_SOLVER, "metasmt", "metaSMT" METASMT_IS_DEFAULT_STR),
                      clEnumValN(DUMMY_SOLVER, "dummy", "Dummy solver"),
                      clEnumValN(Z3_SOLVER, "z3", "Z3" Z3_IS_DEFAULT_STR),
+                     clEnumValN(PORTFOLIO_SOLVER, "portfolio",
+                                "Race all available backends"),
                      clEnumValEnd),
     llvm::cl::init(DEFAULT_CORE_SOLVER));
 }
@@ -42,15 +42,35 @@ namespace klee
 			  << baseSolverQuerySMT2LogPath.c_str() << "\n";
 	  }
 
+	  if (!QueryCacheFile.empty())
+		solver = createPersistentCachingSolver(solver, QueryCacheFile);
+
+	  if (!SharedQueryCache.empty())
+		solver = createSharedCachingSolver(solver, SharedQueryCache,
+		                                   (size_t)SharedQueryCacheSize << 20);
+
+	  if (UseLocalSearch)
+		solver = createLocalSearchSolver(solver, LocalSearchFlips,
+		                                 LocalSearchTime);
+
 	  if (UseFastCexSolver)
 		solver = createFastCexSolver(solver);
 
+	  if (UseKnownBitsSolver)
+		solver = createKnownBitsSolver(solver);
+
+	  if (UseLinearEquationSolver)
+		solver = createLinearEquationSolver(solver);
+
 	  if (UseCexCache)
 		solver = createCexCachingSolver(solver);
 
 	  if (UseCache)
 		solver = createCachingSolver(solver);
 
+	  if (UseQueryCanonicalization)
+		solver = createCanonicalizingSolver(solver);
+
 	  if (UseIndependentSolver)
 		solver = createIndependentSolver(solver);
 
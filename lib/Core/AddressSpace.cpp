@@ -298,8 +298,9 @@ void AddressSpace::copyOutConcretes() {
       ObjectState *os = it->second;
       uint8_t *address = (uint8_t*) (unsigned long) mo->address;
 
-      if (!os->readOnly)
-        memcpy(address, os->concreteStore, mo->size);
+      if (!os->readOnly) {
+        os->copyConcreteStoreTo(address);
+      }
     }
   }
 }
@@ -313,12 +314,12 @@ bool AddressSpace::copyInConcretes() {
       const ObjectState *os = it->second;
       uint8_t *address = (uint8_t*) (unsigned long) mo->address;
 
-      if (memcmp(address, os->concreteStore, mo->size)!=0) {
+      if (!os->concreteStoreMatches(address)) {
         if (os->readOnly) {
           return false;
         } else {
           ObjectState *wos = getWriteable(mo, os);
-          memcpy(wos->concreteStore, address, mo->size);
+          wos->copyConcreteStoreFrom(address);
         }
       }
     }
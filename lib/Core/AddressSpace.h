@@ -56,6 +56,13 @@ namespace klee {
     AddressSpace(const AddressSpace &b) : cowKey(++b.cowKey), objects(b.objects) { }
     ~AddressSpace() {}
 
+    /// Replace the contents with those of \a b, with the same
+    /// ownership semantics as the copy constructor.
+    void copyFrom(const AddressSpace &b) {
+      cowKey = ++b.cowKey;
+      objects = b.objects;
+    }
+
     /// Resolve address to an ObjectPair in result.
     /// \return true iff an object was found.
     bool resolveOne(const ref<ConstantExpr> &address, 
@@ -23,6 +23,7 @@ Statistic stats::minDistToReturn("MinDistToReturn", "Rdist");
 Statistic stats::minDistToUncovered("MinDistToUncovered", "UCdist");
 Statistic stats::reachableUncovered("ReachableUncovered", "IuncovReach");
 Statistic stats::resolveTime("ResolveTime", "Rtime");
+Statistic stats::sharedPaths("SharedPaths", "SharedPaths");
 Statistic stats::solverTime("SolverTime", "Stime");
 Statistic stats::states("States", "States");
 Statistic stats::trueBranches("TrueBranches", "Bt");
@@ -30,6 +30,10 @@ namespace stats {
   /// The number of process forks.
   extern Statistic forks;
 
+  /// The number of paths which ended above the --parallel-workers
+  /// partition depth in a worker other than the one reporting them.
+  extern Statistic sharedPaths;
+
   /// Number of states, this is a "fake" statistic used by istats, it
   /// isn't normally up-to-date.
   extern Statistic states;
@@ -73,16 +73,25 @@ ExecutionState::ExecutionState(KFunction *kf) :
     queryCost(0.), 
     weight(1),
     depth(0),
+    partitionDepth(0),
+    partitionPrefix(0),
 
     instsSinceCovNew(0),
     coveredNew(false),
     forkDisabled(false),
-    ptreeNode(0) {
+    ptreeNode(0),
+    steppedInstructions(0),
+    replay(0),
+    dormant(false),
+    spilled(false),
+    uncheckedSide(false) {
   pushFrame(0, kf);
 }
 
 ExecutionState::ExecutionState(const std::vector<ref<Expr> > &assumptions)
-    : constraints(assumptions), queryCost(0.), ptreeNode(0) {}
+    : constraints(assumptions), queryCost(0.), partitionDepth(0),
+      partitionPrefix(0), ptreeNode(0), steppedInstructions(0), replay(0),
+      dormant(false), spilled(false), uncheckedSide(false) {}
 
 ExecutionState::~ExecutionState() {
   for (unsigned int i=0; i<symbolics.size(); i++)
@@ -110,6 +119,8 @@ ExecutionState::ExecutionState(const ExecutionState& state):
     queryCost(state.queryCost),
     weight(state.weight),
     depth(state.depth),
+    partitionDepth(state.partitionDepth),
+    partitionPrefix(state.partitionPrefix),
 
     pathOS(state.pathOS),
     symPathOS(state.symPathOS),
@@ -119,9 +130,17 @@ ExecutionState::ExecutionState(const ExecutionState& state):
     forkDisabled(state.forkDisabled),
     coveredLines(state.coveredLines),
     ptreeNode(state.ptreeNode),
+    steppedInstructions(state.steppedInstructions),
+    replayLog(state.replayLog),
+    replay(0),
+    dormant(false),
+    spilled(false),
+    uncheckedBranch(state.uncheckedBranch),
+    uncheckedSide(state.uncheckedSide),
     symbolics(state.symbolics),
     arrayNames(state.arrayNames)
 {
+  assert(!state.dormant && "copying a dormant state");
   for (unsigned int i=0; i<symbolics.size(); i++)
     symbolics[i].first->refCount++;
 }
@@ -133,6 +152,12 @@ ExecutionState *ExecutionState::branch() {
   falseState->coveredNew = false;
   falseState->coveredLines.clear();
 
+  // Both sides continue the log in a node of their own.
+  if (!replayLog.isNull()) {
+    replayLog = new ReplayLog(replayLog);
+    falseState->replayLog = new ReplayLog(falseState->replayLog);
+  }
+
   weight *= .5;
   falseState->weight -= weight;
 
@@ -344,10 +369,35 @@ bool ExecutionState::merge(const ExecutionState &b) {
          ie = commonConstraints.end(); it != ie; ++it)
     constraints.addConstraint(*it);
   constraints.addConstraint(OrExpr::create(inA, inB));
+  spilled = false;
+
+  if (!replayLog.isNull())
+    replayLog->markNotReplayable();
 
   return true;
 }
 
+void ExecutionState::makeDormant() {
+  assert(!dormant && !replayLog.isNull() && replayLog->isReplayable());
+  addressSpace.objects = MemoryMap();
+  constraints = ConstraintManager();
+  dormant = true;
+}
+
+void ExecutionState::wake(ExecutionState &replica) {
+  assert(dormant && pc == replica.pc && "replica did not reach the state");
+  addressSpace.copyFrom(replica.addressSpace);
+  constraints = replica.constraints;
+  prevPC = replica.prevPC;
+  incomingBBIndex = replica.incomingBBIndex;
+  stack.swap(replica.stack);
+  symbolics.swap(replica.symbolics);
+  arrayNames.swap(replica.arrayNames);
+  fnAliases.swap(replica.fnAliases);
+  dormant = false;
+  spilled = false;
+}
+
 void ExecutionState::dumpStack(llvm::raw_ostream &out) const {
   unsigned idx = 0;
   const KInstruction *target = prevPC;
@@ -18,6 +18,7 @@
 #include "Searcher.h"
 #include "SeedInfo.h"
 #include "SpecialFunctionHandler.h"
+#include "SpillFile.h"
 #include "StatsTracker.h"
 #include "TimingSolver.h"
 #include "UserSearcher.h"
@@ -106,7 +107,15 @@
 using namespace llvm;
 using namespace klee;
 
+// Also set by klee --resume.
+cl::opt<bool>
+AllowSeedExtension("allow-seed-extension", 
+                   cl::desc("Allow extra (unbound) values to become symbolic during seeding."));
 
+cl::opt<bool>
+ZeroSeedExtension("zero-seed-extension");
+
+extern cl::opt<double> CheckpointInterval;
 
 
 
@@ -180,13 +189,6 @@ namespace {
   OnlySeed("only-seed", 
            cl::desc("Stop execution after seeding is done without doing regular search."));
  
-  cl::opt<bool>
-  AllowSeedExtension("allow-seed-extension", 
-                     cl::desc("Allow extra (unbound) values to become symbolic during seeding."));
- 
-  cl::opt<bool>
-  ZeroSeedExtension("zero-seed-extension");
- 
   cl::opt<bool>
   AllowSeedTruncation("allow-seed-truncation", 
                       cl::desc("Allow smaller buffers than in seeds."));
@@ -238,6 +240,40 @@ namespace {
   MaxMemoryInhibit("max-memory-inhibit",
             cl::desc("Inhibit forking at memory cap (vs. random terminate) (default=on)"),
             cl::init(true));
+
+  cl::opt<bool>
+  MaxMemorySpill("max-memory-spill",
+                 cl::desc("At the memory cap, write the contents of large objects "
+                          "of inactive states to disk before terminating states "
+                          "(default=off)"),
+                 cl::init(false));
+
+  cl::opt<bool>
+  DormantStates("dormant-states",
+                cl::desc("At the memory cap, drop the contents of inactive "
+                         "states and rebuild them by re-executing their path "
+                         "when they are selected again (default=off)"),
+                cl::init(false));
+
+  cl::opt<unsigned>
+  SpillObjectSize("spill-object-size",
+                  cl::desc("Minimum size of the objects written to disk by "
+                           "--max-memory-spill (in bytes, default=4096)"),
+                  cl::init(4096));
+
+  cl::opt<bool>
+  LazyFork("lazy-fork",
+           cl::init(false),
+           cl::desc("Take both sides of a symbolic branch without asking "
+                    "the solver, and check the side a state took when it "
+                    "is next selected or terminated (default=off)"));
+
+  cl::opt<unsigned>
+  AsyncSolverWorkers("async-solver-workers",
+                     cl::desc("Answer branch queries in this many solver "
+                              "worker processes, running other states while "
+                              "a query is in flight (default=0, off)"),
+                     cl::init(0));
 }
 
 
@@ -253,14 +289,18 @@ Executor::Executor(const InterpreterOptions &opts,
     interpreterHandler(ih),
     searcher(0),
     externalDispatcher(new ExternalDispatcher()),
+    asyncSolver(0),
     statsTracker(0),
     pathWriter(0),
     symPathWriter(0),
+    checkpointPathWriter(0),
     specialFunctionHandler(0),
     processTree(0),
     replayOut(0),
     replayPath(0),    
     usingSeeds(0),
+    seedPrefixes(0),
+    replayRoot(0),
     atMemoryLimit(false),
     inhibitForking(false),
     haltExecution(false),
@@ -284,6 +324,32 @@ Executor::Executor(const InterpreterOptions &opts,
 
   this->solver = new TimingSolver(solver, EqualitySubstitution);
   memory = new MemoryManager(&arrayCache);
+
+  if (AsyncSolverWorkers) {
+    // Each worker keeps caches of its own, the queries of a path share
+    // most of their constraints wherever they are solved. The logging
+    // and persistent cache layers of constructSolverChain are left out,
+    // the workers would all write to the same files.
+    std::vector<Solver*> workerSolvers;
+    for (unsigned i = 0; i != AsyncSolverWorkers; ++i) {
+      Solver *s = klee::createCoreSolver(CoreSolverToUse);
+      if (UseCexCache)
+        s = createCexCachingSolver(s);
+      if (UseCache)
+        s = createCachingSolver(s);
+      if (UseIndependentSolver)
+        s = createIndependentSolver(s);
+      workerSolvers.push_back(s);
+    }
+    asyncSolver = new AsyncSolver(workerSolvers, coreSolverTimeout);
+  }
+
+  spillFile = 0;
+  if (MaxMemorySpill) {
+    spillFile = new SpillFile();
+    if (spillFile->open(interpreterHandler->getOutputFilename("spill.bin")))
+      memory->setSpillFile(spillFile);
+  }
 }
 
 
@@ -320,6 +386,7 @@ const Module *Executor::setModule(llvm::Module *module,
 
 Executor::~Executor() {
   delete memory;
+  delete spillFile;
   delete externalDispatcher;
   if (processTree)
     delete processTree;
@@ -327,7 +394,9 @@ Executor::~Executor() {
     delete specialFunctionHandler;
   if (statsTracker)
     delete statsTracker;
+  delete asyncSolver;
   delete solver;
+  delete checkpointPathWriter;
   delete kmodule;
   while(!timers.empty()) {
     delete timers.back();
@@ -566,6 +635,18 @@ void Executor::branch(ExecutionState &state,
   unsigned N = conditions.size();
   assert(N);
 
+  if (state.replay) {
+    // Rebuilding a dormant state, only follow the condition it took.
+    unsigned index;
+    if (!state.replay->nextBranch(index) || index >= N) {
+      state.replay->diverged = true;
+      index = N;
+    }
+    for (unsigned i=0; i<N; ++i)
+      result.push_back(i == index ? &state : NULL);
+    return;
+  }
+
   if (MaxForks!=~0u && stats::forks >= MaxForks) {
     unsigned next = theRNG.getInt32() % N;
     for (unsigned i=0; i<N; ++i) {
@@ -593,6 +674,11 @@ void Executor::branch(ExecutionState &state,
     }
   }
 
+  if (!state.replayLog.isNull())
+    for (unsigned i=0; i<N; ++i)
+      if (result[i])
+        result[i]->replayLog->addBranch(i);
+
   // If necessary redistribute seeds to match conditions, killing
   // states if necessary due to OnlyReplaySeeds (inefficient but
   // simple).
@@ -603,6 +689,14 @@ void Executor::branch(ExecutionState &state,
     std::vector<SeedInfo> seeds = it->second;
     seedMap.erase(it);
 
+    // The other sides were explored before the checkpoint being resumed
+    // from if the checkpointed state came this way.
+    bool replayingPrefix = false;
+    for (std::vector<SeedInfo>::iterator siit = seeds.begin(),
+           siie = seeds.end(); siit != siie; ++siit)
+      if (siit->isReplayingPrefix(state))
+        replayingPrefix = true;
+
     // Assume each seed only satisfies one condition (necessarily true
     // when conditions are mutually exclusive and their conjunction is
     // a tautology).
@@ -630,10 +724,14 @@ void Executor::branch(ExecutionState &state,
         seedMap[result[i]].push_back(*siit);
     }
 
-    if (OnlyReplaySeeds) {
+    if (OnlyReplaySeeds || replayingPrefix) {
       for (unsigned i=0; i<N; ++i) {
         if (result[i] && !seedMap.count(result[i])) {
-          terminateState(*result[i]);
+          // Those paths were counted by the run being resumed.
+          if (replayingPrefix)
+            removeState(*result[i]);
+          else
+            terminateState(*result[i]);
           result[i] = NULL;
         }
       } 
@@ -679,18 +777,113 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
     }
   }
 
-  double timeout = coreSolverTimeout;
-  if (isSeeding)
-    timeout *= it->second.size();
-  solver->setTimeout(timeout);
-  bool success = solver->evaluate(current, condition, res);
-  solver->setTimeout(0);
+  bool forkInhibited = (MaxMemoryInhibit && atMemoryLimit) ||
+    current.forkDisabled || inhibitForking ||
+    (MaxForks!=~0u && stats::forks >= MaxForks);
+
+  // With --lazy-fork a symbolic branch is forked without a query, the
+  // sides are checked by checkUncheckedBranch(). Only conditions the
+  // constraint manager simplifies to a constant are still decided here,
+  // a branch which can only go one way is forked all the same.
+  bool lazy = LazyFork && !isInternal && !isSeeding && !current.replay &&
+    current.replayLog.isNull() && !replayPath && !replayOut &&
+    !forkInhibited &&
+    current.partitionDepth >= interpreterOpts.PartitionDepth &&
+    !isa<ConstantExpr>(current.constraints.simplifyExpr(condition));
+
+  // With --async-solver-workers a branch query is handed to a worker
+  // and the state is parked while other states run. It steps the branch
+  // again once the answer is in, a query the workers failed on for other
+  // reasons than time is then asked here.
+  bool success = false, answered = false;
+  if (lazy) {
+    res = Solver::Unknown;
+    success = answered = true;
+  } else if (asyncSolver && !isInternal && !isSeeding && !current.replay &&
+             !replayPath && !isa<ConstantExpr>(condition)) {
+    ref<Expr> query = solver->simplifyExprs ?
+      current.constraints.simplifyExpr(condition) : condition;
+    std::map<ExecutionState*, AsyncSolver::Answer>::iterator ai =
+      asyncAnswers.find(&current);
+    if (ai != asyncAnswers.end()) {
+      AsyncSolver::Answer answer = ai->second;
+      asyncAnswers.erase(ai);
+      if (answer.expr == query && (answer.success || answer.timedOut)) {
+        answered = true;
+        success = answer.success;
+        res = answer.validity;
+        current.queryCost += answer.time;
+        if (!current.replayLog.isNull())
+          current.replayLog->addValidity(success, res);
+      }
+    } else if (!isa<ConstantExpr>(query)) {
+      asyncSolver->submit(&current, current.constraints, query);
+      parkingStates.insert(&current);
+      // The branch is executed again when the state is resumed, without
+      // being counted a second time (see run()).
+      current.pc = current.prevPC;
+      return StatePair(0, 0);
+    }
+  }
+
+  // When resuming from a checkpoint the states follow the branches
+  // recorded for the checkpointed states, the sides taken were feasible
+  // then. The other sides were explored before the checkpoint.
+  if (isSeeding && !isInternal) {
+    bool trueSeed = false, falseSeed = false, otherSeed = false;
+    for (std::vector<SeedInfo>::iterator siit = it->second.begin(),
+           siie = it->second.end(); siit != siie; ++siit) {
+      bool branch;
+      if (!siit->nextPrefixBranch(branch))
+        otherSeed = true;
+      else if (branch)
+        trueSeed = true;
+      else
+        falseSeed = true;
+    }
+    if (!otherSeed && !isa<ConstantExpr>(condition)) {
+      success = answered = true;
+      if (trueSeed && falseSeed) {
+        res = Solver::Unknown;
+      } else if (trueSeed) {
+        addConstraint(current, condition);
+        res = Solver::True;
+      } else {
+        addConstraint(current, Expr::createIsZero(condition));
+        res = Solver::False;
+      }
+    }
+  }
+
+  if (!answered) {
+    double timeout = coreSolverTimeout;
+    if (isSeeding)
+      timeout *= it->second.size();
+    solver->setTimeout(timeout);
+    success = solver->evaluate(current, condition, res);
+    solver->setTimeout(0);
+  }
   if (!success) {
     current.pc = current.prevPC;
     terminateStateEarly(current, "Query timed out (fork).");
     return StatePair(0, 0);
   }
 
+  if (res==Solver::Unknown && current.replay) {
+    // Rebuilding a dormant state, follow the side it took.
+    unsigned branch;
+    if (!current.replay->nextBranch(branch))
+      return StatePair(0, 0);
+    if (branch) {
+      addConstraint(current, condition);
+      return StatePair(&current, 0);
+    } else {
+      addConstraint(current, Expr::createIsZero(condition));
+      return StatePair(0, &current);
+    }
+  }
+  bool logBranch = res==Solver::Unknown && !current.replayLog.isNull();
+
   if (!isSeeding) {
     if (replayPath && !isInternal) {
       assert(replayPosition<replayPath->size() &&
@@ -714,10 +907,7 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
     } else if (res==Solver::Unknown) {
       assert(!replayOut && "in replay mode, only one branch can be true.");
       
-      if ((MaxMemoryInhibit && atMemoryLimit) || 
-          current.forkDisabled ||
-          inhibitForking || 
-          (MaxForks!=~0u && stats::forks >= MaxForks)) {
+      if (forkInhibited) {
 
 	if (MaxMemoryInhibit && atMemoryLimit)
 	  klee_warning_once(0, "skipping fork (memory cap exceeded)");
@@ -740,6 +930,28 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
     }
   }
 
+  // In --parallel-workers mode the first forks on each path pick the
+  // partition, drop the sides which belong to other workers.
+  if (res==Solver::Unknown && !isInternal &&
+      current.partitionDepth < interpreterOpts.PartitionDepth) {
+    unsigned depth = current.partitionDepth + 1;
+    bool ownsTrue = ownsPartition(depth, (current.partitionPrefix << 1) | 1);
+    bool ownsFalse = ownsPartition(depth, current.partitionPrefix << 1);
+    assert((ownsTrue || ownsFalse) && "exploring a state of another worker");
+
+    if (!ownsTrue || !ownsFalse) {
+      current.partitionDepth = depth;
+      current.partitionPrefix = (current.partitionPrefix << 1) | ownsTrue;
+      if (ownsTrue) {
+        addConstraint(current, condition);
+        res = Solver::True;
+      } else {
+        addConstraint(current, Expr::createIsZero(condition));
+        res = Solver::False;
+      }
+    }
+  }
+
   // Fix branch in only-replay-seed mode, if we don't have both true
   // and false seeds.
   if (isSeeding && 
@@ -784,6 +996,8 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
         current.pathOS << "1";
       }
     }
+    if (logBranch)
+      current.replayLog->addBranch(1);
 
     return StatePair(&current, 0);
   } else if (res==Solver::False) {
@@ -792,6 +1006,8 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
         current.pathOS << "0";
       }
     }
+    if (logBranch)
+      current.replayLog->addBranch(0);
 
     return StatePair(0, &current);
   } else {
@@ -859,8 +1075,30 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
       }
     }
 
-    addConstraint(*trueState, condition);
-    addConstraint(*falseState, Expr::createIsZero(condition));
+    if (logBranch) {
+      trueState->replayLog->addBranch(1);
+      falseState->replayLog->addBranch(0);
+    }
+
+    if (!isInternal &&
+        current.partitionDepth < interpreterOpts.PartitionDepth) {
+      ++trueState->partitionDepth;
+      ++falseState->partitionDepth;
+      trueState->partitionPrefix = (trueState->partitionPrefix << 1) | 1;
+      falseState->partitionPrefix <<= 1;
+    }
+
+    if (lazy) {
+      ref<UncheckedBranch> branch =
+        new UncheckedBranch(condition, theStatisticManager->getIndex(),
+                            theStatisticManager->getContext());
+      trueState->uncheckedBranch = falseState->uncheckedBranch = branch;
+      trueState->uncheckedSide = true;
+      falseState->uncheckedSide = false;
+    } else {
+      addConstraint(*trueState, condition);
+      addConstraint(*falseState, Expr::createIsZero(condition));
+    }
 
     // Kinda gross, do we even really still want this option?
     if (MaxDepth && MaxDepth<=trueState->depth) {
@@ -1102,6 +1340,7 @@ void Executor::stepInstruction(ExecutionState &state) {
     statsTracker->stepInstruction(state);
 
   ++stats::instructions;
+  ++state.steppedInstructions;
   state.prevPC = state.pc;
   ++state.pc;
 
@@ -1184,7 +1423,7 @@ void Executor::executeCall(ExecutionState &state,
     state.pushFrame(state.prevPC, kf);
     state.pc = kf->instructions;
         
-    if (statsTracker)
+    if (statsTracker && !state.replay)
       statsTracker->framePushed(state, &state.stack[state.stack.size()-2]);
  
      // TODO: support "byval" parameter attribute
@@ -1230,7 +1469,7 @@ void Executor::executeCall(ExecutionState &state,
         }
       }
 
-      MemoryObject *mo = sf.varargs = memory->allocate(size, true, false, 
+      MemoryObject *mo = sf.varargs = allocateForState(state, size, true,
                                                        state.prevPC->inst);
       if (!mo) {
         terminateStateOnExecError(state, "out of memory (varargs)");
@@ -1382,7 +1621,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     } else {
       state.popFrame();
 
-      if (statsTracker)
+      if (statsTracker && !state.replay)
         statsTracker->framePopped(state);
 
       if (InvokeInst *ii = dyn_cast<InvokeInst>(caller)) {
@@ -1397,7 +1636,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
         if (t != Type::getVoidTy(getGlobalContext())) {
           // may need to do coercion due to bitcasts
           Expr::Width from = result->getWidth();
-          Expr::Width to = getWidthForLLVMType(t);
+          Expr::Width to = kcaller->width;
             
           if (from != to) {
             CallSite cs = (isa<InvokeInst>(caller) ? CallSite(cast<InvokeInst>(caller)) : 
@@ -1437,7 +1676,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       KInstruction *kcaller = state.stack.back().caller;
       state.popFrame();
 
-      if (statsTracker)
+      if (statsTracker && !state.replay)
         statsTracker->framePopped(state);
 
       if (state.stack.empty()) {
@@ -1469,7 +1708,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       // requires that we still be in the context of the branch
       // instruction (it reuses its statistic id). Should be cleaned
       // up with convenient instruction specific data.
-      if (statsTracker && state.stack.back().kf->trackCoverage)
+      if (statsTracker && !state.replay &&
+          state.stack.back().kf->trackCoverage)
         statsTracker->markBranchVisited(branches.first, branches.second);
 
       if (branches.first)
@@ -1941,38 +2181,30 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
     // Conversion
   case Instruction::Trunc: {
-    CastInst *ci = cast<CastInst>(i);
-    ref<Expr> result = ExtractExpr::create(eval(ki, 0, state).value,
-                                           0,
-                                           getWidthForLLVMType(ci->getType()));
+    ref<Expr> result = ExtractExpr::create(eval(ki, 0, state).value, 0,
+                                           ki->width);
     bindLocal(ki, state, result);
     break;
   }
   case Instruction::ZExt: {
-    CastInst *ci = cast<CastInst>(i);
-    ref<Expr> result = ZExtExpr::create(eval(ki, 0, state).value,
-                                        getWidthForLLVMType(ci->getType()));
+    ref<Expr> result = ZExtExpr::create(eval(ki, 0, state).value, ki->width);
     bindLocal(ki, state, result);
     break;
   }
   case Instruction::SExt: {
-    CastInst *ci = cast<CastInst>(i);
-    ref<Expr> result = SExtExpr::create(eval(ki, 0, state).value,
-                                        getWidthForLLVMType(ci->getType()));
+    ref<Expr> result = SExtExpr::create(eval(ki, 0, state).value, ki->width);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::IntToPtr: {
-    CastInst *ci = cast<CastInst>(i);
-    Expr::Width pType = getWidthForLLVMType(ci->getType());
+    Expr::Width pType = ki->width;
     ref<Expr> arg = eval(ki, 0, state).value;
     bindLocal(ki, state, ZExtExpr::create(arg, pType));
     break;
   } 
   case Instruction::PtrToInt: {
-    CastInst *ci = cast<CastInst>(i);
-    Expr::Width iType = getWidthForLLVMType(ci->getType());
+    Expr::Width iType = ki->width;
     ref<Expr> arg = eval(ki, 0, state).value;
     bindLocal(ki, state, ZExtExpr::create(arg, iType));
     break;
@@ -2086,8 +2318,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::FPTrunc: {
-    FPTruncInst *fi = cast<FPTruncInst>(i);
-    Expr::Width resultType = getWidthForLLVMType(fi->getType());
+    Expr::Width resultType = ki->width;
     ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).value,
                                        "floating point");
     if (!fpWidthToSemantics(arg->getWidth()) || resultType > arg->getWidth())
@@ -2107,8 +2338,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::FPExt: {
-    FPExtInst *fi = cast<FPExtInst>(i);
-    Expr::Width resultType = getWidthForLLVMType(fi->getType());
+    Expr::Width resultType = ki->width;
     ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).value,
                                         "floating point");
     if (!fpWidthToSemantics(arg->getWidth()) || arg->getWidth() > resultType)
@@ -2127,8 +2357,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::FPToUI: {
-    FPToUIInst *fi = cast<FPToUIInst>(i);
-    Expr::Width resultType = getWidthForLLVMType(fi->getType());
+    Expr::Width resultType = ki->width;
     ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).value,
                                        "floating point");
     if (!fpWidthToSemantics(arg->getWidth()) || resultType > 64)
@@ -2148,8 +2377,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::FPToSI: {
-    FPToSIInst *fi = cast<FPToSIInst>(i);
-    Expr::Width resultType = getWidthForLLVMType(fi->getType());
+    Expr::Width resultType = ki->width;
     ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).value,
                                        "floating point");
     if (!fpWidthToSemantics(arg->getWidth()) || resultType > 64)
@@ -2169,8 +2397,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::UIToFP: {
-    UIToFPInst *fi = cast<UIToFPInst>(i);
-    Expr::Width resultType = getWidthForLLVMType(fi->getType());
+    Expr::Width resultType = ki->width;
     ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).value,
                                        "floating point");
     const llvm::fltSemantics *semantics = fpWidthToSemantics(resultType);
@@ -2185,8 +2412,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::SIToFP: {
-    SIToFPInst *fi = cast<SIToFPInst>(i);
-    Expr::Width resultType = getWidthForLLVMType(fi->getType());
+    Expr::Width resultType = ki->width;
     ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).value,
                                        "floating point");
     const llvm::fltSemantics *semantics = fpWidthToSemantics(resultType);
@@ -2329,7 +2555,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
     ref<Expr> agg = eval(ki, 0, state).value;
 
-    ref<Expr> result = ExtractExpr::create(agg, kgepi->offset*8, getWidthForLLVMType(i->getType()));
+    ref<Expr> result = ExtractExpr::create(agg, kgepi->offset*8, ki->width);
 
     bindLocal(ki, state, result);
     break;
@@ -2352,8 +2578,22 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
 void Executor::updateStates(ExecutionState *current) {
   if (searcher) {
-    searcher->update(current, addedStates, removedStates);
+    if (parkingStates.empty() && parkedStates.empty()) {
+      searcher->update(current, addedStates, removedStates);
+    } else {
+      // Parked states left the searcher already, the ones parked during
+      // this step leave it now.
+      std::set<ExecutionState*> leaving(parkingStates);
+      for (std::set<ExecutionState*>::iterator
+             it = removedStates.begin(), ie = removedStates.end();
+           it != ie; ++it)
+        if (!parkedStates.count(*it))
+          leaving.insert(*it);
+      searcher->update(current, addedStates, leaving);
+    }
   }
+  parkedStates.insert(parkingStates.begin(), parkingStates.end());
+  parkingStates.clear();
   
   states.insert(addedStates.begin(), addedStates.end());
   addedStates.clear();
@@ -2369,6 +2609,11 @@ void Executor::updateStates(ExecutionState *current) {
       seedMap.find(es);
     if (it3 != seedMap.end())
       seedMap.erase(it3);
+    if (asyncSolver) {
+      asyncSolver->cancel(es);
+      parkedStates.erase(es);
+      asyncAnswers.erase(es);
+    }
     processTree->remove(es->ptreeNode);
     delete es;
   }
@@ -2437,6 +2682,202 @@ void Executor::bindModuleConstants() {
   }
 }
 
+uint64_t Executor::spillInactiveStates(ExecutionState &current) {
+  // Contents of the running state would be read back right away. Other
+  // states share them chunk by chunk, through object states of their
+  // own.
+  std::set<const ObjectChunk*> active;
+  for (MemoryMap::iterator it = current.addressSpace.objects.begin(),
+         ie = current.addressSpace.objects.end(); it != ie; ++it) {
+    const ObjectState *os = it->second;
+    os->getChunks(active);
+  }
+
+  uint64_t freed = 0;
+  for (std::set<ExecutionState*>::iterator it = states.begin(),
+         ie = states.end(); it != ie; ++it) {
+    ExecutionState *es = *it;
+    if (es == &current || es->spilled)
+      continue;
+    // Contents shared with the running state stay, so come back to the
+    // state next time if it has any.
+    bool kept = false;
+    AddressSpace &as = es->addressSpace;
+    for (MemoryMap::iterator oi = as.objects.begin(), oe = as.objects.end();
+         oi != oe; ++oi) {
+      const ObjectState *os = oi->second;
+      if (os->size >= SpillObjectSize && !os->isSpilled())
+        freed += os->spill(active, kept);
+    }
+    es->spilled = !kept;
+  }
+
+  return freed;
+}
+
+unsigned Executor::suspendStates(ExecutionState &current, unsigned count) {
+  std::vector<ExecutionState*> arr;
+  for (std::set<ExecutionState*>::iterator it = states.begin(),
+         ie = states.end(); it != ie; ++it) {
+    ExecutionState *es = *it;
+    if (es != &current && !es->dormant && es->replayLog->isReplayable() &&
+        !removedStates.count(es))
+      arr.push_back(es);
+  }
+
+  unsigned suspended = 0;
+  for (unsigned N=arr.size(); N && suspended<count; ++suspended,--N) {
+    unsigned idx = theRNG.getInt32() % N;
+
+    // Make two pulls to try and keep states that covered new code.
+    if (arr[idx]->coveredNew)
+      idx = theRNG.getInt32() % N;
+
+    std::swap(arr[idx], arr[N-1]);
+    arr[N-1]->makeDormant();
+  }
+
+  return suspended;
+}
+
+bool Executor::wakeState(ExecutionState &state) {
+  assert(state.dormant && replayRoot);
+  ReplayCursor cursor(*state.replayLog);
+  ExecutionState *replica = new ExecutionState(*replayRoot);
+  replica->replay = &cursor;
+
+  // Re-execute the path, solver answers, branch directions and
+  // allocations come from the log. This bypasses stepInstruction, and
+  // the StatsTracker is not told about the calls and branches of a
+  // replaying state, so the path is not counted again.
+  while (!cursor.diverged &&
+         replica->steppedInstructions < state.steppedInstructions) {
+    KInstruction *ki = replica->pc;
+    replica->prevPC = replica->pc;
+    ++replica->pc;
+    ++replica->steppedInstructions;
+    executeInstruction(*replica, ki);
+  }
+
+  bool success = !cursor.diverged && cursor.atEnd() &&
+    replica->pc == state.pc;
+  if (success)
+    state.wake(*replica);
+  else
+    klee_warning_once(0, "unable to rebuild dormant state, dropping it");
+
+  replica->replay = 0;
+  delete replica;
+  return success;
+}
+
+void Executor::resumeParkedStates(bool wait) {
+  std::vector<AsyncSolver::Answer> answers;
+  asyncSolver->poll(wait, answers);
+  for (unsigned i = 0; i != answers.size(); ++i) {
+    ExecutionState *es = static_cast<ExecutionState*>(answers[i].tag);
+    parkedStates.erase(es);
+    asyncAnswers[es] = answers[i];
+    addedStates.insert(es);
+  }
+}
+
+bool Executor::checkUncheckedBranch(ExecutionState &state) {
+  ref<UncheckedBranch> branch = state.uncheckedBranch;
+  state.uncheckedBranch = 0;
+  ref<Expr> condition = state.uncheckedSide ? branch->condition :
+    Expr::createIsZero(branch->condition);
+
+  bool feasible;
+  if (branch->decided) {
+    feasible = state.uncheckedSide == branch->feasibleSide;
+  } else {
+    solver->setTimeout(coreSolverTimeout);
+    bool success = solver->mayBeTrue(state, condition, feasible);
+    solver->setTimeout(0);
+    if (!success) {
+      terminateStateEarly(state, "Query timed out (lazy fork).");
+      return false;
+    }
+    if (!feasible) {
+      branch->decided = true;
+      branch->feasibleSide = !state.uncheckedSide;
+    }
+  }
+
+  if (!feasible) {
+    // The path does not exist, drop it without counting it, nor the
+    // fork which created it. The statistics still point at the last
+    // instruction stepped, which may be in another state.
+    StatisticManager &sm = *theStatisticManager;
+    unsigned index = sm.getIndex();
+    StatisticRecord *context = sm.getContext();
+    sm.setIndex(branch->statIndex);
+    sm.setContext(branch->statContext);
+    stats::forks += (uint64_t)-1;
+    sm.setIndex(index);
+    sm.setContext(context);
+    removeState(state);
+    return false;
+  }
+  addConstraint(state, condition);
+  return true;
+}
+
+bool Executor::abortReplay(ExecutionState &state) {
+  if (!state.replay)
+    return false;
+  state.replay->diverged = true;
+  return true;
+}
+
+MemoryObject *Executor::allocateForState(ExecutionState &state,
+                                         uint64_t size, bool isLocal,
+                                         const llvm::Value *allocSite) {
+  MemoryObject *mo;
+  if (state.replay && state.replay->nextAllocation(size, mo))
+    return mo;
+
+  mo = memory->allocate(size, isLocal, false, allocSite);
+  if (!state.replayLog.isNull())
+    state.replayLog->addAllocation(mo);
+  return mo;
+}
+
+MemoryObject *Executor::allocateFixedForState(ExecutionState &state,
+                                              uint64_t address, uint64_t size,
+                                              const llvm::Value *allocSite) {
+  MemoryObject *mo;
+  if (state.replay) {
+    // A fixed object can not be allocated twice, on a mismatch the
+    // replica is dropped without allocating.
+    if (state.replay->nextAllocation(size, mo) && mo && mo->address == address)
+      return mo;
+    state.replay->diverged = true;
+    return 0;
+  }
+
+  mo = memory->allocateFixed(address, size, allocSite);
+  if (!state.replayLog.isNull())
+    state.replayLog->addAllocation(mo);
+  return mo;
+}
+
+/// The totals a checkpoint carries over to the resumed run (see
+/// --resume), the work of getting back to the checkpointed states is not
+/// counted in them again.
+static Statistic *const resumedStatistics[] = {
+  &stats::instructions,
+  &stats::forks,
+  &stats::queries,
+  &stats::queriesValid,
+  &stats::queriesInvalid,
+  &stats::queryCounterexamples,
+  &stats::queryConstructs
+};
+static const unsigned NumResumedStatistics =
+  sizeof(resumedStatistics) / sizeof(resumedStatistics[0]);
+
 void Executor::run(ExecutionState &initialState) {
   bindModuleConstants();
 
@@ -2444,14 +2885,29 @@ void Executor::run(ExecutionState &initialState) {
   // optimization and such.
   initTimers();
 
+  if (DormantStates) {
+    if (usingSeeds || replayOut || replayPath ||
+        MaxStaticForkPct!=1. || MaxStaticSolvePct != 1. ||
+        MaxStaticCPForkPct!=1. || MaxStaticCPSolvePct != 1.) {
+      klee_warning("--dormant-states can not be used with seeding, replay "
+                   "or --max-static-*-pct, ignoring it");
+    } else {
+      replayRoot = new ExecutionState(initialState);
+      replayRoot->ptreeNode = 0;
+      initialState.replayLog = new ReplayLog(ref<ReplayLog>());
+    }
+  }
+
   states.insert(&initialState);
 
   if (usingSeeds) {
     std::vector<SeedInfo> &v = seedMap[&initialState];
     
-    for (std::vector<KTest*>::const_iterator it = usingSeeds->begin(), 
-           ie = usingSeeds->end(); it != ie; ++it)
-      v.push_back(SeedInfo(*it));
+    for (unsigned i = 0; i != usingSeeds->size(); ++i) {
+      v.push_back(SeedInfo((*usingSeeds)[i]));
+      if (seedPrefixes)
+        v.back().prefix = &(*seedPrefixes)[i];
+    }
 
     int lastNumSeeds = usingSeeds->size()+10;
     double lastTime, startTime = lastTime = util::getWallTime();
@@ -2467,13 +2923,33 @@ void Executor::run(ExecutionState &initialState) {
       unsigned numSeeds = it->second.size();
       ExecutionState &state = *lastState;
       KInstruction *ki = state.pc;
-      stepInstruction(state);
 
+      // The path to a checkpointed state was counted by the run being
+      // resumed, only its coverage is counted again.
+      bool replayingPrefix = false;
+      for (std::vector<SeedInfo>::iterator siit = it->second.begin(),
+             siie = it->second.end(); siit != siie; ++siit) {
+        if (siit->isReplayingPrefix(state))
+          replayingPrefix = true;
+        else if (siit->prefix &&
+                 state.steppedInstructions == siit->prefix->instructions)
+          state.depth = siit->prefix->depth;
+      }
+      uint64_t counted[NumResumedStatistics];
+      if (replayingPrefix)
+        for (unsigned i = 0; i != NumResumedStatistics; ++i)
+          counted[i] = *resumedStatistics[i];
+
+      stepInstruction(state);
       executeInstruction(state, ki);
+
+      if (replayingPrefix)
+        for (unsigned i = 0; i != NumResumedStatistics; ++i)
+          *resumedStatistics[i] += counted[i] - *resumedStatistics[i];
       processTimers(&state, MaxInstructionTime * numSeeds);
       updateStates(&state);
 
-      if ((stats::instructions % 1000) == 0) {
+      if (!replayingPrefix && (stats::instructions % 1000) == 0) {
         int numSeeds = 0, numStates = 0;
         for (std::map<ExecutionState*, std::vector<SeedInfo> >::iterator
                it = seedMap.begin(), ie = seedMap.end();
@@ -2515,9 +2991,37 @@ void Executor::run(ExecutionState &initialState) {
   searcher->update(0, states, std::set<ExecutionState*>());
 
   while (!states.empty() && !haltExecution) {
+    // Poll for answers now and then, and wait for one when every state
+    // is parked.
+    if (!parkedStates.empty() &&
+        (searcher->empty() || (stats::instructions & 0xFF) == 0)) {
+      resumeParkedStates(searcher->empty());
+      updateStates(0);
+      if (searcher->empty())
+        continue;
+    }
+
     ExecutionState &state = searcher->selectState();
+    // Running may read back the objects spilled to disk.
+    state.spilled = false;
+    if (state.dormant && !wakeState(state)) {
+      terminateState(state);
+      updateStates(0);
+      continue;
+    }
+    if (!state.uncheckedBranch.isNull() && !checkUncheckedBranch(state)) {
+      updateStates(0);
+      continue;
+    }
     KInstruction *ki = state.pc;
-    stepInstruction(state);
+    // A state resumed with the answer to its branch query executes the
+    // branch again, it was stepped already when the query was submitted.
+    if (asyncAnswers.count(&state)) {
+      state.prevPC = state.pc;
+      ++state.pc;
+    } else {
+      stepInstruction(state);
+    }
 
     executeInstruction(state, ki);
     processTimers(&state, MaxInstructionTime);
@@ -2528,6 +3032,21 @@ void Executor::run(ExecutionState &initialState) {
         // is O(elts on freelist). This is really bad since we start
         // to pummel the freelist once we hit the memory cap.
         unsigned mbs = util::GetTotalMallocUsage() >> 20;
+        if (mbs > MaxMemory && memory->getSpillFile()) {
+          if (spillInactiveStates(state)) {
+            klee_warning_once(0, "spilling inactive states to disk (over memory cap)");
+            mbs = util::GetTotalMallocUsage() >> 20;
+          }
+        }
+        if (mbs > MaxMemory && replayRoot) {
+          unsigned numStates = states.size();
+          unsigned toSuspend =
+            std::max(1U, numStates - numStates*MaxMemory/mbs);
+          if (unsigned n = suspendStates(state, toSuspend)) {
+            klee_warning("suspending %d states (over memory cap)", n);
+            mbs = util::GetTotalMallocUsage() >> 20;
+          }
+        }
         if (mbs > MaxMemory) {
           if (mbs > MaxMemory + 100) {
             // just guess at how many to kill
@@ -2546,7 +3065,11 @@ void Executor::run(ExecutionState &initialState) {
                 idx = rand() % N;
 
               std::swap(arr[idx], arr[N-1]);
-              terminateStateEarly(*arr[N-1], "Memory limit exceeded.");
+              // Don't rebuild a dormant state just to kill it.
+              if (arr[N-1]->dormant)
+                terminateState(*arr[N-1]);
+              else
+                terminateStateEarly(*arr[N-1], "Memory limit exceeded.");
             }
           }
           atMemoryLimit = true;
@@ -2563,17 +3086,30 @@ void Executor::run(ExecutionState &initialState) {
   searcher = 0;
   
  dump:
+  writeHaltCheckpoint();
+
   if (DumpStatesOnHalt && !states.empty()) {
     llvm::errs() << "KLEE: halting execution, dumping remaining states\n";
     for (std::set<ExecutionState*>::iterator
            it = states.begin(), ie = states.end();
          it != ie; ++it) {
       ExecutionState &state = **it;
+      bool wasDormant = state.dormant;
+      if (wasDormant && !wakeState(state)) {
+        terminateState(state);
+        continue;
+      }
       stepInstruction(state); // keep stats rolling
       terminateStateEarly(state, "Execution halting.");
+      // The test case is written, drop the contents again.
+      if (wasDormant)
+        state.makeDormant();
     }
     updateStates(0);
   }
+
+  delete replayRoot;
+  replayRoot = 0;
 }
 
 std::string Executor::getAddressInfo(ExecutionState &state, 
@@ -2627,13 +3163,24 @@ std::string Executor::getAddressInfo(ExecutionState &state,
 }
 
 void Executor::terminateState(ExecutionState &state) {
+  if (abortReplay(state))
+    return;
+
   if (replayOut && replayPosition!=replayOut->numObjects) {
     klee_warning_once(replayOut, 
                       "replay did not consume all objects in test input.");
   }
 
-  interpreterHandler->incPathsExplored();
+  // In --parallel-workers mode a path which ends above the partition
+  // depth is run by several workers, only the one reporting it counts it.
+  if (ownsTestCase(state))
+    interpreterHandler->incPathsExplored();
+  else
+    ++stats::sharedPaths;
+  removeState(state);
+}
 
+void Executor::removeState(ExecutionState &state) {
   std::set<ExecutionState*>::iterator it = addedStates.find(&state);
   if (it==addedStates.end()) {
     state.pc = state.prevPC;
@@ -2651,8 +3198,44 @@ void Executor::terminateState(ExecutionState &state) {
   }
 }
 
+bool Executor::ownsPartition(unsigned depth, uint64_t prefix) const {
+  unsigned count = interpreterOpts.PartitionCount;
+  if (count <= 1)
+    return true;
+
+  // The 2^PartitionDepth leaf partitions are dealt round-robin, the
+  // subtree below prefix covers the leaves [first, first+size).
+  unsigned shift = interpreterOpts.PartitionDepth - depth;
+  uint64_t first = prefix << shift;
+  uint64_t size = (uint64_t) 1 << shift;
+  if (size >= count)
+    return true;
+  unsigned offset = (interpreterOpts.PartitionIndex + count - first % count) %
+    count;
+  return offset < size;
+}
+
+bool Executor::ownsTestCase(const ExecutionState &state) const {
+  unsigned count = interpreterOpts.PartitionCount;
+  if (count <= 1)
+    return true;
+
+  // Report the state in the worker owning the leftmost leaf below it.
+  unsigned shift = interpreterOpts.PartitionDepth - state.partitionDepth;
+  uint64_t first = state.partitionPrefix << shift;
+  return first % count == interpreterOpts.PartitionIndex;
+}
+
 void Executor::terminateStateEarly(ExecutionState &state, 
                                    const Twine &message) {
+  if (abortReplay(state))
+    return;
+  if (!ownsTestCase(state) || (state.dormant && !wakeState(state))) {
+    terminateState(state);
+    return;
+  }
+  if (!state.uncheckedBranch.isNull() && !checkUncheckedBranch(state))
+    return;
   if (!OnlyOutputStatesCoveringNew || state.coveredNew ||
       (AlwaysOutputSeeds && seedMap.count(&state)))
     interpreterHandler->processTestCase(state, (message + "\n").str().c_str(),
@@ -2661,6 +3244,12 @@ void Executor::terminateStateEarly(ExecutionState &state,
 }
 
 void Executor::terminateStateOnExit(ExecutionState &state) {
+  if (abortReplay(state))
+    return;
+  if (!ownsTestCase(state) || (state.dormant && !wakeState(state))) {
+    terminateState(state);
+    return;
+  }
   if (!OnlyOutputStatesCoveringNew || state.coveredNew || 
       (AlwaysOutputSeeds && seedMap.count(&state)))
     interpreterHandler->processTestCase(state, 0, 0);
@@ -2713,6 +3302,13 @@ void Executor::terminateStateOnError(ExecutionState &state,
                                      const llvm::Twine &messaget,
                                      const char *suffix,
                                      const llvm::Twine &info) {
+  if (abortReplay(state))
+    return;
+  if (!ownsTestCase(state) || (state.dormant && !wakeState(state))) {
+    terminateState(state);
+    return;
+  }
+
   std::string message = messaget.str();
   static std::set< std::pair<Instruction*, std::string> > emittedErrors;
   Instruction * lastInst;
@@ -2765,6 +3361,12 @@ void Executor::callExternalFunction(ExecutionState &state,
   // check if specialFunctionHandler wants it
   if (specialFunctionHandler->handle(state, function, target, arguments))
     return;
+
+  // External calls can not be repeated when rebuilding a dormant state.
+  if (abortReplay(state))
+    return;
+  if (!state.replayLog.isNull())
+    state.replayLog->markNotReplayable();
   
   if (NoExternals && !okExternals.count(function->getName())) {
     llvm::errs() << "KLEE:ERROR: Calling not-OK external function : "
@@ -2839,8 +3441,7 @@ void Executor::callExternalFunction(ExecutionState &state,
 
   LLVM_TYPE_Q Type *resultType = target->inst->getType();
   if (resultType != Type::getVoidTy(getGlobalContext())) {
-    ref<Expr> e = ConstantExpr::fromMemory((void*) args, 
-                                           getWidthForLLVMType(resultType));
+    ref<Expr> e = ConstantExpr::fromMemory((void*) args, target->width);
     bindLocal(target, state, e);
   }
 }
@@ -2899,7 +3500,7 @@ void Executor::executeAlloc(ExecutionState &state,
                             const ObjectState *reallocFrom) {
   size = toUnique(state, size);
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(size)) {
-    MemoryObject *mo = memory->allocate(CE->getZExtValue(), isLocal, false, 
+    MemoryObject *mo = allocateForState(state, CE->getZExtValue(), isLocal,
                                         state.prevPC->inst);
     if (!mo) {
       bindLocal(target, state, 
@@ -3071,8 +3672,7 @@ void Executor::executeMemoryOperation(ExecutionState &state,
                                       ref<Expr> address,
                                       ref<Expr> value /* undef if read */,
                                       KInstruction *target /* undef if write */) {
-  Expr::Width type = (isWrite ? value->getWidth() : 
-                     getWidthForLLVMType(target->inst->getType()));
+  Expr::Width type = isWrite ? value->getWidth() : target->width;
   unsigned bytes = Expr::getMinBytesForWidth(type);
 
   if (SimplifySymIndices) {
@@ -3316,6 +3916,14 @@ void Executor::runFunctionAsMain(Function *f,
   }
 
   ExecutionState *state = new ExecutionState(kmodule->functionMap[f]);
+
+  // Checkpoints record the branches of each state, resuming follows
+  // them again.
+  if (CheckpointInterval && !pathWriter) {
+    checkpointPathWriter = new TreeStreamWriter(
+      interpreterHandler->getOutputFilename("checkpoint-paths.ts"));
+    pathWriter = checkpointPathWriter;
+  }
   
   if (pathWriter) 
     state->pathOS = pathWriter->open();
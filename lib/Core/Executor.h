@@ -15,6 +15,7 @@
 #ifndef KLEE_EXECUTOR_H
 #define KLEE_EXECUTOR_H
 
+#include "klee/AsyncSolver.h"
 #include "klee/ExecutionState.h"
 #include "klee/Interpreter.h"
 #include "klee/Internal/Module/Cell.h"
@@ -67,6 +68,7 @@ namespace klee {
   class Searcher;
   class SeedInfo;
   class SpecialFunctionHandler;
+  class SpillFile;
   struct StackFrame;
   class StatsTracker;
   class TimingSolver;
@@ -81,6 +83,7 @@ namespace klee {
 
 class Executor : public Interpreter {
   friend class BumpMergingSearcher;
+  friend class DynamicMergingSearcher;
   friend class MergingSearcher;
   friend class RandomPathSearcher;
   friend class OwningSearcher;
@@ -109,10 +112,17 @@ private:
 
   ExternalDispatcher *externalDispatcher;
   TimingSolver *solver;
+  /// Answers branch queries in worker processes, non-null when
+  /// --async-solver-workers is in effect. \see fork()
+  AsyncSolver *asyncSolver;
   MemoryManager *memory;
+  SpillFile *spillFile;
   std::set<ExecutionState*> states;
   StatsTracker *statsTracker;
   TreeStreamWriter *pathWriter, *symPathWriter;
+  /// Records the branches of each state for --checkpoint-interval when
+  /// no pathWriter is given, owned by the executor.
+  TreeStreamWriter *checkpointPathWriter;
   SpecialFunctionHandler *specialFunctionHandler;
   std::vector<TimerInfo*> timers;
   PTree *processTree;
@@ -128,6 +138,17 @@ private:
   /// \invariant \ref addedStates and \ref removedStates are disjoint.
   std::set<ExecutionState*> removedStates;
 
+  /// States which submitted a branch query to asyncSolver during the
+  /// current instructions step, they leave the searcher at the next
+  /// update.
+  std::set<ExecutionState*> parkingStates;
+  /// States out of the searcher waiting for their branch query.
+  /// \invariant \ref parkedStates is a subset of \ref states.
+  std::set<ExecutionState*> parkedStates;
+  /// The answers for resumed states which have not re-executed their
+  /// branch yet.
+  std::map<ExecutionState*, AsyncSolver::Answer> asyncAnswers;
+
   /// When non-empty the Executor is running in "seed" mode. The
   /// states in this map will be executed in an arbitrary order
   /// (outside the normal search interface) until they terminate. When
@@ -161,6 +182,14 @@ private:
   /// drive execution.
   const std::vector<struct KTest *> *usingSeeds;  
 
+  /// When non-null the checkpointed state reached by each seed, the
+  /// path to it is replayed without exploring the other sides.
+  const std::vector<CheckpointPosition> *seedPrefixes;
+
+  /// Copy of the initial state which dormant states are rebuilt from,
+  /// non-null when --dormant-states is in effect.
+  ExecutionState *replayRoot;
+
   /// Disables forking, instead a random path is chosen. Enabled as
   /// needed to control memory usage. \see fork()
   bool atMemoryLimit;
@@ -192,6 +221,45 @@ private:
 
   void run(ExecutionState &initialState);
 
+  /// Write the contents of the large objects which are not used by
+  /// \a current to the spill file. Returns the number of bytes freed.
+  uint64_t spillInactiveStates(ExecutionState &current);
+
+  /// Make up to \a count states other than \a current dormant.
+  /// Returns the number of states suspended.
+  unsigned suspendStates(ExecutionState &current, unsigned count);
+
+  /// Rebuild a dormant state by re-executing its path from
+  /// replayRoot. Returns false if the re-execution did not reach the
+  /// state, which is then left dormant.
+  bool wakeState(ExecutionState &state);
+
+  /// Check that the side of its --lazy-fork branch \a state took is
+  /// feasible and add it to the constraints. Otherwise the state is
+  /// dropped, or terminated if the solver failed, and false returned.
+  bool checkUncheckedBranch(ExecutionState &state);
+
+  /// Hand the states whose branch queries were answered back to the
+  /// searcher, waiting for an answer first if \a wait is set.
+  void resumeParkedStates(bool wait);
+
+  /// If \a state is a replica rebuilding a dormant state, mark the
+  /// replay as diverged and return true. Used where the replica would
+  /// have side effects the original path did not have.
+  bool abortReplay(ExecutionState &state);
+
+  /// Allocate a new object for \a state, reusing the object of the
+  /// original path when rebuilding a dormant state.
+  MemoryObject *allocateForState(ExecutionState &state, uint64_t size,
+                                 bool isLocal,
+                                 const llvm::Value *allocSite);
+
+  /// Allocate the object of klee_define_fixed_object for \a state, as
+  /// allocateForState. Returns null if a rebuilt state diverges.
+  MemoryObject *allocateFixedForState(ExecutionState &state,
+                                      uint64_t address, uint64_t size,
+                                      const llvm::Value *allocSite);
+
   // Given a concrete object in our [klee's] address space, add it to 
   // objects checked code can reference.
   MemoryObject *addExternalObject(ExecutionState &state, void *addr, 
@@ -351,8 +419,19 @@ private:
   const InstructionInfo & getLastNonKleeInternalInstruction(const ExecutionState &state,
       llvm::Instruction** lastInstruction);
 
+  // Returns true if this worker owns at least one of the partitions
+  // below the given partitioning prefix (see --parallel-workers).
+  bool ownsPartition(unsigned depth, uint64_t prefix) const;
+
+  // Returns true if this worker is responsible for emitting the test
+  // case of the state. A state which ends before the partitioning
+  // depth is explored by several workers, only one of them reports it.
+  bool ownsTestCase(const ExecutionState &state) const;
+
   // remove state from queue and delete
   void terminateState(ExecutionState &state);
+  // remove state from queue and delete, without counting it as a path
+  void removeState(ExecutionState &state);
   // call exit handler and terminate state
   void terminateStateEarly(ExecutionState &state, const llvm::Twine &message);
   // call exit handler and terminate state
@@ -437,6 +516,11 @@ public:
     usingSeeds = seeds;
   }
 
+  virtual void useSeedPrefixes(const std::vector<CheckpointPosition>
+                               *positions) {
+    seedPrefixes = positions;
+  }
+
   virtual void runFunctionAsMain(llvm::Function *f,
                                  int argc,
                                  char **argv,
@@ -448,6 +532,14 @@ public:
     haltExecution = value;
   }
 
+  /// Hand the inputs of all live states to the interpreter handler as
+  /// a checkpoint. Run periodically from a timer.
+  void writeCheckpoint();
+
+  /// Write a last checkpoint when execution halts with live states, so
+  /// that the run can be resumed from where it stopped.
+  void writeHaltCheckpoint();
+
   virtual void setInhibitForking(bool value) {
     inhibitForking = value;
   }
@@ -42,6 +42,14 @@ MaxTime("max-time",
         cl::desc("Halt execution after the specified number of seconds (0=off)"),
         cl::init(0));
 
+// Also used by Executor, which records the branches of the states.
+cl::opt<double>
+CheckpointInterval("checkpoint-interval",
+                   cl::desc("Write the inputs of all live states to the "
+                            "checkpoint directory every N seconds and "
+                            "when execution halts, see --resume (0=off)"),
+                   cl::init(0));
+
 ///
 
 class HaltTimer : public Executor::Timer {
@@ -59,6 +67,20 @@ public:
 
 ///
 
+class CheckpointTimer : public Executor::Timer {
+  Executor *executor;
+
+public:
+  CheckpointTimer(Executor *_executor) : executor(_executor) {}
+  ~CheckpointTimer() {}
+
+  void run() {
+    executor->writeCheckpoint();
+  }
+};
+
+///
+
 static const double kSecondsPerTick = .1;
 static volatile unsigned timerTicks = 0;
 
@@ -95,6 +117,51 @@ void Executor::initTimers() {
   if (MaxTime) {
     addTimer(new HaltTimer(this), MaxTime.getValue());
   }
+
+  if (CheckpointInterval) {
+    addTimer(new CheckpointTimer(this), CheckpointInterval.getValue());
+  }
+}
+
+void Executor::writeCheckpoint() {
+  std::vector< std::vector< std::pair<std::string,
+                            std::vector<unsigned char> > > > solutions;
+  std::vector<CheckpointPosition> positions;
+
+  for (std::set<ExecutionState*>::iterator it = states.begin(),
+         ie = states.end(); it != ie; ++it) {
+    ExecutionState *es = *it;
+    if (removedStates.count(es))
+      continue;
+
+    // Dormant states have no constraints, rebuild them one at a time.
+    bool wasDormant = es->dormant;
+    if (wasDormant && !wakeState(*es))
+      continue;
+
+    solutions.push_back(std::vector< std::pair<std::string,
+                                     std::vector<unsigned char> > >());
+    if (getSymbolicSolution(*es, solutions.back())) {
+      positions.push_back(CheckpointPosition());
+      CheckpointPosition &position = positions.back();
+      position.depth = es->depth;
+      position.instructions = es->steppedInstructions;
+      if (pathWriter)
+        pathWriter->readStream(es->pathOS.getID(), position.branches);
+    } else {
+      solutions.pop_back();
+    }
+
+    if (wasDormant)
+      es->makeDormant();
+  }
+
+  interpreterHandler->processCheckpoint(solutions, positions);
+}
+
+void Executor::writeHaltCheckpoint() {
+  if (CheckpointInterval && !states.empty())
+    writeCheckpoint();
 }
 
 ///
@@ -18,6 +18,7 @@
 
 #include "ObjectHolder.h"
 #include "MemoryManager.h"
+#include "SpillFile.h"
 
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
 #include <llvm/IR/Function.h>
@@ -32,6 +33,7 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <cassert>
 #include <sstream>
 
@@ -98,14 +100,65 @@ void MemoryObject::getAllocInfo(std::string &result) const {
 
 /***/
 
+ObjectChunk::ObjectChunk(unsigned _size)
+  : refCount(1),
+    size(_size),
+    concreteStore(new uint8_t[_size]),
+    spillOffset(0),
+    concreteMask(0),
+    flushMask(0),
+    knownSymbolics(0) {
+  memset(concreteStore, 0, size);
+}
+
+ObjectChunk::ObjectChunk(const ObjectChunk &c)
+  : refCount(1),
+    size(c.size),
+    concreteStore(new uint8_t[c.size]),
+    spillOffset(0),
+    concreteMask(c.concreteMask ? new BitArray(*c.concreteMask, c.size) : 0),
+    flushMask(c.flushMask ? new BitArray(*c.flushMask, c.size) : 0),
+    knownSymbolics(0) {
+  assert(c.concreteStore && "copy of spilled chunk");
+  memcpy(concreteStore, c.concreteStore, size*sizeof(*concreteStore));
+
+  if (c.knownSymbolics) {
+    knownSymbolics = new ref<Expr>[size];
+    for (unsigned i=0; i<size; i++)
+      knownSymbolics[i] = c.knownSymbolics[i];
+  }
+}
+
+ObjectChunk::~ObjectChunk() {
+  makeConcrete();
+  if (concreteStore) delete[] concreteStore;
+}
+
+void ObjectChunk::makeConcrete() {
+  if (concreteMask) delete concreteMask;
+  if (flushMask) delete flushMask;
+  if (knownSymbolics) delete[] knownSymbolics;
+  concreteMask = 0;
+  flushMask = 0;
+  knownSymbolics = 0;
+}
+
+void ObjectChunk::makeSymbolic() {
+  makeConcrete();
+  // all bytes symbolic and flushed
+  concreteMask = new BitArray(size, false);
+  flushMask = new BitArray(size, false);
+}
+
+/***/
+
 ObjectState::ObjectState(const MemoryObject *mo)
   : copyOnWriteOwner(0),
     refCount(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
-    concreteMask(0),
-    flushMask(0),
-    knownSymbolics(0),
+    chunks(0),
+    singleChunk(0),
+    numChunks(0),
     updates(0, 0),
     size(mo->size),
     readOnly(false) {
@@ -116,7 +169,7 @@ ObjectState::ObjectState(const MemoryObject *mo)
         getArrayCache()->CreateArray("tmp_arr" + llvm::utostr(++id), size);
     updates = UpdateList(array, 0);
   }
-  memset(concreteStore, 0, size);
+  initChunks();
 }
 
 
@@ -124,26 +177,24 @@ ObjectState::ObjectState(const MemoryObject *mo, const Array *array)
   : copyOnWriteOwner(0),
     refCount(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
-    concreteMask(0),
-    flushMask(0),
-    knownSymbolics(0),
+    chunks(0),
+    singleChunk(0),
+    numChunks(0),
     updates(array, 0),
     size(mo->size),
     readOnly(false) {
   mo->refCount++;
+  initChunks();
   makeSymbolic();
-  memset(concreteStore, 0, size);
 }
 
 ObjectState::ObjectState(const ObjectState &os) 
   : copyOnWriteOwner(0),
     refCount(0),
     object(os.object),
-    concreteStore(new uint8_t[os.size]),
-    concreteMask(os.concreteMask ? new BitArray(*os.concreteMask, os.size) : 0),
-    flushMask(os.flushMask ? new BitArray(*os.flushMask, os.size) : 0),
-    knownSymbolics(0),
+    chunks(os.numChunks > 1 ? new ObjectChunk*[os.numChunks] : &singleChunk),
+    singleChunk(0),
+    numChunks(os.numChunks),
     updates(os.updates),
     size(os.size),
     readOnly(false) {
@@ -151,20 +202,17 @@ ObjectState::ObjectState(const ObjectState &os)
   if (object)
     object->refCount++;
 
-  if (os.knownSymbolics) {
-    knownSymbolics = new ref<Expr>[size];
-    for (unsigned i=0; i<size; i++)
-      knownSymbolics[i] = os.knownSymbolics[i];
+  for (unsigned i=0; i<numChunks; i++) {
+    chunks[i] = os.chunks[i];
+    ++chunks[i]->refCount;
   }
-
-  memcpy(concreteStore, os.concreteStore, size*sizeof(*concreteStore));
 }
 
 ObjectState::~ObjectState() {
-  if (concreteMask) delete concreteMask;
-  if (flushMask) delete flushMask;
-  if (knownSymbolics) delete[] knownSymbolics;
-  delete[] concreteStore;
+  for (unsigned i=0; i<numChunks; i++)
+    releaseChunk(chunks[i]);
+  if (chunks != &singleChunk)
+    delete[] chunks;
 
   if (object)
   {
@@ -177,6 +225,107 @@ ObjectState::~ObjectState() {
   }
 }
 
+void ObjectState::initChunks() {
+  numChunks = (size + ObjectChunk::Mask) >> ObjectChunk::Bits;
+  chunks = numChunks > 1 ? new ObjectChunk*[numChunks] : &singleChunk;
+  for (unsigned i=0; i<numChunks; i++) {
+    unsigned base = i << ObjectChunk::Bits;
+    chunks[i] = new ObjectChunk(std::min(size - base,
+                                         (unsigned) ObjectChunk::Size));
+  }
+}
+
+ObjectChunk *ObjectState::copyChunk(unsigned index) const {
+  ObjectChunk *c = chunks[index];
+  assert(c->refCount > 1 && "copy of unshared chunk");
+  pageIn(c);
+  --c->refCount;
+  return chunks[index] = new ObjectChunk(*c);
+}
+
+void ObjectState::releaseChunk(ObjectChunk *c) {
+  if (--c->refCount)
+    return;
+  if (!c->concreteStore)
+    object->parent->getSpillFile()->release(c->spillOffset, c->size);
+  delete c;
+}
+
+unsigned ObjectState::spill(const std::set<const ObjectChunk*> &keep,
+                            bool &kept) const {
+  if (!object || !object->parent)
+    return 0;
+
+  SpillFile *spillFile = object->parent->getSpillFile();
+  if (!spillFile)
+    return 0;
+
+  unsigned freed = 0;
+  for (unsigned i=0; i<numChunks; i++) {
+    ObjectChunk *c = chunks[i];
+    if (!c->concreteStore)
+      continue;
+    if (keep.count(c)) {
+      kept = true;
+      continue;
+    }
+    if (!spillFile->write(c->concreteStore, c->size, c->spillOffset))
+      break;
+    delete[] c->concreteStore;
+    c->concreteStore = 0;
+    freed += c->size;
+  }
+  return freed;
+}
+
+bool ObjectState::isSpilled() const {
+  for (unsigned i=0; i<numChunks; i++)
+    if (chunks[i]->concreteStore)
+      return false;
+  return numChunks != 0;
+}
+
+void ObjectState::getChunks(std::set<const ObjectChunk*> &result) const {
+  result.insert(chunks, chunks + numChunks);
+}
+
+void ObjectState::pageInSlow(const ObjectChunk *c) const {
+  c->concreteStore = new uint8_t[c->size];
+  object->parent->getSpillFile()->read(c->spillOffset, c->concreteStore,
+                                       c->size);
+}
+
+void ObjectState::copyConcreteStoreTo(uint8_t *dst) const {
+  for (unsigned i=0; i<numChunks; i++) {
+    const ObjectChunk *c = chunks[i];
+    pageIn(c);
+    memcpy(dst + (i << ObjectChunk::Bits), c->concreteStore, c->size);
+  }
+}
+
+bool ObjectState::concreteStoreMatches(const uint8_t *src) const {
+  for (unsigned i=0; i<numChunks; i++) {
+    const ObjectChunk *c = chunks[i];
+    pageIn(c);
+    if (memcmp(src + (i << ObjectChunk::Bits), c->concreteStore, c->size))
+      return false;
+  }
+  return true;
+}
+
+void ObjectState::copyConcreteStoreFrom(const uint8_t *src) {
+  // Only chunks which changed are made private.
+  for (unsigned i=0; i<numChunks; i++) {
+    const uint8_t *chunkSrc = src + (i << ObjectChunk::Bits);
+    const ObjectChunk *c = chunks[i];
+    pageIn(c);
+    if (memcmp(chunkSrc, c->concreteStore, c->size)) {
+      ObjectChunk *wc = getWriteableChunk(i);
+      memcpy(wc->concreteStore, chunkSrc, wc->size);
+    }
+  }
+}
+
 ArrayCache *ObjectState::getArrayCache() const {
   assert(object && "object was NULL");
   return object->parent->getArrayCache();
@@ -236,36 +385,37 @@ const UpdateList &ObjectState::getUpdates() const {
 }
 
 void ObjectState::makeConcrete() {
-  if (concreteMask) delete concreteMask;
-  if (flushMask) delete flushMask;
-  if (knownSymbolics) delete[] knownSymbolics;
-  concreteMask = 0;
-  flushMask = 0;
-  knownSymbolics = 0;
+  for (unsigned i=0; i<numChunks; i++) {
+    const ObjectChunk *c = chunks[i];
+    if (c->concreteMask || c->flushMask || c->knownSymbolics)
+      getWriteableChunk(i)->makeConcrete();
+  }
 }
 
 void ObjectState::makeSymbolic() {
   assert(!updates.head &&
          "XXX makeSymbolic of objects with symbolic values is unsupported");
 
-  // XXX simplify this, can just delete various arrays I guess
-  for (unsigned i=0; i<size; i++) {
-    markByteSymbolic(i);
-    setKnownSymbolic(i, 0);
-    markByteFlushed(i);
-  }
+  for (unsigned i=0; i<numChunks; i++)
+    getWriteableChunk(i)->makeSymbolic();
 }
 
 void ObjectState::initializeToZero() {
   makeConcrete();
-  memset(concreteStore, 0, size);
+  for (unsigned i=0; i<numChunks; i++) {
+    ObjectChunk *c = getWriteableChunk(i);
+    pageIn(c);
+    memset(c->concreteStore, 0, c->size);
+  }
 }
 
 void ObjectState::initializeToRandom() {  
   makeConcrete();
-  for (unsigned i=0; i<size; i++) {
+  for (unsigned i=0; i<numChunks; i++) {
+    ObjectChunk *c = getWriteableChunk(i);
+    pageIn(c);
     // randomly selected by 256 sided die
-    concreteStore[i] = 0xAB;
+    memset(c->concreteStore, 0xAB, c->size);
   }
 }
 
@@ -286,111 +436,91 @@ void ObjectState::fastRangeCheckOffset(ref<Expr> offset,
 
 void ObjectState::flushRangeForRead(unsigned rangeBase, 
                                     unsigned rangeSize) const {
-  if (!flushMask) flushMask = new BitArray(size, true);
- 
-  for (unsigned offset=rangeBase; offset<rangeBase+rangeSize; offset++) {
-    if (!isByteFlushed(offset)) {
-      if (isByteConcrete(offset)) {
-        updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       ConstantExpr::create(concreteStore[offset], Expr::Int8));
-      } else {
-        assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
-        updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       knownSymbolics[offset]);
+  unsigned rangeEnd = rangeBase + rangeSize;
+  for (unsigned offset=rangeBase; offset<rangeEnd;) {
+    unsigned index = offset >> ObjectChunk::Bits;
+    unsigned chunkEnd = std::min(rangeEnd, (index + 1) << ObjectChunk::Bits);
+
+    // Chunks which are already flushed can stay shared.
+    const ObjectChunk *sc = chunks[index];
+    while (offset<chunkEnd && sc->isByteFlushed(offset & ObjectChunk::Mask))
+      offset++;
+    if (offset == chunkEnd)
+      continue;
+
+    ObjectChunk *c = getWriteableChunk(index);
+    if (!c->flushMask) c->flushMask = new BitArray(c->size, true);
+    pageIn(c);
+
+    for (; offset<chunkEnd; offset++) {
+      unsigned i = offset & ObjectChunk::Mask;
+      if (!c->isByteFlushed(i)) {
+        if (c->isByteConcrete(i)) {
+          updates.extend(ConstantExpr::create(offset, Expr::Int32),
+                         ConstantExpr::create(c->concreteStore[i], Expr::Int8));
+        } else {
+          assert(c->isByteKnownSymbolic(i) && "invalid bit set in flushMask");
+          updates.extend(ConstantExpr::create(offset, Expr::Int32),
+                         c->knownSymbolics[i]);
+        }
+
+        c->flushMask->unset(i);
       }
-
-      flushMask->unset(offset);
     }
   } 
 }
 
 void ObjectState::flushRangeForWrite(unsigned rangeBase, 
                                      unsigned rangeSize) {
-  if (!flushMask) flushMask = new BitArray(size, true);
-
-  for (unsigned offset=rangeBase; offset<rangeBase+rangeSize; offset++) {
-    if (!isByteFlushed(offset)) {
-      if (isByteConcrete(offset)) {
-        updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       ConstantExpr::create(concreteStore[offset], Expr::Int8));
-        markByteSymbolic(offset);
+  unsigned rangeEnd = rangeBase + rangeSize;
+  for (unsigned offset=rangeBase; offset<rangeEnd;) {
+    unsigned index = offset >> ObjectChunk::Bits;
+    unsigned chunkEnd = std::min(rangeEnd, (index + 1) << ObjectChunk::Bits);
+
+    ObjectChunk *c = getWriteableChunk(index);
+    if (!c->flushMask) c->flushMask = new BitArray(c->size, true);
+    pageIn(c);
+
+    for (; offset<chunkEnd; offset++) {
+      unsigned i = offset & ObjectChunk::Mask;
+      if (!c->isByteFlushed(i)) {
+        if (c->isByteConcrete(i)) {
+          updates.extend(ConstantExpr::create(offset, Expr::Int32),
+                         ConstantExpr::create(c->concreteStore[i], Expr::Int8));
+          c->markByteSymbolic(i);
+        } else {
+          assert(c->isByteKnownSymbolic(i) && "invalid bit set in flushMask");
+          updates.extend(ConstantExpr::create(offset, Expr::Int32),
+                         c->knownSymbolics[i]);
+          c->setKnownSymbolic(i, 0);
+        }
+
+        c->flushMask->unset(i);
       } else {
-        assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
-        updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       knownSymbolics[offset]);
-        setKnownSymbolic(offset, 0);
-      }
-
-      flushMask->unset(offset);
-    } else {
-      // flushed bytes that are written over still need
-      // to be marked out
-      if (isByteConcrete(offset)) {
-        markByteSymbolic(offset);
-      } else if (isByteKnownSymbolic(offset)) {
-        setKnownSymbolic(offset, 0);
+        // flushed bytes that are written over still need
+        // to be marked out
+        if (c->isByteConcrete(i)) {
+          c->markByteSymbolic(i);
+        } else if (c->isByteKnownSymbolic(i)) {
+          c->setKnownSymbolic(i, 0);
+        }
       }
     }
   } 
 }
 
-bool ObjectState::isByteConcrete(unsigned offset) const {
-  return !concreteMask || concreteMask->get(offset);
-}
-
-bool ObjectState::isByteFlushed(unsigned offset) const {
-  return flushMask && !flushMask->get(offset);
-}
-
-bool ObjectState::isByteKnownSymbolic(unsigned offset) const {
-  return knownSymbolics && knownSymbolics[offset].get();
-}
-
-void ObjectState::markByteConcrete(unsigned offset) {
-  if (concreteMask)
-    concreteMask->set(offset);
-}
-
-void ObjectState::markByteSymbolic(unsigned offset) {
-  if (!concreteMask)
-    concreteMask = new BitArray(size, true);
-  concreteMask->unset(offset);
-}
-
-void ObjectState::markByteUnflushed(unsigned offset) {
-  if (flushMask)
-    flushMask->set(offset);
-}
-
-void ObjectState::markByteFlushed(unsigned offset) {
-  if (!flushMask) {
-    flushMask = new BitArray(size, false);
-  } else {
-    flushMask->unset(offset);
-  }
-}
-
-void ObjectState::setKnownSymbolic(unsigned offset, 
-                                   Expr *value /* can be null */) {
-  if (knownSymbolics) {
-    knownSymbolics[offset] = value;
-  } else {
-    if (value) {
-      knownSymbolics = new ref<Expr>[size];
-      knownSymbolics[offset] = value;
-    }
-  }
-}
-
 /***/
 
 ref<Expr> ObjectState::read8(unsigned offset) const {
-  if (isByteConcrete(offset)) {
-    return ConstantExpr::create(concreteStore[offset], Expr::Int8);
-  } else if (isByteKnownSymbolic(offset)) {
-    return knownSymbolics[offset];
+  const ObjectChunk *c = chunks[offset >> ObjectChunk::Bits];
+  unsigned i = offset & ObjectChunk::Mask;
+  if (c->isByteConcrete(i)) {
+    pageIn(c);
+    return ConstantExpr::create(c->concreteStore[i], Expr::Int8);
+  } else if (c->isByteKnownSymbolic(i)) {
+    return c->knownSymbolics[i];
   } else {
-    assert(isByteFlushed(offset) && "unflushed byte without cache value");
+    assert(c->isByteFlushed(i) && "unflushed byte without cache value");
     
     return ReadExpr::create(getUpdates(), 
                             ConstantExpr::create(offset, Expr::Int32));
@@ -416,11 +546,14 @@ ref<Expr> ObjectState::read8(ref<Expr> offset) const {
 
 void ObjectState::write8(unsigned offset, uint8_t value) {
   //assert(read_only == false && "writing to read-only object!");
-  concreteStore[offset] = value;
-  setKnownSymbolic(offset, 0);
+  ObjectChunk *c = getWriteableChunk(offset >> ObjectChunk::Bits);
+  unsigned i = offset & ObjectChunk::Mask;
+  pageIn(c);
+  c->concreteStore[i] = value;
+  c->setKnownSymbolic(i, 0);
 
-  markByteConcrete(offset);
-  markByteUnflushed(offset);
+  c->markByteConcrete(i);
+  c->markByteUnflushed(i);
 }
 
 void ObjectState::write8(unsigned offset, ref<Expr> value) {
@@ -428,10 +561,12 @@ void ObjectState::write8(unsigned offset, ref<Expr> value) {
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(value)) {
     write8(offset, (uint8_t) CE->getZExtValue(8));
   } else {
-    setKnownSymbolic(offset, value.get());
+    ObjectChunk *c = getWriteableChunk(offset >> ObjectChunk::Bits);
+    unsigned i = offset & ObjectChunk::Mask;
+    c->setKnownSymbolic(i, value.get());
       
-    markByteSymbolic(offset);
-    markByteUnflushed(offset);
+    c->markByteSymbolic(i);
+    c->markByteUnflushed(i);
   }
 }
 
@@ -12,9 +12,11 @@
 
 #include "Context.h"
 #include "klee/Expr.h"
+#include "klee/util/BitArray.h"
 
 #include "llvm/ADT/StringExtras.h"
 
+#include <set>
 #include <vector>
 #include <string>
 
@@ -24,7 +26,6 @@ namespace llvm {
 
 namespace klee {
 
-class BitArray;
 class MemoryManager;
 class Solver;
 class ArrayCache;
@@ -33,11 +34,16 @@ class MemoryObject {
   friend class STPBuilder;
   friend class ObjectState;
   friend class ExecutionState;
+  friend class ReplayLog;
+  friend class MemoryManager;
 
 private:
   static int counter;
   mutable unsigned refCount;
 
+  // links in the parent MemoryManager's list of live objects
+  MemoryObject *prevLive, *nextLive;
+
 public:
   unsigned id;
   uint64_t address;
@@ -76,6 +82,8 @@ public:
   explicit
   MemoryObject(uint64_t _address) 
     : refCount(0),
+      prevLive(0),
+      nextLive(0),
       id(counter++), 
       address(_address),
       size(0),
@@ -89,6 +97,8 @@ public:
                const llvm::Value *_allocSite,
                MemoryManager *_parent)
     : refCount(0), 
+      prevLive(0),
+      nextLive(0),
       id(counter++),
       address(_address),
       size(_size),
@@ -146,6 +156,71 @@ public:
   }
 };
 
+/// ObjectChunk - A fixed size piece of the contents of an ObjectState:
+/// the concrete bytes of that range and the caches tracking which of
+/// them are symbolic. Chunks are reference counted and shared between
+/// copies of an object state until one of the copies modifies them, so
+/// a write to a large object after a fork only copies one chunk.
+class ObjectChunk {
+public:
+  enum { Bits = 12, Size = 1 << Bits, Mask = Size - 1 };
+
+  unsigned refCount;
+  unsigned size;
+
+  // null while the contents are written out to the spill file
+  mutable uint8_t *concreteStore;
+  mutable uint64_t spillOffset;
+  // XXX cleanup name of flushMask (its backwards or something)
+  BitArray *concreteMask;
+  BitArray *flushMask;
+  ref<Expr> *knownSymbolics;
+
+public:
+  explicit ObjectChunk(unsigned size);
+  /// Copy a chunk which is not spilled.
+  ObjectChunk(const ObjectChunk &c);
+  ~ObjectChunk();
+
+  void makeConcrete();
+  void makeSymbolic();
+
+  bool isByteConcrete(unsigned i) const {
+    return !concreteMask || concreteMask->get(i);
+  }
+  bool isByteFlushed(unsigned i) const {
+    return flushMask && !flushMask->get(i);
+  }
+  bool isByteKnownSymbolic(unsigned i) const {
+    return knownSymbolics && knownSymbolics[i].get();
+  }
+
+  void markByteConcrete(unsigned i) {
+    if (concreteMask)
+      concreteMask->set(i);
+  }
+  void markByteSymbolic(unsigned i) {
+    if (!concreteMask)
+      concreteMask = new BitArray(size, true);
+    concreteMask->unset(i);
+  }
+  void markByteUnflushed(unsigned i) {
+    if (flushMask)
+      flushMask->set(i);
+  }
+  void setKnownSymbolic(unsigned i, Expr *value /* can be null */) {
+    if (knownSymbolics) {
+      knownSymbolics[i] = value;
+    } else if (value) {
+      knownSymbolics = new ref<Expr>[size];
+      knownSymbolics[i] = value;
+    }
+  }
+
+private:
+  ObjectChunk &operator=(const ObjectChunk &);
+};
+
 class ObjectState {
 private:
   friend class AddressSpace;
@@ -156,14 +231,11 @@ private:
 
   const MemoryObject *object;
 
-  uint8_t *concreteStore;
-  // XXX cleanup name of flushMask (its backwards or something)
-  BitArray *concreteMask;
-
-  // mutable because may need flushed during read of const
-  mutable BitArray *flushMask;
-
-  ref<Expr> *knownSymbolics;
+  // chunks[i] holds bytes [i * ObjectChunk::Size, (i + 1) * ObjectChunk::Size),
+  // objects of at most one chunk point it at singleChunk.
+  ObjectChunk **chunks;
+  ObjectChunk *singleChunk;
+  unsigned numChunks;
 
   // mutable because we may need flush during read of const
   mutable UpdateList updates;
@@ -183,6 +255,7 @@ public:
   /// contents.
   ObjectState(const MemoryObject *mo, const Array *array);
 
+  /// Copies share all chunks with \a os.
   ObjectState(const ObjectState &os);
   ~ObjectState();
 
@@ -208,7 +281,41 @@ public:
   void write32(unsigned offset, uint32_t value);
   void write64(unsigned offset, uint64_t value);
 
+  /// Write the concrete contents out to the spill file and free them,
+  /// they are read back on the next access. This does not change the
+  /// value of the object, so it is fine for shared states (and shared
+  /// chunks). The chunks in \a keep are left alone, \a kept is set if
+  /// any of them is in this object. Returns the number of bytes freed.
+  unsigned spill(const std::set<const ObjectChunk*> &keep, bool &kept) const;
+  bool isSpilled() const;
+  /// Add the chunks of this object to \a result.
+  void getChunks(std::set<const ObjectChunk*> &result) const;
+
 private:
+  void initChunks();
+
+  /// Return chunk \a index, copied first if it is shared with another
+  /// object state. This is const because flushing for a read has to
+  /// modify the chunk.
+  ObjectChunk *getWriteableChunk(unsigned index) const {
+    ObjectChunk *c = chunks[index];
+    return c->refCount == 1 ? c : copyChunk(index);
+  }
+  ObjectChunk *copyChunk(unsigned index) const;
+  void releaseChunk(ObjectChunk *c);
+
+  // read back spilled contents
+  void pageIn(const ObjectChunk *c) const {
+    if (!c->concreteStore)
+      pageInSlow(c);
+  }
+  void pageInSlow(const ObjectChunk *c) const;
+
+  // Concrete contents as one buffer of size bytes, for AddressSpace.
+  void copyConcreteStoreTo(uint8_t *dst) const;
+  bool concreteStoreMatches(const uint8_t *src) const;
+  void copyConcreteStoreFrom(const uint8_t *src);
+
   const UpdateList &getUpdates() const;
 
   void makeConcrete();
@@ -224,15 +331,18 @@ private:
   void flushRangeForRead(unsigned rangeBase, unsigned rangeSize) const;
   void flushRangeForWrite(unsigned rangeBase, unsigned rangeSize);
 
-  bool isByteConcrete(unsigned offset) const;
-  bool isByteFlushed(unsigned offset) const;
-  bool isByteKnownSymbolic(unsigned offset) const;
-
-  void markByteConcrete(unsigned offset);
-  void markByteSymbolic(unsigned offset);
-  void markByteFlushed(unsigned offset);
-  void markByteUnflushed(unsigned offset);
-  void setKnownSymbolic(unsigned offset, Expr *value);
+  bool isByteConcrete(unsigned offset) const {
+    return chunks[offset >> ObjectChunk::Bits]->isByteConcrete(
+        offset & ObjectChunk::Mask);
+  }
+  bool isByteFlushed(unsigned offset) const {
+    return chunks[offset >> ObjectChunk::Bits]->isByteFlushed(
+        offset & ObjectChunk::Mask);
+  }
+  bool isByteKnownSymbolic(unsigned offset) const {
+    return chunks[offset >> ObjectChunk::Bits]->isByteKnownSymbolic(
+        offset & ObjectChunk::Mask);
+  }
 
   void print();
   ArrayCache *getArrayCache() const;
@@ -18,18 +18,165 @@
 
 #include "llvm/Support/CommandLine.h"
 
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+
+using namespace llvm;
 using namespace klee;
 
+namespace {
+  cl::opt<bool>
+  DeterministicAllocation("allocate-determ",
+                          cl::desc("Allocate memory for the program from a "
+                                   "reserved address range, so that "
+                                   "addresses are the same in every run "
+                                   "(default=off)"),
+                          cl::init(false));
+
+  cl::opt<unsigned>
+  DeterministicAllocationSize("allocate-determ-size",
+                              cl::desc("Size of the address range reserved "
+                                       "by --allocate-determ (in MB, "
+                                       "default=4096)"),
+                              cl::init(4096));
+
+  cl::opt<unsigned>
+  AllocationQuarantine("allocate-quarantine",
+                       cl::desc("Number of freed objects whose addresses "
+                                "--allocate-determ holds back from reuse, "
+                                "so that dangling pointers keep failing to "
+                                "resolve (default=0)"),
+                       cl::init(0));
+}
+
+// Where --allocate-determ asks for its range on 64-bit hosts, and how
+// many ranges after it to try when something is mapped there.
+static const uint64_t kArenaStartAddress = 0x7ff30000000ULL;
+static const unsigned kArenaAttempts = 8;
+
+// Freed arena blocks of at least this size are returned to the host.
+static const uint64_t kArenaReleaseSize = 64 * 1024;
+
+unsigned MemoryManager::getSizeClass(uint64_t size) {
+  unsigned c = 0;
+  while ((1ULL << (c + MinBlockBits)) < size)
+    ++c;
+  return c;
+}
+
 /***/
 
+MemoryManager::MemoryManager(ArrayCache *arrayCache)
+  : liveObjects(0), arrayCache(arrayCache), spillFile(0),
+    arenaBase(0), arenaSize(0), arenaNext(0) {
+  if (DeterministicAllocation)
+    reserveArena();
+}
+
 MemoryManager::~MemoryManager() { 
-  while (!objects.empty()) {
-    MemoryObject *mo = *objects.begin();
-    if (!mo->isFixed)
-      free((void *)mo->address);
-    objects.erase(mo);
-    delete mo;
+  // ~MemoryObject unlinks each object through markFreed.
+  while (liveObjects)
+    delete liveObjects;
+
+  if (arenaBase)
+    munmap((void*) (unsigned long) arenaBase, arenaSize);
+}
+
+void MemoryManager::reserveArena() {
+  arenaSize = (uint64_t) DeterministicAllocationSize * 1024 * 1024;
+  void *base = MAP_FAILED;
+
+  // The address is only a hint, the kernel places the range elsewhere
+  // when it overlaps an existing mapping. Such a range would move with
+  // the layout of the host process, so try the next fixed candidates
+  // instead, which keeps the addresses the same between runs.
+  if (sizeof(void*) == 8) {
+    for (unsigned i = 0; i != kArenaAttempts && base == MAP_FAILED; ++i) {
+      void *hint = (void*) (unsigned long) (kArenaStartAddress +
+                                            i * arenaSize);
+      base = mmap(hint, arenaSize, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (base != MAP_FAILED && base != hint) {
+        munmap(base, arenaSize);
+        base = MAP_FAILED;
+      } else if (base != MAP_FAILED && i) {
+        klee_warning("--allocate-determ: range not available at %p, "
+                     "using %p", (void*) (unsigned long) kArenaStartAddress,
+                     base);
+      }
+    }
+    if (base == MAP_FAILED)
+      klee_warning("--allocate-determ: no range available from %p, "
+                   "addresses will differ between runs",
+                   (void*) (unsigned long) kArenaStartAddress);
   }
+
+  if (base == MAP_FAILED)
+    base = mmap(0, arenaSize, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED)
+    klee_error("unable to reserve %u MB for --allocate-determ: %s",
+               (unsigned) DeterministicAllocationSize, strerror(errno));
+  arenaBase = (uint64_t) (unsigned long) base;
+}
+
+uint64_t MemoryManager::allocateBlock(uint64_t size) {
+  unsigned c = getSizeClass(size);
+  if (c >= NumSizeClasses)
+    return 0;
+
+  std::vector<uint64_t> &blocks = freeBlocks[c];
+  if (!blocks.empty()) {
+    uint64_t address = blocks.back();
+    blocks.pop_back();
+    return address;
+  }
+
+  uint64_t blockSize = 1ULL << (c + MinBlockBits);
+  if (arenaNext + blockSize > arenaSize) {
+    klee_warning_once(0, "--allocate-determ: reserved range exhausted, "
+                      "see --allocate-determ-size");
+    return 0;
+  }
+  uint64_t address = arenaBase + arenaNext;
+  arenaNext += blockSize;
+  return address;
+}
+
+void MemoryManager::releaseBlock(uint64_t address, uint64_t size) {
+  unsigned c = getSizeClass(size);
+  uint64_t blockSize = 1ULL << (c + MinBlockBits);
+  if (blockSize >= kArenaReleaseSize)
+    madvise((void*) (unsigned long) address, blockSize, MADV_DONTNEED);
+
+  if (AllocationQuarantine) {
+    quarantine.push_back(std::make_pair(address, c));
+    if (quarantine.size() <= AllocationQuarantine)
+      return;
+    address = quarantine.front().first;
+    c = quarantine.front().second;
+    quarantine.pop_front();
+  }
+  freeBlocks[c].push_back(address);
+}
+
+void MemoryManager::link(MemoryObject *mo) {
+  mo->prevLive = 0;
+  mo->nextLive = liveObjects;
+  if (liveObjects)
+    liveObjects->prevLive = mo;
+  liveObjects = mo;
+}
+
+void MemoryManager::unlink(MemoryObject *mo) {
+  if (mo->prevLive)
+    mo->prevLive->nextLive = mo->nextLive;
+  else
+    liveObjects = mo->nextLive;
+  if (mo->nextLive)
+    mo->nextLive->prevLive = mo->prevLive;
+  mo->prevLive = mo->nextLive = 0;
 }
 
 MemoryObject *MemoryManager::allocate(uint64_t size, bool isLocal, 
@@ -38,23 +185,22 @@ MemoryObject *MemoryManager::allocate(uint64_t size, bool isLocal,
   if (size>10*1024*1024)
     klee_warning_once(0, "Large alloc: %u bytes.  KLEE may run out of memory.", (unsigned) size);
   
-  uint64_t address = (uint64_t) (unsigned long) malloc((unsigned) size);
+  uint64_t address = arenaBase ? allocateBlock(size) :
+    (uint64_t) (unsigned long) malloc((unsigned) size);
   if (!address)
     return 0;
   
   ++stats::allocations;
   MemoryObject *res = new MemoryObject(address, size, isLocal, isGlobal, false,
                                        allocSite, this);
-  objects.insert(res);
+  link(res);
   return res;
 }
 
 MemoryObject *MemoryManager::allocateFixed(uint64_t address, uint64_t size,
                                            const llvm::Value *allocSite) {
 #ifndef NDEBUG
-  for (objects_ty::iterator it = objects.begin(), ie = objects.end();
-       it != ie; ++it) {
-    MemoryObject *mo = *it;
+  for (MemoryObject *mo = liveObjects; mo; mo = mo->nextLive) {
     if (address+size > mo->address && address < mo->address+mo->size)
       klee_error("Trying to allocate an overlapping object");
   }
@@ -63,7 +209,7 @@ MemoryObject *MemoryManager::allocateFixed(uint64_t address, uint64_t size,
   ++stats::allocations;
   MemoryObject *res = new MemoryObject(address, size, false, true, true,
                                        allocSite, this);
-  objects.insert(res);
+  link(res);
   return res;
 }
 
@@ -72,10 +218,11 @@ void MemoryManager::deallocate(const MemoryObject *mo) {
 }
 
 void MemoryManager::markFreed(MemoryObject *mo) {
-  if (objects.find(mo) != objects.end())
-  {
-    if (!mo->isFixed)
+  unlink(mo);
+  if (!mo->isFixed) {
+    if (arenaBase)
+      releaseBlock(mo->address, mo->size);
+    else
       free((void *)mo->address);
-    objects.erase(mo);
   }
 }
@@ -10,7 +10,8 @@
 #ifndef KLEE_MEMORYMANAGER_H
 #define KLEE_MEMORYMANAGER_H
 
-#include <set>
+#include <deque>
+#include <vector>
 #include <stdint.h>
 
 namespace llvm {
@@ -20,15 +21,40 @@ namespace llvm {
 namespace klee {
   class MemoryObject;
   class ArrayCache;
+  class SpillFile;
 
   class MemoryManager {
   private:
-    typedef std::set<MemoryObject*> objects_ty;
-    objects_ty objects;
+    // Blocks of the --allocate-determ arena are powers of two, from
+    // 1 << MinBlockBits bytes up to 4GB.
+    enum { MinBlockBits = 4, NumSizeClasses = 33 - MinBlockBits };
+
+    // Live objects, linked through MemoryObject::prevLive/nextLive.
+    MemoryObject *liveObjects;
     ArrayCache *const arrayCache;
+    SpillFile *spillFile;
+
+    /// Address range reserved for --allocate-determ, arenaBase is 0
+    /// when allocating with malloc.
+    uint64_t arenaBase;
+    uint64_t arenaSize;
+    /// Offset of the first never allocated byte of the arena.
+    uint64_t arenaNext;
+    /// Freed arena blocks by size class, reused last in first out.
+    std::vector<uint64_t> freeBlocks[NumSizeClasses];
+    /// Freed arena blocks held back from reuse, oldest first.
+    std::deque< std::pair<uint64_t, unsigned> > quarantine;
+
+    void link(MemoryObject *mo);
+    void unlink(MemoryObject *mo);
+
+    static unsigned getSizeClass(uint64_t size);
+    void reserveArena();
+    uint64_t allocateBlock(uint64_t size);
+    void releaseBlock(uint64_t address, uint64_t size);
 
   public:
-    MemoryManager(ArrayCache *arrayCache) : arrayCache(arrayCache) {}
+    MemoryManager(ArrayCache *arrayCache);
     ~MemoryManager();
 
     MemoryObject *allocate(uint64_t size, bool isLocal, bool isGlobal,
@@ -38,6 +64,11 @@ namespace klee {
     void deallocate(const MemoryObject *mo);
     void markFreed(MemoryObject *mo);
     ArrayCache *getArrayCache() const { return arrayCache; }
+
+    /// Storage for object contents written out at the memory cap, or
+    /// null if spilling is disabled.
+    SpillFile *getSpillFile() const { return spillFile; }
+    void setSpillFile(SpillFile *sf) { spillFile = sf; }
   };
 
 } // End klee namespace
@@ -0,0 +1,124 @@
+//===-- ReplayLog.cpp -----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ReplayLog.h"
+
+#include "Memory.h"
+
+using namespace klee;
+
+/***/
+
+ReplayLog::~ReplayLog() {
+  for (std::vector<ReplayEntry>::iterator it = entries.begin(),
+         ie = entries.end(); it != ie; ++it) {
+    MemoryObject *mo = it->object;
+    if (mo && --mo->refCount == 0)
+      delete mo;
+  }
+}
+
+void ReplayLog::addValue(bool success, ref<ConstantExpr> result) {
+  entries.push_back(ReplayEntry(ReplayEntry::Value, success, 0));
+  entries.back().first = result;
+}
+
+void ReplayLog::addRange(const std::pair< ref<Expr>, ref<Expr> > &result) {
+  entries.push_back(ReplayEntry(ReplayEntry::Range, true, 0));
+  entries.back().first = result.first;
+  entries.back().second = result.second;
+}
+
+void ReplayLog::addAllocation(MemoryObject *mo) {
+  // Keep the object (and so its address) alive, the re-execution has
+  // to get the same one back.
+  if (mo)
+    mo->refCount++;
+  entries.push_back(ReplayEntry(ReplayEntry::Allocation, true, 0));
+  entries.back().object = mo;
+}
+
+void ReplayLog::getEntries(std::vector<const ReplayEntry*> &result) const {
+  std::vector<const ReplayLog*> path;
+  for (const ReplayLog *log = this; log; log = log->parent.get())
+    path.push_back(log);
+
+  for (std::vector<const ReplayLog*>::reverse_iterator it = path.rbegin(),
+         ie = path.rend(); it != ie; ++it)
+    for (std::vector<ReplayEntry>::const_iterator
+           eit = (*it)->entries.begin(), eie = (*it)->entries.end();
+         eit != eie; ++eit)
+      result.push_back(&*eit);
+}
+
+/***/
+
+const ReplayEntry *ReplayCursor::take(ReplayEntry::Kind kind) {
+  if (diverged || next == entries.size() || entries[next]->kind != kind) {
+    diverged = true;
+    return 0;
+  }
+  return entries[next++];
+}
+
+bool ReplayCursor::nextBranch(unsigned &index) {
+  const ReplayEntry *e = take(ReplayEntry::Branch);
+  if (!e)
+    return false;
+  index = e->data;
+  return true;
+}
+
+bool ReplayCursor::nextValidity(bool &success, Solver::Validity &result) {
+  const ReplayEntry *e = take(ReplayEntry::Validity);
+  if (!e)
+    return false;
+  success = e->success;
+  result = (Solver::Validity) e->data;
+  return true;
+}
+
+bool ReplayCursor::nextTruth(bool &success, bool &result) {
+  const ReplayEntry *e = take(ReplayEntry::Truth);
+  if (!e)
+    return false;
+  success = e->success;
+  result = e->data;
+  return true;
+}
+
+bool ReplayCursor::nextValue(bool &success, ref<ConstantExpr> &result) {
+  const ReplayEntry *e = take(ReplayEntry::Value);
+  if (!e)
+    return false;
+  success = e->success;
+  if (success)
+    result = cast<ConstantExpr>(e->first);
+  return true;
+}
+
+bool ReplayCursor::nextRange(std::pair< ref<Expr>, ref<Expr> > &result) {
+  const ReplayEntry *e = take(ReplayEntry::Range);
+  if (!e)
+    return false;
+  result = std::make_pair(e->first, e->second);
+  return true;
+}
+
+bool ReplayCursor::nextAllocation(uint64_t size, MemoryObject *&result) {
+  const ReplayEntry *e = take(ReplayEntry::Allocation);
+  if (!e)
+    return false;
+  if (e->object && e->object->size != size) {
+    diverged = true;
+    return false;
+  }
+  result = e->object;
+  return true;
+}
@@ -0,0 +1,118 @@
+//===-- ReplayLog.h ---------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_REPLAYLOG_H
+#define KLEE_REPLAYLOG_H
+
+#include "klee/Expr.h"
+#include "klee/Solver.h"
+
+#include <vector>
+
+namespace klee {
+  class MemoryObject;
+
+  /// ReplayEntry - One nondeterministic event on a path: a solver
+  /// answer, the side taken at a branch, or an allocated object.
+  struct ReplayEntry {
+    enum Kind {
+      Branch,     ///< index of the state among the branch results
+      Validity,   ///< TimingSolver::evaluate
+      Truth,      ///< TimingSolver::mustBeTrue (and the may/mustBeFalse forms)
+      Value,      ///< TimingSolver::getValue
+      Range,      ///< TimingSolver::getRange
+      Allocation  ///< object returned by the memory manager
+    };
+
+    Kind kind;
+    bool success;
+    int64_t data;
+    ref<Expr> first, second;
+    MemoryObject *object;
+
+    ReplayEntry(Kind _kind, bool _success, int64_t _data)
+      : kind(_kind), success(_success), data(_data), object(0) {}
+  };
+
+  /// ReplayLog - The events of a path, in execution order, as needed
+  /// to rebuild a dormant state (see --dormant-states) by
+  /// re-executing it from the initial state. The log of a path is a
+  /// chain of nodes shared with the states it was forked from, each
+  /// state only appends to its own node.
+  class ReplayLog {
+  public:
+    /// Required by klee::ref-managed objects.
+    unsigned refCount;
+
+  private:
+    ref<ReplayLog> parent;
+    std::vector<ReplayEntry> entries;
+
+    /// False once the path called an external function (which can not
+    /// be executed a second time) or was merged with another path.
+    bool replayable;
+
+  public:
+    explicit ReplayLog(const ref<ReplayLog> &_parent)
+      : refCount(0), parent(_parent),
+        replayable(_parent.isNull() || _parent->replayable) {}
+    ~ReplayLog();
+
+    bool isReplayable() const { return replayable; }
+    void markNotReplayable() { replayable = false; }
+
+    void addBranch(unsigned index) {
+      entries.push_back(ReplayEntry(ReplayEntry::Branch, true, index));
+    }
+    void addValidity(bool success, Solver::Validity result) {
+      entries.push_back(ReplayEntry(ReplayEntry::Validity, success, result));
+    }
+    void addTruth(bool success, bool result) {
+      entries.push_back(ReplayEntry(ReplayEntry::Truth, success, result));
+    }
+    void addValue(bool success, ref<ConstantExpr> result);
+    void addRange(const std::pair< ref<Expr>, ref<Expr> > &result);
+    void addAllocation(MemoryObject *mo);
+
+    /// Append the entries of the path, oldest first, to \a result.
+    void getEntries(std::vector<const ReplayEntry*> &result) const;
+  };
+
+  /// ReplayCursor - Reads back a replay log while a dormant state is
+  /// being rebuilt. The next* methods return false if the next entry
+  /// does not match the request, which marks the cursor as diverged;
+  /// the caller then falls back to doing the real work and the
+  /// rebuilt state is discarded.
+  class ReplayCursor {
+  private:
+    std::vector<const ReplayEntry*> entries;
+    unsigned next;
+
+    const ReplayEntry *take(ReplayEntry::Kind kind);
+
+  public:
+    bool diverged;
+
+    explicit ReplayCursor(const ReplayLog &log)
+      : next(0), diverged(false) {
+      log.getEntries(entries);
+    }
+
+    bool atEnd() const { return next == entries.size(); }
+
+    bool nextBranch(unsigned &index);
+    bool nextValidity(bool &success, Solver::Validity &result);
+    bool nextTruth(bool &success, bool &result);
+    bool nextValue(bool &success, ref<ConstantExpr> &result);
+    bool nextRange(std::pair< ref<Expr>, ref<Expr> > &result);
+    bool nextAllocation(uint64_t size, MemoryObject *&result);
+  };
+}
+
+#endif
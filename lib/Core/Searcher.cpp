@@ -11,11 +11,13 @@
 
 #include "CoreStats.h"
 #include "Executor.h"
+#include "Memory.h"
 #include "PTree.h"
 #include "StatsTracker.h"
 
 #include "klee/ExecutionState.h"
 #include "klee/Statistics.h"
+#include "klee/Internal/Module/Cell.h"
 #include "klee/Internal/Module/InstructionInfoTable.h"
 #include "klee/Internal/Module/KInstruction.h"
 #include "klee/Internal/Module/KModule.h"
@@ -339,7 +341,8 @@ entry:
       statesAtMerge.insert(std::make_pair(mp, &es));
     } else {
       ExecutionState *mergeWith = it->second;
-      if (mergeWith->merge(es)) {
+      // Dormant states have no constraints or memory to merge.
+      if (!mergeWith->dormant && !es.dormant && mergeWith->merge(es)) {
         // hack, because we are terminating the state we need to let
         // the baseSearcher know about it again
         baseSearcher->addState(&es);
@@ -438,7 +441,9 @@ ExecutionState &MergingSearcher::selectState() {
              ie = toMerge.end(); it != ie; ++it) {
         ExecutionState *mergeWith = *it;
         
-        if (base->merge(*mergeWith)) {
+        // Dormant states have no constraints or memory to merge.
+        if (!base->dormant && !mergeWith->dormant &&
+            base->merge(*mergeWith)) {
           toErase.insert(mergeWith);
         }
       }
@@ -494,6 +499,202 @@ void MergingSearcher::update(ExecutionState *current,
 
 ///
 
+DynamicMergingSearcher::DynamicMergingSearcher(Executor &_executor,
+                                               Searcher *_baseSearcher,
+                                               unsigned _maxLag,
+                                               unsigned _maxNewSymbolic)
+  : executor(_executor),
+    baseSearcher(_baseSearcher),
+    maxLag(_maxLag),
+    maxNewSymbolic(_maxNewSymbolic),
+    laggard(0),
+    leader(0),
+    catchUpLimit(0) {
+}
+
+DynamicMergingSearcher::~DynamicMergingSearcher() {
+  delete baseSearcher;
+}
+
+static uint64_t getDistToReturn(const ExecutionState &es) {
+  return theStatisticManager->getIndexedValue(stats::minDistToReturn,
+                                              es.pc->info->id);
+}
+
+static bool sameStack(const ExecutionState &a, const ExecutionState &b) {
+  if (a.stack.size() != b.stack.size())
+    return false;
+  for (unsigned i = 0; i != a.stack.size(); ++i)
+    if (a.stack[i].caller != b.stack[i].caller ||
+        a.stack[i].kf != b.stack[i].kf)
+      return false;
+  return true;
+}
+
+void DynamicMergingSearcher::track(ExecutionState *es) {
+  Key key(es->stack.back().kf, es->stack.size());
+  std::map<ExecutionState*, Key>::iterator it = keys.find(es);
+  if (it != keys.end()) {
+    if (it->second == key)
+      return;
+    groups[it->second].erase(es);
+    it->second = key;
+  } else {
+    keys.insert(std::make_pair(es, key));
+  }
+  groups[key].insert(es);
+}
+
+void DynamicMergingSearcher::untrack(ExecutionState *es) {
+  std::map<ExecutionState*, Key>::iterator it = keys.find(es);
+  if (it != keys.end()) {
+    groups[it->second].erase(es);
+    keys.erase(it);
+  }
+  if (es == laggard || es == leader)
+    laggard = leader = 0;
+}
+
+ExecutionState *DynamicMergingSearcher::findPartner(ExecutionState &es) {
+  uint64_t dist = getDistToReturn(es);
+  if (!dist)
+    return 0;
+
+  // The closest state with the same stack, from which the return is
+  // reachable as well.
+  ExecutionState *best = 0;
+  uint64_t bestLag = maxLag + 1;
+  std::set<ExecutionState*> &group = groups[keys[&es]];
+  for (std::set<ExecutionState*>::iterator it = group.begin(),
+         ie = group.end(); it != ie; ++it) {
+    ExecutionState *other = *it;
+    uint64_t otherDist = getDistToReturn(*other);
+    if (other == &es || !otherDist)
+      continue;
+    uint64_t lag = dist > otherDist ? dist - otherDist : otherDist - dist;
+    if (lag < bestLag && (lag || other->pc == es.pc) &&
+        sameStack(es, *other)) {
+      best = other;
+      bestLag = lag;
+    }
+  }
+  return best;
+}
+
+bool DynamicMergingSearcher::mergePays(const ExecutionState &a,
+                                       const ExecutionState &b) {
+  // Merging turns the values which are concrete in both states but
+  // differ into ite expressions, and each branch on them which was
+  // decided for free becomes a query. Values already symbolic in either
+  // state cost no new queries, so count the others.
+  unsigned newSymbolic = 0;
+  for (unsigned i = 0; i != a.stack.size(); ++i) {
+    const StackFrame &af = a.stack[i], &bf = b.stack[i];
+    for (unsigned j = 0; j != af.kf->numRegisters; ++j) {
+      const ref<Expr> &av = af.locals[j].value, &bv = bf.locals[j].value;
+      if (!av.isNull() && !bv.isNull() && av != bv &&
+          isa<ConstantExpr>(av) && isa<ConstantExpr>(bv) &&
+          ++newSymbolic > maxNewSymbolic)
+        return false;
+    }
+  }
+
+  MemoryMap::iterator ai = a.addressSpace.objects.begin();
+  MemoryMap::iterator bi = b.addressSpace.objects.begin();
+  MemoryMap::iterator ae = a.addressSpace.objects.end();
+  MemoryMap::iterator be = b.addressSpace.objects.end();
+  for (; ai != ae && bi != be; ++ai, ++bi) {
+    // The merge fails on different bindings.
+    if (ai->first != bi->first)
+      return false;
+    if (ai->second == bi->second)
+      continue;
+    const ObjectState *aos = ai->second, *bos = bi->second;
+    for (unsigned i = 0; i != ai->first->size; ++i) {
+      ref<Expr> av = aos->read8(i), bv = bos->read8(i);
+      if (av != bv && isa<ConstantExpr>(av) && isa<ConstantExpr>(bv) &&
+          ++newSymbolic > maxNewSymbolic)
+        return false;
+    }
+  }
+  return ai == ae && bi == be;
+}
+
+bool DynamicMergingSearcher::tryMerge(ExecutionState &a, ExecutionState &b) {
+  // States whose contents or constraints are not all there yet, and
+  // states of different --parallel-workers partitions, stay apart. At a
+  // PHI node the states must have come from the same block, as the
+  // merged state keeps the incoming block of a.
+  if (a.dormant || b.dormant ||
+      (isa<PHINode>(a.pc->inst) && a.incomingBBIndex != b.incomingBBIndex) ||
+      !a.uncheckedBranch.isNull() || !b.uncheckedBranch.isNull() ||
+      a.partitionDepth != b.partitionDepth ||
+      a.partitionPrefix != b.partitionPrefix ||
+      !mergePays(a, b) || !a.merge(b))
+    return false;
+
+  if (DebugLogMerge)
+    llvm::errs() << "\tdynamic merge: " << &a << " with " << &b << "\n";
+  executor.removeState(b);
+  return true;
+}
+
+ExecutionState &DynamicMergingSearcher::selectState() {
+  if (laggard) {
+    ExecutionState *a = leader, *b = laggard;
+    if (b->pc == a->pc) {
+      laggard = leader = 0;
+      if (tryMerge(*a, *b))
+        return *a;
+    } else if (b->steppedInstructions < catchUpLimit &&
+               (keys[b] != keys[a] ||
+                getDistToReturn(*b) > getDistToReturn(*a))) {
+      return *b;
+    } else {
+      laggard = leader = 0;
+    }
+  }
+
+  ExecutionState &es = baseSearcher->selectState();
+  ExecutionState *partner = findPartner(es);
+  if (!partner)
+    return es;
+
+  if (partner->pc == es.pc)
+    return tryMerge(*partner, es) ? *partner : es;
+
+  // The state further from the return runs until it reaches the other
+  // one, passes it, or has run twice the distance between them.
+  uint64_t dist = getDistToReturn(es), partnerDist = getDistToReturn(*partner);
+  if (dist > partnerDist) {
+    laggard = &es;
+    leader = partner;
+  } else {
+    laggard = partner;
+    leader = &es;
+  }
+  uint64_t lag = dist > partnerDist ? dist - partnerDist : partnerDist - dist;
+  catchUpLimit = laggard->steppedInstructions + 2 * lag;
+  return *laggard;
+}
+
+void DynamicMergingSearcher::update(ExecutionState *current,
+                                    const std::set<ExecutionState*> &addedStates,
+                                    const std::set<ExecutionState*> &removedStates) {
+  baseSearcher->update(current, addedStates, removedStates);
+
+  for (std::set<ExecutionState*>::const_iterator it = addedStates.begin(),
+         ie = addedStates.end(); it != ie; ++it)
+    track(*it);
+  for (std::set<ExecutionState*>::const_iterator it = removedStates.begin(),
+         ie = removedStates.end(); it != ie; ++it)
+    untrack(*it);
+  if (current && !removedStates.count(current))
+    track(current);
+}
+
+///
+
 BatchingSearcher::BatchingSearcher(Searcher *_baseSearcher,
                                    double _timeBudget,
                                    unsigned _instructionBudget) 
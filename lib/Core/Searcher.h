@@ -11,6 +11,7 @@
 #define KLEE_SEARCHER_H
 
 #include "llvm/Support/raw_ostream.h"
+#include <stdint.h>
 #include <vector>
 #include <set>
 #include <map>
@@ -27,6 +28,7 @@ namespace klee {
   template<class T> class DiscretePDF;
   class ExecutionState;
   class Executor;
+  class KFunction;
 
   class Searcher {
   public:
@@ -226,6 +228,54 @@ namespace klee {
     }
   };
 
+  /// DynamicMergingSearcher - Merges states without klee_merge() calls.
+  /// When the state picked by the base searcher has the same stack as
+  /// another one which is at most a few instructions apart by the
+  /// distance to the function return StatsTracker computes, the one
+  /// behind is run on its own until it catches up. States which meet
+  /// at the same instruction are merged when an estimate of the
+  /// queries it adds says it pays off.
+  class DynamicMergingSearcher : public Searcher {
+    typedef std::pair<KFunction*, unsigned> Key;
+
+    Executor &executor;
+    Searcher *baseSearcher;
+    unsigned maxLag;
+    unsigned maxNewSymbolic;
+    /// The states by the function and depth of their stack.
+    std::map<Key, std::set<ExecutionState*> > groups;
+    std::map<ExecutionState*, Key> keys;
+    /// The state which is catching up with leader, and the count of
+    /// stepped instructions at which it gives up.
+    ExecutionState *laggard, *leader;
+    uint64_t catchUpLimit;
+
+  private:
+    void track(ExecutionState *es);
+    void untrack(ExecutionState *es);
+    ExecutionState *findPartner(ExecutionState &es);
+    bool mergePays(const ExecutionState &a, const ExecutionState &b);
+    bool tryMerge(ExecutionState &a, ExecutionState &b);
+
+  public:
+    DynamicMergingSearcher(Executor &executor, Searcher *baseSearcher,
+                           unsigned _maxLag, unsigned _maxNewSymbolic);
+    ~DynamicMergingSearcher();
+
+    ExecutionState &selectState();
+    void update(ExecutionState *current,
+                const std::set<ExecutionState*> &addedStates,
+                const std::set<ExecutionState*> &removedStates);
+    bool empty() { return baseSearcher->empty(); }
+    void printName(llvm::raw_ostream &os) {
+      os << "<DynamicMergingSearcher> maxLag: " << maxLag
+         << ", maxNewSymbolic: " << maxNewSymbolic
+         << ", baseSearcher:\n";
+      baseSearcher->printName(os);
+      os << "</DynamicMergingSearcher>\n";
+    }
+  };
+
   class BatchingSearcher : public Searcher {
     Searcher *baseSearcher;
     double timeBudget;
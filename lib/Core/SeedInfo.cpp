@@ -13,12 +13,24 @@
 
 #include "klee/ExecutionState.h"
 #include "klee/Expr.h"
+#include "klee/Interpreter.h"
 #include "klee/util/ExprUtil.h"
 #include "klee/Internal/ADT/KTest.h"
 #include "klee/Internal/Support/ErrorHandling.h"
 
 using namespace klee;
 
+bool SeedInfo::isReplayingPrefix(const ExecutionState &state) const {
+  return prefix && state.steppedInstructions < prefix->instructions;
+}
+
+bool SeedInfo::nextPrefixBranch(bool &branch) {
+  if (!prefix || prefixBranch == prefix->branches.size())
+    return false;
+  branch = prefix->branches[prefixBranch++] == '1';
+  return true;
+}
+
 KTestObject *SeedInfo::getNextInput(const MemoryObject *mo,
                                    bool byName) {
   if (byName) {
@@ -18,6 +18,7 @@ extern "C" {
 }
 
 namespace klee {
+  struct CheckpointPosition;
   class ExecutionState;
   class TimingSolver;
 
@@ -27,12 +28,27 @@ namespace klee {
     KTest *input;
     unsigned inputPosition;
     std::set<struct KTestObject*> used;
+    /// When resuming, the checkpointed state the seed reaches and the
+    /// next of its recorded branches, so that the path leading to it is
+    /// not explored again.
+    const CheckpointPosition *prefix;
+    unsigned prefixBranch;
     
   public:
     explicit
     SeedInfo(KTest *_input) : assignment(true),
                              input(_input),
-                             inputPosition(0) {}
+                             inputPosition(0),
+                             prefix(0),
+                             prefixBranch(0) {}
+
+    /// Whether \a state, which follows the seed, has not yet reached
+    /// the checkpointed state of the seed.
+    bool isReplayingPrefix(const ExecutionState &state) const;
+
+    /// Take the next branch recorded for the checkpointed state, returns
+    /// false once they are all taken.
+    bool nextPrefixBranch(bool &branch);
     
     KTestObject *getNextInput(const MemoryObject *mo,
                              bool byName);
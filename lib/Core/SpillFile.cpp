@@ -0,0 +1,82 @@
+//===-- SpillFile.cpp -----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SpillFile.h"
+
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace klee;
+
+SpillFile::~SpillFile() {
+  if (fd >= 0)
+    close(fd);
+}
+
+bool SpillFile::open(const std::string &path) {
+  assert(fd < 0 && "spill file already open");
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    klee_warning("unable to create spill file \"%s\": %s", path.c_str(),
+                 strerror(errno));
+    return false;
+  }
+  unlink(path.c_str());
+  return true;
+}
+
+bool SpillFile::write(const uint8_t *data, unsigned size, uint64_t &offset) {
+  std::map<unsigned, std::vector<uint64_t> >::iterator it =
+    freeExtents.find(size);
+  bool reused = it != freeExtents.end() && !it->second.empty();
+  offset = reused ? it->second.back() : end;
+
+  unsigned written = 0;
+  while (written < size) {
+    ssize_t n = pwrite(fd, data + written, size - written, offset + written);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      klee_warning_once(0, "unable to write spill file: %s", strerror(errno));
+      return false;
+    }
+    written += n;
+  }
+
+  if (reused)
+    it->second.pop_back();
+  else
+    end += size;
+  bytesSpilled += size;
+  return true;
+}
+
+void SpillFile::read(uint64_t offset, uint8_t *data, unsigned size) {
+  unsigned done = 0;
+  while (done < size) {
+    ssize_t n = pread(fd, data + done, size - done, offset + done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      klee_error("unable to read spill file: %s", strerror(errno));
+    done += n;
+  }
+  release(offset, size);
+}
+
+void SpillFile::release(uint64_t offset, unsigned size) {
+  assert(bytesSpilled >= size);
+  freeExtents[size].push_back(offset);
+  bytesSpilled -= size;
+}
@@ -0,0 +1,60 @@
+//===-- SpillFile.h ---------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_SPILLFILE_H
+#define KLEE_SPILLFILE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace klee {
+
+  /// SpillFile - Backing storage for the concrete contents of object
+  /// states which were written out at the memory cap (see
+  /// --max-memory-spill). The file is unlinked as soon as it is
+  /// created, so it disappears with the process.
+  class SpillFile {
+  private:
+    int fd;
+    uint64_t end;
+
+    /// Released extents, by size, reused for later writes of the same
+    /// size.
+    std::map<unsigned, std::vector<uint64_t> > freeExtents;
+
+    uint64_t bytesSpilled;
+
+  public:
+    SpillFile() : fd(-1), end(0), bytesSpilled(0) {}
+    ~SpillFile();
+
+    /// Create the backing file at \a path. Returns false on failure.
+    bool open(const std::string &path);
+    bool isOpen() const { return fd >= 0; }
+
+    /// Write \a size bytes and return the offset they were written at
+    /// in \a offset. Returns false if the data could not be written.
+    bool write(const uint8_t *data, unsigned size, uint64_t &offset);
+
+    /// Read back \a size bytes written at \a offset and release the
+    /// extent.
+    void read(uint64_t offset, uint8_t *data, unsigned size);
+
+    /// Release an extent which will not be read back.
+    void release(uint64_t offset, unsigned size);
+
+    /// Number of bytes currently stored in the file.
+    uint64_t getBytesSpilled() const { return bytesSpilled; }
+  };
+
+} // End klee namespace
+
+#endif
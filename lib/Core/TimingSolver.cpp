@@ -32,6 +32,13 @@ bool TimingSolver::evaluate(const ExecutionState& state, ref<Expr> expr,
     return true;
   }
 
+  // Rebuilding a dormant state, reuse the answer it got.
+  if (state.replay) {
+    bool success;
+    if (state.replay->nextValidity(success, result))
+      return success;
+  }
+
   sys::TimeValue now = util::getWallTimeVal();
 
   if (simplifyExprs)
@@ -44,6 +51,9 @@ bool TimingSolver::evaluate(const ExecutionState& state, ref<Expr> expr,
   stats::solverTime += delta.usec();
   state.queryCost += delta.usec()/1000000.;
 
+  if (!state.replayLog.isNull())
+    state.replayLog->addValidity(success, result);
+
   return success;
 }
 
@@ -55,6 +65,12 @@ bool TimingSolver::mustBeTrue(const ExecutionState& state, ref<Expr> expr,
     return true;
   }
 
+  if (state.replay) {
+    bool success;
+    if (state.replay->nextTruth(success, result))
+      return success;
+  }
+
   sys::TimeValue now = util::getWallTimeVal();
 
   if (simplifyExprs)
@@ -67,6 +83,9 @@ bool TimingSolver::mustBeTrue(const ExecutionState& state, ref<Expr> expr,
   stats::solverTime += delta.usec();
   state.queryCost += delta.usec()/1000000.;
 
+  if (!state.replayLog.isNull())
+    state.replayLog->addTruth(success, result);
+
   return success;
 }
 
@@ -100,6 +119,12 @@ bool TimingSolver::getValue(const ExecutionState& state, ref<Expr> expr,
     result = CE;
     return true;
   }
+
+  if (state.replay) {
+    bool success;
+    if (state.replay->nextValue(success, result))
+      return success;
+  }
   
   sys::TimeValue now = util::getWallTimeVal();
 
@@ -113,6 +138,9 @@ bool TimingSolver::getValue(const ExecutionState& state, ref<Expr> expr,
   stats::solverTime += delta.usec();
   state.queryCost += delta.usec()/1000000.;
 
+  if (!state.replayLog.isNull())
+    state.replayLog->addValue(success, result);
+
   return success;
 }
 
@@ -141,5 +169,14 @@ TimingSolver::getInitialValues(const ExecutionState& state,
 
 std::pair< ref<Expr>, ref<Expr> >
 TimingSolver::getRange(const ExecutionState& state, ref<Expr> expr) {
-  return solver->getRange(Query(state.constraints, expr));
+  std::pair< ref<Expr>, ref<Expr> > result;
+  if (state.replay && state.replay->nextRange(result))
+    return result;
+
+  result = solver->getRange(Query(state.constraints, expr));
+
+  if (!state.replayLog.isNull())
+    state.replayLog->addRange(result);
+
+  return result;
 }
@@ -61,6 +61,21 @@ namespace {
   UseBumpMerge("use-bump-merge", 
            cl::desc("Enable support for klee_merge() (extra experimental)"));
 
+  cl::opt<bool>
+  UseDynamicMerge("use-dynamic-merge",
+                  cl::desc("Merge states with the same stack which meet, letting the one behind catch up (experimental)"),
+                  cl::init(false));
+
+  cl::opt<unsigned>
+  DynamicMergeMaxLag("dynamic-merge-max-lag",
+                     cl::desc("Most instructions a state may be behind another one to catch up with it when using --use-dynamic-merge"),
+                     cl::init(32));
+
+  cl::opt<unsigned>
+  DynamicMergeMaxNewSymbolic("dynamic-merge-max-new-symbolic",
+                             cl::desc("Most values concrete in both states a merge may make symbolic when using --use-dynamic-merge"),
+                             cl::init(2));
+
 }
 
 
@@ -69,7 +84,8 @@ bool klee::userSearcherRequiresMD2U() {
 	  std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_CovNew) != CoreSearch.end() ||
 	  std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_ICnt) != CoreSearch.end() ||
 	  std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_CPICnt) != CoreSearch.end() ||
-	  std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_QC) != CoreSearch.end());
+	  std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_QC) != CoreSearch.end() ||
+	  UseDynamicMerge);
 }
 
 
@@ -123,6 +139,12 @@ Searcher *klee::constructUserSearcher(Executor &executor) {
   } else if (UseBumpMerge) {
     searcher = new BumpMergingSearcher(executor, searcher);
   }
+
+  if (UseDynamicMerge) {
+    searcher = new DynamicMergingSearcher(executor, searcher,
+                                          DynamicMergeMaxLag,
+                                          DynamicMergeMaxNewSymbolic);
+  }
   
   if (UseIterativeDeepeningTimeSearch) {
     searcher = new IterativeDeepeningTimeSearcher(searcher);
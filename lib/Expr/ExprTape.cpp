@@ -0,0 +1,364 @@
+//===-- ExprTape.cpp ------------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/util/ExprTape.h"
+
+#include "klee/util/Assignment.h"
+
+using namespace klee;
+
+static inline uint64_t getMask(Expr::Width w) {
+  return w >= 64 ? ~0ULL : (1ULL << w) - 1;
+}
+
+static inline int64_t signExtend(uint64_t v, Expr::Width w) {
+  unsigned shift = 64 - w;
+  return (int64_t)(v << shift) >> shift;
+}
+
+unsigned ExprTape::newSlot() {
+  values.resize((numSlots + 1) * Lanes);
+  undefined.resize((numSlots + 1) * Lanes);
+  return numSlots++;
+}
+
+unsigned ExprTape::getArrayIndex(const Array *array) {
+  std::map<const Array *, unsigned>::iterator it = arrayIndices.find(array);
+  if (it != arrayIndices.end())
+    return it->second;
+  unsigned index = arrays.size();
+  arrays.push_back(array);
+  arrayIndices.insert(std::make_pair(array, index));
+  return index;
+}
+
+unsigned ExprTape::compile(const ref<Expr> &e) {
+  std::map<const Expr *, unsigned>::iterator it = slots.find(e.get());
+  if (it != slots.end())
+    return it->second;
+
+  if (e->getWidth() > 64) {
+    valid = false;
+    return 0;
+  }
+
+  if (ConstantExpr *ce = dyn_cast<ConstantExpr>(e)) {
+    unsigned slot = newSlot();
+    uint64_t value = ce->getZExtValue();
+    for (unsigned l = 0; l != Lanes; ++l)
+      values[slot * Lanes + l] = value;
+    slots.insert(std::make_pair(e.get(), slot));
+    return slot;
+  }
+
+  if (NotOptimizedExpr *noe = dyn_cast<NotOptimizedExpr>(e)) {
+    unsigned slot = compile(noe->src);
+    slots.insert(std::make_pair(e.get(), slot));
+    return slot;
+  }
+
+  Instruction ins;
+  ins.kind = e->getKind();
+  ins.width = e->getWidth();
+  ins.aux = 0;
+  ins.ops[0] = ins.ops[1] = ins.ops[2] = 0;
+  ins.numOps = e->getNumKids();
+
+  switch (e->getKind()) {
+  case Expr::Read: {
+    ReadExpr *re = cast<ReadExpr>(e);
+    Read read;
+    read.root = re->updates.root;
+    read.array = getArrayIndex(read.root);
+    for (const UpdateNode *un = re->updates.head; un; un = un->next)
+      read.updates.push_back(
+          std::make_pair(compile(un->index), compile(un->value)));
+    for (unsigned i = 0, n = read.root->constantValues.size(); i != n; ++i)
+      read.constants.push_back(read.root->constantValues[i]->getZExtValue());
+    ins.ops[0] = compile(re->index);
+    ins.numOps = 1;
+    ins.aux = reads.size();
+    reads.push_back(read);
+    break;
+  }
+  case Expr::Extract:
+    ins.ops[0] = compile(e->getKid(0));
+    ins.aux = cast<ExtractExpr>(e)->offset;
+    break;
+  case Expr::ZExt:
+  case Expr::SExt:
+    ins.ops[0] = compile(e->getKid(0));
+    ins.aux = e->getKid(0)->getWidth();
+    break;
+  case Expr::Slt:
+  case Expr::Sle:
+  case Expr::Sgt:
+  case Expr::Sge:
+    // Signed comparisons need the width of their operands.
+    ins.ops[0] = compile(e->getKid(0));
+    ins.ops[1] = compile(e->getKid(1));
+    ins.aux = e->getKid(0)->getWidth();
+    break;
+  case Expr::Concat:
+    ins.ops[0] = compile(e->getKid(0));
+    ins.ops[1] = compile(e->getKid(1));
+    ins.aux = e->getKid(1)->getWidth();
+    break;
+  default:
+    for (unsigned i = 0; i != e->getNumKids(); ++i)
+      ins.ops[i] = compile(e->getKid(i));
+    break;
+  }
+
+  if (!valid)
+    return 0;
+  ins.result = newSlot();
+  instructions.push_back(ins);
+  slots.insert(std::make_pair(e.get(), ins.result));
+  return ins.result;
+}
+
+bool ExprTape::addConstraint(const ref<Expr> &constraint) {
+  if (valid) {
+    held.push_back(constraint);
+    constraints.push_back(compile(constraint));
+  }
+  return valid;
+}
+
+void ExprTape::evaluate(const Assignment *const *assignments, unsigned count,
+                        bool *satisfied) {
+  assert(valid && "evaluating an unusable tape");
+  assert(count <= Lanes && "too many assignments");
+
+  // The bindings of every array in every lane; missing ones read as 0,
+  // as in Assignment::evaluate().
+  std::vector<const unsigned char *> data(arrays.size() * Lanes, 0);
+  std::vector<size_t> sizes(arrays.size() * Lanes, 0);
+  for (unsigned a = 0; a != arrays.size(); ++a) {
+    for (unsigned l = 0; l != count; ++l) {
+      Assignment::bindings_ty::const_iterator it =
+          assignments[l]->bindings.find(arrays[a]);
+      if (it != assignments[l]->bindings.end() && !it->second.empty()) {
+        data[a * Lanes + l] = &it->second[0];
+        sizes[a * Lanes + l] = it->second.size();
+      }
+    }
+  }
+
+  uint64_t *v = &values[0];
+  unsigned char *u = &undefined[0];
+  for (std::vector<Instruction>::const_iterator it = instructions.begin(),
+                                                ie = instructions.end();
+       it != ie; ++it) {
+    const Instruction &ins = *it;
+    uint64_t *__restrict r = v + ins.result * Lanes;
+    const uint64_t *a = v + ins.ops[0] * Lanes;
+    const uint64_t *b = v + ins.ops[1] * Lanes;
+    const uint64_t *c = v + ins.ops[2] * Lanes;
+    Expr::Width w = ins.width;
+    uint64_t m = getMask(w);
+
+    // A result is undefined when an operand is; selects and reads below
+    // only look at the operands they use.
+    unsigned char *__restrict ur = u + ins.result * Lanes;
+    const unsigned char *ua = u + ins.ops[0] * Lanes;
+    const unsigned char *ub = u + ins.ops[1] * Lanes;
+    const unsigned char *uc = u + ins.ops[2] * Lanes;
+    for (unsigned l = 0; l != Lanes; ++l)
+      ur[l] = ins.numOps > 0 && ua[l];
+    for (unsigned i = 1; i < ins.numOps; ++i) {
+      const unsigned char *uo = u + ins.ops[i] * Lanes;
+      for (unsigned l = 0; l != Lanes; ++l)
+        ur[l] |= uo[l];
+    }
+
+    switch (ins.kind) {
+    case Expr::Read: {
+      const Read &read = reads[ins.aux];
+      for (unsigned l = 0; l != Lanes; ++l) {
+        uint64_t index = a[l];
+        // Like the evaluator, give up at an undefined update index.
+        std::vector<std::pair<unsigned, unsigned> >::const_iterator
+            ui = read.updates.begin(), ue = read.updates.end();
+        for (; ui != ue; ++ui) {
+          ur[l] |= u[ui->first * Lanes + l];
+          if (v[ui->first * Lanes + l] == index)
+            break;
+        }
+        if (ui != ue) {
+          r[l] = v[ui->second * Lanes + l];
+          ur[l] |= u[ui->second * Lanes + l];
+        } else if (index < read.constants.size())
+          r[l] = read.constants[index];
+        else if (index < sizes[read.array * Lanes + l])
+          r[l] = data[read.array * Lanes + l][index] & m;
+        else
+          r[l] = 0;
+      }
+      break;
+    }
+    case Expr::Select:
+      for (unsigned l = 0; l != Lanes; ++l) {
+        r[l] = a[l] ? b[l] : c[l];
+        ur[l] = ua[l] | (a[l] ? ub[l] : uc[l]);
+      }
+      break;
+    case Expr::Concat:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = (a[l] << ins.aux) | b[l];
+      break;
+    case Expr::Extract:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = (a[l] >> ins.aux) & m;
+      break;
+    case Expr::ZExt:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = a[l];
+      break;
+    case Expr::SExt:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = (uint64_t)signExtend(a[l], ins.aux) & m;
+      break;
+    case Expr::Add:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = (a[l] + b[l]) & m;
+      break;
+    case Expr::Sub:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = (a[l] - b[l]) & m;
+      break;
+    case Expr::Mul:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = (a[l] * b[l]) & m;
+      break;
+    case Expr::UDiv:
+      for (unsigned l = 0; l != Lanes; ++l) {
+        ur[l] |= !b[l];
+        r[l] = b[l] ? a[l] / b[l] : 0;
+      }
+      break;
+    case Expr::URem:
+      for (unsigned l = 0; l != Lanes; ++l) {
+        ur[l] |= !b[l];
+        r[l] = b[l] ? a[l] % b[l] : 0;
+      }
+      break;
+    case Expr::SDiv:
+      for (unsigned l = 0; l != Lanes; ++l) {
+        int64_t sa = signExtend(a[l], w), sb = signExtend(b[l], w);
+        ur[l] |= !sb;
+        // Dividing by -1 negates, wrapping like APInt does.
+        r[l] = (sb == -1 ? 0 - a[l] : sb ? (uint64_t)(sa / sb) : 0) & m;
+      }
+      break;
+    case Expr::SRem:
+      for (unsigned l = 0; l != Lanes; ++l) {
+        int64_t sa = signExtend(a[l], w), sb = signExtend(b[l], w);
+        ur[l] |= !sb;
+        r[l] = (sb == -1 || !sb ? 0 : (uint64_t)(sa % sb)) & m;
+      }
+      break;
+    case Expr::Not:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = ~a[l] & m;
+      break;
+    case Expr::And:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = a[l] & b[l];
+      break;
+    case Expr::Or:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = a[l] | b[l];
+      break;
+    case Expr::Xor:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = a[l] ^ b[l];
+      break;
+    case Expr::Shl:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = b[l] >= w ? 0 : (a[l] << b[l]) & m;
+      break;
+    case Expr::LShr:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = b[l] >= w ? 0 : a[l] >> b[l];
+      break;
+    case Expr::AShr:
+      for (unsigned l = 0; l != Lanes; ++l) {
+        int64_t sa = signExtend(a[l], w);
+        r[l] = (uint64_t)(sa >> (b[l] >= w ? w - 1 : b[l])) & m;
+      }
+      break;
+    case Expr::Eq:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = a[l] == b[l];
+      break;
+    case Expr::Ne:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = a[l] != b[l];
+      break;
+    case Expr::Ult:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = a[l] < b[l];
+      break;
+    case Expr::Ule:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = a[l] <= b[l];
+      break;
+    case Expr::Ugt:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = a[l] > b[l];
+      break;
+    case Expr::Uge:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = a[l] >= b[l];
+      break;
+    case Expr::Slt:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = signExtend(a[l], ins.aux) < signExtend(b[l], ins.aux);
+      break;
+    case Expr::Sle:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = signExtend(a[l], ins.aux) <= signExtend(b[l], ins.aux);
+      break;
+    case Expr::Sgt:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = signExtend(a[l], ins.aux) > signExtend(b[l], ins.aux);
+      break;
+    case Expr::Sge:
+      for (unsigned l = 0; l != Lanes; ++l)
+        r[l] = signExtend(a[l], ins.aux) >= signExtend(b[l], ins.aux);
+      break;
+    default:
+      assert(0 && "invalid expression kind");
+    }
+  }
+
+  for (unsigned l = 0; l != count; ++l) {
+    bool ok = true;
+    for (unsigned i = 0; ok && i != constraints.size(); ++i)
+      ok = v[constraints[i] * Lanes + l] == 1 &&
+           !u[constraints[i] * Lanes + l];
+    satisfied[l] = ok;
+  }
+}
+
+int ExprTape::findSatisfying(
+    const std::vector<const Assignment *> &assignments) {
+  bool satisfied[Lanes];
+  for (unsigned i = 0; i < assignments.size(); i += Lanes) {
+    unsigned count = std::min((unsigned)Lanes,
+                              (unsigned)assignments.size() - i);
+    evaluate(&assignments[i], count, satisfied);
+    for (unsigned l = 0; l != count; ++l)
+      if (satisfied[l])
+        return i + l;
+  }
+  return -1;
+}
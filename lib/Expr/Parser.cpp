@@ -110,7 +110,8 @@ namespace {
     const std::string Filename;
     const MemoryBuffer *TheMemoryBuffer;
     ExprBuilder *Builder;
-    ArrayCache TheArrayCache;
+    ArrayCache OwnArrayCache;
+    ArrayCache *TheArrayCache;
 
     Lexer TheLexer;
     unsigned MaxErrors;
@@ -324,12 +325,15 @@ namespace {
   public:
     ParserImpl(const std::string _Filename,
                const MemoryBuffer *MB,
-               ExprBuilder *_Builder) : Filename(_Filename),
-                                        TheMemoryBuffer(MB),
-                                        Builder(_Builder),
-                                        TheLexer(MB),
-                                        MaxErrors(~0u),
-                                        NumErrors(0) {}
+               ExprBuilder *_Builder,
+               ArrayCache *_Cache) : Filename(_Filename),
+                                     TheMemoryBuffer(MB),
+                                     Builder(_Builder),
+                                     TheArrayCache(_Cache ? _Cache
+                                                          : &OwnArrayCache),
+                                     TheLexer(MB),
+                                     MaxErrors(~0u),
+                                     NumErrors(0) {}
 
     virtual ~ParserImpl();
 
@@ -525,10 +529,10 @@ DeclResult ParserImpl::ParseArrayDecl() {
   const Identifier *Label = GetOrCreateIdentifier(Name);
   const Array *Root;
   if (!Values.empty())
-    Root = TheArrayCache.CreateArray(Label->Name, Size.get(), &Values[0],
+    Root = TheArrayCache->CreateArray(Label->Name, Size.get(), &Values[0],
                                      &Values[0] + Values.size());
   else
-    Root = TheArrayCache.CreateArray(Label->Name, Size.get());
+    Root = TheArrayCache->CreateArray(Label->Name, Size.get());
   ArrayDecl *AD = new ArrayDecl(Label, Size.get(), 
                                 DomainType.get(), RangeType.get(), Root);
 
@@ -1312,7 +1316,7 @@ VersionResult ParserImpl::ParseVersionSpecifier() {
   if (!Res.isValid()) {
     // FIXME: I'm not sure if this is right. Do we need a unique array here?
     Res =
-        VersionResult(true, UpdateList(TheArrayCache.CreateArray("", 0), NULL));
+        VersionResult(true, UpdateList(TheArrayCache->CreateArray("", 0), NULL));
   }
   
   if (Label)
@@ -1643,8 +1647,9 @@ Parser::~Parser() {
 
 Parser *Parser::Create(const std::string Filename,
                        const MemoryBuffer *MB,
-                       ExprBuilder *Builder) {
-  ParserImpl *P = new ParserImpl(Filename, MB, Builder);
+                       ExprBuilder *Builder,
+                       ArrayCache *Cache) {
+  ParserImpl *P = new ParserImpl(Filename, MB, Builder, Cache);
   P->Initialize();
   return P;
 }
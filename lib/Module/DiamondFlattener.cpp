@@ -0,0 +1,165 @@
+//===-- DiamondFlattener.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Passes.h"
+
+#include "klee/Config/Version.h"
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
+#include "llvm/IR/IntrinsicInst.h"
+#else
+#include "llvm/IntrinsicInst.h"
+#endif
+
+using namespace llvm;
+
+char klee::DiamondFlattenerPass::ID = 0;
+
+/// Whether \a i may be executed whether or not its block would have been.
+static bool isSpeculatable(const Instruction &i) {
+  // The executor concretizes floating point operands, or fails on
+  // unsupported widths, so these may only run on the paths taking them.
+  if (i.getType()->isFPOrFPVectorTy())
+    return false;
+  for (unsigned j = 0, e = i.getNumOperands(); j != e; ++j)
+    if (i.getOperand(j)->getType()->isFPOrFPVectorTy())
+      return false;
+
+  switch (i.getOpcode()) {
+  case Instruction::UDiv:
+  case Instruction::SDiv:
+  case Instruction::URem:
+  case Instruction::SRem:
+    return false;
+  default:
+    return isa<BinaryOperator>(i) || isa<CastInst>(i) || isa<CmpInst>(i) ||
+      isa<SelectInst>(i) || isa<GetElementPtrInst>(i);
+  }
+}
+
+/// Whether \a b is a side of a branch in \a head which can be hoisted
+/// into it, and if so add its size to \a cost.
+static bool isSide(BasicBlock *b, BasicBlock *head, unsigned &cost) {
+  if (b == head || b->getSinglePredecessor() != head || b->hasAddressTaken())
+    return false;
+
+  BranchInst *br = dyn_cast<BranchInst>(b->getTerminator());
+  if (!br || br->isConditional() || br->getSuccessor(0) == b)
+    return false;
+
+  unsigned size = 0;
+  for (BasicBlock::iterator it = b->begin(); &*it != br; ++it) {
+    if (isa<DbgInfoIntrinsic>(*it))
+      continue;
+    if (!isSpeculatable(*it))
+      return false;
+    ++size;
+  }
+  cost += size;
+  return true;
+}
+
+bool klee::DiamondFlattenerPass::flatten(BasicBlock &head) {
+  BranchInst *br = dyn_cast<BranchInst>(head.getTerminator());
+  if (!br || !br->isConditional() ||
+      br->getSuccessor(0) == br->getSuccessor(1))
+    return false;
+
+  // Each way of the branch reaches the join block either through a side
+  // block or directly, as in an if-then triangle.
+  unsigned cost = 0;
+  BasicBlock *sides[2], *preds[2], *targets[2];
+  for (unsigned i = 0; i != 2; ++i) {
+    BasicBlock *succ = br->getSuccessor(i);
+    sides[i] = isSide(succ, &head, cost) ? succ : 0;
+    preds[i] = sides[i] ? sides[i] : &head;
+    targets[i] = sides[i] ? sides[i]->getTerminator()->getSuccessor(0) : succ;
+  }
+  BasicBlock *join = targets[0];
+  if (join != targets[1] || join == &head || (!sides[0] && !sides[1]))
+    return false;
+
+  for (BasicBlock::iterator it = join->begin(); isa<PHINode>(*it); ++it) {
+    PHINode *phi = cast<PHINode>(it);
+    if (phi->getIncomingValueForBlock(preds[0]) !=
+        phi->getIncomingValueForBlock(preds[1]))
+      ++cost;
+  }
+  if (cost > maxCost)
+    return false;
+
+  // Debug intrinsics would describe the variables of a side on both
+  // paths, drop them.
+  for (unsigned i = 0; i != 2; ++i)
+    if (sides[i])
+      while (&sides[i]->front() != sides[i]->getTerminator()) {
+        Instruction *inst = &sides[i]->front();
+        if (isa<DbgInfoIntrinsic>(inst))
+          inst->eraseFromParent();
+        else
+          inst->moveBefore(br);
+      }
+
+  Value *condition = br->getCondition();
+  for (BasicBlock::iterator it = join->begin(); isa<PHINode>(*it); ++it) {
+    PHINode *phi = cast<PHINode>(it);
+    Value *values[2];
+    for (unsigned i = 0; i != 2; ++i) {
+      values[i] = phi->getIncomingValueForBlock(preds[i]);
+      phi->removeIncomingValue(preds[i], false);
+    }
+    if (values[0] != values[1])
+      values[0] = SelectInst::Create(condition, values[0], values[1],
+                                     phi->getName() + ".flat", br);
+    phi->addIncoming(values[0], &head);
+  }
+
+  br->eraseFromParent();
+  BranchInst::Create(join, &head);
+  for (unsigned i = 0; i != 2; ++i)
+    if (sides[i])
+      sides[i]->eraseFromParent();
+
+  // Merge the join block when the region was all that led there, so the
+  // code after it may form a region with the head in turn.
+  if (join->getSinglePredecessor() == &head && !join->hasAddressTaken()) {
+    while (PHINode *phi = dyn_cast<PHINode>(join->begin())) {
+      phi->replaceAllUsesWith(phi->getIncomingValue(0));
+      phi->eraseFromParent();
+    }
+    TerminatorInst *term = join->getTerminator();
+    for (unsigned i = 0, e = term->getNumSuccessors(); i != e; ++i) {
+      BasicBlock *succ = term->getSuccessor(i);
+      for (BasicBlock::iterator it = succ->begin(); isa<PHINode>(*it); ++it) {
+        PHINode *phi = cast<PHINode>(it);
+        for (unsigned j = 0, je = phi->getNumIncomingValues(); j != je; ++j)
+          if (phi->getIncomingBlock(j) == join)
+            phi->setIncomingBlock(j, &head);
+      }
+    }
+    head.getTerminator()->eraseFromParent();
+    head.getInstList().splice(head.end(), join->getInstList());
+    join->eraseFromParent();
+  }
+  return true;
+}
+
+bool klee::DiamondFlattenerPass::runOnFunction(Function &f) {
+  bool changed = false;
+
+  // Flattening a region may turn an enclosing one into a candidate, so
+  // go over the function until nothing changes.
+  for (bool again = true; again; ) {
+    again = false;
+    for (Function::iterator b = f.begin(), be = f.end(); b != be; ++b)
+      while (flatten(*b))
+        again = changed = true;
+  }
+
+  return changed;
+}
@@ -96,6 +96,19 @@ namespace {
                         clEnumValEnd),
              cl::init(eSwitchTypeInternal));
   
+  cl::opt<bool>
+  FlattenDiamonds("flatten-diamonds",
+                  cl::desc("Join small branches which only compute values "
+                           "with select instead of forking (default=off)"),
+                  cl::init(false));
+
+  cl::opt<unsigned>
+  FlattenDiamondsMaxCost("flatten-diamonds-max-cost",
+                         cl::desc("Largest number of instructions and selects "
+                                  "of a branch joined by --flatten-diamonds "
+                                  "(default=12)"),
+                         cl::init(12));
+
   cl::opt<bool>
   DebugPrintEscapingFunctions("debug-print-escaping-functions", 
                               cl::desc("Print functions whose address is taken."));
@@ -373,6 +386,8 @@ void KModule::prepare(const Interpreter::ModuleOptions &opts,
   default: klee_error("invalid --switch-type");
   }
   pm3.add(new IntrinsicCleanerPass(*targetData));
+  if (FlattenDiamonds)
+    pm3.add(new DiamondFlattenerPass(FlattenDiamondsMaxCost));
   pm3.add(new PhiCleanerPass());
   pm3.run(*module);
 #if LLVM_VERSION_CODE < LLVM_VERSION(3, 3)
@@ -564,6 +579,8 @@ KFunction::KFunction(llvm::Function *_function,
 
       ki->inst = it;      
       ki->dest = registerMap[it];
+      ki->width = it->getType()->isSized() ?
+        km->targetData->getTypeSizeInBits(it->getType()) : 0;
 
       if (isa<CallInst>(it) || isa<InvokeInst>(it)) {
         CallSite cs(it);
@@ -177,6 +177,30 @@ private:
                      llvm::BasicBlock *defaultBlock);
 };
 
+/// DiamondFlattenerPass - Replace small if/else diamonds and if-then
+/// triangles, whose sides only compute values, with straight-line code
+/// and select instructions. The executor then evaluates both sides and
+/// joins them in an ite expression instead of forking.
+///
+/// A side may contain arithmetic, casts, comparisons, selects and
+/// address computations, but no memory accesses, calls or divisions,
+/// which could have effects or fail when speculated. The cost of a
+/// region, its instructions plus the selects it needs, is bounded so
+/// that the expressions do not grow too large for the solver.
+class DiamondFlattenerPass : public llvm::FunctionPass {
+  static char ID;
+
+  unsigned maxCost;
+
+  bool flatten(llvm::BasicBlock &head);
+
+public:
+  explicit DiamondFlattenerPass(unsigned _maxCost)
+    : llvm::FunctionPass(ID), maxCost(_maxCost) {}
+
+  virtual bool runOnFunction(llvm::Function &f);
+};
+
 }
 
 #endif
@@ -0,0 +1,50 @@
+//===-- AssertionStack.h ----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_ASSERTIONSTACK_H
+#define KLEE_ASSERTIONSTACK_H
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+
+#include <vector>
+
+namespace klee {
+
+/// AssertionStack - The constraints asserted in a live solver context
+/// for --solver-incremental, one push level each. States forked from
+/// one another share a prefix of their constraints, so a query from a
+/// sibling or a descendant of the last queried state only has to pop
+/// the levels past the shared prefix and assert its own suffix.
+class AssertionStack {
+  std::vector< ref<Expr> > asserted;
+
+public:
+  unsigned size() const { return asserted.size(); }
+
+  /// Number of asserted levels that \a constraints begins with.
+  unsigned sharedPrefix(const ConstraintManager &constraints) const {
+    unsigned n = 0;
+    for (ConstraintManager::const_iterator it = constraints.begin(),
+           ie = constraints.end(); it != ie && n < asserted.size(); ++it, ++n)
+      if (asserted[n] != *it)
+        break;
+    return n;
+  }
+
+  /// Record that the levels past \a n were popped.
+  void truncate(unsigned n) { asserted.resize(n); }
+
+  /// Record a constraint asserted in a new level.
+  void push(ref<Expr> e) { asserted.push_back(e); }
+};
+
+}
+
+#endif
@@ -0,0 +1,178 @@
+//===-- AsyncSolver.cpp ---------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/AsyncSolver.h"
+
+#include "SolverWorker.h"
+
+#include "klee/SolverStats.h"
+#include "klee/Internal/System/Time.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <poll.h>
+
+using namespace klee;
+
+AsyncSolver::AsyncSolver(const std::vector<Solver*> &solvers, double _timeout)
+    : timeout(_timeout), nextID(0), jobs(solvers.size()) {
+  for (unsigned i = 0; i != solvers.size(); ++i)
+    workers.push_back(new SolverWorker(solvers[i]));
+}
+
+AsyncSolver::~AsyncSolver() {
+  for (unsigned i = 0; i != workers.size(); ++i)
+    delete workers[i];
+}
+
+void AsyncSolver::submit(Tag tag, const ConstraintManager &constraints,
+                         ref<Expr> expr) {
+  assert(!ids.count(tag) && "query already in flight");
+  ++stats::asyncQueries;
+  uint64_t id = nextID++;
+  Pending &p = pending[id];
+  p.tag = tag;
+  p.constraints = constraints;
+  p.expr = expr;
+  p.submitted = util::getWallTime();
+  p.sides[0] = p.sides[1] = Unanswered;
+  ids[tag] = id;
+
+  Job job;
+  job.id = id;
+  job.deadline = 0;
+  for (job.side = 0; job.side != 2; ++job.side)
+    queue.push_back(job);
+}
+
+void AsyncSolver::cancel(Tag tag) {
+  std::map<Tag, uint64_t>::iterator it = ids.find(tag);
+  if (it != ids.end())
+    drop(pending.find(it->second));
+}
+
+void AsyncSolver::drop(std::map<uint64_t, Pending>::iterator it) {
+  // A worker still solving the other side is left to finish, killing it
+  // would cost a fork and a warm up for its next job. finish() ignores
+  // its answer, and receive() kills it past its deadline. The queued
+  // jobs are skipped when they come up in the queue.
+  ids.erase(it->second.tag);
+  pending.erase(it);
+}
+
+void AsyncSolver::dispatch(std::vector<Answer> &answers) {
+  for (unsigned i = 0; i != workers.size() && !queue.empty(); ++i) {
+    if (workers[i]->isBusy())
+      continue;
+
+    Job job;
+    std::map<uint64_t, Pending>::iterator it;
+    do {
+      job = queue.front();
+      queue.pop_front();
+      it = pending.find(job.id);
+    } while (it == pending.end() && !queue.empty());
+    if (it == pending.end())
+      break;
+
+    // The expression may be true if there is a counterexample to its
+    // negation, and conversely.
+    Pending &p = it->second;
+    ref<Expr> expr = job.side ? p.expr : Expr::createIsZero(p.expr);
+    SolverImpl::SolverRunStatus status;
+    if (workers[i]->send(Query(p.constraints, expr),
+                         std::vector<const Array*>(), status)) {
+      job.deadline = timeout ? util::getWallTime() + timeout : 0;
+      jobs[i] = job;
+    } else {
+      finish(job, status, false, answers);
+    }
+  }
+}
+
+void AsyncSolver::receive(unsigned worker, std::vector<Answer> &answers) {
+  std::vector<std::vector<unsigned char> > values;
+  bool hasSolution = false;
+  SolverImpl::SolverRunStatus status =
+    workers[worker]->receive(values, hasSolution, jobs[worker].deadline);
+  finish(jobs[worker], status, hasSolution, answers);
+}
+
+void AsyncSolver::finish(const Job &job, SolverImpl::SolverRunStatus status,
+                         bool hasSolution, std::vector<Answer> &answers) {
+  std::map<uint64_t, Pending>::iterator it = pending.find(job.id);
+  if (it == pending.end())
+    return;
+
+  Pending &p = it->second;
+  Answer answer;
+  answer.tag = p.tag;
+  answer.expr = p.expr;
+  answer.success = true;
+  answer.timedOut = false;
+  answer.validity = Solver::Unknown;
+  answer.time = util::getWallTime() - p.submitted;
+
+  if (status != SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE &&
+      status != SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
+    answer.success = false;
+    answer.timedOut = status == SolverImpl::SOLVER_RUN_STATUS_TIMEOUT;
+  } else if (!hasSolution) {
+    answer.validity = job.side ? Solver::True : Solver::False;
+  } else {
+    p.sides[job.side] = Possible;
+    if (p.sides[!job.side] != Possible)
+      return;
+  }
+
+  drop(it);
+  answers.push_back(answer);
+}
+
+void AsyncSolver::poll(bool wait, std::vector<Answer> &answers) {
+  unsigned numAnswers = answers.size();
+  for (;;) {
+    dispatch(answers);
+
+    std::vector<struct pollfd> fds;
+    double now = util::getWallTime(), deadline = 0;
+    for (unsigned i = 0; i != workers.size(); ++i) {
+      SolverWorker *w = workers[i];
+      if (!w->isBusy())
+        continue;
+      if (w->isReady() || (jobs[i].deadline && now >= jobs[i].deadline)) {
+        // A worker past its deadline is killed by receive().
+        receive(i, answers);
+        continue;
+      }
+      struct pollfd pfd;
+      pfd.fd = w->getFD();
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      fds.push_back(pfd);
+      if (jobs[i].deadline && (!deadline || jobs[i].deadline < deadline))
+        deadline = jobs[i].deadline;
+    }
+
+    if (!wait || answers.size() != numAnswers || pending.empty()) {
+      // Hand the queued jobs to the workers which just became idle.
+      dispatch(answers);
+      return;
+    }
+    if (fds.empty()) {
+      if (queue.empty())
+        return;
+      continue;
+    }
+
+    int ms = deadline ? std::max(0, (int)((deadline - now) * 1000)) + 1 : -1;
+    if (::poll(&fds[0], fds.size(), ms) < 0 && errno == EINTR)
+      return;
+  }
+}
@@ -0,0 +1,247 @@
+//===-- CanonicalizingSolver.cpp ------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "QueryHash.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+#include "klee/util/ArrayCache.h"
+
+#include "llvm/ADT/StringExtras.h"
+
+using namespace klee;
+
+namespace {
+/// QueryCanonicalizer - Rewrites the expressions of a single query into
+/// canonical form: symbolic arrays are replaced by canonical arrays
+/// numbered in first-use order, and the operands of commutative
+/// operators are put in an order that does not depend on array names.
+/// Two queries that differ only in these respects are rewritten to the
+/// same expressions.
+class QueryCanonicalizer {
+  ArrayCache &arrayCache;
+  /// Hashes operands by shape, to order the operands of commutative
+  /// operators before any of their arrays are numbered.
+  QueryHasher shapes;
+  std::map<const Expr *, ref<Expr> > exprs;
+  std::map<const UpdateNode *, UpdateList> updates;
+  std::map<const Array *, const Array *> arrays;
+
+  UpdateList visitUpdates(const UpdateList &ul);
+  bool isCommutative(const Expr &e);
+
+public:
+  QueryCanonicalizer(ArrayCache &_arrayCache)
+      : arrayCache(_arrayCache), shapes(false) {}
+
+  ref<Expr> visit(const ref<Expr> &e);
+
+  /// The canonical array for \a array, numbering it if it was not seen
+  /// yet. Constant arrays are already identified by their contents and
+  /// are kept.
+  const Array *getArray(const Array *array);
+};
+
+class CanonicalizingSolver : public SolverImpl {
+private:
+  Solver *solver;
+  ArrayCache arrayCache;
+
+  void canonicalize(QueryCanonicalizer &canonicalizer, const Query &query,
+                    std::vector<ref<Expr> > &constraints, ref<Expr> &expr);
+
+public:
+  CanonicalizingSolver(Solver *_solver) : solver(_solver) {}
+  ~CanonicalizingSolver() { delete solver; }
+
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValidity(const Query &, Solver::Validity &result);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+  char *getConstraintLog(const Query &);
+  void setCoreSolverTimeout(double timeout);
+};
+}
+
+const Array *QueryCanonicalizer::getArray(const Array *array) {
+  if (array->isConstantArray())
+    return array;
+
+  std::map<const Array *, const Array *>::iterator it = arrays.find(array);
+  if (it != arrays.end())
+    return it->second;
+
+  // The cache keeps one array per name and size, so the name carries the
+  // rest of the shape.
+  std::string name = "canon" + llvm::utostr(arrays.size());
+  if (array->domain != Expr::Int32 || array->range != Expr::Int8)
+    name += "_" + llvm::utostr(array->domain) + "_" +
+            llvm::utostr(array->range);
+  const Array *canonical = arrayCache.CreateArray(
+      name, array->size, 0, 0, array->domain, array->range);
+  arrays.insert(std::make_pair(array, canonical));
+  return canonical;
+}
+
+UpdateList QueryCanonicalizer::visitUpdates(const UpdateList &ul) {
+  // Rewrite from the oldest update forwards, reusing the rewritten
+  // prefix shared with lists seen before.
+  std::vector<const UpdateNode *> pending;
+  const UpdateNode *un = ul.head;
+  std::map<const UpdateNode *, UpdateList>::iterator it = updates.end();
+  for (; un; un = un->next) {
+    it = updates.find(un);
+    if (it != updates.end())
+      break;
+    pending.push_back(un);
+  }
+
+  UpdateList result =
+      un ? it->second : UpdateList(getArray(ul.root), 0);
+  while (!pending.empty()) {
+    un = pending.back();
+    pending.pop_back();
+    ref<Expr> index = visit(un->index);
+    result.extend(index, visit(un->value));
+    updates.insert(std::make_pair(un, result));
+  }
+  return result;
+}
+
+bool QueryCanonicalizer::isCommutative(const Expr &e) {
+  switch (e.getKind()) {
+  case Expr::Add:
+  case Expr::Mul:
+  case Expr::And:
+  case Expr::Or:
+  case Expr::Xor:
+  case Expr::Eq:
+    return true;
+  default:
+    return false;
+  }
+}
+
+ref<Expr> QueryCanonicalizer::visit(const ref<Expr> &e) {
+  if (isa<ConstantExpr>(e))
+    return e;
+
+  std::map<const Expr *, ref<Expr> >::iterator it = exprs.find(e.get());
+  if (it != exprs.end())
+    return it->second;
+
+  ref<Expr> result;
+  if (ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+    UpdateList ul = visitUpdates(re->updates);
+    result = ReadExpr::create(ul, visit(re->index));
+  } else {
+    ref<Expr> kids[8];
+    unsigned count = e->getNumKids();
+    assert(count <= 8 && "too many kids");
+    if (isCommutative(*e) && !isa<ConstantExpr>(e->getKid(0)) &&
+        shapes.hash(e->getKid(1)) < shapes.hash(e->getKid(0))) {
+      // Visit in the canonical order as well, so that the arrays are
+      // numbered in it.
+      kids[0] = visit(e->getKid(1));
+      kids[1] = visit(e->getKid(0));
+    } else {
+      for (unsigned i = 0; i != count; ++i)
+        kids[i] = visit(e->getKid(i));
+    }
+    result = e->rebuild(kids);
+  }
+
+  exprs.insert(std::make_pair(e.get(), result));
+  return result;
+}
+
+void CanonicalizingSolver::canonicalize(QueryCanonicalizer &canonicalizer,
+                                        const Query &query,
+                                        std::vector<ref<Expr> > &constraints,
+                                        ref<Expr> &expr) {
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                         ie = query.constraints.end();
+       it != ie; ++it)
+    constraints.push_back(canonicalizer.visit(*it));
+  expr = canonicalizer.visit(query.expr);
+}
+
+bool CanonicalizingSolver::computeValidity(const Query &query,
+                                           Solver::Validity &result) {
+  QueryCanonicalizer canonicalizer(arrayCache);
+  std::vector<ref<Expr> > constraints;
+  ref<Expr> expr;
+  canonicalize(canonicalizer, query, constraints, expr);
+  ConstraintManager cm(constraints);
+  return solver->impl->computeValidity(Query(cm, expr), result);
+}
+
+bool CanonicalizingSolver::computeTruth(const Query &query, bool &isValid) {
+  QueryCanonicalizer canonicalizer(arrayCache);
+  std::vector<ref<Expr> > constraints;
+  ref<Expr> expr;
+  canonicalize(canonicalizer, query, constraints, expr);
+  ConstraintManager cm(constraints);
+  return solver->impl->computeTruth(Query(cm, expr), isValid);
+}
+
+bool CanonicalizingSolver::computeValue(const Query &query,
+                                        ref<Expr> &result) {
+  QueryCanonicalizer canonicalizer(arrayCache);
+  std::vector<ref<Expr> > constraints;
+  ref<Expr> expr;
+  canonicalize(canonicalizer, query, constraints, expr);
+  ConstraintManager cm(constraints);
+  return solver->impl->computeValue(Query(cm, expr), result);
+}
+
+bool CanonicalizingSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  QueryCanonicalizer canonicalizer(arrayCache);
+  std::vector<ref<Expr> > constraints;
+  ref<Expr> expr;
+  canonicalize(canonicalizer, query, constraints, expr);
+  ConstraintManager cm(constraints);
+
+  // Objects the query does not mention are numbered after the ones it
+  // does. The values come back in the order of the objects, so they need
+  // no mapping back.
+  std::vector<const Array *> canonicalObjects;
+  canonicalObjects.reserve(objects.size());
+  for (unsigned i = 0; i != objects.size(); ++i)
+    canonicalObjects.push_back(canonicalizer.getArray(objects[i]));
+
+  return solver->impl->computeInitialValues(Query(cm, expr), canonicalObjects,
+                                            values, hasSolution);
+}
+
+SolverImpl::SolverRunStatus CanonicalizingSolver::getOperationStatusCode() {
+  return solver->impl->getOperationStatusCode();
+}
+
+char *CanonicalizingSolver::getConstraintLog(const Query &query) {
+  return solver->impl->getConstraintLog(query);
+}
+
+void CanonicalizingSolver::setCoreSolverTimeout(double timeout) {
+  solver->impl->setCoreSolverTimeout(timeout);
+}
+
+///
+
+Solver *klee::createCanonicalizingSolver(Solver *s) {
+  return new Solver(new CanonicalizingSolver(s));
+}
@@ -9,14 +9,17 @@
 
 #include "klee/Solver.h"
 
+#include "ConstraintJIT.h"
+
 #include "klee/Constraints.h"
 #include "klee/Expr.h"
 #include "klee/SolverImpl.h"
 #include "klee/TimerStatIncrementer.h"
 #include "klee/util/Assignment.h"
+#include "klee/util/ExprTape.h"
 #include "klee/util/ExprUtil.h"
 #include "klee/util/ExprVisitor.h"
-#include "klee/Internal/ADT/MapOfSets.h"
+#include "klee/Internal/ADT/BitsetMapOfSets.h"
 
 #include "klee/SolverStats.h"
 
@@ -44,6 +47,20 @@ namespace {
   cl::opt<bool>
   CexCacheExperimental("cex-cache-exp", cl::init(false));
 
+  cl::opt<unsigned>
+  CexCacheBudget("cex-cache-budget",
+                 cl::desc("Approximate memory in MB for the counterexample cache, least recently used entries are evicted beyond it (0=unlimited, default=1024)"),
+                 cl::init(1024));
+
+  cl::opt<bool>
+  UseConstraintJIT("use-constraint-jit",
+                   cl::desc("Compile the constraint sets the counterexample cache checks often to native code (default=off)"),
+                   cl::init(false));
+
+  cl::opt<unsigned>
+  ConstraintJITThreshold("constraint-jit-threshold",
+                         cl::desc("Number of assignment checks after which a constraint set is compiled (default=256)"),
+                         cl::init(256));
 }
 
 ///
@@ -51,20 +68,27 @@ namespace {
 typedef std::set< ref<Expr> > KeyType;
 
 struct AssignmentLessThan {
-  bool operator()(const Assignment *a, const Assignment *b) {
+  bool operator()(const Assignment *a, const Assignment *b) const {
     return a->bindings < b->bindings;
   }
 };
 
 
 class CexCachingSolver : public SolverImpl {
-  typedef std::set<Assignment*, AssignmentLessThan> assignmentsTable_ty;
+  /// The distinct assignments, with the number of cache entries holding
+  /// each.
+  typedef std::map<Assignment*, unsigned, AssignmentLessThan>
+    assignmentsTable_ty;
 
   Solver *solver;
   
-  MapOfSets<ref<Expr>, Assignment*> cache;
+  BitsetMapOfSets<ref<Expr>, Assignment*> cache;
   // memo table
   assignmentsTable_ty assignmentsTable;
+  /// Compiles the hot constraint sets, or null if disabled.
+  ConstraintJIT *jit;
+
+  void releaseAssignments(const std::vector<Assignment*> &dropped);
 
   bool searchForAssignment(KeyType &key, 
                            Assignment *&result);
@@ -79,7 +103,9 @@ class CexCachingSolver : public SolverImpl {
   bool getAssignment(const Query& query, Assignment *&result);
   
 public:
-  CexCachingSolver(Solver *_solver) : solver(_solver) {}
+  CexCachingSolver(Solver *_solver)
+    : solver(_solver), cache((size_t) CexCacheBudget << 20),
+      jit(UseConstraintJIT ? new ConstraintJIT(ConstraintJITThreshold) : 0) {}
   ~CexCachingSolver();
   
   bool computeTruth(const Query&, bool &isValid);
@@ -106,11 +132,18 @@ struct NonNullAssignment {
 
 struct NullOrSatisfyingAssignment {
   KeyType &key;
+  const CompiledPredicate *predicate;
   
-  NullOrSatisfyingAssignment(KeyType &_key) : key(_key) {}
+  NullOrSatisfyingAssignment(KeyType &_key,
+                             const CompiledPredicate *_predicate)
+    : key(_key), predicate(_predicate) {}
 
   bool operator()(Assignment *a) const { 
-    return !a || a->satisfies(key.begin(), key.end()); 
+    if (!a)
+      return true;
+    if (predicate)
+      return predicate->satisfies(*a);
+    return a->satisfies(key.begin(), key.end()); 
   }
 };
 
@@ -145,15 +178,46 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
       return true;
     }
 
-    // Otherwise, iterate through the set of current assignments to see if one
-    // of them satisfies the query.
-    for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
-           ie = assignmentsTable.end(); it != ie; ++it) {
-      Assignment *a = *it;
-      if (a->satisfies(key.begin(), key.end())) {
-        result = a;
+    // Otherwise, check the set of current assignments to see if one of them
+    // satisfies the query. Hot queries are checked natively, others are
+    // compiled once to a tape and the assignments checked in batches,
+    // unless they have expressions the tape cannot handle.
+    if (CompiledPredicate *predicate =
+          jit ? jit->get(key, assignmentsTable.size()) : 0) {
+      for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
+             ie = assignmentsTable.end(); it != ie; ++it) {
+        if (predicate->satisfies(*it->first)) {
+          result = it->first;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    ExprTape tape;
+    for (KeyType::iterator it = key.begin(), ie = key.end();
+         it != ie && tape.addConstraint(*it); ++it)
+      ;
+    if (tape.isValid()) {
+      std::vector<const Assignment*> candidates;
+      candidates.reserve(assignmentsTable.size());
+      for (assignmentsTable_ty::iterator it = assignmentsTable.begin(),
+             ie = assignmentsTable.end(); it != ie; ++it)
+        candidates.push_back(it->first);
+      int index = tape.findSatisfying(candidates);
+      if (index >= 0) {
+        result = const_cast<Assignment*>(candidates[index]);
         return true;
       }
+    } else {
+      for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
+             ie = assignmentsTable.end(); it != ie; ++it) {
+        Assignment *a = it->first;
+        if (a->satisfies(key.begin(), key.end())) {
+          result = a;
+          return true;
+        }
+      }
     }
   } else {
     // FIXME: Which order? one is sure to be better.
@@ -170,7 +234,8 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
     // satisfiable subsets to see if they solve the current query and return
     // them if so. This is cheap and frequently succeeds.
     if (!lookup) 
-      lookup = cache.findSubset(key, NullOrSatisfyingAssignment(key));
+      lookup = cache.findSubset(key, NullOrSatisfyingAssignment(
+                                  key, jit ? jit->get(key) : 0));
 
     // If either lookup succeeded, then we have a cached solution.
     if (lookup) {
@@ -228,16 +293,23 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
     return false;
     
   Assignment *binding;
+  size_t cost = 0;
   if (hasSolution) {
     binding = new Assignment(objects, values);
 
     // Memoize the result.
     std::pair<assignmentsTable_ty::iterator, bool>
-      res = assignmentsTable.insert(binding);
+      res = assignmentsTable.insert(std::make_pair(binding, 0));
     if (!res.second) {
       delete binding;
-      binding = *res.first;
+      binding = res.first->first;
     }
+    ++res.first->second;
+
+    cost = sizeof(Assignment);
+    for (Assignment::bindings_ty::iterator it = binding->bindings.begin(),
+           ie = binding->bindings.end(); it != ie; ++it)
+      cost += it->second.size();
     
     if (DebugCexCacheCheckBinding)
       if (!binding->satisfies(key.begin(), key.end())) {
@@ -250,19 +322,42 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
   }
   
   result = binding;
-  cache.insert(key, binding);
+  std::vector<Assignment*> dropped;
+  uint64_t evictions = cache.getNumEvictions();
+  cache.insert(key, binding, cost, dropped);
+  stats::cexCacheEvictions += cache.getNumEvictions() - evictions;
+  releaseAssignments(dropped);
 
   return true;
 }
 
+/// releaseAssignments - Drop the cache entries' holds on \arg dropped,
+/// deleting the assignments no entry holds anymore.
+void CexCachingSolver::releaseAssignments(
+    const std::vector<Assignment*> &dropped) {
+  for (std::vector<Assignment*>::const_iterator it = dropped.begin(),
+         ie = dropped.end(); it != ie; ++it) {
+    if (!*it)
+      continue;
+    assignmentsTable_ty::iterator entry = assignmentsTable.find(*it);
+    assert(entry != assignmentsTable.end() && entry->first == *it &&
+           "dropped assignment is not in the table");
+    if (--entry->second == 0) {
+      assignmentsTable.erase(entry);
+      delete *it;
+    }
+  }
+}
+
 ///
 
 CexCachingSolver::~CexCachingSolver() {
-  cache.clear();
+  std::vector<Assignment*> dropped;
+  cache.clear(dropped);
+  releaseAssignments(dropped);
+  assert(assignmentsTable.empty() && "assignments not held by the cache");
+  delete jit;
   delete solver;
-  for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
-         ie = assignmentsTable.end(); it != ie; ++it)
-    delete *it;
 }
 
 bool CexCachingSolver::computeValidity(const Query& query,
@@ -0,0 +1,424 @@
+//===-- ConstraintJIT.cpp -------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ConstraintJIT.h"
+
+#include "klee/Config/Version.h"
+#include "klee/util/Assignment.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include <algorithm>
+
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#else
+#include "llvm/Constants.h"
+#include "llvm/DerivedTypes.h"
+#include "llvm/Function.h"
+#include "llvm/GlobalVariable.h"
+#include "llvm/LLVMContext.h"
+#include "llvm/Module.h"
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 2)
+#include "llvm/IRBuilder.h"
+#else
+#include "llvm/Support/IRBuilder.h"
+#endif
+#endif
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ExecutionEngine/JIT.h"
+
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 0)
+#include "llvm/Target/TargetSelect.h"
+#else
+#include "llvm/Support/TargetSelect.h"
+#endif
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+/// The most constraint sets compiled in one run, which bounds the code
+/// the JIT keeps.
+const unsigned MaxCompiled = 1024;
+/// The most sets whose checks are counted; beyond it the counts of the
+/// sets that were not compiled are dropped.
+const unsigned MaxEntries = 1 << 16;
+
+/// PredicateBuilder - Lowers the constraints of one predicate to LLVM IR.
+class PredicateBuilder {
+  LLVMContext &ctx;
+  Module &module;
+  IRBuilder<> builder;
+  Value *data, *sizes;
+  std::map<const Expr *, Value *> values;
+  std::map<const Array *, unsigned> arrayIndices;
+  std::map<const Array *, GlobalVariable *> constantArrays;
+  /// Whether any division so far had a zero divisor.
+  Value *divByZero;
+
+  Type *getType(Expr::Width w) { return IntegerType::get(ctx, w); }
+  Value *resize(Value *v, Expr::Width w) {
+    unsigned from = cast<IntegerType>(v->getType())->getBitWidth();
+    if (from == w)
+      return v;
+    return from < w ? builder.CreateZExt(v, getType(w))
+                    : builder.CreateTrunc(v, getType(w));
+  }
+
+  Value *lowerRead(const ReadExpr &re);
+  Value *lowerInitialValue(const Array *root, Value *index);
+  Value *lowerDivision(const Expr &e, Value *l, Value *r);
+  Value *lowerShift(const Expr &e, Value *l, Value *r);
+
+public:
+  std::vector<const Array *> arrays;
+
+  PredicateBuilder(LLVMContext &_ctx, Module &_module, BasicBlock *entry,
+                   Value *_data, Value *_sizes)
+      : ctx(_ctx), module(_module), builder(entry), data(_data),
+        sizes(_sizes), divByZero(ConstantInt::getFalse(_ctx)) {}
+
+  Value *lower(const ref<Expr> &e);
+  void finish(const std::vector<Value *> &constraints);
+};
+}
+
+Value *PredicateBuilder::lowerInitialValue(const Array *root, Value *index) {
+  // The binding, or 0 past its end. Missing bindings have size 0 and
+  // point at a zero byte, so the load is always valid.
+  unsigned position;
+  std::map<const Array *, unsigned>::iterator it = arrayIndices.find(root);
+  if (it != arrayIndices.end()) {
+    position = it->second;
+  } else {
+    position = arrays.size();
+    arrays.push_back(root);
+    arrayIndices.insert(std::make_pair(root, position));
+  }
+  Type *i64 = Type::getInt64Ty(ctx);
+  Value *slot = ConstantInt::get(i64, position);
+  Value *bytes = builder.CreateLoad(builder.CreateGEP(data, slot));
+  Value *size = builder.CreateLoad(builder.CreateGEP(sizes, slot));
+  Value *inBounds = builder.CreateICmpULT(index, size);
+  Value *safe = builder.CreateSelect(inBounds, index, ConstantInt::get(i64, 0));
+  Value *byte = builder.CreateLoad(builder.CreateGEP(bytes, safe));
+  Value *bound = builder.CreateSelect(inBounds, resize(byte, root->range),
+                                      ConstantInt::get(getType(root->range), 0));
+  if (root->isSymbolicArray())
+    return bound;
+
+  GlobalVariable *&table = constantArrays[root];
+  if (!table) {
+    std::vector<Constant *> contents;
+    for (unsigned i = 0; i != root->size; ++i)
+      contents.push_back(
+          ConstantInt::get(ctx, root->constantValues[i]->getAPValue()));
+    ArrayType *type = ArrayType::get(getType(root->range), root->size);
+    table = new GlobalVariable(module, type, true, GlobalValue::InternalLinkage,
+                               ConstantArray::get(type, contents));
+  }
+  inBounds = builder.CreateICmpULT(index, ConstantInt::get(i64, root->size));
+  safe = builder.CreateSelect(inBounds, index, ConstantInt::get(i64, 0));
+  std::vector<Value *> indices;
+  indices.push_back(ConstantInt::get(i64, 0));
+  indices.push_back(safe);
+  Value *constant = builder.CreateLoad(builder.CreateGEP(table, indices));
+  return builder.CreateSelect(inBounds, constant, bound);
+}
+
+Value *PredicateBuilder::lowerRead(const ReadExpr &re) {
+  Value *index = lower(re.index);
+  Value *result = lowerInitialValue(
+      re.updates.root, resize(index, 64));
+
+  // Apply the updates from the oldest, so that newer ones win.
+  std::vector<const UpdateNode *> updates;
+  for (const UpdateNode *un = re.updates.head; un; un = un->next)
+    updates.push_back(un);
+  for (std::vector<const UpdateNode *>::reverse_iterator
+           it = updates.rbegin(), ie = updates.rend(); it != ie; ++it) {
+    Value *matches = builder.CreateICmpEQ(index, lower((*it)->index));
+    result = builder.CreateSelect(matches, lower((*it)->value), result);
+  }
+  return result;
+}
+
+Value *PredicateBuilder::lowerDivision(const Expr &e, Value *l, Value *r) {
+  // Divisions whose result LLVM leaves undefined are steered to a safe
+  // divisor; a zero divisor also fails the predicate.
+  Type *type = r->getType();
+  Value *isZero = builder.CreateICmpEQ(r, ConstantInt::get(type, 0));
+  divByZero = builder.CreateOr(divByZero, isZero);
+  Value *one = ConstantInt::get(type, 1);
+  switch (e.getKind()) {
+  case Expr::UDiv:
+    return builder.CreateUDiv(l, builder.CreateSelect(isZero, one, r));
+  case Expr::URem:
+    return builder.CreateURem(l, builder.CreateSelect(isZero, one, r));
+  default: {
+    // Dividing by -1 negates, wrapping like APInt does.
+    Value *isMinusOne =
+        builder.CreateICmpEQ(r, ConstantInt::getAllOnesValue(type));
+    Value *safe =
+        builder.CreateSelect(builder.CreateOr(isZero, isMinusOne), one, r);
+    if (e.getKind() == Expr::SDiv)
+      return builder.CreateSelect(isMinusOne, builder.CreateNeg(l),
+                                  builder.CreateSDiv(l, safe));
+    return builder.CreateSelect(isMinusOne, ConstantInt::get(type, 0),
+                                builder.CreateSRem(l, safe));
+  }
+  }
+}
+
+Value *PredicateBuilder::lowerShift(const Expr &e, Value *l, Value *r) {
+  // Shifting by the width or more gives 0, or the sign for AShr.
+  Type *type = r->getType();
+  Expr::Width w = e.getWidth();
+  Value *over = builder.CreateICmpUGE(r, ConstantInt::get(type, w));
+  Value *safe = builder.CreateSelect(over, ConstantInt::get(type, 0), r);
+  switch (e.getKind()) {
+  case Expr::Shl:
+    return builder.CreateSelect(over, ConstantInt::get(type, 0),
+                                builder.CreateShl(l, safe));
+  case Expr::LShr:
+    return builder.CreateSelect(over, ConstantInt::get(type, 0),
+                                builder.CreateLShr(l, safe));
+  default:
+    return builder.CreateSelect(
+        over, builder.CreateAShr(l, ConstantInt::get(type, w - 1)),
+        builder.CreateAShr(l, safe));
+  }
+}
+
+Value *PredicateBuilder::lower(const ref<Expr> &e) {
+  std::map<const Expr *, Value *>::iterator it = values.find(e.get());
+  if (it != values.end())
+    return it->second;
+
+  Value *result;
+  Expr::Width w = e->getWidth();
+  switch (e->getKind()) {
+  case Expr::Constant:
+    result = ConstantInt::get(ctx, cast<klee::ConstantExpr>(e)->getAPValue());
+    break;
+  case Expr::NotOptimized:
+    result = lower(cast<NotOptimizedExpr>(e)->src);
+    break;
+  case Expr::Read:
+    result = lowerRead(*cast<ReadExpr>(e));
+    break;
+  case Expr::Select:
+    result = builder.CreateSelect(lower(e->getKid(0)), lower(e->getKid(1)),
+                                  lower(e->getKid(2)));
+    break;
+  case Expr::Concat: {
+    ref<Expr> right = e->getKid(1);
+    Value *l = resize(lower(e->getKid(0)), w);
+    Value *r = resize(lower(right), w);
+    result = builder.CreateOr(
+        builder.CreateShl(l, ConstantInt::get(getType(w), right->getWidth())),
+        r);
+    break;
+  }
+  case Expr::Extract: {
+    Value *src = lower(e->getKid(0));
+    unsigned offset = cast<ExtractExpr>(e)->offset;
+    if (offset)
+      src = builder.CreateLShr(src, ConstantInt::get(src->getType(), offset));
+    result = resize(src, w);
+    break;
+  }
+  case Expr::ZExt:
+    result = resize(lower(e->getKid(0)), w);
+    break;
+  case Expr::SExt: {
+    Value *src = lower(e->getKid(0));
+    result = e->getKid(0)->getWidth() == w ? src
+                                           : builder.CreateSExt(src, getType(w));
+    break;
+  }
+  case Expr::Not:
+    result = builder.CreateNot(lower(e->getKid(0)));
+    break;
+  default: {
+    Value *l = lower(e->getKid(0)), *r = lower(e->getKid(1));
+    switch (e->getKind()) {
+    case Expr::Add: result = builder.CreateAdd(l, r); break;
+    case Expr::Sub: result = builder.CreateSub(l, r); break;
+    case Expr::Mul: result = builder.CreateMul(l, r); break;
+    case Expr::And: result = builder.CreateAnd(l, r); break;
+    case Expr::Or: result = builder.CreateOr(l, r); break;
+    case Expr::Xor: result = builder.CreateXor(l, r); break;
+    case Expr::UDiv:
+    case Expr::SDiv:
+    case Expr::URem:
+    case Expr::SRem:
+      result = lowerDivision(*e, l, r);
+      break;
+    case Expr::Shl:
+    case Expr::LShr:
+    case Expr::AShr:
+      result = lowerShift(*e, l, r);
+      break;
+    case Expr::Eq: result = builder.CreateICmpEQ(l, r); break;
+    case Expr::Ne: result = builder.CreateICmpNE(l, r); break;
+    case Expr::Ult: result = builder.CreateICmpULT(l, r); break;
+    case Expr::Ule: result = builder.CreateICmpULE(l, r); break;
+    case Expr::Ugt: result = builder.CreateICmpUGT(l, r); break;
+    case Expr::Uge: result = builder.CreateICmpUGE(l, r); break;
+    case Expr::Slt: result = builder.CreateICmpSLT(l, r); break;
+    case Expr::Sle: result = builder.CreateICmpSLE(l, r); break;
+    case Expr::Sgt: result = builder.CreateICmpSGT(l, r); break;
+    case Expr::Sge: result = builder.CreateICmpSGE(l, r); break;
+    default:
+      assert(0 && "invalid expression kind");
+      result = 0;
+    }
+  }
+  }
+
+  values.insert(std::make_pair(e.get(), result));
+  return result;
+}
+
+void PredicateBuilder::finish(const std::vector<Value *> &constraints) {
+  Value *result = builder.CreateNot(divByZero);
+  for (unsigned i = 0; i != constraints.size(); ++i)
+    result = builder.CreateAnd(result, constraints[i]);
+  builder.CreateRet(builder.CreateZExt(result, Type::getInt32Ty(ctx)));
+}
+
+/***/
+
+bool CompiledPredicate::satisfies(const Assignment &a) const {
+  static const unsigned char zero = 0;
+  std::vector<const unsigned char *> data(arrays.size(), &zero);
+  std::vector<uint64_t> sizes(arrays.size(), 0);
+  for (unsigned i = 0; i != arrays.size(); ++i) {
+    Assignment::bindings_ty::const_iterator it = a.bindings.find(arrays[i]);
+    if (it != a.bindings.end() && !it->second.empty()) {
+      data[i] = &it->second[0];
+      sizes[i] = it->second.size();
+    }
+  }
+  return function(data.empty() ? 0 : &data[0],
+                  sizes.empty() ? 0 : &sizes[0]);
+}
+
+ConstraintJIT::ConstraintJIT(uint64_t _threshold)
+    : threshold(_threshold), numCompiled(0), context(0), module(0),
+      engine(0), failed(false) {}
+
+ConstraintJIT::~ConstraintJIT() {
+  for (entries_ty::iterator it = entries.begin(), ie = entries.end();
+       it != ie; ++it)
+    delete it->second.predicate;
+  // The engine owns the module.
+  delete engine;
+  delete context;
+}
+
+bool ConstraintJIT::initialize() {
+  if (engine || failed)
+    return engine;
+
+  InitializeNativeTarget();
+  context = new LLVMContext();
+  module = new Module("constraints", *context);
+  std::string error;
+  engine = EngineBuilder(module)
+               .setErrorStr(&error)
+               .setEngineKind(EngineKind::JIT)
+               .create();
+  if (!engine) {
+    klee_warning("unable to create the constraint JIT: %s", error.c_str());
+    delete module;
+    module = 0;
+    failed = true;
+  }
+  return engine;
+}
+
+CompiledPredicate *
+ConstraintJIT::compile(const std::vector<ref<Expr> > &constraints) {
+  if (!initialize())
+    return 0;
+
+  LLVMContext &ctx = *context;
+  std::vector<Type *> args;
+  args.push_back(PointerType::getUnqual(Type::getInt8PtrTy(ctx)));
+  args.push_back(PointerType::getUnqual(Type::getInt64Ty(ctx)));
+  Function *f = Function::Create(
+      FunctionType::get(Type::getInt32Ty(ctx), args, false),
+      GlobalValue::ExternalLinkage, "constraints" + utostr(numCompiled),
+      module);
+  Function::arg_iterator arg = f->arg_begin();
+  Value *data = arg++;
+  Value *sizes = arg;
+
+  PredicateBuilder builder(ctx, *module, BasicBlock::Create(ctx, "entry", f),
+                           data, sizes);
+  std::vector<Value *> lowered;
+  for (unsigned i = 0; i != constraints.size(); ++i)
+    lowered.push_back(builder.lower(constraints[i]));
+  builder.finish(lowered);
+
+  CompiledPredicate *predicate = new CompiledPredicate();
+  predicate->function =
+      (CompiledPredicate::function_ty)engine->getPointerToFunction(f);
+  predicate->arrays = builder.arrays;
+  ++numCompiled;
+  return predicate;
+}
+
+CompiledPredicate *ConstraintJIT::get(const std::set<ref<Expr> > &constraints,
+                                      unsigned checks) {
+  unsigned hash = constraints.size();
+  for (std::set<ref<Expr> >::const_iterator it = constraints.begin(),
+                                            ie = constraints.end();
+       it != ie; ++it)
+    hash = hash * Expr::MAGIC_HASH_CONSTANT + (*it)->hash();
+
+  std::pair<entries_ty::iterator, entries_ty::iterator> range =
+      entries.equal_range(hash);
+  entries_ty::iterator it = range.first;
+  for (; it != range.second; ++it)
+    if (it->second.constraints.size() == constraints.size() &&
+        std::equal(constraints.begin(), constraints.end(),
+                   it->second.constraints.begin()))
+      break;
+
+  if (it == range.second) {
+    if (entries.size() >= MaxEntries) {
+      for (entries_ty::iterator e = entries.begin(); e != entries.end();)
+        if (!e->second.predicate)
+          entries.erase(e++);
+        else
+          ++e;
+    }
+    Entry entry;
+    entry.constraints.assign(constraints.begin(), constraints.end());
+    entry.checks = 0;
+    entry.predicate = 0;
+    it = entries.insert(std::make_pair(hash, entry));
+  }
+
+  Entry &entry = it->second;
+  entry.checks += checks;
+  if (!entry.predicate && entry.checks >= threshold &&
+      numCompiled < MaxCompiled)
+    entry.predicate = compile(entry.constraints);
+  return entry.predicate;
+}
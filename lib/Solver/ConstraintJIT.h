@@ -0,0 +1,88 @@
+//===-- ConstraintJIT.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_CONSTRAINTJIT_H
+#define KLEE_CONSTRAINTJIT_H
+
+#include "klee/Expr.h"
+
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+namespace llvm {
+class ExecutionEngine;
+class LLVMContext;
+class Module;
+}
+
+namespace klee {
+class Assignment;
+
+/// CompiledPredicate - A constraint set compiled to native code, which
+/// checks an assignment against the constraints without building any
+/// expressions.
+class CompiledPredicate {
+  friend class ConstraintJIT;
+
+  typedef int (*function_ty)(const unsigned char *const *data,
+                             const uint64_t *sizes);
+
+  function_ty function;
+  /// The arrays the function reads, in the order it expects their
+  /// bindings.
+  std::vector<const Array *> arrays;
+
+  CompiledPredicate() : function(0) {}
+
+public:
+  /// Check whether \a a satisfies every constraint. Any division by zero
+  /// fails the check, so it is never more permissive than
+  /// Assignment::satisfies().
+  bool satisfies(const Assignment &a) const;
+};
+
+/// ConstraintJIT - Compiles the constraint sets that are checked often
+/// into native predicates with the LLVM JIT. Sets are found by their
+/// expression hash, and compiled once they have been checked against
+/// \a threshold assignments.
+class ConstraintJIT {
+  struct Entry {
+    std::vector<ref<Expr> > constraints;
+    uint64_t checks;
+    CompiledPredicate *predicate;
+  };
+  typedef std::multimap<unsigned, Entry> entries_ty;
+
+  uint64_t threshold;
+  entries_ty entries;
+  unsigned numCompiled;
+  llvm::LLVMContext *context;
+  llvm::Module *module;
+  llvm::ExecutionEngine *engine;
+  /// Set when the JIT could not be created; nothing is compiled then.
+  bool failed;
+
+  bool initialize();
+  CompiledPredicate *compile(const std::vector<ref<Expr> > &constraints);
+
+public:
+  explicit ConstraintJIT(uint64_t _threshold);
+  ~ConstraintJIT();
+
+  /// Note that \a constraints are about to be checked against \a checks
+  /// assignments, and return their predicate if they have one, compiling
+  /// it if they just became hot.
+  CompiledPredicate *get(const std::set<ref<Expr> > &constraints,
+                         unsigned checks = 1);
+};
+}
+
+#endif
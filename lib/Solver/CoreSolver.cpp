@@ -36,24 +36,24 @@ using namespace klee;
 using namespace metaSMT;
 using namespace metaSMT::solver;
 
-static klee::Solver *handleMetaSMT() {
+static klee::Solver *handleMetaSMT(bool useForked) {
   Solver *coreSolver = NULL;
   std::string backend;
   switch (MetaSMTBackend) {
   case METASMT_BACKEND_STP:
     backend = "STP";
     coreSolver = new MetaSMTSolver<DirectSolver_Context<STP_Backend> >(
-        UseForkedCoreSolver, CoreSolverOptimizeDivides);
+        useForked, CoreSolverOptimizeDivides);
     break;
   case METASMT_BACKEND_Z3:
     backend = "Z3";
     coreSolver = new MetaSMTSolver<DirectSolver_Context<Z3_Backend> >(
-        UseForkedCoreSolver, CoreSolverOptimizeDivides);
+        useForked, CoreSolverOptimizeDivides);
     break;
   case METASMT_BACKEND_BOOLECTOR:
     backend = "Boolector";
     coreSolver = new MetaSMTSolver<DirectSolver_Context<Boolector> >(
-        UseForkedCoreSolver, CoreSolverOptimizeDivides);
+        useForked, CoreSolverOptimizeDivides);
     break;
   default:
     llvm_unreachable("Unrecognised metasmt backend");
@@ -79,7 +79,7 @@ Solver *createCoreSolver(CoreSolverType cst) {
   case METASMT_SOLVER:
 #ifdef ENABLE_METASMT
     llvm::errs() << "Using MetaSMT solver backend\n";
-    return handleMetaSMT();
+    return handleMetaSMT(UseForkedCoreSolver);
 #else
     llvm::errs() << "Not compiled with MetaSMT support\n";
     return NULL;
@@ -93,6 +93,26 @@ Solver *createCoreSolver(CoreSolverType cst) {
     llvm::errs() << "Not compiled with Z3 support\n";
     return NULL;
 #endif
+  case PORTFOLIO_SOLVER: {
+    // The portfolio runs each backend in a worker process already.
+    std::vector<Solver *> solvers;
+    std::vector<std::string> names;
+#ifdef ENABLE_STP
+    solvers.push_back(new STPSolver(false, CoreSolverOptimizeDivides));
+    names.push_back("STP");
+#endif
+#ifdef ENABLE_Z3
+    solvers.push_back(new Z3Solver());
+    names.push_back("Z3");
+#endif
+#ifdef ENABLE_METASMT
+    solvers.push_back(handleMetaSMT(false));
+    names.push_back("MetaSMT");
+#endif
+    llvm::errs() << "Using portfolio solver backend with " << solvers.size()
+                 << " solvers\n";
+    return createPortfolioSolver(solvers, names);
+  }
   default:
     llvm_unreachable("Unsupported CoreSolverType");
   }
@@ -0,0 +1,217 @@
+//===-- FileQueryStore.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "QueryStore.h"
+
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <list>
+#include <map>
+
+using namespace klee;
+
+namespace {
+/// The file is a FileHeader followed by records, each a RecordHeader
+/// and its payload. Records are only ever appended; a later record for
+/// the same key replaces an earlier one.
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct RecordHeader {
+  uint64_t lo, hi, check;
+  uint32_t kind;
+  uint32_t size;
+};
+
+const char Magic[8] = {'K', 'L', 'E', 'E', 'Q', 'C', 'C', 0};
+const uint32_t Version = 2;
+
+class FileQueryStore : public QueryStore {
+  struct Key {
+    QueryHash hash;
+    uint32_t kind;
+
+    Key(const QueryHash &h, uint32_t k) : hash(h), kind(k) {}
+    bool operator<(const Key &b) const {
+      return hash < b.hash || (hash == b.hash && kind < b.kind);
+    }
+  };
+  struct Record {
+    uint64_t check;
+    const unsigned char *payload;
+    unsigned size;
+
+    Record() : check(0), payload(0), size(0) {}
+    Record(uint64_t c, const unsigned char *p, unsigned s)
+        : check(c), payload(p), size(s) {}
+  };
+  typedef std::map<Key, Record> index_ty;
+
+  std::string path;
+  int fd;
+  void *mapping;
+  size_t mappingSize;
+  /// Where the payload of each record is, in the mapping or in added.
+  index_ty index;
+  /// The payloads of the records this run appended.
+  std::list<std::vector<unsigned char> > added;
+
+public:
+  FileQueryStore(const std::string &_path)
+      : path(_path), fd(-1), mapping(0), mappingSize(0) {}
+  ~FileQueryStore();
+
+  bool open();
+  bool lookup(const QueryHash &hash, Kind kind,
+              std::vector<unsigned char> &payload);
+  void insert(const QueryHash &hash, Kind kind,
+              const std::vector<unsigned char> &payload);
+};
+}
+
+FileQueryStore::~FileQueryStore() {
+  if (mapping)
+    munmap(mapping, mappingSize);
+  if (fd >= 0)
+    close(fd);
+}
+
+bool FileQueryStore::open() {
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd < 0) {
+    klee_warning("unable to open query cache %s: %s", path.c_str(),
+                 strerror(errno));
+    return false;
+  }
+
+  // Other runs may append to the file concurrently; hold the lock while
+  // checking its structure so a half-written record is not cut off.
+  flock(fd, LOCK_EX);
+
+  struct stat st;
+  fstat(fd, &st);
+  size_t size = st.st_size;
+
+  if (size < sizeof(FileHeader)) {
+    FileHeader header;
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.reserved = 0;
+    if (ftruncate(fd, 0) < 0 ||
+        write(fd, &header, sizeof(header)) != sizeof(header)) {
+      klee_warning("unable to initialize query cache %s", path.c_str());
+      return false;
+    }
+    flock(fd, LOCK_UN);
+    return true;
+  }
+
+  mapping = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    mapping = 0;
+    klee_warning("unable to map query cache %s", path.c_str());
+    return false;
+  }
+  mappingSize = size;
+
+  const unsigned char *base = (const unsigned char *)mapping;
+  FileHeader header;
+  memcpy(&header, base, sizeof(header));
+  if (memcmp(header.magic, Magic, sizeof(Magic)) ||
+      header.version != Version) {
+    klee_warning("ignoring query cache %s with an unknown format",
+                 path.c_str());
+    return false;
+  }
+
+  size_t pos = sizeof(FileHeader);
+  while (pos + sizeof(RecordHeader) <= size) {
+    RecordHeader rh;
+    memcpy(&rh, base + pos, sizeof(rh));
+    if (pos + sizeof(rh) + rh.size > size)
+      break;
+    QueryHash h;
+    h.lo = rh.lo;
+    h.hi = rh.hi;
+    index[Key(h, rh.kind)] = Record(rh.check, base + pos + sizeof(rh),
+                                    rh.size);
+    pos += sizeof(rh) + rh.size;
+  }
+
+  // Drop a record cut short by a crash, so that appends stay readable.
+  if (pos != size && ftruncate(fd, pos) < 0)
+    klee_warning("unable to repair query cache %s", path.c_str());
+  flock(fd, LOCK_UN);
+
+  klee_message("loaded %u answers from query cache %s",
+               (unsigned)index.size(), path.c_str());
+  return true;
+}
+
+bool FileQueryStore::lookup(const QueryHash &hash, Kind kind,
+                            std::vector<unsigned char> &payload) {
+  index_ty::iterator it = index.find(Key(hash, kind));
+  if (it == index.end() || it->second.check != hash.check)
+    return false;
+  const unsigned char *data = it->second.payload;
+  payload.assign(data, data + it->second.size);
+  return true;
+}
+
+void FileQueryStore::insert(const QueryHash &hash, Kind kind,
+                            const std::vector<unsigned char> &payload) {
+  added.push_back(payload);
+  const unsigned char *copy = payload.empty() ? 0 : &added.back()[0];
+  index[Key(hash, kind)] = Record(hash.check, copy, (unsigned)payload.size());
+
+  if (fd < 0)
+    return;
+
+  // Write the record with a single append so that concurrent runs do
+  // not interleave their records.
+  RecordHeader rh;
+  rh.lo = hash.lo;
+  rh.hi = hash.hi;
+  rh.check = hash.check;
+  rh.kind = kind;
+  rh.size = payload.size();
+  std::vector<unsigned char> record(sizeof(rh));
+  memcpy(&record[0], &rh, sizeof(rh));
+  record.insert(record.end(), payload.begin(), payload.end());
+
+  flock(fd, LOCK_EX);
+  ssize_t res = write(fd, &record[0], record.size());
+  flock(fd, LOCK_UN);
+  if (res != (ssize_t)record.size()) {
+    klee_warning("unable to write query cache %s, no longer updating it",
+                 path.c_str());
+    close(fd);
+    fd = -1;
+  }
+}
+
+QueryStore *klee::createFileQueryStore(const std::string &path) {
+  FileQueryStore *store = new FileQueryStore(path);
+  if (!store->open()) {
+    delete store;
+    return 0;
+  }
+  return store;
+}
@@ -0,0 +1,834 @@
+//===-- KnownBitsSolver.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/IncompleteSolver.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+/// The most passes over the facts before propagation gives up on
+/// reaching a fixed point.
+const unsigned MaxRounds = 8;
+
+inline uint64_t getMask(Expr::Width w) {
+  return w >= 64 ? ~0ULL : (1ULL << w) - 1;
+}
+
+inline unsigned countTrailingZeros(uint64_t v) {
+  unsigned n = 0;
+  while (n != 64 && !(v & (1ULL << n)))
+    ++n;
+  return n;
+}
+
+/// BitsRange - An abstract value combining the bits known to be zero or
+/// one with an unsigned interval. Only widths up to 64 bits are tracked,
+/// wider values are always unknown.
+struct BitsRange {
+  Expr::Width width;
+  uint64_t zeros, ones, lo, hi;
+  bool empty;
+
+  explicit BitsRange(Expr::Width w)
+      : width(w), zeros(0), ones(0), lo(0), hi(getMask(w)), empty(false) {}
+  BitsRange(Expr::Width w, uint64_t value)
+      : width(w), zeros(~value & getMask(w)), ones(value & getMask(w)),
+        lo(value & getMask(w)), hi(value & getMask(w)), empty(false) {}
+
+  static BitsRange range(Expr::Width w, uint64_t lo, uint64_t hi) {
+    BitsRange r(w);
+    r.lo = lo;
+    r.hi = hi;
+    r.normalize();
+    return r;
+  }
+  static BitsRange bits(Expr::Width w, uint64_t zeros, uint64_t ones) {
+    BitsRange r(w);
+    r.zeros = zeros;
+    r.ones = ones;
+    r.normalize();
+    return r;
+  }
+
+  bool isSupported() const { return width <= 64; }
+  bool isFixed() const { return !empty && lo == hi; }
+  uint64_t getMax() const { return getMask(width); }
+
+  bool operator==(const BitsRange &b) const {
+    if (empty || b.empty)
+      return empty == b.empty;
+    return zeros == b.zeros && ones == b.ones && lo == b.lo && hi == b.hi;
+  }
+  bool operator!=(const BitsRange &b) const { return !(*this == b); }
+
+  BitsRange meet(const BitsRange &b) const {
+    if (!isSupported())
+      return *this;
+    BitsRange r(*this);
+    r.zeros |= b.zeros;
+    r.ones |= b.ones;
+    r.lo = std::max(lo, b.lo);
+    r.hi = std::min(hi, b.hi);
+    r.empty = empty || b.empty;
+    r.normalize();
+    return r;
+  }
+
+  BitsRange join(const BitsRange &b) const {
+    if (empty)
+      return b;
+    if (b.empty)
+      return *this;
+    BitsRange r(*this);
+    r.zeros &= b.zeros;
+    r.ones &= b.ones;
+    r.lo = std::min(lo, b.lo);
+    r.hi = std::max(hi, b.hi);
+    return r;
+  }
+
+  void normalize();
+};
+
+/// nextConsistent - Find the least value at least \a lo with every bit
+/// of \a zeros clear and every bit of \a ones set.
+bool nextConsistent(Expr::Width w, uint64_t zeros, uint64_t ones,
+                    uint64_t lo, uint64_t &result) {
+  // Walk down while the value equals lo, remembering the lowest free bit
+  // where lo has a 0 as the place to round up to if a forced bit is too
+  // small further down.
+  int backtrack = -1;
+  for (int i = w - 1; i >= 0; --i) {
+    uint64_t bit = 1ULL << i, below = bit - 1;
+    bool want = lo & bit;
+    if (ones & bit) {
+      if (!want) {
+        result = (lo & ~below & ~bit) | bit | (ones & below);
+        return true;
+      }
+    } else if (zeros & bit) {
+      if (want) {
+        if (backtrack < 0)
+          return false;
+        bit = 1ULL << backtrack;
+        below = bit - 1;
+        result = (lo & ~below & ~bit) | bit | (ones & below);
+        return true;
+      }
+    } else if (!want) {
+      backtrack = i;
+    }
+  }
+  result = lo;
+  return true;
+}
+
+void BitsRange::normalize() {
+  if (empty || !isSupported())
+    return;
+  uint64_t m = getMax();
+  zeros &= m;
+  ones &= m;
+  for (unsigned i = 0; i != 4; ++i) {
+    BitsRange old(*this);
+    if (zeros & ones) {
+      empty = true;
+      return;
+    }
+    // Tighten the interval to the values the bits allow, the upper bound
+    // by looking for the complement of the lower one.
+    uint64_t next;
+    if (!nextConsistent(width, zeros, ones, lo, next) || next > hi) {
+      empty = true;
+      return;
+    }
+    lo = next;
+    if (!nextConsistent(width, ones, zeros, ~hi & m, next)) {
+      empty = true;
+      return;
+    }
+    hi = ~next & m;
+    if (lo > hi) {
+      empty = true;
+      return;
+    }
+    // The bits above the highest one where lo and hi differ are shared
+    // by every value in between.
+    uint64_t known = m;
+    for (uint64_t differ = lo ^ hi; differ; differ >>= 1)
+      known <<= 1;
+    known &= m;
+    zeros |= ~lo & known;
+    ones |= lo & known;
+    if (*this == old)
+      return;
+  }
+}
+
+/***/
+
+BitsRange add(const BitsRange &a, const BitsRange &b, bool carry) {
+  Expr::Width w = a.width;
+  if (!a.isSupported() || a.empty || b.empty)
+    return BitsRange(w);
+  uint64_t m = a.getMax();
+
+  // Known bits, as in LLVM's computeKnownBits for additions.
+  uint64_t aMax = ~a.zeros & m, bMax = ~b.zeros & m;
+  uint64_t sumMax = (aMax + bMax + carry) & m;
+  uint64_t sumMin = (a.ones + b.ones + carry) & m;
+  uint64_t carryKnownZero = ~(sumMax ^ aMax ^ bMax);
+  uint64_t carryKnownOne = sumMin ^ a.ones ^ b.ones;
+  uint64_t known = (a.zeros | a.ones) & (b.zeros | b.ones) &
+                   (carryKnownZero | carryKnownOne) & m;
+  BitsRange r = BitsRange::bits(w, ~sumMax & known, sumMin & known);
+
+  // The interval, unless only some of the sums wrap around.
+  uint64_t bHi = b.hi + carry, bLo = b.lo + carry;
+  if (bHi > m || bHi < b.hi)
+    return r;
+  bool loWraps = a.lo > m - bLo, hiWraps = a.hi > m - bHi;
+  if (loWraps == hiWraps)
+    r = r.meet(BitsRange::range(w, (a.lo + bLo) & m, (a.hi + bHi) & m));
+  return r;
+}
+
+BitsRange complement(const BitsRange &a) {
+  BitsRange r(a.width);
+  if (!a.isSupported() || a.empty)
+    return r;
+  uint64_t m = a.getMax();
+  return BitsRange::bits(a.width, a.ones, a.zeros)
+      .meet(BitsRange::range(a.width, m - a.hi, m - a.lo));
+}
+
+BitsRange sub(const BitsRange &a, const BitsRange &b) {
+  return add(a, complement(b), true);
+}
+
+/// flipSign - Map a value to the order of its signed interpretation by
+/// flipping the sign bit.
+BitsRange flipSign(const BitsRange &a) {
+  if (!a.isSupported() || a.empty)
+    return a;
+  uint64_t sign = 1ULL << (a.width - 1);
+  BitsRange r = BitsRange::bits(a.width, (a.zeros & ~sign) | (a.ones & sign),
+                                (a.ones & ~sign) | (a.zeros & sign));
+  if ((a.lo & sign) == (a.hi & sign))
+    r = r.meet(BitsRange::range(a.width, a.lo ^ sign, a.hi ^ sign));
+  return r;
+}
+
+/// KnownBitsPropagator - Propagates known bits and intervals through a
+/// set of facts, each an expression known to be true or false, narrowing
+/// what the symbolic bytes may hold.
+class KnownBitsPropagator {
+  typedef std::pair<const Array *, uint64_t> byte_ty;
+
+  std::vector<std::pair<ref<Expr>, bool> > facts;
+  std::map<byte_ty, BitsRange> bytes;
+  /// The values computed in the current pass. They only ever widen over
+  /// the narrowed bytes, so stale ones stay sound.
+  std::map<const Expr *, BitsRange> values;
+  bool changed;
+
+  BitsRange compute(const ref<Expr> &e);
+  BitsRange computeRead(const ReadExpr &re);
+  bool refineRead(const ReadExpr &re, const BitsRange &r);
+  bool refineCompare(Expr::Kind kind, const ref<Expr> &a, const ref<Expr> &b,
+                     bool value);
+  bool refine(const ref<Expr> &e, const BitsRange &r);
+
+public:
+  KnownBitsPropagator() : changed(false) {}
+
+  void addFact(const ref<Expr> &e, bool value) {
+    facts.push_back(std::make_pair(e, value));
+  }
+
+  /// Propagate the facts to a fixed point. Returns false if they are
+  /// contradictory.
+  bool propagate();
+
+  BitsRange evaluate(const ref<Expr> &e) { return compute(e); }
+};
+}
+
+BitsRange KnownBitsPropagator::computeRead(const ReadExpr &re) {
+  Expr::Width w = re.getWidth();
+  ConstantExpr *index = dyn_cast<ConstantExpr>(re.index);
+  if (!index || w > 64)
+    return BitsRange(w);
+  uint64_t i = index->getZExtValue();
+  for (const UpdateNode *un = re.updates.head; un; un = un->next) {
+    ConstantExpr *ui = dyn_cast<ConstantExpr>(un->index);
+    if (!ui)
+      return BitsRange(w);
+    if (ui->getZExtValue() == i)
+      return compute(un->value);
+  }
+  const Array *root = re.updates.root;
+  if (i >= root->size)
+    return BitsRange(w);
+  if (root->isConstantArray())
+    return BitsRange(w, root->constantValues[i]->getZExtValue());
+  std::map<byte_ty, BitsRange>::iterator it =
+      bytes.find(std::make_pair(root, i));
+  return it == bytes.end() ? BitsRange(w) : it->second;
+}
+
+BitsRange KnownBitsPropagator::compute(const ref<Expr> &e) {
+  std::map<const Expr *, BitsRange>::iterator it = values.find(e.get());
+  if (it != values.end())
+    return it->second;
+
+  Expr::Width w = e->getWidth();
+  BitsRange r(w);
+  if (w > 64) {
+    values.insert(std::make_pair(e.get(), r));
+    return r;
+  }
+  uint64_t m = getMask(w);
+
+  switch (e->getKind()) {
+  case Expr::Constant:
+    r = BitsRange(w, cast<ConstantExpr>(e)->getZExtValue());
+    break;
+  case Expr::NotOptimized:
+    r = compute(e->getKid(0));
+    break;
+  case Expr::Read:
+    r = computeRead(*cast<ReadExpr>(e));
+    break;
+  case Expr::Select: {
+    BitsRange c = compute(e->getKid(0));
+    if (c.isFixed())
+      r = compute(e->getKid(c.lo ? 1 : 2));
+    else
+      r = compute(e->getKid(1)).join(compute(e->getKid(2)));
+    break;
+  }
+  case Expr::Concat: {
+    BitsRange a = compute(e->getKid(0)), b = compute(e->getKid(1));
+    Expr::Width bw = b.width;
+    if (a.isSupported())
+      r = BitsRange::bits(w, (a.zeros << bw) | b.zeros,
+                          (a.ones << bw) | b.ones)
+              .meet(BitsRange::range(w, (a.lo << bw) | b.lo,
+                                     (a.hi << bw) | b.hi));
+    break;
+  }
+  case Expr::Extract: {
+    BitsRange a = compute(e->getKid(0));
+    unsigned offset = cast<ExtractExpr>(e)->offset;
+    if (a.isSupported()) {
+      r = BitsRange::bits(w, a.zeros >> offset, a.ones >> offset);
+      if (!offset && a.hi <= m)
+        r = r.meet(BitsRange::range(w, a.lo, a.hi));
+    }
+    break;
+  }
+  case Expr::ZExt: {
+    BitsRange a = compute(e->getKid(0));
+    r = BitsRange::bits(w, a.zeros | (m & ~a.getMax()), a.ones)
+            .meet(BitsRange::range(w, a.lo, a.hi));
+    break;
+  }
+  case Expr::SExt: {
+    BitsRange a = compute(e->getKid(0));
+    uint64_t sign = 1ULL << (a.width - 1), high = m & ~a.getMax();
+    r = BitsRange::bits(w, a.zeros | (a.zeros & sign ? high : 0),
+                        a.ones | (a.ones & sign ? high : 0));
+    break;
+  }
+  case Expr::Add:
+    r = add(compute(e->getKid(0)), compute(e->getKid(1)), false);
+    break;
+  case Expr::Sub:
+    r = sub(compute(e->getKid(0)), compute(e->getKid(1)));
+    break;
+  case Expr::Mul: {
+    BitsRange a = compute(e->getKid(0)), b = compute(e->getKid(1));
+    // The trailing zeros add up.
+    unsigned tz = countTrailingZeros(~a.zeros) + countTrailingZeros(~b.zeros);
+    if (tz)
+      r = BitsRange::bits(w, tz >= 64 ? m : (1ULL << tz) - 1, 0);
+    if (!b.hi || a.hi <= m / b.hi)
+      r = r.meet(BitsRange::range(w, a.lo * b.lo, a.hi * b.hi));
+    break;
+  }
+  case Expr::UDiv: {
+    BitsRange a = compute(e->getKid(0)), b = compute(e->getKid(1));
+    if (b.lo)
+      r = BitsRange::range(w, a.lo / b.hi, a.hi / b.lo);
+    break;
+  }
+  case Expr::URem: {
+    BitsRange a = compute(e->getKid(0)), b = compute(e->getKid(1));
+    if (b.lo)
+      r = BitsRange::range(w, 0, std::min(a.hi, b.hi - 1));
+    break;
+  }
+  case Expr::Not: {
+    BitsRange a = compute(e->getKid(0));
+    r = complement(a);
+    break;
+  }
+  case Expr::And: {
+    BitsRange a = compute(e->getKid(0)), b = compute(e->getKid(1));
+    r = BitsRange::bits(w, a.zeros | b.zeros, a.ones & b.ones)
+            .meet(BitsRange::range(w, 0, std::min(a.hi, b.hi)));
+    break;
+  }
+  case Expr::Or: {
+    BitsRange a = compute(e->getKid(0)), b = compute(e->getKid(1));
+    r = BitsRange::bits(w, a.zeros & b.zeros, a.ones | b.ones)
+            .meet(BitsRange::range(w, std::max(a.lo, b.lo), m));
+    break;
+  }
+  case Expr::Xor: {
+    BitsRange a = compute(e->getKid(0)), b = compute(e->getKid(1));
+    r = BitsRange::bits(w, (a.zeros & b.zeros) | (a.ones & b.ones),
+                        (a.zeros & b.ones) | (a.ones & b.zeros));
+    break;
+  }
+  case Expr::Shl:
+  case Expr::LShr:
+  case Expr::AShr: {
+    BitsRange a = compute(e->getKid(0)), b = compute(e->getKid(1));
+    if (!b.isFixed()) {
+      if (e->getKind() == Expr::LShr)
+        r = BitsRange::range(w, 0, a.hi);
+      break;
+    }
+    uint64_t k = b.lo;
+    if (k >= w) {
+      // Overshifting leaves nothing, or the sign for AShr.
+      if (e->getKind() != Expr::AShr)
+        r = BitsRange(w, 0);
+      break;
+    }
+    uint64_t sign = 1ULL << (w - 1), low = (1ULL << k) - 1;
+    if (e->getKind() == Expr::Shl) {
+      r = BitsRange::bits(w, (a.zeros << k) | low, a.ones << k);
+    } else if (e->getKind() == Expr::LShr) {
+      uint64_t high = ~(m >> k) & m;
+      r = BitsRange::bits(w, (a.zeros >> k) | high, a.ones >> k)
+              .meet(BitsRange::range(w, a.lo >> k, a.hi >> k));
+    } else {
+      uint64_t high = ~(m >> k) & m;
+      r = BitsRange::bits(w, (a.zeros >> k) | (a.zeros & sign ? high : 0),
+                          (a.ones >> k) | (a.ones & sign ? high : 0));
+    }
+    break;
+  }
+  case Expr::Eq: {
+    BitsRange a = compute(e->getKid(0)), b = compute(e->getKid(1));
+    if (a.isFixed() && b.isFixed() && a.lo == b.lo)
+      r = BitsRange(w, 1);
+    else if (a.meet(b).empty)
+      r = BitsRange(w, 0);
+    break;
+  }
+  case Expr::Ne:
+  case Expr::Ult:
+  case Expr::Ule:
+  case Expr::Ugt:
+  case Expr::Uge:
+  case Expr::Slt:
+  case Expr::Sle:
+  case Expr::Sgt:
+  case Expr::Sge: {
+    BitsRange a = compute(e->getKid(0)), b = compute(e->getKid(1));
+    if (!a.isSupported())
+      break;
+    Expr::Kind kind = e->getKind();
+    if (kind == Expr::Ne) {
+      if (a.isFixed() && b.isFixed() && a.lo == b.lo)
+        r = BitsRange(w, 0);
+      else if (a.meet(b).empty)
+        r = BitsRange(w, 1);
+      break;
+    }
+    if (kind == Expr::Ugt || kind == Expr::Uge || kind == Expr::Sgt ||
+        kind == Expr::Sge) {
+      std::swap(a, b);
+      kind = kind == Expr::Ugt ? Expr::Ult : kind == Expr::Uge ? Expr::Ule
+           : kind == Expr::Sgt ? Expr::Slt : Expr::Sle;
+    }
+    if (kind == Expr::Slt || kind == Expr::Sle) {
+      a = flipSign(a);
+      b = flipSign(b);
+    }
+    bool strict = kind == Expr::Ult || kind == Expr::Slt;
+    if (strict ? a.hi < b.lo : a.hi <= b.lo)
+      r = BitsRange(w, 1);
+    else if (strict ? a.lo >= b.hi : a.lo > b.hi)
+      r = BitsRange(w, 0);
+    break;
+  }
+  default:
+    // Signed division and remainder are left unknown.
+    break;
+  }
+
+  values.insert(std::make_pair(e.get(), r));
+  return r;
+}
+
+bool KnownBitsPropagator::refineRead(const ReadExpr &re, const BitsRange &r) {
+  ConstantExpr *index = dyn_cast<ConstantExpr>(re.index);
+  if (!index)
+    return true;
+  uint64_t i = index->getZExtValue();
+  for (const UpdateNode *un = re.updates.head; un; un = un->next) {
+    ConstantExpr *ui = dyn_cast<ConstantExpr>(un->index);
+    if (!ui)
+      return true;
+    if (ui->getZExtValue() == i)
+      return refine(un->value, r);
+  }
+  const Array *root = re.updates.root;
+  if (i >= root->size || root->isConstantArray())
+    return true;
+
+  std::map<byte_ty, BitsRange>::iterator it =
+      bytes.insert(std::make_pair(std::make_pair(root, i),
+                                  BitsRange(r.width))).first;
+  BitsRange narrowed = it->second.meet(r);
+  if (narrowed != it->second) {
+    it->second = narrowed;
+    changed = true;
+  }
+  return !narrowed.empty;
+}
+
+bool KnownBitsPropagator::refineCompare(Expr::Kind kind, const ref<Expr> &a,
+                                        const ref<Expr> &b, bool value) {
+  BitsRange av = compute(a), bv = compute(b);
+  if (!av.isSupported())
+    return true;
+  Expr::Width w = av.width;
+  uint64_t m = av.getMax();
+  bool isSigned = kind == Expr::Slt || kind == Expr::Sle;
+  if (isSigned) {
+    av = flipSign(av);
+    bv = flipSign(bv);
+  }
+
+  // Both orders reduce to a <= b - strict on the unsigned (or flipped)
+  // values; a false comparison is the reverse one.
+  bool strict = kind == Expr::Ult || kind == Expr::Slt;
+  const ref<Expr> *lhs = &a, *rhs = &b;
+  if (!value) {
+    std::swap(av, bv);
+    std::swap(lhs, rhs);
+    strict = !strict;
+  }
+  BitsRange lhsRange(w), rhsRange(w);
+  if (strict) {
+    if (!bv.hi || av.lo == m)
+      return false;
+    lhsRange = BitsRange::range(w, 0, bv.hi - 1);
+    rhsRange = BitsRange::range(w, av.lo + 1, m);
+  } else {
+    lhsRange = BitsRange::range(w, 0, bv.hi);
+    rhsRange = BitsRange::range(w, av.lo, m);
+  }
+  if (isSigned) {
+    lhsRange = flipSign(lhsRange);
+    rhsRange = flipSign(rhsRange);
+  }
+  return refine(*lhs, lhsRange) && refine(*rhs, rhsRange);
+}
+
+bool KnownBitsPropagator::refine(const ref<Expr> &e, const BitsRange &r) {
+  if (!r.isSupported())
+    return true;
+  BitsRange current = compute(e);
+  BitsRange narrowed = current.meet(r);
+  if (narrowed.empty)
+    return false;
+  // Only a narrower value tells the operands anything new.
+  if (narrowed == current)
+    return true;
+  values.find(e.get())->second = narrowed;
+
+  Expr::Width w = e->getWidth();
+  uint64_t m = getMask(w);
+  switch (e->getKind()) {
+  case Expr::NotOptimized:
+    return refine(e->getKid(0), narrowed);
+  case Expr::Read:
+    return refineRead(*cast<ReadExpr>(e), narrowed);
+  case Expr::Select: {
+    BitsRange c = compute(e->getKid(0));
+    if (c.isFixed())
+      return refine(e->getKid(c.lo ? 1 : 2), narrowed);
+    if (compute(e->getKid(1)).meet(narrowed).empty)
+      return refine(e->getKid(0), BitsRange(1, 0)) &&
+             refine(e->getKid(2), narrowed);
+    if (compute(e->getKid(2)).meet(narrowed).empty)
+      return refine(e->getKid(0), BitsRange(1, 1)) &&
+             refine(e->getKid(1), narrowed);
+    return true;
+  }
+  case Expr::Concat: {
+    ref<Expr> a = e->getKid(0), b = e->getKid(1);
+    Expr::Width bw = b->getWidth();
+    uint64_t bm = getMask(bw);
+    return refine(a, BitsRange::bits(a->getWidth(), narrowed.zeros >> bw,
+                                     narrowed.ones >> bw)
+                         .meet(BitsRange::range(a->getWidth(),
+                                                narrowed.lo >> bw,
+                                                narrowed.hi >> bw))) &&
+           refine(b, BitsRange::bits(bw, narrowed.zeros & bm,
+                                     narrowed.ones & bm));
+  }
+  case Expr::Extract: {
+    ref<Expr> a = e->getKid(0);
+    unsigned offset = cast<ExtractExpr>(e)->offset;
+    if (a->getWidth() > 64)
+      return true;
+    return refine(a, BitsRange::bits(a->getWidth(), narrowed.zeros << offset,
+                                     narrowed.ones << offset));
+  }
+  case Expr::ZExt: {
+    ref<Expr> a = e->getKid(0);
+    Expr::Width aw = a->getWidth();
+    uint64_t am = getMask(aw);
+    return refine(a, BitsRange::bits(aw, narrowed.zeros & am,
+                                     narrowed.ones & am)
+                         .meet(BitsRange::range(aw, narrowed.lo,
+                                                std::min(narrowed.hi, am))));
+  }
+  case Expr::SExt: {
+    ref<Expr> a = e->getKid(0);
+    Expr::Width aw = a->getWidth();
+    uint64_t am = getMask(aw);
+    return refine(a, BitsRange::bits(aw, narrowed.zeros & am,
+                                     narrowed.ones & am));
+  }
+  case Expr::Add: {
+    ref<Expr> a = e->getKid(0), b = e->getKid(1);
+    return refine(a, sub(narrowed, compute(b))) &&
+           refine(b, sub(narrowed, compute(a)));
+  }
+  case Expr::Sub: {
+    ref<Expr> a = e->getKid(0), b = e->getKid(1);
+    return refine(a, add(narrowed, compute(b), false)) &&
+           refine(b, sub(compute(a), narrowed));
+  }
+  case Expr::Not:
+    return refine(e->getKid(0), complement(narrowed));
+  case Expr::And: {
+    ref<Expr> a = e->getKid(0), b = e->getKid(1);
+    BitsRange av = compute(a), bv = compute(b);
+    return refine(a, BitsRange::bits(w, narrowed.zeros & bv.ones,
+                                     narrowed.ones)) &&
+           refine(b, BitsRange::bits(w, narrowed.zeros & av.ones,
+                                     narrowed.ones));
+  }
+  case Expr::Or: {
+    ref<Expr> a = e->getKid(0), b = e->getKid(1);
+    BitsRange av = compute(a), bv = compute(b);
+    return refine(a, BitsRange::bits(w, narrowed.zeros,
+                                     narrowed.ones & bv.zeros)) &&
+           refine(b, BitsRange::bits(w, narrowed.zeros,
+                                     narrowed.ones & av.zeros));
+  }
+  case Expr::Xor: {
+    ref<Expr> a = e->getKid(0), b = e->getKid(1);
+    BitsRange av = compute(a), bv = compute(b);
+    return refine(a, BitsRange::bits(
+                         w, (narrowed.zeros & bv.zeros) | (narrowed.ones & bv.ones),
+                         (narrowed.zeros & bv.ones) | (narrowed.ones & bv.zeros))) &&
+           refine(b, BitsRange::bits(
+                         w, (narrowed.zeros & av.zeros) | (narrowed.ones & av.ones),
+                         (narrowed.zeros & av.ones) | (narrowed.ones & av.zeros)));
+  }
+  case Expr::Shl:
+  case Expr::LShr: {
+    BitsRange b = compute(e->getKid(1));
+    if (!b.isFixed() || b.lo >= w)
+      return true;
+    uint64_t k = b.lo;
+    if (e->getKind() == Expr::Shl)
+      return refine(e->getKid(0), BitsRange::bits(w, narrowed.zeros >> k,
+                                                   narrowed.ones >> k));
+    return refine(e->getKid(0),
+                  BitsRange::bits(w, (narrowed.zeros << k) & m,
+                                  (narrowed.ones << k) & m));
+  }
+  case Expr::Eq:
+  case Expr::Ne: {
+    if (!narrowed.isFixed())
+      return true;
+    ref<Expr> a = e->getKid(0), b = e->getKid(1);
+    BitsRange av = compute(a), bv = compute(b);
+    if ((e->getKind() == Expr::Eq) == (narrowed.lo != 0))
+      return refine(a, bv) && refine(b, compute(a));
+    // A value known to differ from a constant only helps at the ends
+    // of its interval.
+    if (bv.isFixed() && av.isSupported()) {
+      std::swap(a, b);
+      std::swap(av, bv);
+    }
+    if (!av.isFixed() || !bv.isSupported())
+      return true;
+    if (bv.lo == av.lo && bv.hi == av.lo)
+      return false;
+    if (bv.lo == av.lo)
+      return refine(b, BitsRange::range(bv.width, av.lo + 1, bv.getMax()));
+    if (bv.hi == av.lo)
+      return refine(b, BitsRange::range(bv.width, 0, av.lo - 1));
+    return true;
+  }
+  case Expr::Ult:
+  case Expr::Ule:
+  case Expr::Ugt:
+  case Expr::Uge:
+  case Expr::Slt:
+  case Expr::Sle:
+  case Expr::Sgt:
+  case Expr::Sge: {
+    if (!narrowed.isFixed())
+      return true;
+    Expr::Kind kind = e->getKind();
+    ref<Expr> a = e->getKid(0), b = e->getKid(1);
+    bool value = narrowed.lo;
+    switch (kind) {
+    case Expr::Ugt: return refineCompare(Expr::Ult, b, a, value);
+    case Expr::Uge: return refineCompare(Expr::Ule, b, a, value);
+    case Expr::Sgt: return refineCompare(Expr::Slt, b, a, value);
+    case Expr::Sge: return refineCompare(Expr::Sle, b, a, value);
+    default: return refineCompare(kind, a, b, value);
+    }
+  }
+  default:
+    return true;
+  }
+}
+
+bool KnownBitsPropagator::propagate() {
+  for (unsigned round = 0; round != MaxRounds; ++round) {
+    changed = false;
+    values.clear();
+    for (unsigned i = 0; i != facts.size(); ++i)
+      if (!refine(facts[i].first, BitsRange(1, facts[i].second)))
+        return false;
+    if (!changed)
+      break;
+  }
+  values.clear();
+  return true;
+}
+
+/***/
+
+namespace {
+class KnownBitsSolver : public IncompleteSolver {
+  /// Decide \a query from the known bits and intervals of the values
+  /// it reads. When \a checkFalse is set, also try to prove the
+  /// expression false.
+  ///
+  /// As elsewhere in the solver chain, the constraints are assumed to
+  /// be satisfiable, so an expression false under every assignment
+  /// allowed by the constraints must be false.
+  IncompleteSolver::PartialValidity solve(const Query &query,
+                                          bool checkFalse);
+
+public:
+  IncompleteSolver::PartialValidity computeValidity(const Query &query) {
+    return solve(query, true);
+  }
+  IncompleteSolver::PartialValidity computeTruth(const Query &query) {
+    IncompleteSolver::PartialValidity result = solve(query, true);
+    if (result == MustBeFalse)
+      return MayBeFalse;
+    return result == MustBeTrue ? MustBeTrue : None;
+  }
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+};
+}
+
+static void addConstraints(KnownBitsPropagator &p, const Query &query) {
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                         ie = query.constraints.end();
+       it != ie; ++it)
+    p.addFact(*it, true);
+}
+
+IncompleteSolver::PartialValidity
+KnownBitsSolver::solve(const Query &query, bool checkFalse) {
+  KnownBitsPropagator base;
+  addConstraints(base, query);
+  // Contradictory constraints make anything valid.
+  if (!base.propagate())
+    return MustBeTrue;
+
+  BitsRange value = base.evaluate(query.expr);
+  if (value.isFixed())
+    return value.lo ? MustBeTrue : MustBeFalse;
+
+  KnownBitsPropagator negated(base);
+  negated.addFact(query.expr, false);
+  if (!negated.propagate())
+    return MustBeTrue;
+
+  if (checkFalse) {
+    KnownBitsPropagator asserted(base);
+    asserted.addFact(query.expr, true);
+    if (!asserted.propagate())
+      return MustBeFalse;
+  }
+  return None;
+}
+
+bool KnownBitsSolver::computeValue(const Query &query, ref<Expr> &result) {
+  KnownBitsPropagator p;
+  addConstraints(p, query);
+  if (!p.propagate())
+    return false;
+  BitsRange value = p.evaluate(query.expr);
+  if (!value.isSupported() || !value.isFixed())
+    return false;
+  result = ConstantExpr::create(value.lo, value.width);
+  return true;
+}
+
+bool KnownBitsSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  // Propagation narrows values but does not pick any, so it can only
+  // show there is no solution.
+  KnownBitsPropagator p;
+  addConstraints(p, query);
+  p.addFact(query.expr, false);
+  if (p.propagate())
+    return false;
+  hasSolution = false;
+  return true;
+}
+
+Solver *klee::createKnownBitsSolver(Solver *s) {
+  return new Solver(new StagedSolverImpl(new KnownBitsSolver(), s));
+}
@@ -0,0 +1,483 @@
+//===-- LinearEquationSolver.cpp ------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/IncompleteSolver.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprUtil.h"
+
+#include <map>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+/// Larger systems are left to the underlying solver.
+const unsigned MaxVariables = 512;
+const unsigned MaxEquations = 512;
+
+inline uint64_t getMask(Expr::Width w) {
+  return w >= 64 ? ~0ULL : (1ULL << w) - 1;
+}
+
+inline unsigned countTrailingZeros(uint64_t v) {
+  unsigned n = 0;
+  while (n != 64 && !(v & (1ULL << n)))
+    ++n;
+  return n;
+}
+
+/// getInverse - The inverse of an odd \a u modulo 2^64, by Newton's
+/// iteration, which doubles the correct bits each step.
+inline uint64_t getInverse(uint64_t u) {
+  uint64_t x = u;
+  for (unsigned i = 0; i != 5; ++i)
+    x *= 2 - u * x;
+  return x;
+}
+
+/// A symbolic byte, read at a constant index.
+typedef std::pair<const Array *, uint64_t> Variable;
+
+/// LinearForm - A sum of symbolic bytes times coefficients plus a
+/// constant, modulo 2^width.
+struct LinearForm {
+  Expr::Width width;
+  std::map<Variable, uint64_t> coefficients;
+  uint64_t constant;
+  /// Whether the form is the value itself, with no wrap around, so that
+  /// it stays the same when zero extended.
+  bool exact;
+
+  LinearForm() : width(0), constant(0), exact(false) {}
+
+  void scale(uint64_t factor) {
+    uint64_t m = getMask(width);
+    for (std::map<Variable, uint64_t>::iterator it = coefficients.begin(),
+                                                ie = coefficients.end();
+         it != ie;) {
+      it->second = (it->second * factor) & m;
+      if (!it->second)
+        coefficients.erase(it++);
+      else
+        ++it;
+    }
+    constant = (constant * factor) & m;
+  }
+
+  void add(const LinearForm &b, uint64_t factor) {
+    uint64_t m = getMask(width);
+    for (std::map<Variable, uint64_t>::const_iterator
+             it = b.coefficients.begin(), ie = b.coefficients.end();
+         it != ie; ++it) {
+      uint64_t &c = coefficients[it->first];
+      c = (c + it->second * factor) & m;
+      if (!c)
+        coefficients.erase(it->first);
+    }
+    constant = (constant + b.constant * factor) & m;
+  }
+
+  void truncate(Expr::Width w) {
+    width = w;
+    scale(1);
+  }
+};
+
+/// linearize - Write \a e as a linear form over the symbolic bytes, if it
+/// is one.
+bool linearize(const ref<Expr> &e, LinearForm &f) {
+  Expr::Width w = e->getWidth();
+  if (w > 64)
+    return false;
+  f = LinearForm();
+  f.width = w;
+
+  switch (e->getKind()) {
+  case Expr::Constant:
+    f.constant = cast<ConstantExpr>(e)->getZExtValue();
+    f.exact = true;
+    return true;
+  case Expr::NotOptimized:
+    return linearize(e->getKid(0), f);
+  case Expr::Read: {
+    const ReadExpr *re = cast<ReadExpr>(e);
+    const ConstantExpr *index = dyn_cast<ConstantExpr>(re->index);
+    const Array *root = re->updates.root;
+    if (!index || root->getRange() != Expr::Int8)
+      return false;
+    uint64_t i = index->getZExtValue();
+    for (const UpdateNode *un = re->updates.head; un; un = un->next) {
+      const ConstantExpr *ui = dyn_cast<ConstantExpr>(un->index);
+      if (!ui)
+        return false;
+      if (ui->getZExtValue() == i)
+        return linearize(un->value, f);
+    }
+    if (i >= root->size)
+      return false;
+    if (root->isConstantArray())
+      f.constant = root->constantValues[i]->getZExtValue();
+    else
+      f.coefficients[std::make_pair(root, i)] = 1;
+    f.exact = true;
+    return true;
+  }
+  case Expr::Add:
+  case Expr::Sub: {
+    LinearForm b;
+    if (!linearize(e->getKid(0), f) || !linearize(e->getKid(1), b))
+      return false;
+    f.add(b, e->getKind() == Expr::Add ? 1 : getMask(w));
+    f.exact = false;
+    return true;
+  }
+  case Expr::Mul: {
+    // Constants are on the left in canonical multiplications.
+    const ConstantExpr *ce = dyn_cast<ConstantExpr>(e->getKid(0));
+    if (!ce || !linearize(e->getKid(1), f))
+      return false;
+    f.scale(ce->getZExtValue());
+    f.exact = false;
+    return true;
+  }
+  case Expr::Shl: {
+    const ConstantExpr *ce = dyn_cast<ConstantExpr>(e->getKid(1));
+    if (!ce || ce->getZExtValue() >= w || !linearize(e->getKid(0), f))
+      return false;
+    f.scale(1ULL << ce->getZExtValue());
+    f.exact = false;
+    return true;
+  }
+  case Expr::Not:
+    // ~x = -x - 1
+    if (!linearize(e->getKid(0), f))
+      return false;
+    f.scale(getMask(w));
+    f.constant = (f.constant + getMask(w)) & getMask(w);
+    f.exact = false;
+    return true;
+  case Expr::Concat: {
+    LinearForm b;
+    if (!linearize(e->getKid(0), f) || !linearize(e->getKid(1), b) ||
+        !b.exact)
+      return false;
+    bool exact = f.exact;
+    f.width = w;
+    f.scale(1ULL << b.width);
+    b.width = w;
+    f.add(b, 1);
+    f.exact = exact;
+    return true;
+  }
+  case Expr::Extract:
+    if (cast<ExtractExpr>(e)->offset || !linearize(e->getKid(0), f))
+      return false;
+    f.truncate(w);
+    f.exact = false;
+    return true;
+  case Expr::ZExt:
+    if (!linearize(e->getKid(0), f) || !f.exact)
+      return false;
+    f.width = w;
+    return true;
+  default:
+    return false;
+  }
+}
+
+/// LinearSystem - The linear equalities among a set of facts, solved
+/// modulo a power of two by Gaussian elimination.
+class LinearSystem {
+  /// Every equation as a form equal to zero.
+  std::vector<LinearForm> equations;
+
+public:
+  enum Result { Unsatisfiable, Solved, Unknown };
+
+  /// Collect the linear equalities \a e implies when it is \a value.
+  /// Anything else it implies is ignored, so the system is a relaxation
+  /// of the facts.
+  void addFact(const ref<Expr> &e, bool value);
+
+  bool empty() const { return equations.empty(); }
+
+  /// Solve the system. Unsatisfiable is only returned if it has no
+  /// solution; Solved gives one solution in \a model, with the unused
+  /// bytes 0.
+  Result solve(std::map<Variable, uint64_t> &model) const;
+};
+}
+
+void LinearSystem::addFact(const ref<Expr> &e, bool value) {
+  switch (e->getKind()) {
+  case Expr::Not:
+    addFact(e->getKid(0), !value);
+    return;
+  case Expr::And:
+    if (value && e->getWidth() == Expr::Bool) {
+      addFact(e->getKid(0), true);
+      addFact(e->getKid(1), true);
+    }
+    return;
+  case Expr::Or:
+    if (!value && e->getWidth() == Expr::Bool) {
+      addFact(e->getKid(0), false);
+      addFact(e->getKid(1), false);
+    }
+    return;
+  case Expr::Eq: {
+    ref<Expr> a = e->getKid(0), b = e->getKid(1);
+    if (a->getWidth() == Expr::Bool) {
+      // (Eq false x) is how negations are written.
+      if (ConstantExpr *ce = dyn_cast<ConstantExpr>(a))
+        addFact(b, ce->isTrue() == value);
+      return;
+    }
+    LinearForm lhs, rhs;
+    if (!value || !linearize(a, lhs) || !linearize(b, rhs))
+      return;
+    lhs.add(rhs, getMask(lhs.width));
+    equations.push_back(lhs);
+    return;
+  }
+  default:
+    return;
+  }
+}
+
+LinearSystem::Result
+LinearSystem::solve(std::map<Variable, uint64_t> &model) const {
+  if (equations.size() > MaxEquations)
+    return Unknown;
+
+  // An equation modulo 2^w holds exactly when it does modulo 2^W once
+  // multiplied by 2^(W-w), so all of them are lifted to the widest.
+  Expr::Width width = 0;
+  std::map<Variable, unsigned> indices;
+  std::vector<Variable> variables;
+  for (unsigned i = 0; i != equations.size(); ++i) {
+    width = std::max(width, equations[i].width);
+    for (std::map<Variable, uint64_t>::const_iterator
+             it = equations[i].coefficients.begin(),
+             ie = equations[i].coefficients.end();
+         it != ie; ++it) {
+      if (indices.insert(std::make_pair(it->first, variables.size())).second)
+        variables.push_back(it->first);
+    }
+  }
+  if (variables.size() > MaxVariables)
+    return Unknown;
+
+  // Each row holds the coefficients followed by the right hand side.
+  unsigned n = variables.size();
+  uint64_t m = getMask(width);
+  std::vector<std::vector<uint64_t> > rows;
+  for (unsigned i = 0; i != equations.size(); ++i) {
+    const LinearForm &f = equations[i];
+    unsigned lift = width - f.width;
+    std::vector<uint64_t> row(n + 1, 0);
+    for (std::map<Variable, uint64_t>::const_iterator
+             it = f.coefficients.begin(), ie = f.coefficients.end();
+         it != ie; ++it)
+      row[indices[it->first]] = (it->second << lift) & m;
+    row[n] = ((0 - f.constant) << lift) & m;
+    rows.push_back(row);
+  }
+
+  // Bring the rows to echelon form, choosing as pivot the coefficient
+  // with the fewest trailing zeros so that it divides the others.
+  std::vector<unsigned> pivots;
+  unsigned rank = 0;
+  for (unsigned col = 0; col != n && rank != rows.size(); ++col) {
+    unsigned best = rows.size(), bestZeros = width;
+    for (unsigned r = rank; r != rows.size(); ++r) {
+      if (!rows[r][col])
+        continue;
+      unsigned zeros = countTrailingZeros(rows[r][col]);
+      if (zeros < bestZeros) {
+        best = r;
+        bestZeros = zeros;
+      }
+    }
+    if (best == rows.size())
+      continue;
+    std::swap(rows[rank], rows[best]);
+    std::vector<uint64_t> &pivot = rows[rank];
+    uint64_t inverse = getInverse(pivot[col] >> bestZeros);
+    for (unsigned j = 0; j != n + 1; ++j)
+      pivot[j] = (pivot[j] * inverse) & m;
+    for (unsigned r = rank + 1; r != rows.size(); ++r) {
+      uint64_t factor = rows[r][col] >> bestZeros;
+      if (!factor)
+        continue;
+      for (unsigned j = 0; j != n + 1; ++j)
+        rows[r][j] = (rows[r][j] - factor * pivot[j]) & m;
+    }
+    pivots.push_back(col);
+    ++rank;
+  }
+
+  // A row whose coefficients are all multiples of 2^k has no solution
+  // unless its right hand side is one too.
+  for (unsigned r = 0; r != rows.size(); ++r) {
+    unsigned zeros = width;
+    for (unsigned j = 0; j != n; ++j)
+      if (rows[r][j])
+        zeros = std::min(zeros, countTrailingZeros(rows[r][j]));
+    if (rows[r][n] & getMask(zeros))
+      return Unsatisfiable;
+  }
+
+  // Back substitute with the free bytes at 0. The system may still have
+  // solutions when this fails, so it only gives up.
+  std::vector<uint64_t> values(n, 0);
+  for (unsigned i = rank; i-- != 0;) {
+    const std::vector<uint64_t> &row = rows[i];
+    unsigned col = pivots[i], zeros = countTrailingZeros(row[col]);
+    uint64_t rhs = row[n];
+    for (unsigned j = 0; j != n; ++j)
+      if (j != col)
+        rhs = (rhs - row[j] * values[j]) & m;
+    if (rhs & getMask(zeros))
+      return Unknown;
+    values[col] = rhs >> zeros;
+    if (values[col] > 0xFF)
+      return Unknown;
+  }
+
+  for (unsigned i = 0; i != n; ++i)
+    model[variables[i]] = values[i];
+  return Solved;
+}
+
+/***/
+
+namespace {
+class LinearEquationSolver : public IncompleteSolver {
+  /// Look for an assignment satisfying the constraints of \a query and
+  /// giving \a expr the value \a value, or prove there is none.
+  LinearSystem::Result solve(const Query &query, bool value,
+                             std::vector<const Array *> &objects,
+                             std::vector<std::vector<unsigned char> > &values);
+
+public:
+  IncompleteSolver::PartialValidity computeTruth(const Query &);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+};
+}
+
+LinearSystem::Result LinearEquationSolver::solve(
+    const Query &query, bool value, std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values) {
+  LinearSystem system;
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                         ie = query.constraints.end();
+       it != ie; ++it)
+    system.addFact(*it, true);
+  system.addFact(query.expr, value);
+  if (system.empty())
+    return LinearSystem::Unknown;
+
+  std::map<Variable, uint64_t> model;
+  LinearSystem::Result result = system.solve(model);
+  if (result != LinearSystem::Solved)
+    return result;
+
+  // The rest of the query is not linear, so check the solution against
+  // all of it.
+  std::vector<ref<Expr> > exprs(query.constraints.begin(),
+                                query.constraints.end());
+  exprs.push_back(query.expr);
+  findSymbolicObjects(exprs.begin(), exprs.end(), objects);
+  for (unsigned i = 0; i != objects.size(); ++i) {
+    values.push_back(std::vector<unsigned char>(objects[i]->size, 0));
+    for (unsigned j = 0; j != objects[i]->size; ++j) {
+      std::map<Variable, uint64_t>::iterator it =
+          model.find(std::make_pair(objects[i], j));
+      if (it != model.end())
+        values.back()[j] = it->second;
+    }
+  }
+
+  Assignment assignment(objects, values);
+  exprs.back() = value ? query.expr : Expr::createIsZero(query.expr);
+  if (!assignment.satisfies(exprs.begin(), exprs.end()))
+    return LinearSystem::Unknown;
+  return LinearSystem::Solved;
+}
+
+IncompleteSolver::PartialValidity
+LinearEquationSolver::computeTruth(const Query &query) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char> > values;
+  switch (solve(query, false, objects, values)) {
+  case LinearSystem::Unsatisfiable:
+    return MustBeTrue;
+  case LinearSystem::Solved:
+    return MayBeFalse;
+  default:
+    return None;
+  }
+}
+
+bool LinearEquationSolver::computeValue(const Query &query,
+                                        ref<Expr> &result) {
+  // Any value the expression takes in a solution of the constraints will
+  // do, so solve them with the expression left free.
+  Query constraints = query.withFalse();
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char> > values;
+  if (solve(constraints, false, objects, values) != LinearSystem::Solved)
+    return false;
+  std::vector<ref<Expr> > exprs(1, query.expr);
+  findSymbolicObjects(exprs.begin(), exprs.end(), objects);
+  values.resize(objects.size());
+  for (unsigned i = 0; i != objects.size(); ++i)
+    values[i].resize(objects[i]->size);
+  result = Assignment(objects, values).evaluate(query.expr);
+  return isa<ConstantExpr>(result);
+}
+
+bool LinearEquationSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  std::vector<const Array *> found;
+  std::vector<std::vector<unsigned char> > foundValues;
+  switch (solve(query, false, found, foundValues)) {
+  case LinearSystem::Unsatisfiable:
+    hasSolution = false;
+    return true;
+  case LinearSystem::Solved: {
+    Assignment assignment(found, foundValues);
+    for (unsigned i = 0; i != objects.size(); ++i) {
+      Assignment::bindings_ty::iterator it =
+          assignment.bindings.find(objects[i]);
+      values.push_back(it != assignment.bindings.end()
+                           ? it->second
+                           : std::vector<unsigned char>(objects[i]->size, 0));
+    }
+    hasSolution = true;
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+Solver *klee::createLinearEquationSolver(Solver *s) {
+  return new Solver(new StagedSolverImpl(new LinearEquationSolver(), s));
+}
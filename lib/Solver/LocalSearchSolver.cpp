@@ -0,0 +1,380 @@
+//===-- LocalSearchSolver.cpp ---------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/Statistic.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprUtil.h"
+#include "klee/Internal/ADT/RNG.h"
+#include "klee/Internal/Support/Timer.h"
+
+#include <deque>
+#include <set>
+
+using namespace klee;
+
+namespace {
+/// The number of recent solutions kept to start searches from.
+const unsigned MaxStarts = 16;
+/// Searches over more bytes than this are left to the underlying solver.
+const unsigned MaxBytes = 4096;
+
+/// Target - A fact the search has to make true, with the bytes it reads
+/// and the byte values of its constants, which are likely choices.
+struct Target {
+  ref<Expr> expr;
+  std::vector<std::pair<const Array *, unsigned> > bytes;
+  std::vector<unsigned char> constants;
+};
+
+void collectConstants(const ref<Expr> &e, std::set<const Expr *> &visited,
+                      std::set<unsigned char> &constants) {
+  if (!visited.insert(e.get()).second)
+    return;
+  if (ConstantExpr *ce = dyn_cast<ConstantExpr>(e)) {
+    if (ce->getWidth() <= 64)
+      for (uint64_t v = ce->getZExtValue(), i = 0; i < ce->getWidth();
+           i += 8, v >>= 8)
+        constants.insert(v & 0xFF);
+    return;
+  }
+  if (ReadExpr *re = dyn_cast<ReadExpr>(e))
+    for (const UpdateNode *un = re->updates.head; un; un = un->next)
+      collectConstants(un->value, visited, constants);
+  for (unsigned i = 0; i != e->getNumKids(); ++i)
+    collectConstants(e->getKid(i), visited, constants);
+}
+}
+
+/// LocalSearchSolver - Looks for solutions by stochastic local search over
+/// the bytes of the symbolic arrays before asking the underlying solver.
+///
+/// An assignment is scored by the number of facts it satisfies. Each step
+/// picks an unsatisfied fact and one of the bytes it reads, and tries a
+/// few values for the byte: the bytes of the fact's constants, its
+/// neighbours, a flipped bit and a random one. The best is kept, or now
+/// and then a random one to escape local optima. Searches start from
+/// the best of the recent solutions, so that queries along a path, which
+/// share most of their constraints, start close to a solution.
+///
+/// The search only ever finds solutions, so it answers satisfiable
+/// queries and leaves proving anything valid to the underlying solver.
+class LocalSearchSolver : public SolverImpl {
+  Solver *solver;
+  unsigned maxFlips;
+  uint64_t maxMicroseconds;
+  RNG rng;
+  std::deque<Assignment> starts;
+  /// The running average time of the underlying solver, used to estimate
+  /// the time each hit saves.
+  double averageMicroseconds;
+  uint64_t numDelegated;
+
+  unsigned score(Assignment &a, const std::vector<Target> &targets,
+                 std::vector<unsigned> *unsatisfied);
+  /// Look for an assignment to \a objects satisfying every fact in
+  /// \a facts.
+  bool search(std::vector<ref<Expr> > &facts,
+              std::vector<const Array *> &objects, Assignment &result);
+  bool search(const Query &query, bool value,
+              std::vector<const Array *> &objects, Assignment &result);
+  void addStart(const Assignment &a);
+  void recordHit(uint64_t microseconds);
+  void recordDelegated(uint64_t microseconds);
+
+public:
+  LocalSearchSolver(Solver *_solver, unsigned _maxFlips, double maxTime)
+      : solver(_solver), maxFlips(_maxFlips),
+        maxMicroseconds((uint64_t)(maxTime * 1000000.)),
+        averageMicroseconds(0), numDelegated(0) {}
+  ~LocalSearchSolver() { delete solver; }
+
+  bool computeValidity(const Query &, Solver::Validity &result);
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+  char *getConstraintLog(const Query &);
+  void setCoreSolverTimeout(double timeout);
+};
+
+unsigned LocalSearchSolver::score(Assignment &a,
+                                  const std::vector<Target> &targets,
+                                  std::vector<unsigned> *unsatisfied) {
+  unsigned satisfied = 0;
+  for (unsigned i = 0; i != targets.size(); ++i) {
+    ref<Expr> value = a.evaluate(targets[i].expr);
+    ConstantExpr *ce = dyn_cast<ConstantExpr>(value);
+    if (ce && ce->isTrue())
+      ++satisfied;
+    else if (unsatisfied)
+      unsatisfied->push_back(i);
+  }
+  return satisfied;
+}
+
+void LocalSearchSolver::addStart(const Assignment &a) {
+  starts.push_front(a);
+  if (starts.size() > MaxStarts)
+    starts.pop_back();
+}
+
+void LocalSearchSolver::recordHit(uint64_t microseconds) {
+  ++stats::localSearchHits;
+  if (averageMicroseconds > microseconds)
+    stats::localSearchSavedTime +=
+        (uint64_t)(averageMicroseconds - microseconds);
+}
+
+void LocalSearchSolver::recordDelegated(uint64_t microseconds) {
+  ++numDelegated;
+  averageMicroseconds += (microseconds - averageMicroseconds) / numDelegated;
+}
+
+bool LocalSearchSolver::search(std::vector<ref<Expr> > &facts,
+                               std::vector<const Array *> &objects,
+                               Assignment &result) {
+  WallTimer timer;
+  findSymbolicObjects(facts.begin(), facts.end(), objects);
+  unsigned numBytes = 0;
+  for (unsigned i = 0; i != objects.size(); ++i)
+    numBytes += objects[i]->size;
+  if (objects.empty() || numBytes > MaxBytes)
+    return false;
+
+  std::vector<Target> targets(facts.size());
+  for (unsigned i = 0; i != facts.size(); ++i) {
+    Target &t = targets[i];
+    t.expr = facts[i];
+    std::vector<ref<ReadExpr> > reads;
+    findReads(facts[i], true, reads);
+    std::set<std::pair<const Array *, unsigned> > bytes;
+    for (unsigned j = 0; j != reads.size(); ++j) {
+      const Array *root = reads[j]->updates.root;
+      if (root->isConstantArray() || !root->size)
+        continue;
+      // A symbolic index may read any byte.
+      if (ConstantExpr *index = dyn_cast<ConstantExpr>(reads[j]->index)) {
+        if (index->getZExtValue() < root->size)
+          bytes.insert(std::make_pair(root, index->getZExtValue()));
+      } else {
+        for (unsigned k = 0; k != root->size; ++k)
+          bytes.insert(std::make_pair(root, k));
+      }
+    }
+    t.bytes.assign(bytes.begin(), bytes.end());
+    std::set<const Expr *> visited;
+    std::set<unsigned char> constants;
+    collectConstants(facts[i], visited, constants);
+    t.constants.assign(constants.begin(), constants.end());
+  }
+
+  // Start from the best of the recent solutions, with the bytes they do
+  // not bind at 0.
+  std::vector<std::vector<unsigned char> > zeros;
+  for (unsigned i = 0; i != objects.size(); ++i)
+    zeros.push_back(std::vector<unsigned char>(objects[i]->size, 0));
+  Assignment current(objects, zeros);
+  unsigned best = score(current, targets, 0);
+  for (std::deque<Assignment>::iterator it = starts.begin(),
+                                        ie = starts.end();
+       it != ie && best != targets.size(); ++it) {
+    Assignment start(objects, zeros);
+    for (unsigned i = 0; i != objects.size(); ++i) {
+      Assignment::bindings_ty::const_iterator binding =
+          it->bindings.find(objects[i]);
+      if (binding != it->bindings.end() &&
+          binding->second.size() == objects[i]->size)
+        start.bindings[objects[i]] = binding->second;
+    }
+    unsigned s = score(start, targets, 0);
+    if (s > best) {
+      best = s;
+      current = start;
+    }
+  }
+
+  std::vector<unsigned> unsatisfied;
+  score(current, targets, &unsatisfied);
+  for (unsigned flip = 0; !unsatisfied.empty(); ++flip) {
+    if (flip == maxFlips ||
+        ((flip & 15) == 0 && timer.check() > maxMicroseconds))
+      return false;
+
+    const Target &t = targets[unsatisfied[rng.getInt32() %
+                                          unsatisfied.size()]];
+    if (t.bytes.empty())
+      return false;
+    const std::pair<const Array *, unsigned> &byte =
+        t.bytes[rng.getInt32() % t.bytes.size()];
+    unsigned char &slot = current.bindings[byte.first][byte.second];
+    unsigned char old = slot;
+
+    std::vector<unsigned char> candidates;
+    for (unsigned i = 0; i != t.constants.size() && i != 8; ++i)
+      candidates.push_back(
+          t.constants.size() > 8
+              ? t.constants[rng.getInt32() % t.constants.size()]
+              : t.constants[i]);
+    candidates.push_back(old + 1);
+    candidates.push_back(old - 1);
+    candidates.push_back(old ^ (1 << (rng.getInt32() % 8)));
+    candidates.push_back(rng.getInt32());
+
+    // Mostly pick the candidate satisfying the most facts, sometimes a
+    // random one.
+    unsigned char chosen = candidates[rng.getInt32() % candidates.size()];
+    if (rng.getInt32() % 10) {
+      int bestScore = -1;
+      for (unsigned i = 0; i != candidates.size(); ++i) {
+        slot = candidates[i];
+        int s = score(current, targets, 0);
+        if (s > bestScore) {
+          bestScore = s;
+          chosen = candidates[i];
+        }
+      }
+    }
+    slot = chosen;
+    unsatisfied.clear();
+    score(current, targets, &unsatisfied);
+  }
+
+  result = current;
+  return true;
+}
+
+bool LocalSearchSolver::search(const Query &query, bool value,
+                               std::vector<const Array *> &objects,
+                               Assignment &result) {
+  ref<Expr> target = value ? query.expr : Expr::createIsZero(query.expr);
+  if (ConstantExpr *ce = dyn_cast<ConstantExpr>(target))
+    if (ce->isFalse())
+      return false;
+
+  WallTimer timer;
+  std::vector<ref<Expr> > facts(query.constraints.begin(),
+                                query.constraints.end());
+  if (!isa<ConstantExpr>(target))
+    facts.push_back(target);
+  bool success = search(facts, objects, result);
+  uint64_t elapsed = timer.check();
+  stats::localSearchTime += elapsed;
+  if (success) {
+    addStart(result);
+    recordHit(elapsed);
+  } else {
+    ++stats::localSearchMisses;
+  }
+  return success;
+}
+
+bool LocalSearchSolver::computeValidity(const Query &query,
+                                        Solver::Validity &result) {
+  // Solutions on both sides show the expression may be either.
+  std::vector<const Array *> objects;
+  Assignment a;
+  if (search(query, false, objects, a)) {
+    objects.clear();
+    if (search(query, true, objects, a)) {
+      result = Solver::Unknown;
+      return true;
+    }
+  }
+  WallTimer timer;
+  bool success = solver->impl->computeValidity(query, result);
+  recordDelegated(timer.check());
+  return success;
+}
+
+bool LocalSearchSolver::computeTruth(const Query &query, bool &isValid) {
+  std::vector<const Array *> objects;
+  Assignment a;
+  if (search(query, false, objects, a)) {
+    isValid = false;
+    return true;
+  }
+  WallTimer timer;
+  bool success = solver->impl->computeTruth(query, isValid);
+  recordDelegated(timer.check());
+  return success;
+}
+
+bool LocalSearchSolver::computeValue(const Query &query, ref<Expr> &result) {
+  // Any solution of the constraints gives a value.
+  std::vector<const Array *> objects;
+  Assignment a;
+  if (search(query.withFalse(), false, objects, a)) {
+    std::vector<ref<Expr> > exprs(1, query.expr);
+    std::vector<const Array *> unbound;
+    findSymbolicObjects(exprs.begin(), exprs.end(), unbound);
+    for (unsigned i = 0; i != unbound.size(); ++i)
+      a.bindings.insert(std::make_pair(
+          unbound[i], std::vector<unsigned char>(unbound[i]->size, 0)));
+    result = a.evaluate(query.expr);
+    if (isa<ConstantExpr>(result))
+      return true;
+  }
+  WallTimer timer;
+  bool success = solver->impl->computeValue(query, result);
+  recordDelegated(timer.check());
+  return success;
+}
+
+bool LocalSearchSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  std::vector<const Array *> found;
+  Assignment a;
+  if (search(query, false, found, a)) {
+    for (unsigned i = 0; i != objects.size(); ++i) {
+      Assignment::bindings_ty::iterator it = a.bindings.find(objects[i]);
+      values.push_back(it != a.bindings.end()
+                           ? it->second
+                           : std::vector<unsigned char>(objects[i]->size, 0));
+    }
+    hasSolution = true;
+    return true;
+  }
+
+  WallTimer timer;
+  bool success =
+      solver->impl->computeInitialValues(query, objects, values, hasSolution);
+  recordDelegated(timer.check());
+  if (success && hasSolution)
+    addStart(Assignment(objects, values));
+  return success;
+}
+
+SolverImpl::SolverRunStatus LocalSearchSolver::getOperationStatusCode() {
+  return solver->impl->getOperationStatusCode();
+}
+
+char *LocalSearchSolver::getConstraintLog(const Query &query) {
+  return solver->impl->getConstraintLog(query);
+}
+
+void LocalSearchSolver::setCoreSolverTimeout(double timeout) {
+  solver->impl->setCoreSolverTimeout(timeout);
+}
+
+///
+
+Solver *klee::createLocalSearchSolver(Solver *s, unsigned maxFlips,
+                                      double maxTime) {
+  return new Solver(new LocalSearchSolver(s, maxFlips, maxTime));
+}
@@ -0,0 +1,204 @@
+//===-- PersistentCachingSolver.cpp ---------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "QueryStore.h"
+#include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/Statistic.h"
+
+#include "llvm/ADT/APInt.h"
+
+#include <string.h>
+
+using namespace klee;
+
+/// PersistentCachingSolver - Keeps the answers of the underlying solver
+/// in a QueryStore that outlives it.
+class PersistentCachingSolver : public SolverImpl {
+private:
+  Solver *solver;
+  QueryStore *store;
+  Statistic &hits, &misses;
+
+  bool lookup(const QueryHash &hash, QueryStore::Kind kind,
+              std::vector<unsigned char> &payload);
+
+public:
+  PersistentCachingSolver(Solver *s, QueryStore *_store, Statistic &_hits,
+                          Statistic &_misses)
+      : solver(s), store(_store), hits(_hits), misses(_misses) {}
+  ~PersistentCachingSolver() {
+    delete store;
+    delete solver;
+  }
+
+  bool computeValidity(const Query &, Solver::Validity &result);
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+  char *getConstraintLog(const Query &);
+  void setCoreSolverTimeout(double timeout);
+};
+
+bool PersistentCachingSolver::lookup(const QueryHash &hash,
+                                     QueryStore::Kind kind,
+                                     std::vector<unsigned char> &payload) {
+  if (store->lookup(hash, kind, payload)) {
+    ++hits;
+    return true;
+  }
+  ++misses;
+  return false;
+}
+
+bool PersistentCachingSolver::computeValidity(const Query &query,
+                                              Solver::Validity &result) {
+  QueryHash hash = QueryHash::compute(query);
+  std::vector<unsigned char> payload;
+  if (lookup(hash, QueryStore::ValidityAnswer, payload) &&
+      payload.size() == 1) {
+    result = (Solver::Validity)(signed char)payload[0];
+    return true;
+  }
+
+  if (!solver->impl->computeValidity(query, result))
+    return false;
+  store->insert(hash, QueryStore::ValidityAnswer,
+                std::vector<unsigned char>(1, (signed char)result));
+  return true;
+}
+
+bool PersistentCachingSolver::computeTruth(const Query &query,
+                                           bool &isValid) {
+  QueryHash hash = QueryHash::compute(query);
+  std::vector<unsigned char> payload;
+  if (lookup(hash, QueryStore::TruthAnswer, payload) && payload.size() == 1) {
+    isValid = payload[0];
+    return true;
+  }
+  // A known validity answers the truth query as well.
+  if (store->lookup(hash, QueryStore::ValidityAnswer, payload) &&
+      payload.size() == 1) {
+    isValid = (signed char)payload[0] == Solver::True;
+    return true;
+  }
+
+  if (!solver->impl->computeTruth(query, isValid))
+    return false;
+  store->insert(hash, QueryStore::TruthAnswer,
+                std::vector<unsigned char>(1, isValid));
+  return true;
+}
+
+bool PersistentCachingSolver::computeValue(const Query &query,
+                                           ref<Expr> &result) {
+  QueryHash hash = QueryHash::compute(query);
+  std::vector<unsigned char> payload;
+  if (lookup(hash, QueryStore::ValueAnswer, payload) &&
+      payload.size() >= sizeof(uint32_t)) {
+    uint32_t width;
+    memcpy(&width, &payload[0], sizeof(width));
+    unsigned numWords = (width + 63) / 64;
+    if (width &&
+        payload.size() == sizeof(width) + numWords * sizeof(uint64_t)) {
+      std::vector<uint64_t> words(numWords);
+      memcpy(&words[0], &payload[sizeof(width)], numWords * sizeof(uint64_t));
+      result = ConstantExpr::alloc(llvm::APInt(width, numWords, &words[0]));
+      return true;
+    }
+  }
+
+  if (!solver->impl->computeValue(query, result))
+    return false;
+  if (ConstantExpr *ce = dyn_cast<ConstantExpr>(result)) {
+    const llvm::APInt &value = ce->getAPValue();
+    uint32_t width = value.getBitWidth();
+    payload.resize(sizeof(width) + value.getNumWords() * sizeof(uint64_t));
+    memcpy(&payload[0], &width, sizeof(width));
+    memcpy(&payload[sizeof(width)], value.getRawData(),
+           value.getNumWords() * sizeof(uint64_t));
+    store->insert(hash, QueryStore::ValueAnswer, payload);
+  }
+  return true;
+}
+
+bool PersistentCachingSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  QueryHash hash = QueryHash::compute(query, &objects);
+  unsigned total = 0;
+  for (unsigned i = 0; i != objects.size(); ++i)
+    total += objects[i]->size;
+
+  std::vector<unsigned char> payload;
+  if (lookup(hash, QueryStore::InitialValuesAnswer, payload) &&
+      !payload.empty()) {
+    if (!payload[0] && payload.size() == 1) {
+      hasSolution = false;
+      return true;
+    }
+    if (payload[0] && payload.size() == 1 + total) {
+      hasSolution = true;
+      values = std::vector<std::vector<unsigned char> >(objects.size());
+      std::vector<unsigned char>::const_iterator pos = payload.begin() + 1;
+      for (unsigned i = 0; i != objects.size(); ++i) {
+        values[i].assign(pos, pos + objects[i]->size);
+        pos += objects[i]->size;
+      }
+      return true;
+    }
+  }
+
+  if (!solver->impl->computeInitialValues(query, objects, values,
+                                          hasSolution))
+    return false;
+  payload.assign(1, hasSolution);
+  if (hasSolution)
+    for (unsigned i = 0; i != values.size(); ++i)
+      payload.insert(payload.end(), values[i].begin(), values[i].end());
+  store->insert(hash, QueryStore::InitialValuesAnswer, payload);
+  return true;
+}
+
+SolverImpl::SolverRunStatus PersistentCachingSolver::getOperationStatusCode() {
+  return solver->impl->getOperationStatusCode();
+}
+
+char *PersistentCachingSolver::getConstraintLog(const Query &query) {
+  return solver->impl->getConstraintLog(query);
+}
+
+void PersistentCachingSolver::setCoreSolverTimeout(double timeout) {
+  solver->impl->setCoreSolverTimeout(timeout);
+}
+
+///
+
+Solver *klee::createPersistentCachingSolver(Solver *s,
+                                            const std::string &path) {
+  QueryStore *store = createFileQueryStore(path);
+  if (!store)
+    return s;
+  return new Solver(new PersistentCachingSolver(
+      s, store, stats::persistentCacheHits, stats::persistentCacheMisses));
+}
+
+Solver *klee::createSharedCachingSolver(Solver *s, const std::string &name,
+                                        size_t size) {
+  QueryStore *store = createSharedQueryStore(name, size);
+  if (!store)
+    return s;
+  return new Solver(new PersistentCachingSolver(
+      s, store, stats::sharedCacheHits, stats::sharedCacheMisses));
+}
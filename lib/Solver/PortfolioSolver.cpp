@@ -0,0 +1,306 @@
+//===-- PortfolioSolver.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SolverWorker.h"
+#include "klee/Constraints.h"
+#include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/TimerStatIncrementer.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Internal/System/Time.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprUtil.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+
+#include <errno.h>
+#include <poll.h>
+
+using namespace klee;
+
+namespace {
+llvm::cl::opt<unsigned> PortfolioWarmup(
+    "portfolio-warmup", llvm::cl::init(32),
+    llvm::cl::desc("Number of races per query class after which the "
+                   "portfolio solver only runs a backend that won at least "
+                   "90% of them, 0 to always race (default=32)"));
+
+llvm::cl::opt<unsigned> PortfolioRecheck(
+    "portfolio-recheck", llvm::cl::init(64),
+    llvm::cl::desc("Race all backends again on every n-th query of a class "
+                   "that has a preferred backend (default=64)"));
+}
+
+namespace klee {
+
+class PortfolioSolverImpl : public SolverImpl {
+private:
+  // Queries are classed by the magnitude of their number of constraints.
+  enum { NumClasses = 16 };
+
+  struct Backend {
+    std::string name;
+    SolverWorker *worker;
+    // The wall time by which a lost race the worker is still solving
+    // has to end, 0 if it may run to completion.
+    double deadline;
+    unsigned wins;
+    // The number of races won per query class.
+    unsigned classWins[NumClasses];
+  };
+
+  std::vector<Backend> backends;
+  double timeout;
+  SolverRunStatus runStatusCode;
+  // The number of races run per query class.
+  unsigned races[NumClasses];
+  // The number of queries seen per query class.
+  unsigned queries[NumClasses];
+
+  static unsigned getClass(const Query &query);
+  int getPreferred(unsigned cls) const;
+
+public:
+  PortfolioSolverImpl(const std::vector<Solver *> &solvers,
+                      const std::vector<std::string> &names);
+  ~PortfolioSolverImpl();
+
+  char *getConstraintLog(const Query &);
+  void setCoreSolverTimeout(double _timeout) { timeout = _timeout; }
+
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+};
+
+PortfolioSolverImpl::PortfolioSolverImpl(
+    const std::vector<Solver *> &solvers,
+    const std::vector<std::string> &names)
+    : timeout(0.0), runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
+  assert(!solvers.empty() && solvers.size() == names.size() &&
+         "invalid portfolio");
+  for (unsigned i = 0; i != solvers.size(); ++i) {
+    Backend b;
+    b.name = names[i];
+    b.worker = new SolverWorker(solvers[i]);
+    b.deadline = 0;
+    b.wins = 0;
+    std::fill(b.classWins, b.classWins + NumClasses, 0);
+    backends.push_back(b);
+  }
+  std::fill(races, races + NumClasses, 0);
+  std::fill(queries, queries + NumClasses, 0);
+}
+
+PortfolioSolverImpl::~PortfolioSolverImpl() {
+  unsigned total = 0;
+  for (unsigned i = 0; i != NumClasses; ++i)
+    total += races[i];
+  for (std::vector<Backend>::iterator it = backends.begin(),
+                                      ie = backends.end();
+       it != ie; ++it) {
+    if (total)
+      klee_message("portfolio: %s won %u of %u races", it->name.c_str(),
+                   it->wins, total);
+    delete it->worker;
+  }
+}
+
+unsigned PortfolioSolverImpl::getClass(const Query &query) {
+  unsigned cls = 0;
+  for (unsigned n = query.constraints.size(); n; n >>= 1)
+    ++cls;
+  return std::min(cls, (unsigned)NumClasses - 1);
+}
+
+/// The backend to run alone on queries of class \a cls, or -1 to race
+/// all of them.
+int PortfolioSolverImpl::getPreferred(unsigned cls) const {
+  if (!PortfolioWarmup || races[cls] < PortfolioWarmup)
+    return -1;
+  if (PortfolioRecheck && queries[cls] % PortfolioRecheck == 0)
+    return -1;
+  for (unsigned i = 0; i != backends.size(); ++i)
+    if (backends[i].classWins[cls] * 10 >= races[cls] * 9)
+      return i;
+  return -1;
+}
+
+char *PortfolioSolverImpl::getConstraintLog(const Query &query) {
+  return backends[0].worker->getSolver()->getConstraintLog(query);
+}
+
+bool PortfolioSolverImpl::computeTruth(const Query &query, bool &isValid) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char> > values;
+  bool hasSolution;
+
+  if (!computeInitialValues(query, objects, values, hasSolution))
+    return false;
+
+  isValid = !hasSolution;
+  return true;
+}
+
+bool PortfolioSolverImpl::computeValue(const Query &query,
+                                       ref<Expr> &result) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char> > values;
+  bool hasSolution;
+
+  // Find the object used in the expression, and compute an assignment
+  // for them.
+  findSymbolicObjects(query.expr, objects);
+  if (!computeInitialValues(query.withFalse(), objects, values, hasSolution))
+    return false;
+  assert(hasSolution && "state has invalid constraint set");
+
+  // Evaluate the expression with the computed assignment.
+  Assignment a(objects, values);
+  result = a.evaluate(query.expr);
+
+  return true;
+}
+
+bool PortfolioSolverImpl::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+
+  TimerStatIncrementer t(stats::queryTime);
+
+  ++stats::queries;
+  ++stats::queryCounterexamples;
+
+  unsigned cls = getClass(query);
+  int preferred = getPreferred(cls);
+  ++queries[cls];
+
+  // A backend that lost an earlier race may still be working on it.
+  // Drop its late answer if it is there, or cancel it once the race is
+  // past the timeout; otherwise leave it out of this race.
+  std::vector<unsigned> entrants;
+  for (unsigned i = 0; i != backends.size(); ++i) {
+    SolverWorker *w = backends[i].worker;
+    if (w->isBusy() && w->isReady()) {
+      std::vector<std::vector<unsigned char> > lateValues;
+      bool lateHasSolution;
+      w->receive(lateValues, lateHasSolution, 0);
+    } else if (w->isBusy() && backends[i].deadline &&
+               util::getWallTime() >= backends[i].deadline) {
+      w->cancel();
+    }
+    if (!w->isBusy() && (preferred < 0 || (int)i == preferred))
+      entrants.push_back(i);
+  }
+  // A preferred backend still busy is replaced by the others. Only when
+  // every backend is busy are the stragglers cancelled.
+  if (entrants.empty()) {
+    preferred = -1;
+    for (unsigned i = 0; i != backends.size(); ++i)
+      if (!backends[i].worker->isBusy())
+        entrants.push_back(i);
+  }
+  if (entrants.empty()) {
+    for (unsigned i = 0; i != backends.size(); ++i) {
+      backends[i].worker->cancel();
+      entrants.push_back(i);
+    }
+  }
+
+  std::vector<unsigned> running;
+  for (unsigned i = 0; i != entrants.size(); ++i)
+    if (backends[entrants[i]].worker->send(query, objects, runStatusCode))
+      running.push_back(entrants[i]);
+
+  double deadline = timeout ? util::getWallTime() + timeout : 0;
+  int winner = -1;
+  while (!running.empty()) {
+    std::vector<struct pollfd> fds(running.size());
+    for (unsigned i = 0; i != running.size(); ++i) {
+      fds[i].fd = backends[running[i]].worker->getFD();
+      fds[i].events = POLLIN;
+      fds[i].revents = 0;
+    }
+    int wait = -1;
+    if (deadline) {
+      double left = deadline - util::getWallTime();
+      wait = left > 0 ? (int)(left * 1000) + 1 : 0;
+    }
+    int res = poll(&fds[0], fds.size(), wait);
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res <= 0) {
+      for (unsigned i = 0; i != running.size(); ++i)
+        backends[running[i]].worker->cancel();
+      runStatusCode = res == 0 ? SOLVER_RUN_STATUS_TIMEOUT
+                               : SOLVER_RUN_STATUS_FAILURE;
+      break;
+    }
+
+    unsigned i = 0;
+    while (!fds[i].revents)
+      ++i;
+    Backend &b = backends[running[i]];
+    running.erase(running.begin() + i);
+    SolverRunStatus status = b.worker->receive(values, hasSolution, deadline);
+    if (b.worker->isUnreadable()) {
+      // The worker could not read the query back; solve it in a child
+      // which inherits it, within what is left of the timeout.
+      status = b.worker->computeInitialValuesForked(query, objects, values,
+                                                    hasSolution, deadline);
+    }
+    runStatusCode = status;
+    if (status == SOLVER_RUN_STATUS_SUCCESS_SOLVABLE ||
+        status == SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
+      winner = &b - &backends[0];
+      break;
+    }
+  }
+
+  if (winner < 0)
+    return false;
+
+  // The losers keep going in the background, so that a worker is not
+  // restarted for every race, and their answers are dropped when they
+  // come in. With a timeout they are cancelled once it passes.
+  for (unsigned i = 0; i != running.size(); ++i)
+    backends[running[i]].deadline = deadline;
+
+  // A backend left out because it was still busy with an earlier query
+  // counts as having lost this race too.
+  if (preferred < 0) {
+    ++races[cls];
+    ++backends[winner].wins;
+    ++backends[winner].classWins[cls];
+  }
+
+  if (hasSolution)
+    ++stats::queriesInvalid;
+  else
+    ++stats::queriesValid;
+  return true;
+}
+
+SolverImpl::SolverRunStatus PortfolioSolverImpl::getOperationStatusCode() {
+  return runStatusCode;
+}
+
+Solver *createPortfolioSolver(const std::vector<Solver *> &solvers,
+                              const std::vector<std::string> &names) {
+  return new Solver(new PortfolioSolverImpl(solvers, names));
+}
+}
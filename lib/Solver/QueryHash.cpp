@@ -0,0 +1,108 @@
+//===-- QueryHash.cpp -----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "QueryHash.h"
+
+#include "klee/Constraints.h"
+#include "klee/Solver.h"
+
+using namespace klee;
+
+unsigned QueryHasher::getArrayID(const Array *array) {
+  std::map<const Array *, unsigned>::iterator it = arrays.find(array);
+  if (it != arrays.end())
+    return it->second;
+  unsigned id = arrays.size();
+  arrays.insert(std::make_pair(array, id));
+  return id;
+}
+
+QueryHash QueryHasher::hashArray(const Array *array) {
+  QueryHash h;
+  if (numberArrays)
+    h.add(getArrayID(array));
+  h.add(array->size);
+  h.add(array->domain);
+  h.add(array->range);
+  h.add(array->isConstantArray());
+  for (unsigned i = 0, e = array->constantValues.size(); i != e; ++i)
+    h.add(array->constantValues[i]->getZExtValue());
+  return h;
+}
+
+QueryHash QueryHasher::hashUpdates(const UpdateList &ul) {
+  // Hash from the oldest update forwards, without recursing down long
+  // update lists.
+  std::vector<const UpdateNode *> pending;
+  QueryHash h;
+  const UpdateNode *un = ul.head;
+  for (; un; un = un->next) {
+    std::map<const UpdateNode *, QueryHash>::iterator it = updates.find(un);
+    if (it != updates.end()) {
+      h = it->second;
+      break;
+    }
+    pending.push_back(un);
+  }
+  if (!un)
+    h = hashArray(ul.root);
+
+  while (!pending.empty()) {
+    un = pending.back();
+    pending.pop_back();
+    h.add(hash(un->index));
+    h.add(hash(un->value));
+    updates.insert(std::make_pair(un, h));
+  }
+  return h;
+}
+
+QueryHash QueryHasher::hash(const ref<Expr> &e) {
+  std::map<const Expr *, QueryHash>::iterator it = exprs.find(e.get());
+  if (it != exprs.end())
+    return it->second;
+
+  QueryHash h;
+  h.add(e->getKind());
+  h.add(e->getWidth());
+  if (ConstantExpr *ce = dyn_cast<ConstantExpr>(e)) {
+    const llvm::APInt &value = ce->getAPValue();
+    for (unsigned i = 0; i != value.getNumWords(); ++i)
+      h.add(value.getRawData()[i]);
+  } else {
+    if (ReadExpr *re = dyn_cast<ReadExpr>(e))
+      h.add(hashUpdates(re->updates));
+    else if (ExtractExpr *ee = dyn_cast<ExtractExpr>(e))
+      h.add(ee->offset);
+    for (unsigned i = 0; i != e->getNumKids(); ++i)
+      h.add(hash(e->getKid(i)));
+  }
+
+  exprs.insert(std::make_pair(e.get(), h));
+  return h;
+}
+
+QueryHash QueryHash::compute(const Query &query,
+                             const std::vector<const Array *> *objects) {
+  QueryHasher hasher;
+  QueryHash h;
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                         ie = query.constraints.end();
+       it != ie; ++it)
+    h.add(hasher.hash(*it));
+  h.add(query.constraints.size());
+  h.add(hasher.hash(query.expr));
+  if (objects) {
+    for (unsigned i = 0; i != objects->size(); ++i) {
+      h.add(hasher.getArrayID((*objects)[i]));
+      h.add((*objects)[i]->size);
+    }
+  }
+  return h;
+}
@@ -0,0 +1,106 @@
+//===-- QueryHash.h ---------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_QUERYHASH_H
+#define KLEE_QUERYHASH_H
+
+#include "klee/Expr.h"
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+namespace klee {
+struct Query;
+
+/// QueryHash - A 128-bit structural hash of a query that is the same
+/// in every run. It does not depend on the names or addresses of
+/// arrays: arrays are numbered in the order the query first uses them,
+/// so two queries that differ only by a consistent renaming of their
+/// arrays hash alike.
+///
+/// The query is identified by lo and hi. check is computed with a
+/// different mixing function and is not part of the identity: caches
+/// store it with an answer and take a lookup whose check differs as a
+/// miss, so that a collision of lo and hi does not return the answer of
+/// another query.
+struct QueryHash {
+  uint64_t lo, hi, check;
+
+  QueryHash()
+      : lo(0x9e3779b97f4a7c15ULL), hi(0x6a09e667f3bcc908ULL),
+        check(0xbb67ae8584caa73bULL) {}
+
+  void add(uint64_t v) {
+    lo = mix(lo ^ v);
+    hi = mix(hi + v + 0x632be59bd9b4e019ULL);
+    check = mixCheck(check + v);
+  }
+  void add(const QueryHash &h) {
+    add(h.lo);
+    add(h.hi);
+    add(h.check);
+  }
+
+  bool operator==(const QueryHash &b) const { return lo == b.lo && hi == b.hi; }
+  bool operator!=(const QueryHash &b) const { return !(*this == b); }
+  bool operator<(const QueryHash &b) const {
+    return lo < b.lo || (lo == b.lo && hi < b.hi);
+  }
+
+  /// Hash \a query. If \a objects is given, the arrays in it are part
+  /// of the hash as well, in order.
+  static QueryHash compute(const Query &query,
+                           const std::vector<const Array *> *objects = 0);
+
+private:
+  static uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+  }
+  static uint64_t mixCheck(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+};
+
+/// QueryHasher - Computes QueryHashes, numbering the arrays it meets in
+/// first-use order. Hashes of subexpressions are memoized, so one hasher
+/// must only be used for a single query.
+class QueryHasher {
+  std::map<const Expr *, QueryHash> exprs;
+  std::map<const UpdateNode *, QueryHash> updates;
+  std::map<const Array *, unsigned> arrays;
+  bool numberArrays;
+
+  QueryHash hashArray(const Array *array);
+  QueryHash hashUpdates(const UpdateList &ul);
+
+public:
+  /// \param _numberArrays - If false, arrays are hashed by their shape
+  /// only, so that the hash of an expression does not depend on the
+  /// expressions hashed before it.
+  explicit QueryHasher(bool _numberArrays = true)
+      : numberArrays(_numberArrays) {}
+
+  QueryHash hash(const ref<Expr> &e);
+
+  /// The number given to \a array, assigning the next one if it was not
+  /// seen yet.
+  unsigned getArrayID(const Array *array);
+};
+}
+
+#endif
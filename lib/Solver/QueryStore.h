@@ -0,0 +1,57 @@
+//===-- QueryStore.h --------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_QUERYSTORE_H
+#define KLEE_QUERYSTORE_H
+
+#include "QueryHash.h"
+
+#include <string>
+#include <vector>
+
+namespace klee {
+
+/// QueryStore - Storage for solver answers that outlives the solver,
+/// keyed by the QueryHash of the query and the kind of answer. The
+/// payload of an answer is opaque to the store. Stores keep the check
+/// of the hash with each answer, an answer whose check differs from the
+/// one looked up is not returned.
+class QueryStore {
+public:
+  enum Kind {
+    ValidityAnswer = 1,
+    TruthAnswer,
+    ValueAnswer,
+    InitialValuesAnswer
+  };
+
+  virtual ~QueryStore() {}
+
+  /// Find the answer stored for \a hash, copying its payload into
+  /// \a payload.
+  virtual bool lookup(const QueryHash &hash, Kind kind,
+                      std::vector<unsigned char> &payload) = 0;
+
+  /// Store an answer for \a hash. A store may drop answers it has no
+  /// room for.
+  virtual void insert(const QueryHash &hash, Kind kind,
+                      const std::vector<unsigned char> &payload) = 0;
+};
+
+/// createFileQueryStore - Create a store in an append-only file at
+/// \a path, or return null if the file is unusable.
+QueryStore *createFileQueryStore(const std::string &path);
+
+/// createSharedQueryStore - Create a store in the POSIX shared memory
+/// object \a name, of \a size bytes if it does not exist yet, or
+/// return null if it cannot be mapped.
+QueryStore *createSharedQueryStore(const std::string &name, size_t size);
+}
+
+#endif
@@ -8,23 +8,23 @@
 //===----------------------------------------------------------------------===//
 #include "klee/Config/config.h"
 #ifdef ENABLE_STP
+#include "AssertionStack.h"
 #include "STPBuilder.h"
+#include "SolverWorker.h"
+#include "klee/CommandLine.h"
 #include "klee/Solver.h"
 #include "klee/SolverImpl.h"
 #include "klee/Constraints.h"
 #include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Internal/System/Time.h"
 #include "klee/util/Assignment.h"
 #include "klee/util/ExprUtil.h"
 
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ErrorHandling.h"
 
-#include <errno.h>
-#include <unistd.h>
-#include <signal.h>
-#include <sys/wait.h>
-#include <sys/ipc.h>
-#include <sys/shm.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 namespace {
 
@@ -39,19 +39,6 @@ llvm::cl::opt<bool> IgnoreSolverFailures(
 
 #define vc_bvBoolExtract IAMTHESPAWNOFSATAN
 
-static unsigned char *shared_memory_ptr;
-static int shared_memory_id = 0;
-// Darwin by default has a very small limit on the maximum amount of shared
-// memory, which will quickly be exhausted by KLEE running its tests in
-// parallel. For now, we work around this by just requesting a smaller size --
-// in practice users hitting this limit on counterexample sizes probably already
-// are hitting more serious scalability issues.
-#ifdef __APPLE__
-static const unsigned shared_memory_size = 1 << 16;
-#else
-static const unsigned shared_memory_size = 1 << 20;
-#endif
-
 static void stp_error_handler(const char *err_msg) {
   fprintf(stderr, "error: STP Error: %s\n", err_msg);
   abort();
@@ -65,7 +52,17 @@ private:
   STPBuilder *builder;
   double timeout;
   bool useForkedSTP;
+  // The worker process that runs the queries with --use-forked-solver.
+  SolverWorker *worker;
   SolverRunStatus runStatusCode;
+  // The constraints left asserted in vc with --solver-incremental.
+  AssertionStack assertions;
+
+  void popAssertions(unsigned n);
+  SolverRunStatus runInProcess(const Query &,
+                               const std::vector<const Array *> &objects,
+                               std::vector<std::vector<unsigned char> > &values,
+                               bool &hasSolution);
 
 public:
   STPSolverImpl(bool _useForkedSTP, bool _optimizeDivides = true);
@@ -86,7 +83,8 @@ public:
 STPSolverImpl::STPSolverImpl(bool _useForkedSTP, bool _optimizeDivides)
     : vc(vc_createValidityChecker()),
       builder(new STPBuilder(vc, _optimizeDivides)), timeout(0.0),
-      useForkedSTP(_useForkedSTP), runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
+      useForkedSTP(_useForkedSTP), worker(0),
+      runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
   assert(vc && "unable to create validity checker");
   assert(builder && "unable to create STPBuilder");
 
@@ -100,25 +98,13 @@ STPSolverImpl::STPSolverImpl(bool _useForkedSTP, bool _optimizeDivides)
 
   vc_registerErrorHandler(::stp_error_handler);
 
-  if (useForkedSTP) {
-    assert(shared_memory_id == 0 && "shared memory id already allocated");
-    shared_memory_id =
-        shmget(IPC_PRIVATE, shared_memory_size, IPC_CREAT | 0700);
-    if (shared_memory_id < 0)
-      llvm::report_fatal_error("unable to allocate shared memory region");
-    shared_memory_ptr = (unsigned char *)shmat(shared_memory_id, NULL, 0);
-    if (shared_memory_ptr == (void *)-1)
-      llvm::report_fatal_error("unable to attach shared memory region");
-    shmctl(shared_memory_id, IPC_RMID, NULL);
-  }
+  if (useForkedSTP)
+    worker = new SolverWorker(
+        new Solver(new STPSolverImpl(false, _optimizeDivides)));
 }
 
 STPSolverImpl::~STPSolverImpl() {
-  // Detach the memory region.
-  shmdt(shared_memory_ptr);
-  shared_memory_ptr = 0;
-  shared_memory_id = 0;
-
+  delete worker;
   delete builder;
 
   vc_Destroy(vc);
@@ -126,7 +112,14 @@ STPSolverImpl::~STPSolverImpl() {
 
 /***/
 
+void STPSolverImpl::popAssertions(unsigned n) {
+  for (unsigned i = n; i < assertions.size(); ++i)
+    vc_pop(vc);
+  assertions.truncate(n);
+}
+
 char *STPSolverImpl::getConstraintLog(const Query &query) {
+  popAssertions(0);
   vc_push(vc);
   for (std::vector<ref<Expr> >::const_iterator it = query.constraints.begin(),
                                                ie = query.constraints.end();
@@ -209,115 +202,73 @@ runAndGetCex(::VC vc, STPBuilder *builder, ::VCExpr q,
   }
 }
 
-static void stpTimeoutHandler(int x) { _exit(52); }
-
-static SolverImpl::SolverRunStatus
-runAndGetCexForked(::VC vc, STPBuilder *builder, ::VCExpr q,
-                   const std::vector<const Array *> &objects,
-                   std::vector<std::vector<unsigned char> > &values,
-                   bool &hasSolution, double timeout) {
-  unsigned char *pos = shared_memory_ptr;
-  unsigned sum = 0;
-  for (std::vector<const Array *>::const_iterator it = objects.begin(),
-                                                  ie = objects.end();
-       it != ie; ++it)
-    sum += (*it)->size;
-  if (sum >= shared_memory_size)
-    llvm::report_fatal_error("not enough shared memory for counterexample");
-
-  fflush(stdout);
-  fflush(stderr);
-  int pid = fork();
-  if (pid == -1) {
+/// Report a failed query in the worker, exiting unless
+/// --ignore-solver-failures.
+static void reportWorkerFailure(SolverImpl::SolverRunStatus status) {
+  switch (status) {
+  case SolverImpl::SOLVER_RUN_STATUS_TIMEOUT:
+    fprintf(stderr, "error: STP timed out");
+    // a timeout is not a failure of the solver
+    return;
+  case SolverImpl::SOLVER_RUN_STATUS_FORK_FAILED:
     fprintf(stderr, "ERROR: fork failed (for STP)");
-    if (!IgnoreSolverFailures)
-      exit(1);
-    return SolverImpl::SOLVER_RUN_STATUS_FORK_FAILED;
+    break;
+  case SolverImpl::SOLVER_RUN_STATUS_WAITPID_FAILED:
+    fprintf(stderr, "ERROR: waitpid() for STP failed");
+    break;
+  case SolverImpl::SOLVER_RUN_STATUS_INTERRUPTED:
+    fprintf(stderr, "ERROR: STP did not return successfully.  Most likely "
+                    "you forgot to run 'ulimit -s unlimited'\n");
+    break;
+  default:
+    fprintf(stderr, "error: STP did not return a recognized code");
+    break;
   }
+  if (!IgnoreSolverFailures)
+    exit(1);
+}
 
-  if (pid == 0) {
-    if (timeout) {
-      ::alarm(0); /* Turn off alarm so we can safely set signal handler */
-      ::signal(SIGALRM, stpTimeoutHandler);
-      ::alarm(std::max(1, (int)timeout));
-    }
-    unsigned res = vc_query(vc, q);
-    if (!res) {
-      for (std::vector<const Array *>::const_iterator it = objects.begin(),
-                                                      ie = objects.end();
-           it != ie; ++it) {
-        const Array *array = *it;
-        for (unsigned offset = 0; offset < array->size; offset++) {
-          ExprHandle counter =
-              vc_getCounterExample(vc, builder->getInitialRead(array, offset));
-          *pos++ = getBVUnsigned(counter);
-        }
-      }
+SolverImpl::SolverRunStatus STPSolverImpl::runInProcess(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  if (CoreSolverIncremental) {
+    // Keep the constraints shared with the last query asserted, and
+    // assert the rest each in its own scope.
+    popAssertions(assertions.sharedPrefix(query.constraints));
+    for (ConstraintManager::const_iterator
+           it = query.constraints.begin() + assertions.size(),
+           ie = query.constraints.end(); it != ie; ++it) {
+      vc_push(vc);
+      vc_assertFormula(vc, builder->construct(*it));
+      assertions.push(*it);
     }
-    _exit(res);
   } else {
-    int status;
-    pid_t res;
-
-    do {
-      res = waitpid(pid, &status, 0);
-    } while (res < 0 && errno == EINTR);
-
-    if (res < 0) {
-      fprintf(stderr, "ERROR: waitpid() for STP failed");
-      if (!IgnoreSolverFailures)
-        exit(1);
-      return SolverImpl::SOLVER_RUN_STATUS_WAITPID_FAILED;
-    }
+    vc_push(vc);
 
-    // From timed_run.py: It appears that linux at least will on
-    // "occasion" return a status when the process was terminated by a
-    // signal, so test signal first.
-    if (WIFSIGNALED(status) || !WIFEXITED(status)) {
-      fprintf(stderr, "ERROR: STP did not return successfully.  Most likely "
-                      "you forgot to run 'ulimit -s unlimited'\n");
-      if (!IgnoreSolverFailures) {
-        exit(1);
-      }
-      return SolverImpl::SOLVER_RUN_STATUS_INTERRUPTED;
-    }
-
-    int exitcode = WEXITSTATUS(status);
-    if (exitcode == 0) {
-      hasSolution = true;
-    } else if (exitcode == 1) {
-      hasSolution = false;
-    } else if (exitcode == 52) {
-      fprintf(stderr, "error: STP timed out");
-      // mark that a timeout occurred
-      return SolverImpl::SOLVER_RUN_STATUS_TIMEOUT;
-    } else {
-      fprintf(stderr, "error: STP did not return a recognized code");
-      if (!IgnoreSolverFailures)
-        exit(1);
-      return SolverImpl::SOLVER_RUN_STATUS_UNEXPECTED_EXIT_CODE;
-    }
+    for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                           ie = query.constraints.end();
+         it != ie; ++it)
+      vc_assertFormula(vc, builder->construct(*it));
+  }
 
-    if (hasSolution) {
-      values = std::vector<std::vector<unsigned char> >(objects.size());
-      unsigned i = 0;
-      for (std::vector<const Array *>::const_iterator it = objects.begin(),
-                                                      ie = objects.end();
-           it != ie; ++it) {
-        const Array *array = *it;
-        std::vector<unsigned char> &data = values[i++];
-        data.insert(data.begin(), pos, pos + array->size);
-        pos += array->size;
-      }
-    }
+  ExprHandle stp_e = builder->construct(query.expr);
 
-    if (true == hasSolution) {
-      return SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
-    } else {
-      return SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
-    }
+  if (DebugDumpSTPQueries) {
+    char *buf;
+    unsigned long len;
+    vc_printQueryStateToBuffer(vc, stp_e, &buf, &len, false);
+    klee_warning("STP query:\n%.*s\n", (unsigned)len, buf);
   }
+
+  SolverRunStatus status =
+      runAndGetCex(vc, builder, stp_e, objects, values, hasSolution);
+
+  if (!CoreSolverIncremental)
+    vc_pop(vc);
+
+  return status;
 }
+
 bool STPSolverImpl::computeInitialValues(
     const Query &query, const std::vector<const Array *> &objects,
     std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
@@ -325,46 +276,37 @@ bool STPSolverImpl::computeInitialValues(
 
   TimerStatIncrementer t(stats::queryTime);
 
-  vc_push(vc);
-
-  for (ConstraintManager::const_iterator it = query.constraints.begin(),
-                                         ie = query.constraints.end();
-       it != ie; ++it)
-    vc_assertFormula(vc, builder->construct(*it));
-
   ++stats::queries;
   ++stats::queryCounterexamples;
 
-  ExprHandle stp_e = builder->construct(query.expr);
-
-  if (DebugDumpSTPQueries) {
-    char *buf;
-    unsigned long len;
-    vc_printQueryStateToBuffer(vc, stp_e, &buf, &len, false);
-    klee_warning("STP query:\n%.*s\n", (unsigned)len, buf);
-  }
-
-  bool success;
   if (useForkedSTP) {
-    runStatusCode = runAndGetCexForked(vc, builder, stp_e, objects, values,
-                                       hasSolution, timeout);
-    success = ((SOLVER_RUN_STATUS_SUCCESS_SOLVABLE == runStatusCode) ||
-               (SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE == runStatusCode));
-  } else {
-    runStatusCode =
-        runAndGetCex(vc, builder, stp_e, objects, values, hasSolution);
-    success = true;
+    runStatusCode = worker->computeInitialValues(query, objects, values,
+                                                 hasSolution, timeout);
+  }
+  // The worker cannot read back queries over arrays whose names are not
+  // KQuery identifiers; those are solved in a child forked for them,
+  // under the same timeout.
+  if (useForkedSTP && worker->isUnreadable()) {
+    klee_warning_once(worker, "solver worker could not parse a query, "
+                              "running it in a forked process");
+    runStatusCode = worker->computeInitialValuesForked(
+        query, objects, values, hasSolution,
+        timeout ? util::getWallTime() + timeout : 0);
   }
+  if (!useForkedSTP)
+    runStatusCode = runInProcess(query, objects, values, hasSolution);
 
+  bool success = ((SOLVER_RUN_STATUS_SUCCESS_SOLVABLE == runStatusCode) ||
+                  (SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE == runStatusCode));
   if (success) {
     if (hasSolution)
       ++stats::queriesInvalid;
     else
       ++stats::queriesValid;
+  } else {
+    reportWorkerFailure(runStatusCode);
   }
 
-  vc_pop(vc);
-
   return success;
 }
 
@@ -0,0 +1,324 @@
+//===-- SharedQueryStore.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "QueryStore.h"
+
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace klee;
+
+namespace {
+/// The shared memory object is a Header followed by an array of
+/// fixed-size slots. An answer lives in one of the ProbeLength slots
+/// after the slot its hash selects.
+///
+/// Every slot has a sequence number which is odd while the slot is
+/// written. Readers copy a slot without locking and retry the next slot
+/// if the sequence number changed meanwhile; writers claim a slot by
+/// making its sequence number odd with a compare-and-swap, and drop the
+/// answer if another process got there first.
+///
+/// The sequence number shares a word with the pid of the writer, so a
+/// slot left odd by a writer which died can be taken over: the next
+/// writer finding it claims it for a new generation, still odd, with a
+/// compare-and-swap of the whole word.
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t numSlots;
+};
+
+const unsigned SlotSize = 256;
+const unsigned ProbeLength = 8;
+
+struct Slot {
+  /// The sequence number in the low half, the pid of the writer in the
+  /// high half while it is odd.
+  uint64_t seq;
+  /// Set when the slot is read, cleared by writers looking for a slot
+  /// to evict (the clock algorithm, restricted to the probe window).
+  uint8_t referenced;
+  uint8_t kind;
+  uint16_t size;
+  uint32_t reserved;
+  uint64_t lo, hi;
+  /// The check of the hash, an answer whose check differs from the one
+  /// looked up belongs to another query with the same identity.
+  uint64_t check;
+  unsigned char payload[SlotSize - 40];
+};
+
+const char Magic[8] = {'K', 'L', 'E', 'E', 'Q', 'C', 'S', 0};
+const uint32_t Version = 3;
+
+/// The number of 1ms waits for the creator to initialize the object.
+const unsigned AttachTries = 1000;
+
+/// Whether the writer holding \a seq is gone.
+bool isAbandoned(uint64_t seq) {
+  pid_t pid = (pid_t)(seq >> 32);
+  return !pid || (kill(pid, 0) < 0 && errno == ESRCH);
+}
+
+class SharedQueryStore : public QueryStore {
+  std::string name;
+  void *mapping;
+  size_t mappingSize;
+  Slot *slots;
+  uint32_t numSlots;
+  /// The answers dropped for not fitting in a slot.
+  uint64_t numOversized;
+
+  bool create(int fd, size_t size);
+  bool attach(int fd, bool &stale);
+
+  volatile Slot &getSlot(const QueryHash &hash, unsigned probe) {
+    return slots[(hash.lo + probe) % numSlots];
+  }
+
+public:
+  SharedQueryStore(const std::string &_name)
+      : name(_name), mapping(0), mappingSize(0), slots(0), numSlots(0),
+        numOversized(0) {}
+  ~SharedQueryStore();
+
+  bool open(size_t size);
+  bool lookup(const QueryHash &hash, Kind kind,
+              std::vector<unsigned char> &payload);
+  void insert(const QueryHash &hash, Kind kind,
+              const std::vector<unsigned char> &payload);
+};
+}
+
+SharedQueryStore::~SharedQueryStore() {
+  if (numOversized)
+    klee_message("%llu answers too large for the shared query cache %s "
+                 "were not shared", (unsigned long long)numOversized,
+                 name.c_str());
+  if (mapping)
+    munmap(mapping, mappingSize);
+}
+
+bool SharedQueryStore::create(int fd, size_t size) {
+  if (size < sizeof(Header) + ProbeLength * SlotSize) {
+    klee_warning("shared query cache %s is too small", name.c_str());
+    return false;
+  }
+  if (ftruncate(fd, size) < 0) {
+    klee_warning("unable to size shared query cache %s: %s", name.c_str(),
+                 strerror(errno));
+    return false;
+  }
+  mapping = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    mapping = 0;
+    klee_warning("unable to map shared query cache %s", name.c_str());
+    return false;
+  }
+  mappingSize = size;
+
+  // The object starts out zeroed, which leaves every slot empty. Write
+  // the magic last: other processes wait for it before using the slots.
+  Header *header = (Header *)mapping;
+  header->version = Version;
+  header->numSlots = (size - sizeof(Header)) / SlotSize;
+  __sync_synchronize();
+  memcpy(header->magic, Magic, sizeof(Magic));
+  return true;
+}
+
+bool SharedQueryStore::attach(int fd, bool &stale) {
+  // The creator may not have sized and initialized the object yet. If it
+  // does not within AttachTries, it died on the way and the object is
+  // stale.
+  stale = false;
+  for (unsigned i = 0; i != AttachTries; ++i) {
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+      break;
+    if ((size_t)st.st_size >= sizeof(Header)) {
+      if (!mapping) {
+        mapping = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+          mapping = 0;
+          break;
+        }
+        mappingSize = st.st_size;
+      }
+      volatile Header *header = (volatile Header *)mapping;
+      if (!memcmp((const char *)header->magic, Magic, sizeof(Magic))) {
+        __sync_synchronize();
+        if (header->version != Version ||
+            sizeof(Header) + (size_t)header->numSlots * SlotSize >
+                mappingSize) {
+          klee_warning("ignoring shared query cache %s with an unknown format",
+                       name.c_str());
+          return false;
+        }
+        return true;
+      }
+    }
+    usleep(1000);
+  }
+  if (mapping) {
+    munmap(mapping, mappingSize);
+    mapping = 0;
+    mappingSize = 0;
+  }
+  stale = true;
+  return false;
+}
+
+bool SharedQueryStore::open(size_t size) {
+  if (name.empty() || name[0] != '/')
+    name = "/" + name;
+
+  // A stale object is replaced once, a second one means another process
+  // is failing to initialize it as well.
+  bool created = false, ok = false;
+  for (unsigned attempt = 0; attempt != 2 && !ok; ++attempt) {
+    created = true;
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+      created = false;
+      fd = shm_open(name.c_str(), O_RDWR, 0600);
+    }
+    if (fd < 0) {
+      klee_warning("unable to open shared query cache %s: %s", name.c_str(),
+                   strerror(errno));
+      return false;
+    }
+
+    bool stale = false;
+    ok = created ? create(fd, size) : attach(fd, stale);
+    close(fd);
+    if (ok)
+      break;
+    if (created) {
+      // Leave no half initialized object for later runs to wait on.
+      shm_unlink(name.c_str());
+      return false;
+    }
+    if (!stale)
+      return false;
+    klee_warning("replacing stale shared query cache %s", name.c_str());
+    shm_unlink(name.c_str());
+  }
+  if (!ok) {
+    klee_warning("unable to attach to shared query cache %s", name.c_str());
+    return false;
+  }
+
+  Header *header = (Header *)mapping;
+  numSlots = header->numSlots;
+  slots = (Slot *)(header + 1);
+  klee_message("%s shared query cache %s with %u slots",
+               created ? "created" : "attached to", name.c_str(), numSlots);
+  return true;
+}
+
+bool SharedQueryStore::lookup(const QueryHash &hash, Kind kind,
+                              std::vector<unsigned char> &payload) {
+  for (unsigned i = 0; i != ProbeLength; ++i) {
+    volatile Slot &slot = getSlot(hash, i);
+    uint64_t seq = slot.seq;
+    if (seq & 1)
+      continue;
+    __sync_synchronize();
+    if (slot.kind != kind || slot.lo != hash.lo || slot.hi != hash.hi ||
+        slot.check != hash.check)
+      continue;
+    unsigned size = slot.size;
+    if (size > sizeof(slot.payload))
+      continue;
+    payload.assign((const unsigned char *)slot.payload,
+                   (const unsigned char *)slot.payload + size);
+    __sync_synchronize();
+    if (slot.seq != seq)
+      continue;
+    slot.referenced = 1;
+    return true;
+  }
+  return false;
+}
+
+void SharedQueryStore::insert(const QueryHash &hash, Kind kind,
+                              const std::vector<unsigned char> &payload) {
+  if (payload.size() > sizeof(((Slot *)0)->payload)) {
+    if (!numOversized++)
+      klee_warning("answers larger than %u bytes are not shared in %s",
+                   (unsigned)sizeof(((Slot *)0)->payload), name.c_str());
+    return;
+  }
+
+  // Prefer the slot already holding this answer, then an empty one, then
+  // the first one not read since the last sweep.
+  volatile Slot *victim = 0;
+  for (unsigned i = 0; i != ProbeLength; ++i) {
+    volatile Slot &slot = getSlot(hash, i);
+    if (slot.kind == kind && slot.lo == hash.lo && slot.hi == hash.hi) {
+      victim = &slot;
+      break;
+    }
+    if (!slot.kind) {
+      victim = &slot;
+      break;
+    }
+    if (!victim) {
+      if (slot.referenced)
+        slot.referenced = 0;
+      else
+        victim = &slot;
+    }
+  }
+  if (!victim)
+    victim = &getSlot(hash, 0);
+
+  // Claim the slot, or take it over from a writer which died, for the
+  // next odd sequence number.
+  uint64_t seq = victim->seq;
+  uint32_t next = (uint32_t)seq + 1;
+  if (seq & 1) {
+    if (!isAbandoned(seq))
+      return;
+    next = (uint32_t)seq + 2;
+  }
+  uint64_t claimed = ((uint64_t)getpid() << 32) | next;
+  if (!__sync_bool_compare_and_swap((uint64_t *)&victim->seq, seq, claimed))
+    return;
+
+  victim->lo = hash.lo;
+  victim->hi = hash.hi;
+  victim->check = hash.check;
+  victim->kind = kind;
+  victim->size = payload.size();
+  victim->referenced = 0;
+  if (!payload.empty())
+    memcpy((unsigned char *)victim->payload, &payload[0], payload.size());
+  __sync_synchronize();
+  victim->seq = next + 1;
+}
+
+QueryStore *klee::createSharedQueryStore(const std::string &name,
+                                         size_t size) {
+  SharedQueryStore *store = new SharedQueryStore(name);
+  if (!store->open(size)) {
+    delete store;
+    return 0;
+  }
+  return store;
+}
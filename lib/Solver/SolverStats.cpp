@@ -17,12 +17,22 @@ Statistic stats::queriesInvalid("QueriesInvalid", "Qiv");
 Statistic stats::queriesValid("QueriesValid", "Qv");
 Statistic stats::queryCacheHits("QueryCacheHits", "QChits") ;
 Statistic stats::queryCacheMisses("QueryCacheMisses", "QCmisses");
+Statistic stats::persistentCacheHits("PersistentCacheHits", "PChits");
+Statistic stats::persistentCacheMisses("PersistentCacheMisses", "PCmisses");
+Statistic stats::sharedCacheHits("SharedCacheHits", "SChits");
+Statistic stats::sharedCacheMisses("SharedCacheMisses", "SCmisses");
 Statistic stats::queryCexCacheHits("QueryCexCacheHits", "QCexHits") ;
 Statistic stats::queryCexCacheMisses("QueryCexCacheMisses", "QCexMisses");
+Statistic stats::cexCacheEvictions("CexCacheEvictions", "CCevict");
+Statistic stats::localSearchHits("LocalSearchHits", "LShits");
+Statistic stats::localSearchMisses("LocalSearchMisses", "LSmisses");
+Statistic stats::localSearchTime("LocalSearchTime", "LStime");
+Statistic stats::localSearchSavedTime("LocalSearchSavedTime", "LSsaved");
 Statistic stats::queryConstructTime("QueryConstructTime", "QBtime") ;
 Statistic stats::queryConstructs("QueriesConstructs", "QB");
 Statistic stats::queryCounterexamples("QueriesCEX", "Qcex");
 Statistic stats::queryTime("QueryTime", "Qtime");
+Statistic stats::asyncQueries("AsyncQueries", "Qasync");
 
 #ifdef DEBUG
 Statistic stats::arrayHashTime("ArrayHashTime", "AHtime");
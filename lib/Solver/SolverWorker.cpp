@@ -0,0 +1,424 @@
+//===-- SolverWorker.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SolverWorker.h"
+
+#include "expr/Parser.h"
+#include "klee/Config/Version.h"
+#include "klee/Constraints.h"
+#include "klee/ExprBuilder.h"
+#include "klee/Internal/System/Time.h"
+#include "klee/util/ArrayCache.h"
+#include "klee/util/ExprPPrinter.h"
+
+#include "llvm/Support/Casting.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <set>
+#include <string>
+
+using namespace klee;
+
+namespace {
+// The parser creates a new Array for every constant array in a query,
+// and the worker's solver keeps whatever it has seen alive, so a worker
+// is replaced after this many queries to bound its memory.
+const unsigned MaxQueries = 10000;
+
+// Sent in place of a SolverRunStatus when the worker could not parse the
+// query it was given.
+const unsigned char ReplyUnparsed = 0xff;
+
+// The parent's ends of all running workers' sockets. A worker closes
+// the ones it inherited, so that each worker sees end-of-file as soon
+// as its own parent end is closed.
+std::set<int> parentSockets;
+
+enum ReadResult { ReadOK, ReadClosed, ReadTimedOut };
+
+bool writeAll(int fd, const void *buf, size_t n) {
+  const char *p = (const char *)buf;
+  while (n) {
+    ssize_t res = send(fd, p, n, MSG_NOSIGNAL);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += res;
+    n -= res;
+  }
+  return true;
+}
+
+/// Read exactly \a n bytes, giving up at wall time \a deadline unless
+/// it is 0.
+ReadResult readAll(int fd, void *buf, size_t n, double deadline) {
+  char *p = (char *)buf;
+  while (n) {
+    if (deadline) {
+      double left = deadline - util::getWallTime();
+      struct pollfd pfd;
+      pfd.fd = fd;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      int res = poll(&pfd, 1, left > 0 ? (int)(left * 1000) + 1 : 0);
+      if (res < 0) {
+        if (errno == EINTR)
+          continue;
+        return ReadClosed;
+      }
+      if (res == 0)
+        return ReadTimedOut;
+    }
+    ssize_t res = read(fd, p, n);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      return ReadClosed;
+    }
+    if (res == 0)
+      return ReadClosed;
+    p += res;
+    n -= res;
+  }
+  return ReadOK;
+}
+
+/// Send \a reply and, for a solvable query, the counterexample.
+bool writeAnswer(int fd, unsigned char reply,
+                 const std::vector<std::vector<unsigned char> > &values) {
+  bool ok = writeAll(fd, &reply, 1);
+  if (reply == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE)
+    for (unsigned i = 0; ok && i != values.size(); ++i)
+      ok = values[i].empty() ||
+           writeAll(fd, &values[i][0], values[i].size());
+  return ok;
+}
+
+/// Read an answer sent by writeAnswer() for objects of the given
+/// \a sizes, giving up at wall time \a deadline unless it is 0.
+ReadResult readAnswer(int fd, const std::vector<unsigned> &sizes,
+                      unsigned char &reply,
+                      std::vector<std::vector<unsigned char> > &values,
+                      double deadline) {
+  ReadResult res = readAll(fd, &reply, 1, deadline);
+  if (res == ReadOK && reply == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE) {
+    values = std::vector<std::vector<unsigned char> >(sizes.size());
+    for (unsigned i = 0; res == ReadOK && i != sizes.size(); ++i) {
+      values[i].resize(sizes[i]);
+      if (!values[i].empty())
+        res = readAll(fd, &values[i][0], values[i].size(), deadline);
+    }
+  }
+  return res;
+}
+
+/// Close the parent's ends of the workers' sockets in a new child.
+void closeParentSockets() {
+  for (std::set<int>::iterator it = parentSockets.begin(),
+                               ie = parentSockets.end();
+       it != ie; ++it)
+    close(*it);
+  // The solver may start workers of its own, which must not close
+  // these numbers again once they are reused.
+  parentSockets.clear();
+}
+
+/// Reap \a pid, returning the status of a child which died instead of
+/// answering.
+SolverImpl::SolverRunStatus reap(pid_t pid) {
+  int status;
+  pid_t res;
+  do {
+    res = waitpid(pid, &status, 0);
+  } while (res < 0 && errno == EINTR);
+
+  if (res < 0)
+    return SolverImpl::SOLVER_RUN_STATUS_WAITPID_FAILED;
+  // From timed_run.py: It appears that linux at least will on
+  // "occasion" return a status when the process was terminated by a
+  // signal, so test signal first.
+  if (WIFSIGNALED(status) || !WIFEXITED(status))
+    return SolverImpl::SOLVER_RUN_STATUS_INTERRUPTED;
+  return SolverImpl::SOLVER_RUN_STATUS_UNEXPECTED_EXIT_CODE;
+}
+}
+
+SolverWorker::SolverWorker(Solver *_solver)
+    : solver(_solver), pid(0), fd(-1), queries(0), busy(false),
+      unreadable(false) {}
+
+SolverWorker::~SolverWorker() {
+  // A worker still solving would only notice the closed socket after it
+  // is done.
+  stop(busy);
+  delete solver;
+}
+
+bool SolverWorker::start() {
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    return false;
+
+  fflush(stdout);
+  fflush(stderr);
+  pid = fork();
+  if (pid == -1) {
+    pid = 0;
+    close(sv[0]);
+    close(sv[1]);
+    return false;
+  }
+
+  if (pid == 0) {
+    closeParentSockets();
+    close(sv[0]);
+    fd = sv[1];
+    serve();
+  }
+
+  close(sv[1]);
+  fd = sv[0];
+  parentSockets.insert(fd);
+  queries = 0;
+  return true;
+}
+
+void SolverWorker::stop(bool kill) {
+  if (!pid)
+    return;
+
+  if (kill)
+    ::kill(pid, SIGKILL);
+  parentSockets.erase(fd);
+  close(fd);
+  fd = -1;
+  busy = false;
+
+  // Without the socket the worker leaves its loop and exits.
+  int status;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+    ;
+  pid = 0;
+}
+
+SolverImpl::SolverRunStatus SolverWorker::died() {
+  parentSockets.erase(fd);
+  close(fd);
+  fd = -1;
+  busy = false;
+
+  SolverImpl::SolverRunStatus status = reap(pid);
+  pid = 0;
+  return status;
+}
+
+void SolverWorker::serve() {
+  // Interrupting KLEE should not kill the worker under a query; it goes
+  // away when the parent closes the socket.
+  ::signal(SIGINT, SIG_IGN);
+
+  // Symbolic arrays are cached by name and size, so the same array gets
+  // the same Array in every query and the solver's caches stay valid.
+  ArrayCache arrays;
+  ExprBuilder *builder = createDefaultExprBuilder();
+
+  uint32_t length;
+  while (readAll(fd, &length, sizeof(length), 0) == ReadOK) {
+    std::string text(length, '\0');
+    if (length && readAll(fd, &text[0], length, 0) != ReadOK)
+      break;
+
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 6)
+    llvm::MemoryBuffer *MB = llvm::MemoryBuffer::getMemBuffer(text);
+#else
+    std::unique_ptr<llvm::MemoryBuffer> MBPtr =
+        llvm::MemoryBuffer::getMemBuffer(text);
+    llvm::MemoryBuffer *MB = MBPtr.get();
+#endif
+    expr::Parser *P =
+        expr::Parser::Create("solver-worker", MB, builder, &arrays);
+
+    // The array declarations come first, then the query itself.
+    std::vector<expr::Decl *> decls;
+    expr::QueryCommand *QC = 0;
+    while (expr::Decl *D = P->ParseTopLevelDecl()) {
+      decls.push_back(D);
+      if ((QC = llvm::dyn_cast<expr::QueryCommand>(D)))
+        break;
+    }
+
+    unsigned char reply = ReplyUnparsed;
+    std::vector<std::vector<unsigned char> > values;
+    if (QC && !P->GetNumErrors()) {
+      ConstraintManager constraints(QC->Constraints);
+      bool hasSolution;
+      if (solver->impl->computeInitialValues(Query(constraints, QC->Query),
+                                       QC->Objects, values, hasSolution))
+        reply = hasSolution ? SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE
+                            : SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+      else
+        reply = solver->impl->getOperationStatusCode();
+    }
+
+    bool ok = writeAnswer(fd, reply, values);
+
+    for (unsigned i = 0; i != decls.size(); ++i)
+      delete decls[i];
+    delete P;
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 6)
+    delete MB;
+#endif
+    if (!ok)
+      break;
+  }
+
+  _exit(0);
+}
+
+bool SolverWorker::send(const Query &query,
+                        const std::vector<const Array *> &objects,
+                        SolverImpl::SolverRunStatus &status) {
+  assert(!busy && "query already in flight");
+  // A failure to send is not a failure to read the query back.
+  unreadable = false;
+  if (!pid && !start()) {
+    status = SolverImpl::SOLVER_RUN_STATUS_FORK_FAILED;
+    return false;
+  }
+
+  std::string text;
+  llvm::raw_string_ostream os(text);
+  const Array *const *objectsBegin = objects.empty() ? 0 : &objects[0];
+  ExprPPrinter::printQuery(os, query.constraints, query.expr, 0, 0,
+                           objectsBegin, objectsBegin + objects.size());
+  os.flush();
+
+  uint32_t length = text.size();
+  if (!writeAll(fd, &length, sizeof(length)) ||
+      !writeAll(fd, text.data(), length)) {
+    status = died();
+    return false;
+  }
+
+  pending.clear();
+  for (unsigned i = 0; i != objects.size(); ++i)
+    pending.push_back(objects[i]->size);
+  busy = true;
+  return true;
+}
+
+bool SolverWorker::isReady() const {
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  return busy && poll(&pfd, 1, 0) > 0;
+}
+
+SolverImpl::SolverRunStatus
+SolverWorker::receive(std::vector<std::vector<unsigned char> > &values,
+                      bool &hasSolution, double deadline) {
+  assert(busy && "no query in flight");
+  unreadable = false;
+  unsigned char reply;
+  ReadResult res = readAnswer(fd, pending, reply, values, deadline);
+
+  if (res == ReadTimedOut) {
+    stop(true);
+    return SolverImpl::SOLVER_RUN_STATUS_TIMEOUT;
+  }
+  if (res == ReadClosed)
+    return died();
+
+  busy = false;
+  if (++queries == MaxQueries)
+    stop(false);
+
+  if (reply == ReplyUnparsed) {
+    unreadable = true;
+    return SolverImpl::SOLVER_RUN_STATUS_FAILURE;
+  }
+  hasSolution = reply == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+  return (SolverImpl::SolverRunStatus)reply;
+}
+
+SolverImpl::SolverRunStatus SolverWorker::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution,
+    double timeout) {
+  SolverImpl::SolverRunStatus status;
+  if (!send(query, objects, status))
+    return status;
+  return receive(values, hasSolution,
+                 timeout ? util::getWallTime() + timeout : 0);
+}
+
+SolverImpl::SolverRunStatus SolverWorker::computeInitialValuesForked(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution,
+    double deadline) {
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    return SolverImpl::SOLVER_RUN_STATUS_FORK_FAILED;
+
+  fflush(stdout);
+  fflush(stderr);
+  pid_t child = fork();
+  if (child == -1) {
+    close(sv[0]);
+    close(sv[1]);
+    return SolverImpl::SOLVER_RUN_STATUS_FORK_FAILED;
+  }
+
+  if (child == 0) {
+    ::signal(SIGINT, SIG_IGN);
+    closeParentSockets();
+    close(sv[0]);
+    unsigned char reply;
+    std::vector<std::vector<unsigned char> > result;
+    bool solvable;
+    if (solver->impl->computeInitialValues(query, objects, result, solvable))
+      reply = solvable ? SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE
+                       : SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+    else
+      reply = solver->impl->getOperationStatusCode();
+    _exit(writeAnswer(sv[1], reply, result) ? 0 : 1);
+  }
+
+  close(sv[1]);
+  std::vector<unsigned> sizes;
+  for (unsigned i = 0; i != objects.size(); ++i)
+    sizes.push_back(objects[i]->size);
+  unsigned char reply;
+  ReadResult res = readAnswer(sv[0], sizes, reply, values, deadline);
+  close(sv[0]);
+
+  if (res == ReadTimedOut) {
+    kill(child, SIGKILL);
+    reap(child);
+    return SolverImpl::SOLVER_RUN_STATUS_TIMEOUT;
+  }
+  SolverImpl::SolverRunStatus status = reap(child);
+  if (res == ReadClosed)
+    return status;
+  hasSolution = reply == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+  return (SolverImpl::SolverRunStatus)reply;
+}
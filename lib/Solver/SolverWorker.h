@@ -0,0 +1,103 @@
+//===-- SolverWorker.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_SOLVERWORKER_H
+#define KLEE_SOLVERWORKER_H
+
+#include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+
+#include <sys/types.h>
+#include <vector>
+
+namespace klee {
+
+/// SolverWorker - A long-lived child process that answers queries with
+/// a solver of its own. Each query is sent to the worker as KQuery text
+/// over a socket and the counterexample is streamed back, so a crash or
+/// a timeout only takes down the worker while the per-query cost is a
+/// round trip instead of a fork() of the whole interpreter.
+///
+/// The worker is started on the first query and again after it died,
+/// was cancelled, or answered MaxQueries queries.
+class SolverWorker {
+  /// The solver used inside the worker.
+  Solver *solver;
+  pid_t pid;
+  /// The parent's end of the socket while the worker is running.
+  int fd;
+  unsigned queries;
+  /// The sizes of the objects of the query in flight, if any.
+  std::vector<unsigned> pending;
+  bool busy;
+  bool unreadable;
+
+  bool start();
+  void stop(bool kill);
+  SolverImpl::SolverRunStatus died();
+  void serve() __attribute__((noreturn));
+
+public:
+  /// \a solver answers the queries in the worker; the worker takes
+  /// ownership of it.
+  explicit SolverWorker(Solver *solver);
+  ~SolverWorker();
+
+  /// The solver the worker runs.
+  Solver *getSolver() const { return solver; }
+
+  /// Send \a query to the worker, starting it if needed. On failure
+  /// the status is returned in \a status.
+  bool send(const Query &query, const std::vector<const Array *> &objects,
+            SolverImpl::SolverRunStatus &status);
+
+  /// Wait for the answer to the query in flight, until wall time
+  /// \a deadline unless it is 0. The worker is killed if the deadline
+  /// passes.
+  SolverImpl::SolverRunStatus
+  receive(std::vector<std::vector<unsigned char> > &values,
+          bool &hasSolution, double deadline);
+
+  /// Whether the worker failed the last query because it could not read
+  /// it back, so the caller has to solve it another way.
+  bool isUnreadable() const { return unreadable; }
+
+  /// Kill the worker, dropping the query in flight.
+  void cancel() { stop(true); }
+
+  /// Whether a query was sent whose answer was not received yet.
+  bool isBusy() const { return busy; }
+
+  /// Whether the worker started answering the query in flight.
+  bool isReady() const;
+
+  /// The socket to poll for the answer to the query in flight.
+  int getFD() const { return fd; }
+
+  /// Solve \a query in the worker, giving up after \a timeout seconds
+  /// (0 for no limit). See receive().
+  SolverImpl::SolverRunStatus
+  computeInitialValues(const Query &query,
+                       const std::vector<const Array *> &objects,
+                       std::vector<std::vector<unsigned char> > &values,
+                       bool &hasSolution, double timeout);
+
+  /// Solve \a query with the worker's solver in a one-off child process,
+  /// for queries the worker cannot read back: the child inherits the
+  /// query instead of parsing it. The child is killed if wall time
+  /// \a deadline passes, unless it is 0.
+  SolverImpl::SolverRunStatus
+  computeInitialValuesForked(const Query &query,
+                             const std::vector<const Array *> &objects,
+                             std::vector<std::vector<unsigned char> > &values,
+                             bool &hasSolution, double deadline);
+};
+}
+
+#endif
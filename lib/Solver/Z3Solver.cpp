@@ -8,7 +8,9 @@
 //===----------------------------------------------------------------------===//
 #include "klee/Config/config.h"
 #ifdef ENABLE_Z3
+#include "AssertionStack.h"
 #include "Z3Builder.h"
+#include "klee/CommandLine.h"
 #include "klee/Constraints.h"
 #include "klee/Solver.h"
 #include "klee/SolverImpl.h"
@@ -25,6 +27,10 @@ private:
   ::Z3_params solverParameters;
   // Parameter symbols
   ::Z3_symbol timeoutParamStrSymbol;
+  // The solver kept between queries with --solver-incremental, and the
+  // constraints asserted in it.
+  ::Z3_solver liveSolver;
+  AssertionStack assertions;
 
   bool internalRunSolver(const Query &,
                          const std::vector<const Array *> *objects,
@@ -63,15 +69,22 @@ public:
 
 Z3SolverImpl::Z3SolverImpl()
     : builder(new Z3Builder(/*autoClearConstructCache=*/false)), timeout(0.0),
-      runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
+      runStatusCode(SOLVER_RUN_STATUS_FAILURE), liveSolver(0) {
   assert(builder && "unable to create Z3Builder");
   solverParameters = Z3_mk_params(builder->ctx);
   Z3_params_inc_ref(builder->ctx, solverParameters);
   timeoutParamStrSymbol = Z3_mk_string_symbol(builder->ctx, "timeout");
   setCoreSolverTimeout(timeout);
+
+  if (CoreSolverIncremental) {
+    liveSolver = Z3_mk_simple_solver(builder->ctx);
+    Z3_solver_inc_ref(builder->ctx, liveSolver);
+  }
 }
 
 Z3SolverImpl::~Z3SolverImpl() {
+  if (liveSolver)
+    Z3_solver_dec_ref(builder->ctx, liveSolver);
   Z3_params_dec_ref(builder->ctx, solverParameters);
   delete builder;
 }
@@ -163,21 +176,39 @@ bool Z3SolverImpl::internalRunSolver(
     const Query &query, const std::vector<const Array *> *objects,
     std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
   TimerStatIncrementer t(stats::queryTime);
-  // TODO: Does making a new solver for each query have a performance
-  // impact vs making one global solver and using push and pop?
   // TODO: is the "simple_solver" the right solver to use for
   // best performance?
-  Z3_solver theSolver = Z3_mk_simple_solver(builder->ctx);
-  Z3_solver_inc_ref(builder->ctx, theSolver);
+  Z3_solver theSolver;
+  if (liveSolver) {
+    // Pop the constraints this query does not share with the last one
+    // and assert the rest of its constraints, each in its own scope.
+    theSolver = liveSolver;
+    unsigned shared = assertions.sharedPrefix(query.constraints);
+    if (shared != assertions.size()) {
+      Z3_solver_pop(builder->ctx, theSolver, assertions.size() - shared);
+      assertions.truncate(shared);
+    }
+    for (ConstraintManager::const_iterator
+           it = query.constraints.begin() + shared,
+           ie = query.constraints.end(); it != ie; ++it) {
+      Z3_solver_push(builder->ctx, theSolver);
+      Z3_solver_assert(builder->ctx, theSolver, builder->construct(*it));
+      assertions.push(*it);
+    }
+    Z3_solver_push(builder->ctx, theSolver);
+  } else {
+    theSolver = Z3_mk_simple_solver(builder->ctx);
+    Z3_solver_inc_ref(builder->ctx, theSolver);
+    for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                           ie = query.constraints.end();
+         it != ie; ++it) {
+      Z3_solver_assert(builder->ctx, theSolver, builder->construct(*it));
+    }
+  }
   Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
 
   runStatusCode = SOLVER_RUN_STATUS_FAILURE;
 
-  for (ConstraintManager::const_iterator it = query.constraints.begin(),
-                                         ie = query.constraints.end();
-       it != ie; ++it) {
-    Z3_solver_assert(builder->ctx, theSolver, builder->construct(*it));
-  }
   ++stats::queries;
   if (objects)
     ++stats::queryCounterexamples;
@@ -198,7 +229,10 @@ bool Z3SolverImpl::internalRunSolver(
   runStatusCode = handleSolverResponse(theSolver, satisfiable, objects, values,
                                        hasSolution);
 
-  Z3_solver_dec_ref(builder->ctx, theSolver);
+  if (liveSolver)
+    Z3_solver_pop(builder->ctx, theSolver, 1);
+  else
+    Z3_solver_dec_ref(builder->ctx, theSolver);
   // Clear the builder's cache to prevent memory usage exploding.
   // By using ``autoClearConstructCache=false`` and clearning now
   // we allow Z3_ast expressions to be shared from an entire
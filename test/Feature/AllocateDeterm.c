@@ -0,0 +1,34 @@
+// RUN: %llvmgcc %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.second-out %t.quarantine-out
+// RUN: %klee --output-dir=%t.klee-out --allocate-determ %t1.bc > %t1.log 2>&1
+// RUN: %klee --output-dir=%t.second-out --allocate-determ %t1.bc > %t2.log 2>&1
+// RUN: cat %t1.log %t2.log | FileCheck %s
+// RUN: %klee --output-dir=%t.quarantine-out --allocate-determ --allocate-quarantine=1 %t1.bc > %t3.log 2>&1
+// RUN: FileCheck -check-prefix=CHECK-QUARANTINE %s < %t3.log
+
+// Both runs place the objects at the same addresses, and reuse the
+// freed one unless it is held back.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main() {
+  char *p = malloc(100), *q, *r;
+  q = malloc(100);
+  printf("p = %p, q = %p\n", p, q);
+  free(p);
+  r = malloc(100);
+  printf("%s\n", r == p ? "reused" : "not reused");
+  free(q);
+  free(r);
+  return 0;
+}
+
+// CHECK-NOT: addresses will differ
+// CHECK: p = [[P:0x[0-9a-f]+]], q = [[Q:0x[0-9a-f]+]]
+// CHECK: {{^}}reused
+// CHECK-NOT: addresses will differ
+// CHECK: p = [[P]], q = [[Q]]
+// CHECK: {{^}}reused
+
+// CHECK-QUARANTINE: not reused
@@ -0,0 +1,33 @@
+// RUN: %llvmgcc -emit-llvm -g -c -o %t.bc %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --async-solver-workers=2 %t.bc > %t.log 2>&1
+// RUN: FileCheck -input-file=%t.log %s
+// RUN: FileCheck -check-prefix=CHECK-INFO -input-file=%t.klee-out/info %s
+// RUN: rm -rf %t.sync-out
+// RUN: %klee --output-dir=%t.sync-out %t.bc > %t.sync.log 2>&1
+// RUN: cat %t.sync-out/info %t.klee-out/info | FileCheck -check-prefix=CHECK-SAME-COUNT %s
+
+#include <stdio.h>
+
+int main() {
+  char buf[3];
+  unsigned i, n = 0;
+  klee_make_symbolic(buf, sizeof(buf), "buf");
+  for (i = 0; i < sizeof(buf); ++i)
+    if (buf[i] > 'a')
+      ++n;
+  // Only one side of this branch is feasible.
+  if (n > sizeof(buf))
+    printf("unreachable\n");
+  return n;
+}
+
+// CHECK-NOT: unreachable
+// CHECK: KLEE: done: completed paths = 8
+
+// The branches on buf went to the workers.
+// CHECK-INFO: KLEE: done: async queries = {{[1-9][0-9]*}}
+
+// A parked branch is executed again when it is resumed, but counted once.
+// CHECK-SAME-COUNT: KLEE: done: total instructions = [[INSTRUCTIONS:[0-9]+]]
+// CHECK-SAME-COUNT: KLEE: done: total instructions = [[INSTRUCTIONS]]{{$}}
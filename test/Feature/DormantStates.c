@@ -0,0 +1,55 @@
+// RUN: %llvmgcc %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.dormant-out
+// RUN: %klee --output-dir=%t.klee-out --search=dfs %t1.bc > %t1.log 2>&1
+// RUN: %klee --output-dir=%t.dormant-out --search=dfs --dormant-states --max-memory=1 --max-memory-inhibit=false %t1.bc > %t2.log 2>&1
+// RUN: cat %t1.log %t2.log | FileCheck %s
+
+// With a memory cap of 1MB every memory check suspends the inactive
+// states, which then have to be rebuilt, including the fixed object and
+// the calls the StatsTracker has already seen. The run has to do the
+// same work as the one without --dormant-states.
+
+#include <klee/klee.h>
+
+#define FIXED ((unsigned *) 0x0080)
+
+static unsigned work(unsigned x) {
+  unsigned i, sum = 0;
+  for (i = 0; i < 5000; ++i)
+    sum += x ^ i;
+  return sum;
+}
+
+int main() {
+  unsigned char a[4];
+  unsigned i, r = 0, bits = 0;
+
+  klee_define_fixed_object(FIXED, sizeof(unsigned));
+  *FIXED = 0;
+  klee_make_symbolic(a, sizeof a, "a");
+  for (i = 0; i < 4; ++i) {
+    if (a[i] > 'm') {
+      r |= 1 << i;
+      ++*FIXED;
+    }
+    work(r);
+  }
+
+  for (i = 0; i < 4; ++i)
+    bits += (r >> i) & 1;
+  if (*FIXED != bits)
+    klee_report_error(__FILE__, __LINE__, "wrong fixed object", "user.err");
+  return r;
+}
+
+// CHECK-NOT: wrong fixed object
+// CHECK: KLEE: done: total instructions = [[INSTS:[0-9]+]]
+// CHECK: KLEE: done: completed paths = 16
+// CHECK: KLEE: done: generated tests = 16
+// CHECK-NOT: wrong fixed object
+// CHECK: suspending
+// CHECK-NOT: unable to rebuild dormant state
+// CHECK-NOT: wrong fixed object
+// CHECK: KLEE: done: total instructions = [[INSTS]]
+// CHECK: KLEE: done: completed paths = 16
+// CHECK: KLEE: done: generated tests = 16
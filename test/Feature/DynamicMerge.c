@@ -0,0 +1,24 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --use-dynamic-merge --search=dfs --debug-log-merge %t.bc > %t.log 2>&1
+// RUN: FileCheck -input-file=%t.log %s
+
+#include <stdio.h>
+
+int main() {
+  int x, y;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  if (x > 5)
+    y = 1;
+  else
+    y = 2;
+  // The two paths meet here and are merged, y becomes ite(x > 5, 1, 2).
+  int ok = (y == 1) == (x > 5);
+  if (!ok)
+    printf("wrong\n");
+  return 0;
+}
+
+// CHECK: dynamic merge:
+// CHECK-NOT: wrong
+// CHECK: KLEE: done: completed paths = 1
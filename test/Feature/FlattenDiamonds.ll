@@ -0,0 +1,70 @@
+; RUN: llvm-as %s -f -o %t1.bc
+; RUN: rm -rf %t.klee-out
+; RUN: %klee --output-dir=%t.klee-out %t1.bc > %t.log 2>&1
+; RUN: FileCheck -check-prefix=FORK -input-file=%t.log %s
+; RUN: rm -rf %t.klee-out
+; RUN: %klee --output-dir=%t.klee-out --flatten-diamonds %t1.bc > %t.log 2>&1
+; RUN: FileCheck -check-prefix=FLAT -input-file=%t.log %s
+
+declare void @klee_make_symbolic(i8*, i64, i8*)
+
+@.name = private constant [4 x i8] c"buf\00", align 1
+
+define i32 @main() {
+entry:
+  %buf = alloca [2 x i8], align 1
+  %p0 = getelementptr inbounds [2 x i8]* %buf, i64 0, i64 0
+  call void @klee_make_symbolic(i8* %p0, i64 2, i8* getelementptr inbounds ([4 x i8]* @.name, i64 0, i64 0))
+  %x0 = load i8* %p0
+  %p1 = getelementptr inbounds [2 x i8]* %buf, i64 0, i64 1
+  %x1 = load i8* %p1
+  %c0 = icmp ugt i8 %x0, 97
+  br i1 %c0, label %then0, label %else0
+
+then0:
+  %a0 = add i8 %x0, 1
+  %b0 = mul i8 %a0, 3
+  %d0 = xor i8 %b0, 5
+  br label %join0
+
+else0:
+  %e0 = sub i8 %x0, 1
+  %f0 = shl i8 %e0, 1
+  %g0 = or i8 %f0, 1
+  br label %join0
+
+; Both sides of the diamond are joined in a select, and so is the
+; triangle which follows it.
+join0:
+  %n0 = phi i8 [ %d0, %then0 ], [ %g0, %else0 ]
+  %c1 = icmp ugt i8 %x1, %n0
+  br i1 %c1, label %then1, label %join1
+
+then1:
+  %a1 = add i8 %n0, %x1
+  %b1 = mul i8 %a1, 7
+  %d1 = xor i8 %b1, %x0
+  br label %join1
+
+join1:
+  %n1 = phi i8 [ %d1, %then1 ], [ %n0, %join0 ]
+  %lo = and i8 %x0, 1
+  %c2 = icmp eq i8 %lo, 0
+  br i1 %c2, label %then2, label %join2
+
+; Floating point operations are only run on the paths which take them,
+; this triangle is not flattened.
+then2:
+  %f = fadd float 1.0, 2.0
+  br label %join2
+
+join2:
+  %g = phi float [ %f, %then2 ], [ 0.0, %join1 ]
+  %h = fptoui float %g to i8
+  %s = add i8 %n1, %h
+  %r = zext i8 %s to i32
+  ret i32 %r
+}
+
+; FORK: KLEE: done: completed paths = 8
+; FLAT: KLEE: done: completed paths = 2
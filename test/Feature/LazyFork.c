@@ -0,0 +1,40 @@
+// RUN: %llvmgcc %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.lazy-out
+// RUN: %klee --output-dir=%t.klee-out --search=dfs %t1.bc > %t1.log 2>&1
+// RUN: %klee --output-dir=%t.lazy-out --search=dfs --lazy-fork %t1.bc > %t2.log 2>&1
+// RUN: cat %t1.log %t2.log | FileCheck %s
+//
+// Without caches every query reaches the core solver. After the first
+// path the run stops, the lazily forked states which were not selected
+// by then never cost a query, while each fork costs one or two without
+// --lazy-fork.
+// RUN: rm -rf %t.klee-out %t.lazy-out
+// RUN: %klee --output-dir=%t.klee-out --search=dfs --use-cex-cache=false --use-cache=false --use-independent-solver=false --stop-after-n-tests=1 --dump-states-on-halt=false %t1.bc > %t1.log 2>&1
+// RUN: %klee --output-dir=%t.lazy-out --search=dfs --use-cex-cache=false --use-cache=false --use-independent-solver=false --stop-after-n-tests=1 --dump-states-on-halt=false --lazy-fork %t1.bc > %t2.log 2>&1
+// RUN: cat %t.klee-out/info %t.lazy-out/info | FileCheck -check-prefix=CHECK-QUERIES %s
+// RUN: sh -c 'test $(sed -n "s/.*total queries = //p" %t.lazy-out/info) -lt $(sed -n "s/.*total queries = //p" %t.klee-out/info)'
+
+#include <klee/klee.h>
+
+int main() {
+  unsigned char a[4];
+  unsigned i, n = 0;
+
+  klee_make_symbolic(a, sizeof a, "a");
+  for (i = 0; i < 4; ++i)
+    if (a[i] & 1)
+      ++n;
+
+  // Never true, one side of the branch is infeasible.
+  if (n > 4)
+    return 1;
+  return 0;
+}
+
+// CHECK: KLEE: done: completed paths = 16
+// CHECK: KLEE: done: completed paths = 16
+
+// The query totals are compared by the last RUN line, both runs complete
+// the same paths.
+// CHECK-QUERIES: KLEE: done: completed paths = [[PATHS:[0-9]+]]
+// CHECK-QUERIES: KLEE: done: completed paths = [[PATHS]]{{$}}
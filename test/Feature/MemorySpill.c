@@ -0,0 +1,57 @@
+// RUN: %llvmgcc %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.spill-out
+// RUN: %klee --output-dir=%t.klee-out --search=dfs %t1.bc > %t1.log 2>&1
+// RUN: %klee --output-dir=%t.spill-out --search=dfs --max-memory-spill --spill-object-size=256 --max-memory=1 --max-memory-inhibit=false %t1.bc > %t2.log 2>&1
+// RUN: cat %t1.log %t2.log | FileCheck %s
+
+// With a memory cap of 1MB every memory check writes the buffers of the
+// inactive states out, which have to read back the right contents when
+// they run again. The run has to do the same work as the one without
+// --max-memory-spill.
+
+#include <klee/klee.h>
+
+#define SIZE 1024
+
+static unsigned work(unsigned char *buf, unsigned x) {
+  unsigned i, sum = 0;
+  for (i = 0; i < 5000; ++i)
+    sum += buf[i % SIZE] ^ x ^ i;
+  return sum;
+}
+
+int main() {
+  unsigned char a[4];
+  unsigned char buf[SIZE];
+  unsigned i, j, r = 0;
+
+  for (j = 0; j < SIZE; ++j)
+    buf[j] = j;
+  klee_make_symbolic(a, sizeof a, "a");
+  for (i = 0; i < 4; ++i) {
+    if (a[i] > 'm') {
+      r |= 1 << i;
+      for (j = i; j < SIZE; j += 4)
+        buf[j] ^= 0xff;
+    }
+    work(buf, r);
+  }
+
+  for (i = 0; i < 4; ++i)
+    for (j = i; j < SIZE; j += 4)
+      if (buf[j] != (unsigned char) (((r >> i) & 1) ? ~j : j))
+        klee_report_error(__FILE__, __LINE__, "wrong contents", "user.err");
+  return r;
+}
+
+// CHECK-NOT: wrong contents
+// CHECK: KLEE: done: total instructions = [[INSTS:[0-9]+]]
+// CHECK: KLEE: done: completed paths = 16
+// CHECK: KLEE: done: generated tests = 16
+// CHECK-NOT: wrong contents
+// CHECK: spilling inactive states to disk
+// CHECK-NOT: wrong contents
+// CHECK-NOT: killing
+// CHECK: KLEE: done: total instructions = [[INSTS]]
+// CHECK: KLEE: done: completed paths = 16
+// CHECK: KLEE: done: generated tests = 16
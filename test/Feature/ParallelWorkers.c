@@ -0,0 +1,45 @@
+// RUN: %llvmgcc %s -emit-llvm -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.parallel-out
+// RUN: %klee --output-dir=%t.klee-out %t1.bc > %t1.log 2>&1
+// RUN: %klee --output-dir=%t.parallel-out --parallel-workers=2 %t1.bc > %t2.log 2>&1
+// RUN: cat %t.klee-out/info %t.parallel-out/info | FileCheck %s
+// RUN: ls %t.parallel-out | grep ktest | FileCheck -check-prefix=CHECK-TESTS %s
+
+// The workers split the 9 paths between them, the coordinator reports
+// the same totals as a single process and numbers their tests from 1
+// without gaps. The first path ends above the partition depth, so both
+// workers run it.
+
+#include <klee/klee.h>
+
+int main() {
+  unsigned char a[3];
+  unsigned i, r = 0;
+
+  klee_make_symbolic(a, sizeof a, "a");
+  if (a[0] == 0)
+    return 8;
+  for (i = 0; i < 3; ++i)
+    if (a[i] > 'm')
+      r |= 1 << i;
+  return r;
+}
+
+// CHECK: KLEE: done: explored paths = [[PATHS:[0-9]+]]
+// CHECK: KLEE: done: completed paths = [[PATHS]]
+// CHECK: KLEE: done: generated tests = [[PATHS]]
+// CHECK: Workers: 2
+// CHECK: KLEE: done: explored paths = [[PATHS]]
+// CHECK: KLEE: done: completed paths = [[PATHS]]
+// CHECK: KLEE: done: generated tests = [[PATHS]]
+
+// CHECK-TESTS: test000001.ktest
+// CHECK-TESTS-NEXT: test000002.ktest
+// CHECK-TESTS-NEXT: test000003.ktest
+// CHECK-TESTS-NEXT: test000004.ktest
+// CHECK-TESTS-NEXT: test000005.ktest
+// CHECK-TESTS-NEXT: test000006.ktest
+// CHECK-TESTS-NEXT: test000007.ktest
+// CHECK-TESTS-NEXT: test000008.ktest
+// CHECK-TESTS-NEXT: test000009.ktest
+// CHECK-TESTS-NOT: ktest
@@ -0,0 +1,54 @@
+// RUN: %llvmgcc %s -g -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.resume-out %t.full-out
+// RUN: %klee --output-dir=%t.klee-out --search=dfs --checkpoint-interval=3600 --stop-after-n-instructions=20000 --dump-states-on-halt=false %t1.bc > %t1.log 2>&1
+// RUN: FileCheck -check-prefix=FIRST %s < %t1.log
+// RUN: test -f %t.klee-out/checkpoint/test000001.ktest
+// RUN: test -f %t.klee-out/checkpoint/info
+// RUN: test ! -d %t.klee-out/checkpoint.old
+// RUN: %klee --output-dir=%t.resume-out --resume=%t.klee-out %t1.bc > %t2.log 2>&1
+// RUN: FileCheck -check-prefix=RESUME %s < %t2.log
+// RUN: test -f %t.resume-out/test000005.ktest
+// RUN: test ! -f %t.resume-out/test000001.ktest
+// RUN: test ! -f %t.resume-out/test000006.ktest
+// RUN: %klee --output-dir=%t.full-out --search=dfs %t1.bc > %t3.log 2>&1
+// RUN: cat %t.full-out/info %t.resume-out/info | FileCheck -check-prefix=TOTALS %s
+
+// Each branch returns on its false side, which the depth first search
+// runs first, so the four short paths are complete when the run halts in
+// the loop of the last one. Resuming only has that path left to explore,
+// and ends with the same totals as a run which was not stopped.
+
+#include <klee/klee.h>
+
+int main() {
+  unsigned char a[4];
+  volatile unsigned sink = 0;
+  unsigned i;
+
+  klee_make_symbolic(a, sizeof a, "a");
+  for (i = 0; i < 4; ++i) {
+    if (a[i] > 'm') {
+      sink += i;
+    } else {
+      return i;
+    }
+  }
+
+  for (i = 0; i < 100000; ++i)
+    sink += i;
+  return 4;
+}
+
+// FIRST: KLEE: checkpoint: 1 states
+// FIRST: KLEE: done: completed paths = 4
+
+// RESUME: KLEE: using 1 seeds
+// RESUME: KLEE: done: completed paths = 5
+// RESUME: KLEE: done: generated tests = 5
+
+// TOTALS: KLEE: done: explored paths = [[PATHS:[0-9]+]]
+// TOTALS: KLEE: done: total instructions = [[INSTRUCTIONS:[0-9]+]]
+// TOTALS: KLEE: done: completed paths = [[PATHS]]
+// TOTALS: KLEE: done: explored paths = [[PATHS]]
+// TOTALS: KLEE: done: total instructions = [[INSTRUCTIONS]]
+// TOTALS: KLEE: done: completed paths = [[PATHS]]
@@ -308,6 +308,12 @@ static bool EvaluateInputAST(const char *Filename,
       << "query cex = " 
       << *theStatisticManager->getStatisticByName("QueriesCEX") << "\n";
   }
+  if (uint64_t hits = *theStatisticManager->getStatisticByName("QueryCacheHits"))
+    llvm::outs() << "query cache hits = " << hits << "\n";
+  if (uint64_t hits = *theStatisticManager->getStatisticByName("PersistentCacheHits"))
+    llvm::outs() << "persistent cache hits = " << hits << "\n";
+  if (uint64_t hits = *theStatisticManager->getStatisticByName("SharedCacheHits"))
+    llvm::outs() << "shared cache hits = " << hits << "\n";
 
   return success;
 }
@@ -190,6 +190,21 @@ namespace {
   cl::list<std::string>
   SeedOutDir("seed-out-dir");
 
+  cl::opt<std::string>
+  Resume("resume",
+         cl::desc("Continue from the last checkpoint written to the given "
+                  "output directory (see --checkpoint-interval). The "
+                  "checkpointed states are re-executed as seeds, taking "
+                  "the branches recorded for them without asking the "
+                  "solver, and the totals carry on from the checkpoint. "
+                  "Branches decided differently than in the checkpointed "
+                  "run, e.g. by --max-forks, may make the resumed run "
+                  "explore some paths again or miss some"),
+         cl::value_desc("output directory"));
+
+  // The checkpoint directory --resume reads, once chosen.
+  std::string ResumeCheckpoint;
+
   cl::opt<unsigned>
   MakeConcreteSymbolic("make-concrete-symbolic",
                        cl::desc("Probabilistic rate at which to make concrete reads symbolic, "
@@ -206,12 +221,69 @@ namespace {
   Watchdog("watchdog",
            cl::desc("Use a watchdog process to enforce --max-time."),
            cl::init(0));
+
+  cl::opt<unsigned>
+  ParallelWorkers("parallel-workers",
+                  cl::desc("Split the exploration across N worker processes, "
+                           "each exploring its own subtrees of the first "
+                           "symbolic branches (default=0 (off))"),
+                  cl::init(0));
+
+  cl::opt<unsigned>
+  ParallelSplitFactor("parallel-split-factor",
+                      cl::desc("Number of subtrees per worker in --parallel-workers "
+                               "mode. More subtrees even out the load between "
+                               "workers but re-execute more of the shared "
+                               "prefix (default=4)"),
+                      cl::init(4));
 }
 
 extern cl::opt<double> MaxTime;
+extern cl::opt<bool> AllowSeedExtension;
+extern cl::opt<bool> ZeroSeedExtension;
 
 /***/
 
+namespace {
+  /// The totals reported at the end of a run. In --parallel-workers
+  /// mode each worker sends these to the coordinator, which reports
+  /// their sum.
+  struct RunTotals {
+    uint64_t forks;
+    uint64_t queries;
+    uint64_t queriesValid;
+    uint64_t queriesInvalid;
+    uint64_t queryCounterexamples;
+    uint64_t queryConstructs;
+    uint64_t asyncQueries;
+    uint64_t instructions;
+    uint64_t pathsExplored;
+    uint64_t sharedPaths;
+    uint64_t testCases;
+  };
+
+  /// The totals which are statistics, under the names of the
+  /// statistics. Checkpoints record them under the same names.
+  struct RunTotalsStatistic {
+    const char *name;
+    uint64_t RunTotals::*field;
+  };
+
+  const RunTotalsStatistic runTotalsStatistics[] = {
+    { "Forks", &RunTotals::forks },
+    { "Queries", &RunTotals::queries },
+    { "QueriesValid", &RunTotals::queriesValid },
+    { "QueriesInvalid", &RunTotals::queriesInvalid },
+    { "QueriesCEX", &RunTotals::queryCounterexamples },
+    { "QueriesConstructs", &RunTotals::queryConstructs },
+    { "AsyncQueries", &RunTotals::asyncQueries },
+    { "Instructions", &RunTotals::instructions },
+    { "SharedPaths", &RunTotals::sharedPaths }
+  };
+  const unsigned NumRunTotalsStatistics =
+    sizeof(runTotalsStatistics) / sizeof(runTotalsStatistics[0]);
+}
+
 class KleeHandler : public InterpreterHandler {
 private:
   Interpreter *m_interpreter;
@@ -222,6 +294,7 @@ private:
 
   unsigned m_testIndex;  // number of tests written so far
   unsigned m_pathsExplored; // number of paths explored so far
+  RunTotals m_resumedTotals; // totals of the run being resumed
 
   // used for writing .ktest files
   int m_argc;
@@ -236,12 +309,29 @@ public:
   unsigned getNumPathsExplored() { return m_pathsExplored; }
   void incPathsExplored() { m_pathsExplored++; }
 
+  /// The totals so far, those of the run being resumed included.
+  void getRunTotals(RunTotals &totals);
+  /// Carry on from the totals recorded in a checkpoint (see --resume),
+  /// including the numbering of the tests.
+  void resumeTotals(const std::string &checkpoint);
+
   void setInterpreter(Interpreter *i);
 
   void processTestCase(const ExecutionState  &state,
                        const char *errorMessage,
                        const char *errorSuffix);
 
+  void processCheckpoint(const std::vector<
+                         std::vector<
+                         std::pair<std::string,
+                         std::vector<unsigned char> > > > &solutions,
+                         const std::vector<CheckpointPosition> &positions);
+
+  bool writeKTest(const std::string &path,
+                  const std::vector<
+                  std::pair<std::string,
+                  std::vector<unsigned char> > > &out);
+
   std::string getOutputFilename(const std::string &filename);
   llvm::raw_fd_ostream *openOutputFile(const std::string &filename);
   std::string getTestFilename(const std::string &suffix, unsigned id);
@@ -258,6 +348,8 @@ public:
   static void getOutFiles(std::string path,
 			  std::vector<std::string> &results);
 
+  unsigned importTestCases(const std::string &directory);
+
   static std::string getRunTimeLibraryPath(const char *argv0);
 };
 
@@ -271,6 +363,7 @@ KleeHandler::KleeHandler(int argc, char **argv)
     m_pathsExplored(0),
     m_argc(argc),
     m_argv(argv) {
+  memset(&m_resumedTotals, 0, sizeof(m_resumedTotals));
 
   // create output directory (OutputDir or "klee-out-<i>")
   bool dir_given = OutputDir != "";
@@ -405,6 +498,198 @@ llvm::raw_fd_ostream *KleeHandler::openTestFile(const std::string &suffix,
 }
 
 
+bool KleeHandler::writeKTest(const std::string &path,
+                             const std::vector<
+                             std::pair<std::string,
+                             std::vector<unsigned char> > > &out) {
+  KTest b;
+  b.numArgs = m_argc;
+  b.args = m_argv;
+  b.symArgvs = 0;
+  b.symArgvLen = 0;
+  b.numObjects = out.size();
+  b.objects = new KTestObject[b.numObjects];
+  assert(b.objects);
+  for (unsigned i=0; i<b.numObjects; i++) {
+    KTestObject *o = &b.objects[i];
+    o->name = const_cast<char*>(out[i].first.c_str());
+    o->numBytes = out[i].second.size();
+    o->bytes = new unsigned char[o->numBytes];
+    assert(o->bytes);
+    std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
+  }
+
+  bool success = kTest_toFile(&b, path.c_str());
+
+  for (unsigned i=0; i<b.numObjects; i++)
+    delete[] b.objects[i].bytes;
+  delete[] b.objects;
+
+  return success;
+}
+
+static void removeDirectory(const std::string &path) {
+  DIR *dir = opendir(path.c_str());
+  if (!dir)
+    return;
+  while (struct dirent *entry = readdir(dir)) {
+    if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
+      unlink((path + "/" + entry->d_name).c_str());
+  }
+  closedir(dir);
+  rmdir(path.c_str());
+}
+
+/* Writes the inputs of the live states to <output dir>/checkpoint,
+   replacing the previous checkpoint only once the new one is
+   complete. */
+void KleeHandler::processCheckpoint(const std::vector<
+                                    std::vector<
+                                    std::pair<std::string,
+                                    std::vector<unsigned char> > > >
+                                    &solutions,
+                                    const std::vector<CheckpointPosition>
+                                    &positions) {
+  std::string tmpDir = getOutputFilename("checkpoint.tmp");
+  std::string dir = getOutputFilename("checkpoint");
+  std::string oldDir = getOutputFilename("checkpoint.old");
+
+  removeDirectory(tmpDir);
+  if (mkdir(tmpDir.c_str(), 0775) < 0) {
+    klee_warning("cannot create \"%s\": %s", tmpDir.c_str(), strerror(errno));
+    return;
+  }
+
+  // Each state has its inputs in a .ktest file and its branches in a
+  // .path file, the depth and number of instructions of its path are in
+  // the states file.
+  unsigned written = 0;
+  std::string statesFile = tmpDir + "/states";
+  std::ofstream s(statesFile.c_str());
+  for (unsigned i = 0; i < solutions.size(); ++i) {
+    std::string name = getTestFilename("ktest", i + 1);
+    SmallString<128> path(tmpDir);
+    sys::path::append(path, name);
+    if (!writeKTest(path.c_str(), solutions[i]))
+      continue;
+
+    const CheckpointPosition &position = positions[i];
+    SmallString<128> pathFile(tmpDir);
+    sys::path::append(pathFile, getTestFilename("path", i + 1));
+    std::ofstream p(pathFile.c_str());
+    for (unsigned j = 0; j < position.branches.size(); ++j)
+      p << position.branches[j] << "\n";
+    p.close();
+
+    s << name << " " << position.depth << " " << position.instructions
+      << "\n";
+    ++written;
+  }
+  s.close();
+
+  // Totals at the time of the checkpoint, --resume carries on from them.
+  RunTotals totals;
+  getRunTotals(totals);
+  std::string totalsFile = tmpDir + "/totals";
+  std::ofstream t(totalsFile.c_str());
+  for (unsigned i = 0; i != NumRunTotalsStatistics; ++i)
+    t << runTotalsStatistics[i].name << " "
+      << totals.*runTotalsStatistics[i].field << "\n";
+  t << "CompletedPaths " << totals.pathsExplored << "\n";
+  t << "GeneratedTests " << totals.testCases << "\n";
+  t.close();
+
+  // The info file is written last, a checkpoint.tmp with an info file
+  // is complete.
+  std::string info = tmpDir + "/info";
+  std::ofstream f(info.c_str());
+  f << "States: " << written << "\n";
+  f << "Instructions: " << totals.instructions << "\n";
+  f << "Completed paths: " << totals.pathsExplored << "\n";
+  f << "Generated tests: " << totals.testCases << "\n";
+  f.close();
+
+  // Keep the previous checkpoint until the new one is in place, so that
+  // there is a complete one to resume from at any time.
+  removeDirectory(oldDir);
+  if (rename(dir.c_str(), oldDir.c_str()) < 0 && errno != ENOENT) {
+    klee_warning("cannot rename \"%s\": %s", dir.c_str(), strerror(errno));
+    return;
+  }
+  if (rename(tmpDir.c_str(), dir.c_str()) < 0) {
+    klee_warning("cannot create \"%s\": %s", dir.c_str(), strerror(errno));
+    return;
+  }
+  removeDirectory(oldDir);
+  klee_message("checkpoint: %u states", written);
+}
+
+/* Returns the most recent complete checkpoint in an output directory,
+   falling back to the ones left behind when the run stopped while
+   replacing it. */
+static std::string findCheckpoint(const std::string &outputDir) {
+  const char *names[] = { "checkpoint", "checkpoint.tmp", "checkpoint.old" };
+  for (unsigned i = 0; i != sizeof(names) / sizeof(names[0]); ++i) {
+    SmallString<128> info(outputDir);
+    sys::path::append(info, names[i], "info");
+    if (access(info.c_str(), R_OK) == 0) {
+      SmallString<128> dir(outputDir);
+      sys::path::append(dir, names[i]);
+      return dir.str().str();
+    }
+  }
+  return "";
+}
+
+/* Reads the position of each checkpointed state, by ktest file name. */
+static void readCheckpointPositions(const std::string &dir,
+                                    std::map<std::string,
+                                    CheckpointPosition> &positions) {
+  std::string path = dir + "/states";
+  std::ifstream f(path.c_str());
+  std::string name;
+  unsigned depth;
+  uint64_t instructions;
+  while (f >> name >> depth >> instructions) {
+    CheckpointPosition &position = positions[name];
+    position.depth = depth;
+    position.instructions = instructions;
+
+    SmallString<128> pathFile(dir);
+    sys::path::append(pathFile, name);
+    sys::path::replace_extension(pathFile, "path");
+    std::ifstream p(pathFile.c_str());
+    char branch;
+    while (p >> branch)
+      position.branches.push_back(branch);
+  }
+}
+
+void KleeHandler::getRunTotals(RunTotals &totals) {
+  totals = m_resumedTotals;
+  for (unsigned i = 0; i != NumRunTotalsStatistics; ++i)
+    totals.*runTotalsStatistics[i].field +=
+      *theStatisticManager->getStatisticByName(runTotalsStatistics[i].name);
+  totals.pathsExplored = m_pathsExplored;
+  totals.testCases = m_testIndex;
+}
+
+void KleeHandler::resumeTotals(const std::string &checkpoint) {
+  std::string path = checkpoint + "/totals";
+  std::ifstream f(path.c_str());
+  std::string name;
+  uint64_t value;
+  while (f >> name >> value) {
+    if (name == "CompletedPaths")
+      m_pathsExplored = value;
+    else if (name == "GeneratedTests")
+      m_testIndex = value;
+    for (unsigned i = 0; i != NumRunTotalsStatistics; ++i)
+      if (name == runTotalsStatistics[i].name)
+        m_resumedTotals.*runTotalsStatistics[i].field = value;
+  }
+}
+
 /* Outputs all files (.ktest, .pc, .cov etc.) describing a test case */
 void KleeHandler::processTestCase(const ExecutionState &state,
                                   const char *errorMessage,
@@ -426,30 +711,9 @@ void KleeHandler::processTestCase(const ExecutionState &state,
     unsigned id = ++m_testIndex;
 
     if (success) {
-      KTest b;
-      b.numArgs = m_argc;
-      b.args = m_argv;
-      b.symArgvs = 0;
-      b.symArgvLen = 0;
-      b.numObjects = out.size();
-      b.objects = new KTestObject[b.numObjects];
-      assert(b.objects);
-      for (unsigned i=0; i<b.numObjects; i++) {
-        KTestObject *o = &b.objects[i];
-        o->name = const_cast<char*>(out[i].first.c_str());
-        o->numBytes = out[i].second.size();
-        o->bytes = new unsigned char[o->numBytes];
-        assert(o->bytes);
-        std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
-      }
-
-      if (!kTest_toFile(&b, getOutputFilename(getTestFilename("ktest", id)).c_str())) {
+      if (!writeKTest(getOutputFilename(getTestFilename("ktest", id)), out)) {
         klee_warning("unable to write output test case, losing it");
       }
-
-      for (unsigned i=0; i<b.numObjects; i++)
-        delete[] b.objects[i].bytes;
-      delete[] b.objects;
     }
 
     if (errorMessage) {
@@ -573,6 +837,44 @@ void KleeHandler::getOutFiles(std::string path,
   }
 }
 
+/// Move the test cases found in \a directory (the output directory of
+/// a --parallel-workers process) into our output directory, numbering
+/// them after the tests written so far. Returns the number of tests.
+unsigned KleeHandler::importTestCases(const std::string &directory) {
+  DIR *dir = opendir(directory.c_str());
+  if (!dir) {
+    klee_warning("unable to read \"%s\": %s", directory.c_str(),
+                 strerror(errno));
+    return 0;
+  }
+
+  // test id -> file suffixes (ktest, pc, ptr.err, ...)
+  std::map<unsigned, std::vector<std::string> > tests;
+  while (struct dirent *entry = readdir(dir)) {
+    unsigned id;
+    const char *suffix = strchr(entry->d_name, '.');
+    if (suffix && sscanf(entry->d_name, "test%u.", &id) == 1)
+      tests[id].push_back(suffix + 1);
+  }
+  closedir(dir);
+
+  for (std::map<unsigned, std::vector<std::string> >::iterator
+         it = tests.begin(), ie = tests.end(); it != ie; ++it) {
+    unsigned id = ++m_testIndex;
+    for (std::vector<std::string>::iterator
+           sit = it->second.begin(), sie = it->second.end(); sit != sie; ++sit) {
+      SmallString<128> from(directory);
+      sys::path::append(from, getTestFilename(*sit, it->first));
+      std::string to = getOutputFilename(getTestFilename(*sit, id));
+      if (rename(from.c_str(), to.c_str()) < 0)
+        klee_warning("unable to move \"%s\": %s", from.c_str(),
+                     strerror(errno));
+    }
+  }
+
+  return tests.size();
+}
+
 std::string KleeHandler::getRunTimeLibraryPath(const char *argv0) {
   // allow specifying the path to the runtime library
   const char *env = getenv("KLEE_RUNTIME_LIBRARY_PATH");
@@ -959,6 +1261,17 @@ static void interrupt_handle_watchdog() {
   // just wait for the child to finish
 }
 
+static std::vector<pid_t> parallelWorkerPids;
+
+static void interrupt_handle_coordinator() {
+  // The workers run in their own process groups, forward the request
+  // so each of them halts and dumps its states.
+  llvm::errs() << "KLEE: ctrl-c detected, requesting workers to halt.\n";
+  for (unsigned i = 0; i < parallelWorkerPids.size(); ++i)
+    kill(parallelWorkerPids[i], SIGINT);
+  sys::SetInterruptFunction(interrupt_handle_coordinator);
+}
+
 // This is a temporary hack. If the running process has access to
 // externals then it can disable interrupts, which screws up the
 // normal "nice" watchdog termination process. We try to request the
@@ -1140,6 +1453,204 @@ static llvm::Module *linkWithUclibc(llvm::Module *mainModule, StringRef libDir)
 }
 #endif
 
+/// Write end of the pipe to the coordinator, in a --parallel-workers
+/// process.
+static int parallelResultFd = -1;
+
+static void reportRunTotals(KleeHandler *handler, const RunTotals &totals) {
+  handler->getInfoStream()
+    << "KLEE: done: explored paths = " << 1 + totals.forks << "\n";
+
+  // Write some extra information in the info file which users won't
+  // necessarily care about or understand.
+  if (totals.queries)
+    handler->getInfoStream()
+      << "KLEE: done: avg. constructs per query = "
+                             << totals.queryConstructs / totals.queries << "\n";
+  handler->getInfoStream()
+    << "KLEE: done: total queries = " << totals.queries << "\n"
+    << "KLEE: done: valid queries = " << totals.queriesValid << "\n"
+    << "KLEE: done: invalid queries = " << totals.queriesInvalid << "\n"
+    << "KLEE: done: query cex = " << totals.queryCounterexamples << "\n";
+  if (totals.asyncQueries)
+    handler->getInfoStream()
+      << "KLEE: done: async queries = " << totals.asyncQueries << "\n";
+
+  std::stringstream stats;
+  stats << "\n";
+  stats << "KLEE: done: total instructions = "
+        << totals.instructions << "\n";
+  stats << "KLEE: done: completed paths = "
+        << totals.pathsExplored << "\n";
+  stats << "KLEE: done: generated tests = "
+        << totals.testCases << "\n";
+
+  bool useColors = llvm::errs().is_displayed();
+  if (useColors)
+    llvm::errs().changeColor(llvm::raw_ostream::GREEN,
+                             /*bold=*/true,
+                             /*bg=*/false);
+
+  llvm::errs() << stats.str();
+
+  if (useColors)
+    llvm::errs().resetColor();
+
+  handler->getInfoStream() << stats.str();
+}
+
+/// Fork the --parallel-workers processes. Each worker explores the
+/// subtrees of the first symbolic branches assigned to it and writes
+/// its results to <output dir>/worker-<i>. Returns true in the
+/// workers, with \a handler and \a IOpts set up for the worker. In
+/// the coordinator it waits for all workers, moves their test cases
+/// into its output directory, reports the summed totals and returns
+/// false with the exit code in \a exitCode.
+///
+/// The partitioning is static: nothing is exchanged while the
+/// workers run, each one re-executes the (short) shared prefix of the
+/// exploration and then only follows its own subtrees.
+static bool spawnParallelWorkers(KleeHandler *&handler,
+                                 Interpreter::InterpreterOptions &IOpts,
+                                 int argc, char **argv, int &exitCode) {
+  if (!ReplayOutFile.empty() || !ReplayOutDir.empty() ||
+      ReplayPathFile != "" || !SeedOutFile.empty() || !SeedOutDir.empty())
+    klee_error("--parallel-workers cannot be used with replay or seeding");
+
+  unsigned partitions =
+    ParallelWorkers * std::max(1u, (unsigned) ParallelSplitFactor);
+  unsigned depth = 0;
+  while ((1u << depth) < partitions && depth < 24)
+    ++depth;
+
+  llvm::raw_ostream &infoFile = handler->getInfoStream();
+  for (int i=0; i<argc; i++) {
+    infoFile << argv[i] << (i+1<argc ? " ":"\n");
+  }
+  infoFile << "PID: " << getpid() << "\n";
+  infoFile << "Workers: " << ParallelWorkers << " (" << (1u << depth)
+           << " partitions)\n";
+
+  char buf[256];
+  time_t t[2];
+  t[0] = time(NULL);
+  strftime(buf, sizeof(buf), "Started: %Y-%m-%d %H:%M:%S\n", localtime(&t[0]));
+  infoFile << buf;
+  infoFile.flush();
+
+  std::vector<int> resultFds;
+  for (unsigned i = 0; i < ParallelWorkers; ++i) {
+    // Don't let the children flush our buffered output a second time.
+    fflush(NULL);
+    llvm::errs().flush();
+
+    int fds[2];
+    if (pipe(fds) < 0)
+      klee_error("unable to create pipe: %s", strerror(errno));
+
+    pid_t pid = fork();
+    if (pid < 0)
+      klee_error("unable to fork worker: %s", strerror(errno));
+
+    if (pid == 0) {
+      // Keep terminal interrupts to the coordinator, which forwards
+      // them exactly once.
+      setpgid(0, 0);
+      for (unsigned j = 0; j < resultFds.size(); ++j)
+        close(resultFds[j]);
+      close(fds[0]);
+      parallelResultFd = fds[1];
+
+      std::stringstream name;
+      name << "worker-" << i;
+      OutputDir = handler->getOutputFilename(name.str());
+      // The coordinator's handler is left alone, it still owns the
+      // parent's output files.
+      handler = new KleeHandler(argc, argv);
+
+      IOpts.PartitionIndex = i;
+      IOpts.PartitionCount = ParallelWorkers;
+      IOpts.PartitionDepth = depth;
+      return true;
+    }
+
+    close(fds[1]);
+    resultFds.push_back(fds[0]);
+    parallelWorkerPids.push_back(pid);
+    klee_message("started worker %u (pid %d)", i, pid);
+  }
+
+  sys::SetInterruptFunction(interrupt_handle_coordinator);
+
+  RunTotals sum;
+  memset(&sum, 0, sizeof(sum));
+  exitCode = 0;
+  for (unsigned i = 0; i < ParallelWorkers; ++i) {
+    RunTotals totals;
+    char *p = (char*) &totals;
+    size_t remaining = sizeof(totals);
+    while (remaining) {
+      ssize_t n = read(resultFds[i], p, remaining);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      p += n;
+      remaining -= n;
+    }
+    close(resultFds[i]);
+
+    int status;
+    while (waitpid(parallelWorkerPids[i], &status, 0) < 0 && errno == EINTR)
+      ;
+
+    if (remaining || !WIFEXITED(status) || WEXITSTATUS(status)) {
+      klee_warning("worker %u did not finish cleanly, its results are "
+                   "incomplete", i);
+      exitCode = 1;
+    }
+    if (remaining)
+      continue;
+
+    sum.forks += totals.forks;
+    sum.queries += totals.queries;
+    sum.queriesValid += totals.queriesValid;
+    sum.queriesInvalid += totals.queriesInvalid;
+    sum.queryCounterexamples += totals.queryCounterexamples;
+    sum.queryConstructs += totals.queryConstructs;
+    sum.asyncQueries += totals.asyncQueries;
+    sum.instructions += totals.instructions;
+    sum.pathsExplored += totals.pathsExplored;
+    sum.sharedPaths += totals.sharedPaths;
+  }
+
+  // Tests are imported even from workers which died, whatever they
+  // wrote is still valid.
+  for (unsigned i = 0; i < ParallelWorkers; ++i) {
+    std::stringstream name;
+    name << "worker-" << i;
+    sum.testCases += handler->importTestCases(
+      handler->getOutputFilename(name.str()));
+  }
+
+  t[1] = time(NULL);
+  strftime(buf, sizeof(buf), "Finished: %Y-%m-%d %H:%M:%S\n", localtime(&t[1]));
+  infoFile << buf;
+
+  strcpy(buf, "Elapsed: ");
+  strcpy(format_tdiff(buf, t[1] - t[0]), "\n");
+  infoFile << buf;
+
+  // Each worker explored 1 + forks paths, the shared ones were explored
+  // by another worker as well.
+  sum.forks += ParallelWorkers - 1;
+  sum.forks -= sum.sharedPaths;
+  reportRunTotals(handler, sum);
+
+  delete handler;
+  return false;
+}
+
 int main(int argc, char **argv, char **envp) {
   atexit(llvm_shutdown);  // Call llvm_shutdown() on exit.
 
@@ -1213,6 +1724,19 @@ int main(int argc, char **argv, char **envp) {
 
   sys::SetInterruptFunction(interrupt_handle);
 
+  if (Resume != "") {
+    if (!ReplayOutFile.empty() || !ReplayOutDir.empty())
+      klee_error("--resume cannot be used with --replay-out");
+    // Resuming re-executes the checkpointed states as seeds. Symbolic
+    // objects created after the checkpoint have no input in the seed.
+    ResumeCheckpoint = findCheckpoint(Resume);
+    if (ResumeCheckpoint == "")
+      klee_error("no complete checkpoint in \"%s\"", Resume.c_str());
+    SeedOutDir.push_back(ResumeCheckpoint);
+    if (!AllowSeedExtension && !ZeroSeedExtension)
+      AllowSeedExtension = true;
+  }
+
   // Load the bytecode...
   std::string ErrorMsg;
   Module *mainModule = 0;
@@ -1359,9 +1883,16 @@ int main(int argc, char **argv, char **envp) {
   Interpreter::InterpreterOptions IOpts;
   IOpts.MakeConcreteSymbolic = MakeConcreteSymbolic;
   KleeHandler *handler = new KleeHandler(pArgc, pArgv);
+  if (ParallelWorkers > 1) {
+    int exitCode;
+    if (!spawnParallelWorkers(handler, IOpts, pArgc, pArgv, exitCode))
+      return exitCode;
+  }
   Interpreter *interpreter =
     theInterpreter = Interpreter::create(IOpts, handler);
   handler->setInterpreter(interpreter);
+  if (ResumeCheckpoint != "")
+    handler->resumeTotals(ResumeCheckpoint);
 
   llvm::raw_ostream &infoFile = handler->getInfoStream();
   for (int i=0; i<argc; i++) {
@@ -1432,6 +1963,7 @@ int main(int argc, char **argv, char **envp) {
     }
   } else {
     std::vector<KTest *> seeds;
+    std::vector<CheckpointPosition> seedPrefixes;
     for (std::vector<std::string>::iterator
            it = SeedOutFile.begin(), ie = SeedOutFile.end();
          it != ie; ++it) {
@@ -1441,12 +1973,16 @@ int main(int argc, char **argv, char **envp) {
         exit(1);
       }
       seeds.push_back(out);
+      seedPrefixes.push_back(CheckpointPosition());
     }
     for (std::vector<std::string>::iterator
            it = SeedOutDir.begin(), ie = SeedOutDir.end();
          it != ie; ++it) {
       std::vector<std::string> outFiles;
       KleeHandler::getOutFiles(*it, outFiles);
+      std::map<std::string, CheckpointPosition> positions;
+      if (*it == ResumeCheckpoint)
+        readCheckpointPositions(*it, positions);
       for (std::vector<std::string>::iterator
              it2 = outFiles.begin(), ie = outFiles.end();
            it2 != ie; ++it2) {
@@ -1456,6 +1992,7 @@ int main(int argc, char **argv, char **envp) {
           exit(1);
         }
         seeds.push_back(out);
+        seedPrefixes.push_back(positions[sys::path::filename(*it2).str()]);
       }
       if (outFiles.empty()) {
         llvm::errs() << "KLEE: seeds directory is empty: " << *it << "\n";
@@ -1466,6 +2003,8 @@ int main(int argc, char **argv, char **envp) {
     if (!seeds.empty()) {
       llvm::errs() << "KLEE: using " << seeds.size() << " seeds\n";
       interpreter->useSeeds(&seeds);
+      if (ResumeCheckpoint != "")
+        interpreter->useSeedPrefixes(&seedPrefixes);
     }
     if (RunInDir != "") {
       int res = chdir(RunInDir.c_str());
@@ -1496,57 +2035,17 @@ int main(int argc, char **argv, char **envp) {
 
   delete interpreter;
 
-  uint64_t queries =
-    *theStatisticManager->getStatisticByName("Queries");
-  uint64_t queriesValid =
-    *theStatisticManager->getStatisticByName("QueriesValid");
-  uint64_t queriesInvalid =
-    *theStatisticManager->getStatisticByName("QueriesInvalid");
-  uint64_t queryCounterexamples =
-    *theStatisticManager->getStatisticByName("QueriesCEX");
-  uint64_t queryConstructs =
-    *theStatisticManager->getStatisticByName("QueriesConstructs");
-  uint64_t instructions =
-    *theStatisticManager->getStatisticByName("Instructions");
-  uint64_t forks =
-    *theStatisticManager->getStatisticByName("Forks");
-
-  handler->getInfoStream()
-    << "KLEE: done: explored paths = " << 1 + forks << "\n";
-
-  // Write some extra information in the info file which users won't
-  // necessarily care about or understand.
-  if (queries)
-    handler->getInfoStream()
-      << "KLEE: done: avg. constructs per query = "
-                             << queryConstructs / queries << "\n";
-  handler->getInfoStream()
-    << "KLEE: done: total queries = " << queries << "\n"
-    << "KLEE: done: valid queries = " << queriesValid << "\n"
-    << "KLEE: done: invalid queries = " << queriesInvalid << "\n"
-    << "KLEE: done: query cex = " << queryCounterexamples << "\n";
-
-  std::stringstream stats;
-  stats << "\n";
-  stats << "KLEE: done: total instructions = "
-        << instructions << "\n";
-  stats << "KLEE: done: completed paths = "
-        << handler->getNumPathsExplored() << "\n";
-  stats << "KLEE: done: generated tests = "
-        << handler->getNumTestCases() << "\n";
-
-  bool useColors = llvm::errs().is_displayed();
-  if (useColors)
-    llvm::errs().changeColor(llvm::raw_ostream::GREEN,
-                             /*bold=*/true,
-                             /*bg=*/false);
-
-  llvm::errs() << stats.str();
+  RunTotals totals;
+  handler->getRunTotals(totals);
 
-  if (useColors)
-    llvm::errs().resetColor();
+  reportRunTotals(handler, totals);
 
-  handler->getInfoStream() << stats.str();
+  if (parallelResultFd >= 0) {
+    if (write(parallelResultFd, &totals, sizeof(totals)) != sizeof(totals))
+      klee_warning("unable to send results to the coordinator: %s",
+                   strerror(errno));
+    close(parallelResultFd);
+  }
 
 #if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
   // FIXME: This really doesn't look right
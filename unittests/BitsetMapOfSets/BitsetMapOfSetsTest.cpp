@@ -0,0 +1,196 @@
+//===-- BitsetMapOfSetsTest.cpp -------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Internal/ADT/BitsetMapOfSets.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <set>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+typedef BitsetMapOfSets<int, int> Map;
+typedef std::set<int> Set;
+
+struct Any {
+  bool operator()(int) const { return true; }
+};
+
+struct Odd {
+  bool operator()(int v) const { return v % 2; }
+};
+
+Set makeSet(int a, int b = -1, int c = -1) {
+  Set s;
+  s.insert(a);
+  if (b >= 0)
+    s.insert(b);
+  if (c >= 0)
+    s.insert(c);
+  return s;
+}
+
+bool contains(const std::vector<int> &v, int x) {
+  return std::find(v.begin(), v.end(), x) != v.end();
+}
+
+TEST(BitsetMapOfSetsTest, SubsetsAndSupersets) {
+  Map m;
+  std::vector<int> dropped;
+  m.insert(makeSet(1, 2), 0, 0, dropped);
+  m.insert(makeSet(2, 3, 4), 1, 0, dropped);
+  m.insert(makeSet(5), 2, 0, dropped);
+  EXPECT_TRUE(dropped.empty());
+  EXPECT_EQ(3U, m.size());
+
+  ASSERT_TRUE(m.lookup(makeSet(2, 3, 4)));
+  EXPECT_EQ(1, *m.lookup(makeSet(2, 3, 4)));
+  EXPECT_FALSE(m.lookup(makeSet(2, 3)));
+  EXPECT_FALSE(m.lookup(makeSet(1, 2, 6)));
+
+  ASSERT_TRUE(m.findSuperset(makeSet(2, 4), Any()));
+  EXPECT_EQ(1, *m.findSuperset(makeSet(2, 4), Any()));
+  EXPECT_FALSE(m.findSuperset(makeSet(1, 3), Any()));
+  // An element no key has cannot be in a superset.
+  EXPECT_FALSE(m.findSuperset(makeSet(2, 6), Any()));
+
+  ASSERT_TRUE(m.findSubset(makeSet(1, 2, 3), Any()));
+  EXPECT_EQ(0, *m.findSubset(makeSet(1, 2, 3), Any()));
+  // But it may be in the set searched for subsets.
+  ASSERT_TRUE(m.findSubset(makeSet(5, 6), Any()));
+  EXPECT_EQ(2, *m.findSubset(makeSet(5, 6), Any()));
+  EXPECT_FALSE(m.findSubset(makeSet(3, 4), Any()));
+
+  // The predicate chooses among the matches.
+  ASSERT_TRUE(m.findSuperset(makeSet(2), Odd()));
+  EXPECT_EQ(1, *m.findSuperset(makeSet(2), Odd()));
+  EXPECT_FALSE(m.findSubset(makeSet(1, 2, 5), Odd()));
+
+  // Inserting an existing set replaces its value.
+  m.insert(makeSet(5), 3, 0, dropped);
+  EXPECT_EQ(3U, m.size());
+  ASSERT_EQ(1U, dropped.size());
+  EXPECT_EQ(2, dropped[0]);
+  EXPECT_EQ(3, *m.lookup(makeSet(5)));
+}
+
+TEST(BitsetMapOfSetsTest, MatchesBruteForce) {
+  srand(1);
+  // Enough elements for keys of several words and signature collisions.
+  const int NumElements = 200;
+  std::vector<Set> sets;
+  Map m;
+  std::vector<int> dropped;
+
+  for (unsigned i = 0; i != 300; ++i) {
+    Set s;
+    for (unsigned n = rand() % 6; n; --n)
+      s.insert(rand() % NumElements);
+    if (m.lookup(s))
+      continue;
+    m.insert(s, sets.size(), 0, dropped);
+    sets.push_back(s);
+  }
+  EXPECT_TRUE(dropped.empty());
+  EXPECT_EQ(sets.size(), m.size());
+
+  for (unsigned i = 0; i != 1000; ++i) {
+    Set s;
+    for (unsigned n = rand() % 8; n; --n)
+      s.insert(rand() % NumElements);
+
+    bool hasSuperset = false, hasSubset = false;
+    for (unsigned j = 0; j != sets.size(); ++j) {
+      hasSuperset |= std::includes(sets[j].begin(), sets[j].end(),
+                                   s.begin(), s.end());
+      hasSubset |= std::includes(s.begin(), s.end(),
+                                 sets[j].begin(), sets[j].end());
+    }
+
+    int *superset = m.findSuperset(s, Any());
+    EXPECT_EQ(hasSuperset, superset != 0);
+    if (superset)
+      EXPECT_TRUE(std::includes(sets[*superset].begin(),
+                                sets[*superset].end(), s.begin(), s.end()));
+
+    int *subset = m.findSubset(s, Any());
+    EXPECT_EQ(hasSubset, subset != 0);
+    if (subset)
+      EXPECT_TRUE(std::includes(s.begin(), s.end(), sets[*subset].begin(),
+                                sets[*subset].end()));
+  }
+}
+
+// The counterexample cache passes --cex-cache-budget in MB and the size of
+// each assignment as the cost of its entry.
+TEST(BitsetMapOfSetsTest, Eviction) {
+  const size_t MB = 1 << 20;
+  // Entries cost a little more than given, so only two fit.
+  Map m(3 * MB);
+  std::vector<int> dropped;
+
+  m.insert(makeSet(1), 1, MB, dropped);
+  m.insert(makeSet(2), 2, MB, dropped);
+  EXPECT_TRUE(dropped.empty());
+  EXPECT_EQ(2U, m.size());
+
+  // The least recently used entry goes first.
+  m.insert(makeSet(3), 3, MB, dropped);
+  EXPECT_EQ(2U, m.size());
+  EXPECT_LE(m.getCost(), 3 * MB);
+  EXPECT_EQ(1U, m.getNumEvictions());
+  ASSERT_EQ(1U, dropped.size());
+  EXPECT_EQ(1, dropped[0]);
+  EXPECT_FALSE(m.lookup(makeSet(1)));
+  // Its elements are forgotten as well.
+  EXPECT_FALSE(m.findSuperset(makeSet(1), Any()));
+
+  // An entry found by a search outlives one which was not.
+  dropped.clear();
+  ASSERT_TRUE(m.findSubset(makeSet(2, 7), Any()));
+  m.insert(makeSet(4), 4, MB, dropped);
+  ASSERT_EQ(1U, dropped.size());
+  EXPECT_EQ(3, dropped[0]);
+  EXPECT_TRUE(m.lookup(makeSet(2)));
+
+  // The entry just inserted is never evicted, even over the budget.
+  dropped.clear();
+  m.insert(makeSet(5, 6), 5, 4 * MB, dropped);
+  EXPECT_EQ(1U, m.size());
+  EXPECT_EQ(2U, dropped.size());
+  EXPECT_TRUE(contains(dropped, 2));
+  EXPECT_TRUE(contains(dropped, 4));
+  ASSERT_TRUE(m.findSuperset(makeSet(6), Any()));
+  EXPECT_EQ(5, *m.findSuperset(makeSet(6), Any()));
+  EXPECT_EQ(4U, m.getNumEvictions());
+
+  dropped.clear();
+  m.clear(dropped);
+  EXPECT_EQ(0U, m.size());
+  EXPECT_EQ(0U, m.getCost());
+  ASSERT_EQ(1U, dropped.size());
+  EXPECT_EQ(5, dropped[0]);
+}
+
+TEST(BitsetMapOfSetsTest, Unlimited) {
+  Map m;
+  std::vector<int> dropped;
+  for (int i = 0; i != 100; ++i)
+    m.insert(makeSet(i), i, 1 << 20, dropped);
+  EXPECT_EQ(100U, m.size());
+  EXPECT_TRUE(dropped.empty());
+  EXPECT_EQ(0U, m.getNumEvictions());
+}
+
+}
@@ -0,0 +1,204 @@
+//===-- ExprTapeTest.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr.h"
+#include "klee/util/ArrayCache.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprTape.h"
+
+#include <stdlib.h>
+
+using namespace klee;
+
+namespace {
+
+const unsigned NumBytes = 4;
+// Small values, so that zero divisors and overshifts are common.
+const unsigned char g_bytes[] = { 0, 1, 2, 3, 7, 0x80, 0xff };
+const uint64_t g_constants[] = { 0, 1, 2, 3, 8, 31, 0x7f, 0x80, 0xff };
+
+ArrayCache ac;
+const Array *array = ac.CreateArray("tape", NumBytes);
+
+unsigned pick(unsigned n) { return rand() % n; }
+
+ref<Expr> randomExpr(unsigned depth, Expr::Width w, bool guardDivisions);
+
+ref<Expr> randomLeaf(Expr::Width w) {
+  if (pick(3) == 0) {
+    uint64_t value = g_constants[pick(sizeof g_constants /
+                                      sizeof g_constants[0])];
+    return ConstantExpr::create(value & (w >= 64 ? ~0ULL : (1ULL << w) - 1),
+                                w);
+  }
+  ref<Expr> read = ReadExpr::create(
+      UpdateList(array, 0), ConstantExpr::alloc(pick(NumBytes), Expr::Int32));
+  if (w == Expr::Int8)
+    return read;
+  return pick(2) ? ZExtExpr::create(read, w) : SExtExpr::create(read, w);
+}
+
+ref<Expr> randomCondition(unsigned depth, bool guardDivisions) {
+  Expr::Width w = pick(2) ? Expr::Int8 : Expr::Int32;
+  ref<Expr> l = randomExpr(depth, w, guardDivisions);
+  ref<Expr> r = randomExpr(depth, w, guardDivisions);
+  switch (pick(6)) {
+  case 0: return EqExpr::create(l, r);
+  case 1: return NeExpr::create(l, r);
+  case 2: return UltExpr::create(l, r);
+  case 3: return UleExpr::create(l, r);
+  case 4: return SltExpr::create(l, r);
+  default: return SleExpr::create(l, r);
+  }
+}
+
+/// Build a random division of width \a w. When \a guardDivisions is set
+/// it is the side of a select which is only taken for a nonzero divisor,
+/// so the other side is taken whenever the division is by zero.
+ref<Expr> randomDivision(unsigned depth, Expr::Width w, bool guardDivisions) {
+  ref<Expr> l = randomExpr(depth, w, guardDivisions);
+  ref<Expr> r = randomExpr(depth, w, guardDivisions);
+  // Divisions of constants are folded when built, keep the divisor
+  // symbolic.
+  while (isa<ConstantExpr>(r))
+    r = randomLeaf(w);
+  ref<Expr> division;
+  switch (pick(4)) {
+  case 0: division = UDivExpr::create(l, r); break;
+  case 1: division = SDivExpr::create(l, r); break;
+  case 2: division = URemExpr::create(l, r); break;
+  default: division = SRemExpr::create(l, r); break;
+  }
+  if (!guardDivisions)
+    return division;
+  return SelectExpr::create(EqExpr::create(r, ConstantExpr::create(0, w)),
+                            randomExpr(depth, w, guardDivisions), division);
+}
+
+ref<Expr> randomExpr(unsigned depth, Expr::Width w, bool guardDivisions) {
+  if (!depth)
+    return randomLeaf(w);
+  --depth;
+
+  ref<Expr> l = randomExpr(depth, w, guardDivisions);
+  switch (pick(12)) {
+  case 0: return AddExpr::create(l, randomExpr(depth, w, guardDivisions));
+  case 1: return SubExpr::create(l, randomExpr(depth, w, guardDivisions));
+  case 2: return MulExpr::create(l, randomExpr(depth, w, guardDivisions));
+  case 3: return AndExpr::create(l, randomExpr(depth, w, guardDivisions));
+  case 4: return XorExpr::create(l, randomExpr(depth, w, guardDivisions));
+  case 5: return ShlExpr::create(l, randomExpr(depth, w, guardDivisions));
+  case 6: return LShrExpr::create(l, randomExpr(depth, w, guardDivisions));
+  case 7: return AShrExpr::create(l, randomExpr(depth, w, guardDivisions));
+  case 8:
+    return SelectExpr::create(randomCondition(depth, guardDivisions), l,
+                              randomExpr(depth, w, guardDivisions));
+  case 9:
+    if (w == Expr::Int32)
+      return ZExtExpr::create(
+          ExtractExpr::create(l, pick(3) * 8, Expr::Int8), w);
+    return ExtractExpr::create(
+        ZExtExpr::create(l, Expr::Int32), pick(2), Expr::Int8);
+  default:
+    return randomDivision(depth, w, guardDivisions);
+  }
+}
+
+Assignment randomAssignment() {
+  Assignment a;
+  std::vector<unsigned char> &bytes = a.bindings[array];
+  for (unsigned i = 0; i != NumBytes; ++i)
+    bytes.push_back(g_bytes[pick(sizeof g_bytes / sizeof g_bytes[0])]);
+  return a;
+}
+
+/// Check \a constraint against ExprTape::Lanes random assignments, both
+/// with a tape and with the evaluator, and return how many the evaluator
+/// found satisfying. With \a exact the answers must be the same,
+/// otherwise the tape must not accept an assignment the evaluator does
+/// not.
+unsigned compare(const ref<Expr> &constraint, bool exact) {
+  ExprTape tape;
+  EXPECT_TRUE(tape.addConstraint(constraint));
+
+  std::vector<Assignment> assignments;
+  std::vector<const Assignment *> lanes;
+  for (unsigned l = 0; l != ExprTape::Lanes; ++l)
+    assignments.push_back(randomAssignment());
+  for (unsigned l = 0; l != ExprTape::Lanes; ++l)
+    lanes.push_back(&assignments[l]);
+
+  bool satisfied[ExprTape::Lanes];
+  tape.evaluate(&lanes[0], lanes.size(), satisfied);
+
+  unsigned count = 0;
+  for (unsigned l = 0; l != ExprTape::Lanes; ++l) {
+    bool expected = assignments[l].satisfies(&constraint, &constraint + 1);
+    if (exact)
+      EXPECT_EQ(expected, satisfied[l]);
+    else if (satisfied[l])
+      EXPECT_TRUE(expected);
+    count += expected;
+  }
+  return count;
+}
+
+TEST(ExprTapeTest, MatchesEvaluator) {
+  srand(1);
+  unsigned satisfied = 0;
+  for (unsigned i = 0; i != 2000; ++i)
+    satisfied += compare(randomCondition(1 + pick(3), true), true);
+  // Make sure the comparison was not trivial.
+  EXPECT_LT(0U, satisfied);
+}
+
+TEST(ExprTapeTest, NeverMorePermissive) {
+  srand(2);
+  for (unsigned i = 0; i != 2000; ++i)
+    compare(randomCondition(1 + pick(3), false), false);
+}
+
+TEST(ExprTapeTest, UntakenDivisionByZero) {
+  ref<Expr> read0 = ReadExpr::create(UpdateList(array, 0),
+                                     ConstantExpr::alloc(0, Expr::Int32));
+  ref<Expr> read1 = ReadExpr::create(UpdateList(array, 0),
+                                     ConstantExpr::alloc(1, Expr::Int32));
+  ref<Expr> zero = ConstantExpr::create(0, Expr::Int8);
+  ref<Expr> isZero = EqExpr::create(read1, zero);
+  ref<Expr> quotient = UDivExpr::create(read0, read1);
+
+  // select(b == 0, 0, a / b) == 0 holds for b == 0.
+  ref<Expr> guarded =
+      EqExpr::create(SelectExpr::create(isZero, zero, quotient), zero);
+  // The division is taken whatever b is.
+  ref<Expr> unguarded =
+      EqExpr::create(SelectExpr::create(isZero, quotient, zero), zero);
+
+  Assignment a;
+  a.bindings[array] = std::vector<unsigned char>(NumBytes, 0);
+  a.bindings[array][0] = 5;
+  const Assignment *lane = &a;
+
+  ExprTape guardedTape;
+  ASSERT_TRUE(guardedTape.addConstraint(guarded));
+  bool satisfied;
+  guardedTape.evaluate(&lane, 1, &satisfied);
+  EXPECT_TRUE(a.satisfies(&guarded, &guarded + 1));
+  EXPECT_TRUE(satisfied);
+
+  ExprTape unguardedTape;
+  ASSERT_TRUE(unguardedTape.addConstraint(unguarded));
+  unguardedTape.evaluate(&lane, 1, &satisfied);
+  EXPECT_FALSE(a.satisfies(&unguarded, &unguarded + 1));
+  EXPECT_FALSE(satisfied);
+}
+
+}
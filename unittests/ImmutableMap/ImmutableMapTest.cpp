@@ -0,0 +1,115 @@
+//===-- ImmutableMapTest.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Internal/ADT/ImmutableMap.h"
+
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+typedef ImmutableMap<int, int> Map;
+typedef std::map<int, int> Reference;
+
+void checkEqual(const Map &m, const Reference &r) {
+  ASSERT_EQ(r.size(), m.size());
+  ASSERT_EQ(r.empty(), m.empty());
+
+  Map::iterator it = m.begin(), ie = m.end();
+  for (Reference::const_iterator ri = r.begin(); ri != r.end(); ++ri, ++it) {
+    ASSERT_TRUE(it != ie);
+    EXPECT_EQ(ri->first, it->first);
+    EXPECT_EQ(ri->second, it->second);
+  }
+  EXPECT_TRUE(it == ie);
+
+  // and backwards from the end
+  for (Reference::const_reverse_iterator ri = r.rbegin(); ri != r.rend();
+       ++ri) {
+    ASSERT_TRUE(it != m.begin());
+    --it;
+    EXPECT_EQ(ri->first, it->first);
+  }
+
+  for (int k = -1; k <= 1001; ++k) {
+    EXPECT_EQ(r.count(k), m.count(k));
+
+    const Map::value_type *prev = m.lookup_previous(k);
+    Reference::const_iterator ub = r.upper_bound(k);
+    if (ub == r.begin()) {
+      EXPECT_TRUE(prev == 0);
+    } else {
+      --ub;
+      ASSERT_TRUE(prev != 0);
+      EXPECT_EQ(ub->first, prev->first);
+    }
+
+    Map::iterator mub = m.upper_bound(k);
+    if (r.upper_bound(k) == r.end())
+      EXPECT_TRUE(mub == m.end());
+    else
+      EXPECT_EQ(r.upper_bound(k)->first, mub->first);
+  }
+}
+
+TEST(ImmutableMapTest, MatchesStdMap) {
+  srand(1);
+  for (unsigned round = 0; round < 20; ++round) {
+    Map m;
+    Reference r;
+    std::vector< std::pair<Map, Reference> > snapshots;
+
+    for (unsigned op = 0; op < 2000; ++op) {
+      int k = rand() % 1000, v = rand();
+      switch (rand() % 3) {
+      case 0:
+        m = m.insert(std::make_pair(k, v));
+        r.insert(std::make_pair(k, v));
+        break;
+      case 1:
+        m = m.replace(std::make_pair(k, v));
+        r[k] = v;
+        break;
+      default:
+        m = m.remove(k);
+        r.erase(k);
+        break;
+      }
+      if (op % 200 == 0)
+        snapshots.push_back(std::make_pair(m, r));
+    }
+
+    checkEqual(m, r);
+    // Older versions are unaffected by later updates.
+    for (unsigned i = 0; i < snapshots.size(); ++i)
+      checkEqual(snapshots[i].first, snapshots[i].second);
+  }
+}
+
+TEST(ImmutableMapTest, NoLeaks) {
+  size_t before = Map::getAllocated();
+  {
+    Map m;
+    for (int i = 0; i < 10000; ++i)
+      m = m.insert(std::make_pair(i, i));
+    Map copy = m;
+    for (int i = 0; i < 10000; i += 2)
+      m = m.remove(i);
+    EXPECT_EQ(5000u, m.size());
+    EXPECT_EQ(10000u, copy.size());
+  }
+  EXPECT_EQ(before, Map::getAllocated());
+}
+
+}